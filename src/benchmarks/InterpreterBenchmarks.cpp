@@ -0,0 +1,409 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "../lib/Equality.h"
+#include "../lib/EvalTask.h"
+#include "../lib/Interpreter.h"
+#include <catch.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace Procdraw;
+
+namespace {
+
+std::string SumExpression(int numArgs)
+{
+    std::string expr{"(+"};
+    for (int i = 1; i <= numArgs; ++i) {
+        expr += " " + std::to_string(i);
+    }
+    return expr + ")";
+}
+
+ListPtr MakeList(int length)
+{
+    ListPtr lst = nullptr;
+    for (int i = 0; i < length; ++i) {
+        lst = Cons(i, std::move(lst));
+    }
+    return lst;
+}
+
+ListPtr MakeBlockList(int length)
+{
+    ListBuilder builder(length);
+    for (int i = 0; i < length; ++i) {
+        builder.Append(i);
+    }
+    return builder.Finish();
+}
+
+int SumList(const ListPtr& lst)
+{
+    int sum = 0;
+    for (const ListNode* node = lst.get(); node != nullptr; node = node->Rest().get()) {
+        sum += node->First().GetIntegerUnchecked();
+    }
+    return sum;
+}
+
+// Allocates many small objects between the nodes of a Cons list, as a
+// long running program would, so that its nodes are scattered in memory
+ListPtr MakeScatteredList(int length, std::vector<ListPtr>& garbage)
+{
+    ListPtr lst = nullptr;
+    for (int i = 0; i < length; ++i) {
+        lst = Cons(i, std::move(lst));
+        for (int j = 0; j < 16; ++j) {
+            garbage.push_back(Cons(j, nullptr));
+        }
+    }
+    return lst;
+}
+
+} // namespace
+
+#ifdef PROCDRAW_REFCOUNT_STATS
+TEST_CASE("Reference count operations")
+{
+    Interpreter interpreter;
+    Object sumExpr = interpreter.Read(SumExpression(100));
+    Object lst{MakeList(100)};
+
+    RefCountStats::Reset();
+    MakeList(100);
+    WARN("Build and free 100 element list: " << RefCountStats::increments << " increments, "
+                                             << RefCountStats::decrements << " decrements");
+
+    RefCountStats::Reset();
+    interpreter.Eval(sumExpr);
+    WARN("Eval (+ 1 ... 100): " << RefCountStats::increments << " increments, "
+                                << RefCountStats::decrements << " decrements");
+
+    RefCountStats::Reset();
+    interpreter.Print(lst);
+    WARN("Print 100 element list: " << RefCountStats::increments << " increments, "
+                                    << RefCountStats::decrements << " decrements");
+}
+#endif
+
+TEST_CASE("Interpreter benchmarks")
+{
+    Interpreter interpreter;
+    Object sumExpr = interpreter.Read(SumExpression(100));
+    Object lst{MakeList(1000)};
+
+    BENCHMARK("Eval (+ 1 ... 100)")
+    {
+        return interpreter.Eval(sumExpr);
+    };
+
+    BENCHMARK("Print 1000 element list")
+    {
+        return interpreter.Print(lst);
+    };
+
+    BENCHMARK("Build and free 1000 element list")
+    {
+        return MakeList(1000) != nullptr;
+    };
+
+    BENCHMARK("Build and free 1000 element block list")
+    {
+        return MakeBlockList(1000) != nullptr;
+    };
+}
+
+TEST_CASE("List traversal benchmarks")
+{
+    std::vector<ListPtr> garbage;
+    ListPtr scattered = MakeScatteredList(100000, garbage);
+    ListPtr block = MakeBlockList(100000);
+
+    BENCHMARK("Sum 100000 element scattered list")
+    {
+        return SumList(scattered);
+    };
+
+    BENCHMARK("Sum 100000 element block list")
+    {
+        return SumList(block);
+    };
+}
+
+TEST_CASE("Numeric array benchmarks")
+{
+    Interpreter interpreter;
+    interpreter.SetSymbolValue(interpreter.SymbolRef("field"),
+                               interpreter.Eval(interpreter.Read("(make-float-array 1000000 0.5)")));
+    Object addExpr = interpreter.Read("(array-add field 1)");
+    Object nestedExpr = interpreter.Read("(array-clamp (array-lerp -1 1 (array-mul field 2)) 0 1)");
+    Object sumExpr = interpreter.Read("(array-sum field)");
+
+    BENCHMARK("Eval (array-add field 1) for 1M elements")
+    {
+        return interpreter.Eval(addExpr);
+    };
+
+    BENCHMARK("Eval nested array operations for 1M elements")
+    {
+        return interpreter.Eval(nestedExpr);
+    };
+
+    BENCHMARK("Eval (array-sum field) for 1M elements")
+    {
+        return interpreter.Eval(sumExpr);
+    };
+}
+
+TEST_CASE("HashMap benchmarks")
+{
+    HashMap map;
+    for (int i = 0; i < 1000; ++i) {
+        map.Insert(Object::MakeSymbolHandle(i), i);
+        map.Insert(i, i);
+    }
+
+    BENCHMARK("Find 1000 SymbolHandle keys")
+    {
+        int sum = 0;
+        for (int i = 0; i < 1000; ++i) {
+            sum += map.Find(Object::MakeSymbolHandle(i))->GetIntegerUnchecked();
+        }
+        return sum;
+    };
+
+    BENCHMARK("Find 1000 Integer keys")
+    {
+        int sum = 0;
+        for (int i = 0; i < 1000; ++i) {
+            sum += map.Find(i)->GetIntegerUnchecked();
+        }
+        return sum;
+    };
+}
+
+TEST_CASE("Sequence benchmarks")
+{
+    Interpreter interpreter;
+    Object sumExpr = interpreter.Read("(+ (map - (range 100000)))");
+    Object reduceExpr = interpreter.Read("(reduce + 0 (take 1000 (map - (range 1000000))))");
+
+    BENCHMARK("Eval (+ (map - (range 100000)))")
+    {
+        return interpreter.Eval(sumExpr);
+    };
+
+    BENCHMARK("Eval reduce over a take of 1000 from a 1M range")
+    {
+        return interpreter.Eval(reduceExpr);
+    };
+}
+
+TEST_CASE("Closure benchmarks")
+{
+    Interpreter interpreter;
+    interpreter.SetSymbolValue(interpreter.SymbolRef("scale"),
+                               interpreter.Eval(interpreter.Read("(let ((k 0.5)) (lambda (x y) (let ((dx (* x k)) (dy (* y k))) (+ dx dy))))")));
+    Object callExpr = interpreter.Read("(scale 3 4)");
+    Object mapExpr = interpreter.Read("(+ (map (lambda (x) (scale x x)) (range 10000)))");
+
+    BENCHMARK("Call a closure with let locals")
+    {
+        return interpreter.Eval(callExpr);
+    };
+
+    BENCHMARK("Eval (+ (map (lambda ...) (range 10000)))")
+    {
+        return interpreter.Eval(mapExpr);
+    };
+}
+
+TEST_CASE("Loop benchmarks")
+{
+    Interpreter interpreter;
+    Object loopExpr = interpreter.Read("(do ((i 0 (+ i 1)) (sum 0 (+ sum (* i i)))) ((= i 10000) sum))");
+    Object recursiveExpr = interpreter.Read("(define sum-squares (lambda (i sum) (if (= i 10000) sum (sum-squares (+ i 1) (+ sum (* i i))))))");
+    interpreter.Eval(recursiveExpr);
+    Object recursiveCallExpr = interpreter.Read("(sum-squares 0 0)");
+
+    BENCHMARK("Eval a do loop of 10000 iterations")
+    {
+        return interpreter.Eval(loopExpr);
+    };
+
+    BENCHMARK("Eval a recursive loop of 10000 iterations")
+    {
+        return interpreter.Eval(recursiveCallExpr);
+    };
+}
+
+TEST_CASE("Memo benchmarks")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define fib (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))))"));
+    Object fibExpr = interpreter.Read("(fib 20)");
+    Object squareExpr = interpreter.Read("(define sq (lambda (x) (* x x)))");
+    interpreter.Eval(squareExpr);
+    Object sumExpr = interpreter.Read("(+ (map sq (range 1000)))");
+
+    BENCHMARK("Eval (fib 20)")
+    {
+        return interpreter.Eval(fibExpr);
+    };
+
+    BENCHMARK("Eval (+ (map sq (range 1000)))")
+    {
+        return interpreter.Eval(sumExpr);
+    };
+
+    interpreter.Eval(interpreter.Read("(set-pure! fib)"));
+    interpreter.Eval(interpreter.Read("(set-pure! sq)"));
+
+    BENCHMARK("Eval (fib 20) with fib pure")
+    {
+        return interpreter.Eval(fibExpr);
+    };
+
+    BENCHMARK("Eval (+ (map sq (range 1000))) with sq pure")
+    {
+        return interpreter.Eval(sumExpr);
+    };
+}
+
+TEST_CASE("Macro benchmarks")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(defmacro unless (test then) (list 'if test none then))"));
+    Object directExpr = interpreter.Read("(if (> 1 2) none (+ 1 2))");
+    Object macroExpr = interpreter.Read("(unless (> 1 2) (+ 1 2))");
+
+    BENCHMARK("Eval (if (> 1 2) none (+ 1 2))")
+    {
+        return interpreter.Eval(directExpr);
+    };
+
+    BENCHMARK("Eval (unless (> 1 2) (+ 1 2))")
+    {
+        return interpreter.Eval(macroExpr);
+    };
+}
+
+TEST_CASE("EvalTask benchmarks")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define fib (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))))"));
+    Object fibExpr = interpreter.Read("(fib 20)");
+
+    BENCHMARK("Eval (fib 20)")
+    {
+        return interpreter.Eval(fibExpr);
+    };
+
+    BENCHMARK("EvalTask (fib 20)")
+    {
+        EvalTask task(&interpreter, fibExpr);
+        task.Run(EvalBudget{});
+        return task.Result();
+    };
+
+    BENCHMARK("EvalTask (fib 20) in slices of 1000 steps")
+    {
+        EvalTask task(&interpreter, fibExpr);
+        EvalBudget budget;
+        budget.maxSteps = 1000;
+        while (task.Run(budget) == EvalStatus::Suspended) {
+        }
+        return task.Result();
+    };
+}
+
+TEST_CASE("Signal benchmarks")
+{
+    // A static scene of 1000 cubes, drawn directly and through a signal
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read(
+        "(define grid (lambda ()"
+        "  (do ((i 0 (+ i 1))) ((= i 1000))"
+        "    (translate (wrap 0 10 i) 0 0)"
+        "    (cube))))"));
+    interpreter.Eval(interpreter.Read("(define grid-signal (computed grid))"));
+    Object directExpr = interpreter.Read("(grid)");
+    Object signalExpr = interpreter.Read("(signal-value grid-signal)");
+    Scene scene;
+    interpreter.SetScene(&scene);
+
+    BENCHMARK("Draw (grid)")
+    {
+        scene.Clear();
+        return interpreter.Eval(directExpr);
+    };
+
+    BENCHMARK("Draw (signal-value grid-signal)")
+    {
+        scene.Clear();
+        return interpreter.Eval(signalExpr);
+    };
+
+    interpreter.SetScene(nullptr);
+}
+
+TEST_CASE("String benchmarks")
+{
+    // Appending to a string extends its buffer in place, and substrings
+    // share it
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read(
+        "(define build (lambda (n)"
+        "  (do ((i 0 (+ i 1)) (s \"\" (string-append s \"label \"))) ((= i n) s))))"));
+    interpreter.Eval(interpreter.Read("(define text (build 10000))"));
+    Object buildExpr = interpreter.Read("(build 10000)");
+    Object substringExpr = interpreter.Read("(do ((i 0 (+ i 1))) ((= i 1000)) (substring text i (+ i 50000)))");
+
+    BENCHMARK("(build 10000)")
+    {
+        return interpreter.Eval(buildExpr);
+    };
+
+    BENCHMARK("1000 substrings of 50000 characters")
+    {
+        return interpreter.Eval(substringExpr);
+    };
+}
+
+TEST_CASE("Equality benchmarks")
+{
+    // Two separately built lists of 10000 vectors, so that no structure
+    // is shared and every element is compared
+    Interpreter interpreter;
+    auto build = [&]() {
+        return interpreter.Eval(interpreter.Read(
+            "(do ((i 0 (+ i 1)) (lst '() (cons [i 1.5 \"s\"] lst))) ((= i 10000) lst))"));
+    };
+    Object a = build();
+    Object b = build();
+
+    BENCHMARK("EqualObjects on lists of 10000 vectors")
+    {
+        return EqualObjects(a, b);
+    };
+
+    BENCHMARK("HashObject on a list of 10000 vectors")
+    {
+        return HashObject(a);
+    };
+}
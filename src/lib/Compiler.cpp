@@ -0,0 +1,435 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Compiler.h"
+#include "Interpreter.h"
+#include <algorithm>
+
+namespace Procdraw {
+
+namespace {
+
+size_t Length(const ListPtr& lst)
+{
+    size_t length = 0;
+    for (const ListNode* next = lst.get(); next != nullptr; next = next->Rest().get()) {
+        ++length;
+    }
+    return length;
+}
+
+Object BadSyntax()
+{
+    return Object::MakeError(ErrorKind::BadSyntax);
+}
+
+} // namespace
+
+Compiler::Compiler(Interpreter* interpreter)
+    : interpreter(interpreter),
+      defineSymbol(interpreter->SymbolRef("define")),
+      defmacroSymbol(interpreter->SymbolRef("defmacro")),
+      doSymbol(interpreter->SymbolRef("do")),
+      ifSymbol(interpreter->SymbolRef("if")),
+      lambdaSymbol(interpreter->SymbolRef("lambda")),
+      letSymbol(interpreter->SymbolRef("let")),
+      quoteSymbol(interpreter->SymbolRef("quote"))
+{
+}
+
+std::uint32_t Compiler::Scope::AllocateSlot()
+{
+    std::uint32_t slot = nextSlot++;
+    frameSize = std::max(frameSize, nextSlot);
+    return slot;
+}
+
+Object Compiler::Compile(const ListPtr& form)
+{
+    return CompileExpr(Object{form}, nullptr);
+}
+
+bool Compiler::IsMacroCall(SymbolHandle head, Scope* scope)
+{
+    // A local variable hides a global macro of the same name
+    for (; scope != nullptr; scope = scope->parent) {
+        for (const auto& local : scope->locals) {
+            if (local.first == head) {
+                return false;
+            }
+        }
+        for (SymbolHandle name : scope->capturedNames) {
+            if (name == head) {
+                return false;
+            }
+        }
+    }
+    return interpreter->SymbolValue(head).Type() == ObjectType::MacroPtr;
+}
+
+std::optional<Object> Compiler::Resolve(SymbolHandle name, Scope* scope)
+{
+    // Returns the LocalRef for name, or no value if it is not a local
+    // variable. A variable of an enclosing scope is added to the
+    // captures of each scope between it and the reference.
+    if (scope == nullptr) {
+        return std::nullopt;
+    }
+    for (auto local = scope->locals.rbegin(); local != scope->locals.rend(); ++local) {
+        if (local->first == name) {
+            return Object::MakeLocalRef(LocalRef{false, local->second});
+        }
+    }
+    for (size_t i = 0; i < scope->capturedNames.size(); ++i) {
+        if (scope->capturedNames[i] == name) {
+            return Object::MakeLocalRef(LocalRef{true, static_cast<std::uint32_t>(i)});
+        }
+    }
+    std::optional<Object> outer = Resolve(name, scope->parent);
+    if (!outer) {
+        return std::nullopt;
+    }
+    scope->capturedNames.push_back(name);
+    scope->captures.push_back(std::move(*outer));
+    return Object::MakeLocalRef(LocalRef{true, static_cast<std::uint32_t>(scope->captures.size() - 1)});
+}
+
+Object Compiler::CompileBody(const ListPtr& body, Scope* scope)
+{
+    // A body is one or more expressions
+    if (body == nullptr) {
+        return BadSyntax();
+    }
+    return CompileExprs(body, scope);
+}
+
+Object Compiler::CompileExprs(const ListPtr& body, Scope* scope)
+{
+    // Returns a list of the compiled expressions, which may be empty
+    if (body == nullptr) {
+        return Object::EmptyList();
+    }
+    ListBuilder builder(Length(body));
+    for (const ListNode* next = body.get(); next != nullptr; next = next->Rest().get()) {
+        Object expr = CompileExpr(next->First(), scope);
+        if (expr.Type() == ObjectType::Error) {
+            return expr;
+        }
+        builder.Append(std::move(expr));
+    }
+    return Object{builder.Finish()};
+}
+
+Object Compiler::CompileDefine(const ListPtr& form, Scope* scope)
+{
+    // (define name value)
+    if (Length(form) != 3) {
+        return BadSyntax();
+    }
+    const ListPtr& rest = form->Rest();
+    std::optional<SymbolHandle> name = rest->First().TryGetSymbolHandle();
+    if (!name) {
+        return BadSyntax();
+    }
+    Object value = CompileExpr(rest->Rest()->First(), scope);
+    if (value.Type() == ObjectType::Error) {
+        return value;
+    }
+    return Object{SpecialForm::MakeDefine(*name, std::move(value))};
+}
+
+Object Compiler::CompileDefmacro(const ListPtr& form, Scope* scope)
+{
+    // (defmacro name (param ...) body ...)
+    const ListPtr& rest = form->Rest();
+    std::optional<SymbolHandle> name = rest != nullptr ? rest->First().TryGetSymbolHandle() : std::nullopt;
+    if (!name) {
+        return BadSyntax();
+    }
+    // The rest of the form has the shape of a lambda expression, with the
+    // name in place of lambda
+    Object expander = CompileLambda(rest, scope);
+    if (expander.Type() == ObjectType::Error) {
+        return expander;
+    }
+    return Object{SpecialForm::MakeDefmacro(*name, std::move(expander))};
+}
+
+Object Compiler::CompileDo(const ListPtr& form, Scope* scope)
+{
+    // (do ((name init [step]) ...) (test result ...) body ...)
+    const ListPtr& rest = form->Rest();
+    const ListPtr* bindingForms = rest != nullptr ? rest->First().TryGetListPtr() : nullptr;
+    if (bindingForms == nullptr || rest->Rest() == nullptr) {
+        return BadSyntax();
+    }
+    const ListPtr* exit = rest->Rest()->First().TryGetListPtr();
+    if (exit == nullptr || *exit == nullptr) {
+        return BadSyntax();
+    }
+    // A do loop that is not inside a lambda has a frame of its own
+    std::optional<Scope> frameScope;
+    if (scope == nullptr) {
+        scope = &frameScope.emplace(nullptr);
+    }
+    // The inits are compiled before any of the names are bound, as for
+    // let, and the steps after, so that they see the loop variables
+    std::vector<SymbolHandle> names;
+    std::vector<LocalBinding> bindings;
+    for (const ListNode* next = bindingForms->get(); next != nullptr; next = next->Rest().get()) {
+        const ListPtr* binding = next->First().TryGetListPtr();
+        size_t length = binding != nullptr ? Length(*binding) : 0;
+        if (length != 2 && length != 3) {
+            return BadSyntax();
+        }
+        std::optional<SymbolHandle> name = (*binding)->First().TryGetSymbolHandle();
+        if (!name) {
+            return BadSyntax();
+        }
+        Object init = CompileExpr((*binding)->Rest()->First(), scope);
+        if (init.Type() == ObjectType::Error) {
+            return init;
+        }
+        names.push_back(*name);
+        bindings.push_back(LocalBinding{0, std::move(init), std::nullopt, 0});
+    }
+    size_t numLocals = scope->locals.size();
+    std::uint32_t nextSlot = scope->nextSlot;
+    for (size_t i = 0; i < names.size(); ++i) {
+        bindings[i].slot = scope->AllocateSlot();
+        scope->locals.emplace_back(names[i], bindings[i].slot);
+    }
+    // Each step is evaluated into a slot of its own, so that all of the
+    // steps see the values of the variables from the previous pass
+    Object compiled = Object::None();
+    size_t i = 0;
+    for (const ListNode* next = bindingForms->get(); next != nullptr; next = next->Rest().get(), ++i) {
+        const ListPtr& step = next->First().GetListPtrUnchecked()->Rest()->Rest();
+        if (step != nullptr) {
+            compiled = CompileExpr(step->First(), scope);
+            if (compiled.Type() == ObjectType::Error) {
+                break;
+            }
+            bindings[i].step = std::move(compiled);
+            bindings[i].stepSlot = scope->AllocateSlot();
+        }
+    }
+    Object test = compiled.Type() == ObjectType::Error ? compiled : CompileExpr((*exit)->First(), scope);
+    Object result = test.Type() == ObjectType::Error ? test : CompileExprs((*exit)->Rest(), scope);
+    Object body = result.Type() == ObjectType::Error ? result : CompileExprs(rest->Rest()->Rest(), scope);
+    // The slots are reused by later forms in the enclosing body
+    scope->locals.resize(numLocals);
+    scope->nextSlot = nextSlot;
+    if (body.Type() == ObjectType::Error) {
+        return body;
+    }
+    int frameSize = frameScope ? frameScope->frameSize : 0;
+    return Object{SpecialForm::MakeDo(frameSize,
+                                      std::move(bindings),
+                                      std::move(test),
+                                      result.GetListPtrUnchecked(),
+                                      body.GetListPtrUnchecked())};
+}
+
+Object Compiler::CompileExpr(const Object& expr, Scope* scope)
+{
+    switch (expr.Type()) {
+    case ObjectType::SymbolHandle: {
+        std::optional<Object> local = Resolve(expr.GetSymbolHandle(), scope);
+        return local ? *local : expr;
+    }
+    case ObjectType::ListPtr: {
+        const ListPtr& lst = expr.GetListPtrUnchecked();
+        if (lst == nullptr) {
+            return expr;
+        }
+        if (std::optional<SymbolHandle> head = lst->First().TryGetSymbolHandle()) {
+            if (*head == defineSymbol) {
+                return CompileDefine(lst, scope);
+            }
+            if (*head == defmacroSymbol) {
+                return CompileDefmacro(lst, scope);
+            }
+            if (*head == doSymbol) {
+                return CompileDo(lst, scope);
+            }
+            if (*head == ifSymbol) {
+                return CompileIf(lst, scope);
+            }
+            if (*head == lambdaSymbol) {
+                return CompileLambda(lst, scope);
+            }
+            if (*head == letSymbol) {
+                return CompileLet(lst, scope);
+            }
+            if (*head == quoteSymbol) {
+                return CompileQuote(lst);
+            }
+            if (IsMacroCall(*head, scope)) {
+                Object expansion = interpreter->MacroExpand(lst);
+                if (expansion.Type() == ObjectType::Error) {
+                    return expansion;
+                }
+                return CompileExpr(expansion, scope);
+            }
+        }
+        return CompileBody(lst, scope);
+    }
+    case ObjectType::HashMapPtr: {
+        HashMapPtr result(new HashMap());
+        std::optional<Object> error;
+        expr.GetHashMapPtrUnchecked()->ForEach([&](const Object& key, const Object& value) {
+            Object compiled = CompileExpr(value, scope);
+            if (compiled.Type() == ObjectType::Error) {
+                error = std::move(compiled);
+            }
+            else {
+                result->Insert(key, std::move(compiled));
+            }
+        });
+        if (error) {
+            return *error;
+        }
+        return Object{std::move(result)};
+    }
+    case ObjectType::VectorPtr: {
+        const Vector& vec = *expr.GetVectorPtrUnchecked();
+        VectorPtr result(new Vector());
+        result->Reserve(vec.Size());
+        for (size_t i = 0; i < vec.Size(); ++i) {
+            Object compiled = CompileExpr(vec.At(i), scope);
+            if (compiled.Type() == ObjectType::Error) {
+                return compiled;
+            }
+            result->PushBack(std::move(compiled));
+        }
+        return Object{std::move(result)};
+    }
+    default:
+        return expr;
+    }
+}
+
+Object Compiler::CompileIf(const ListPtr& form, Scope* scope)
+{
+    // (if test then [else])
+    size_t length = Length(form);
+    if (length != 3 && length != 4) {
+        return BadSyntax();
+    }
+    Object parts[3] = {Object::None(), Object::None(), Object::None()};
+    size_t i = 0;
+    for (const ListNode* next = form->Rest().get(); next != nullptr; next = next->Rest().get(), ++i) {
+        parts[i] = CompileExpr(next->First(), scope);
+        if (parts[i].Type() == ObjectType::Error) {
+            return parts[i];
+        }
+    }
+    return Object{SpecialForm::MakeIf(std::move(parts[0]), std::move(parts[1]), std::move(parts[2]))};
+}
+
+Object Compiler::CompileLambda(const ListPtr& form, Scope* scope)
+{
+    // (lambda (param ...) body ...)
+    const ListPtr& rest = form->Rest();
+    const ListPtr* params = rest != nullptr ? rest->First().TryGetListPtr() : nullptr;
+    if (params == nullptr) {
+        return BadSyntax();
+    }
+    Scope lambdaScope(scope);
+    int numParams = 0;
+    for (const ListNode* next = params->get(); next != nullptr; next = next->Rest().get()) {
+        std::optional<SymbolHandle> param = next->First().TryGetSymbolHandle();
+        if (!param) {
+            return BadSyntax();
+        }
+        lambdaScope.locals.emplace_back(*param, lambdaScope.AllocateSlot());
+        ++numParams;
+    }
+    Object body = CompileBody(rest->Rest(), &lambdaScope);
+    if (body.Type() == ObjectType::Error) {
+        return body;
+    }
+    SpecialFormPtr lambda = SpecialForm::MakeLambda(numParams,
+                                                    lambdaScope.frameSize,
+                                                    std::move(lambdaScope.captures),
+                                                    body.GetListPtrUnchecked());
+    if (lambda->Captures().empty()) {
+        // Every evaluation would make an identical closure
+        return Object{ClosurePtr(new Closure(std::move(lambda), {}))};
+    }
+    return Object{std::move(lambda)};
+}
+
+Object Compiler::CompileLet(const ListPtr& form, Scope* scope)
+{
+    // (let ((name init) ...) body ...)
+    const ListPtr& rest = form->Rest();
+    const ListPtr* bindingForms = rest != nullptr ? rest->First().TryGetListPtr() : nullptr;
+    if (bindingForms == nullptr) {
+        return BadSyntax();
+    }
+    // A let that is not inside a lambda has a frame of its own
+    std::optional<Scope> frameScope;
+    if (scope == nullptr) {
+        scope = &frameScope.emplace(nullptr);
+    }
+    // The inits are compiled before any of the names are bound, so that
+    // they refer to the enclosing variables
+    std::vector<SymbolHandle> names;
+    std::vector<LocalBinding> bindings;
+    for (const ListNode* next = bindingForms->get(); next != nullptr; next = next->Rest().get()) {
+        const ListPtr* binding = next->First().TryGetListPtr();
+        if (binding == nullptr || Length(*binding) != 2) {
+            return BadSyntax();
+        }
+        std::optional<SymbolHandle> name = (*binding)->First().TryGetSymbolHandle();
+        if (!name) {
+            return BadSyntax();
+        }
+        Object init = CompileExpr((*binding)->Rest()->First(), scope);
+        if (init.Type() == ObjectType::Error) {
+            return init;
+        }
+        names.push_back(*name);
+        bindings.push_back(LocalBinding{0, std::move(init), std::nullopt, 0});
+    }
+    size_t numLocals = scope->locals.size();
+    std::uint32_t nextSlot = scope->nextSlot;
+    for (size_t i = 0; i < names.size(); ++i) {
+        bindings[i].slot = scope->AllocateSlot();
+        scope->locals.emplace_back(names[i], bindings[i].slot);
+    }
+    Object body = CompileBody(rest->Rest(), scope);
+    // The slots are reused by later forms in the enclosing body
+    scope->locals.resize(numLocals);
+    scope->nextSlot = nextSlot;
+    if (body.Type() == ObjectType::Error) {
+        return body;
+    }
+    int frameSize = frameScope ? frameScope->frameSize : 0;
+    return Object{SpecialForm::MakeLet(frameSize, std::move(bindings), body.GetListPtrUnchecked())};
+}
+
+Object Compiler::CompileQuote(const ListPtr& form)
+{
+    // (quote datum). The datum is not compiled, so that a quoted list is
+    // returned as it was read.
+    if (Length(form) != 2) {
+        return BadSyntax();
+    }
+    return Object{SpecialForm::MakeQuote(form->Rest()->First())};
+}
+
+} // namespace Procdraw
@@ -0,0 +1,87 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROCDRAW_COMPILER_H
+#define PROCDRAW_COMPILER_H
+
+#include "InterpreterTypes.h"
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace Procdraw {
+
+class Interpreter;
+
+// Compiles special form expressions (define, defmacro, do, if, lambda,
+// let and quote) into SpecialForms, resolving each local variable to a
+// frame slot or a captured value. Calls to macros are replaced by their
+// expansions. Symbols that are not local variables are left as they are,
+// and are looked up in the Interpreter's global symbols when evaluated.
+
+class Compiler {
+public:
+    explicit Compiler(Interpreter* interpreter);
+    // Returns the compiled expression: for a special form, a SpecialFormPtr
+    // or a ClosurePtr for a lambda that captures nothing. Returns an error
+    // for bad syntax or a failed macro expansion.
+    Object Compile(const ListPtr& form);
+    bool IsSpecialFormSymbol(SymbolHandle handle) const
+    {
+        return handle == defineSymbol || handle == defmacroSymbol || handle == doSymbol || handle == ifSymbol ||
+               handle == lambdaSymbol || handle == letSymbol || handle == quoteSymbol;
+    }
+
+private:
+    // The local variables visible while compiling a lambda, or a let that
+    // is not inside a lambda, and the variables of enclosing scopes that
+    // it captures
+    struct Scope {
+        explicit Scope(Scope* parent)
+            : parent(parent) {}
+        Scope* parent;
+        std::vector<std::pair<SymbolHandle, std::uint32_t>> locals;
+        std::uint32_t nextSlot = 0;
+        std::uint32_t frameSize = 0;
+        std::vector<SymbolHandle> capturedNames;
+        std::vector<Object> captures;
+        std::uint32_t AllocateSlot();
+    };
+
+    Interpreter* interpreter;
+    SymbolHandle defineSymbol;
+    SymbolHandle defmacroSymbol;
+    SymbolHandle doSymbol;
+    SymbolHandle ifSymbol;
+    SymbolHandle lambdaSymbol;
+    SymbolHandle letSymbol;
+    SymbolHandle quoteSymbol;
+    Object CompileBody(const ListPtr& body, Scope* scope);
+    Object CompileDefine(const ListPtr& form, Scope* scope);
+    Object CompileDefmacro(const ListPtr& form, Scope* scope);
+    Object CompileDo(const ListPtr& form, Scope* scope);
+    Object CompileExpr(const Object& expr, Scope* scope);
+    Object CompileExprs(const ListPtr& exprs, Scope* scope);
+    Object CompileIf(const ListPtr& form, Scope* scope);
+    Object CompileLambda(const ListPtr& form, Scope* scope);
+    Object CompileLet(const ListPtr& form, Scope* scope);
+    Object CompileQuote(const ListPtr& form);
+    bool IsMacroCall(SymbolHandle head, Scope* scope);
+    std::optional<Object> Resolve(SymbolHandle name, Scope* scope);
+};
+
+} // namespace Procdraw
+
+#endif
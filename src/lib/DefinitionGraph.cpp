@@ -0,0 +1,98 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "DefinitionGraph.h"
+#include <algorithm>
+#include <utility>
+
+namespace Procdraw {
+
+void DefinitionGraph::Define(SymbolHandle symbol, Object valueExpr, std::vector<SymbolHandle> reads)
+{
+    // Replaces any earlier definition of symbol
+    Forget(symbol);
+    std::sort(reads.begin(), reads.end());
+    reads.erase(std::unique(reads.begin(), reads.end()), reads.end());
+    for (SymbolHandle read : reads) {
+        if (SymbolSet* symbolReaders = readers.Find(read)) {
+            symbolReaders->Insert(symbol, true);
+        }
+        else {
+            SymbolSet newReaders;
+            newReaders.Insert(symbol, true);
+            readers.Insert(read, std::move(newReaders));
+        }
+    }
+    definitions.Insert(symbol, Definition{std::move(valueExpr), std::move(reads)});
+}
+
+std::vector<SymbolHandle> DefinitionGraph::Dependents(SymbolHandle symbol) const
+{
+    // A depth-first search over the readers from symbol. Each definition
+    // is finished after the definitions that read it, other than those in
+    // a cycle with it, so the reverse of the finishing order has each
+    // after the definitions it reads.
+    struct Visit {
+        SymbolHandle symbol;
+        bool expanded;
+    };
+    std::vector<SymbolHandle> finished;
+    if (readers.Find(symbol) == nullptr) {
+        return finished;
+    }
+    SymbolSet visited;
+    std::vector<Visit> stack{Visit{symbol, false}};
+    while (!stack.empty()) {
+        Visit visit = stack.back();
+        stack.pop_back();
+        if (visit.expanded) {
+            finished.push_back(visit.symbol);
+            continue;
+        }
+        if (visited.Find(visit.symbol) != nullptr) {
+            continue;
+        }
+        visited.Insert(visit.symbol, true);
+        stack.push_back(Visit{visit.symbol, true});
+        if (const SymbolSet* symbolReaders = readers.Find(visit.symbol)) {
+            symbolReaders->ForEach([&](SymbolHandle reader, bool) {
+                if (visited.Find(reader) == nullptr) {
+                    stack.push_back(Visit{reader, false});
+                }
+            });
+        }
+    }
+    // The search started from symbol, so it finished last
+    finished.pop_back();
+    std::reverse(finished.begin(), finished.end());
+    return finished;
+}
+
+void DefinitionGraph::Forget(SymbolHandle symbol)
+{
+    const Definition* definition = definitions.Find(symbol);
+    if (definition == nullptr) {
+        return;
+    }
+    for (SymbolHandle read : definition->reads) {
+        SymbolSet* symbolReaders = readers.Find(read);
+        symbolReaders->Erase(symbol);
+        if (symbolReaders->Size() == 0) {
+            readers.Erase(read);
+        }
+    }
+    definitions.Erase(symbol);
+}
+
+} // namespace Procdraw
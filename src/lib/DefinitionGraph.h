@@ -0,0 +1,75 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROCDRAW_DEFINITIONGRAPH_H
+#define PROCDRAW_DEFINITIONGRAPH_H
+
+#include "InterpreterTypes.h"
+#include "OpenHashMap.h"
+#include <cstddef>
+#include <vector>
+
+namespace Procdraw {
+
+struct SymbolHandleHash {
+    size_t operator()(SymbolHandle handle) const
+    {
+        return static_cast<size_t>(MixHash(handle));
+    }
+};
+
+using SymbolSet = OpenHashMap<SymbolHandle, bool, SymbolHandleHash>;
+
+// Records the top-level definitions: for each symbol set by a define
+// outside of any lambda or let, the expression that computed its value,
+// and the symbols read while evaluating it. When a symbol changes, the
+// definitions that read it, directly or through other definitions, are
+// found from an index of the readers of each symbol, so the work done is
+// proportional to the number of definitions affected rather than to the
+// number of definitions. Replacing a definition is proportional to the
+// number of symbols it reads.
+
+class DefinitionGraph {
+public:
+    struct Definition {
+        Object valueExpr;
+        // Sorted, without duplicates
+        std::vector<SymbolHandle> reads;
+    };
+
+    void Define(SymbolHandle symbol, Object valueExpr, std::vector<SymbolHandle> reads);
+    // Returns the definitions that depend on symbol, directly or
+    // transitively, with each after the definitions that it reads. The
+    // definitions in a cycle are each returned once, in no particular
+    // order.
+    std::vector<SymbolHandle> Dependents(SymbolHandle symbol) const;
+    const Definition* Find(SymbolHandle symbol) const
+    {
+        return definitions.Find(symbol);
+    }
+    void Forget(SymbolHandle symbol);
+    size_t Size() const
+    {
+        return definitions.Size();
+    }
+
+private:
+    OpenHashMap<SymbolHandle, Definition, SymbolHandleHash> definitions;
+    // The definitions that read each symbol
+    OpenHashMap<SymbolHandle, SymbolSet, SymbolHandleHash> readers;
+};
+
+} // namespace Procdraw
+
+#endif
@@ -0,0 +1,347 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Equality.h"
+#include "OpenHashMap.h"
+#include <cstring>
+#include <optional>
+#include <vector>
+
+namespace Procdraw {
+
+namespace {
+
+struct PendingPair {
+    const Object* a;
+    const Object* b;
+};
+
+// The pending objects of the traversals on this thread. The traversals
+// do not call out to other code, so they are never nested.
+thread_local std::vector<PendingPair> pendingPairs;
+thread_local std::vector<const Object*> pendingObjects;
+
+// The number of elements of lists and Vectors pushed by one hash, after
+// which the remaining elements are not hashed
+constexpr size_t maxHashedElements = size_t{1} << 21;
+
+struct ContainerPair {
+    const void* x;
+    const void* y;
+    bool operator==(const ContainerPair& other) const
+    {
+        return x == other.x && y == other.y;
+    }
+};
+
+struct ContainerPairHash {
+    size_t operator()(const ContainerPair& pair) const
+    {
+        return static_cast<size_t>(MixHash(reinterpret_cast<std::uintptr_t>(pair.x) ^ MixHash(reinterpret_cast<std::uintptr_t>(pair.y))));
+    }
+};
+
+// The pairs of Vectors and HashMaps compared by one traversal. A
+// container can hold itself, so a pair reached again is taken to be
+// equal, which ends the traversal of a cycle; if the pair is not equal,
+// its first comparison finds the difference. Pairs are recorded only
+// once a traversal has compared many containers, so that comparing
+// small objects does not allocate.
+class ComparedContainers {
+public:
+    // Returns false if x and y have already been compared
+    bool Insert(const void* x, const void* y)
+    {
+        if (++count <= unrecordedCount) {
+            return true;
+        }
+        if (!pairs) {
+            pairs.emplace();
+        }
+        ContainerPair pair{x, y};
+        if (pairs->Find(pair) != nullptr) {
+            return false;
+        }
+        pairs->Insert(pair, true);
+        return true;
+    }
+
+private:
+    static constexpr size_t unrecordedCount = 1024;
+    size_t count = 0;
+    std::optional<OpenHashMap<ContainerPair, bool, ContainerPairHash>> pairs;
+};
+
+template <typename T>
+bool EqualElements(const T* x, const T* y, size_t n)
+{
+    // Compares with ==, so that 0.0 equals -0.0
+    for (size_t i = 0; i < n; ++i) {
+        if (!(x[i] == y[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool EqualArrays(const NumericArray& x, const NumericArray& y)
+{
+    if (&x == &y) {
+        return true;
+    }
+    if (x.Type() != y.Type() || x.Size() != y.Size()) {
+        return false;
+    }
+    if (x.Type() == NumericArrayType::Float32) {
+        return EqualElements(x.Float32Data(), y.Float32Data(), x.Size());
+    }
+    return EqualElements(x.Int32Data(), y.Int32Data(), x.Size());
+}
+
+// Compares a and b, other than their elements, and pushes the pairs of
+// elements still to be compared
+bool ComparePair(const Object& a, const Object& b, std::vector<PendingPair>& pending, ComparedContainers& compared)
+{
+    if (a.Type() != b.Type()) {
+        return false;
+    }
+    switch (a.Type()) {
+    case ObjectType::Float:
+        // Unlike IdenticalObjects(), 0.0 is equal to -0.0
+        return a.GetFloatUnchecked() == b.GetFloatUnchecked();
+    case ObjectType::HashMapPtr: {
+        const HashMap& x = *a.GetHashMapPtrUnchecked();
+        const HashMap& y = *b.GetHashMapPtrUnchecked();
+        if (&x == &y) {
+            return true;
+        }
+        if (x.Size() != y.Size()) {
+            return false;
+        }
+        if (!compared.Insert(&x, &y)) {
+            return true;
+        }
+        bool sameKeys = true;
+        x.ForEach([&](const Object& key, const Object& value) {
+            if (const Object* other = y.Find(key)) {
+                pending.push_back(PendingPair{&value, other});
+            }
+            else {
+                sameKeys = false;
+            }
+        });
+        return sameKeys;
+    }
+    case ObjectType::ListPtr: {
+        // Stops at a tail shared by both lists
+        const ListNode* x = a.GetListPtrUnchecked().get();
+        const ListNode* y = b.GetListPtrUnchecked().get();
+        for (; x != y; x = x->Rest().get(), y = y->Rest().get()) {
+            if (x == nullptr || y == nullptr) {
+                return false;
+            }
+            pending.push_back(PendingPair{&x->First(), &y->First()});
+        }
+        return true;
+    }
+    case ObjectType::NumericArrayPtr:
+        return EqualArrays(*a.GetNumericArrayPtrUnchecked(), *b.GetNumericArrayPtrUnchecked());
+    case ObjectType::VectorPtr: {
+        const Vector& x = *a.GetVectorPtrUnchecked();
+        const Vector& y = *b.GetVectorPtrUnchecked();
+        if (&x == &y) {
+            return true;
+        }
+        if (x.Size() != y.Size()) {
+            return false;
+        }
+        if (!compared.Insert(&x, &y)) {
+            return true;
+        }
+        for (size_t i = 0; i < x.Size(); ++i) {
+            pending.push_back(PendingPair{&x.At(i), &y.At(i)});
+        }
+        return true;
+    }
+    default:
+        return IdenticalObjects(a, b);
+    }
+}
+
+std::uint64_t FloatBits(double val)
+{
+    // -0.0 is equal to 0.0, so has the same bits
+    if (val == 0.0) {
+        return 0;
+    }
+    std::uint64_t bits;
+    std::memcpy(&bits, &val, sizeof(bits));
+    return bits;
+}
+
+// The hash of obj other than its elements, and of all of an atom
+std::uint64_t ShallowHash(const Object& obj)
+{
+    std::uint64_t bits = 0;
+    switch (obj.Type()) {
+    case ObjectType::Boolean:
+        bits = obj.GetBooleanUnchecked();
+        break;
+    case ObjectType::CFunctionHandle:
+        bits = obj.GetCFunctionHandle();
+        break;
+    case ObjectType::ClosurePtr:
+        bits = reinterpret_cast<std::uintptr_t>(obj.GetClosurePtrUnchecked().get());
+        break;
+    case ObjectType::Error:
+        bits = static_cast<std::uint64_t>(obj.GetError());
+        break;
+    case ObjectType::Float:
+        bits = FloatBits(obj.GetFloatUnchecked());
+        break;
+    case ObjectType::HashMapPtr:
+        bits = obj.GetHashMapPtrUnchecked()->Size();
+        break;
+    case ObjectType::Integer:
+        bits = static_cast<std::uint32_t>(obj.GetIntegerUnchecked());
+        break;
+    case ObjectType::ListPtr:
+        for (const ListNode* next = obj.GetListPtrUnchecked().get(); next != nullptr; next = next->Rest().get()) {
+            ++bits;
+        }
+        break;
+    case ObjectType::LocalRef: {
+        LocalRef ref = obj.GetLocalRefUnchecked();
+        bits = (static_cast<std::uint64_t>(ref.captured) << 32) | ref.slot;
+        break;
+    }
+    case ObjectType::MacroPtr:
+        bits = reinterpret_cast<std::uintptr_t>(obj.GetMacroPtrUnchecked().get());
+        break;
+    case ObjectType::None:
+        break;
+    case ObjectType::NumericArrayPtr: {
+        const NumericArray& array = *obj.GetNumericArrayPtrUnchecked();
+        bits = (array.Size() << 1) | (array.Type() == NumericArrayType::Int32);
+        break;
+    }
+    case ObjectType::SequencePtr:
+        bits = reinterpret_cast<std::uintptr_t>(obj.GetSequencePtrUnchecked().get());
+        break;
+    case ObjectType::SignalPtr:
+        bits = reinterpret_cast<std::uintptr_t>(obj.GetSignalPtrUnchecked().get());
+        break;
+    case ObjectType::SpecialFormPtr:
+        bits = reinterpret_cast<std::uintptr_t>(obj.GetSpecialFormPtrUnchecked().get());
+        break;
+    case ObjectType::StringPtr:
+        bits = StringHash(obj.GetStringPtrUnchecked()->View());
+        break;
+    case ObjectType::SymbolHandle:
+        bits = obj.GetSymbolHandle();
+        break;
+    case ObjectType::VectorPtr:
+        bits = obj.GetVectorPtrUnchecked()->Size();
+        break;
+    }
+    return MixHash(bits ^ (static_cast<std::uint64_t>(obj.Type()) << 56));
+}
+
+std::uint64_t HashArray(const NumericArray& array)
+{
+    std::uint64_t h = 0;
+    for (size_t i = 0; i < array.Size(); ++i) {
+        std::uint64_t bits;
+        if (array.Type() == NumericArrayType::Float32) {
+            bits = FloatBits(array.Float32Data()[i]);
+        }
+        else {
+            bits = static_cast<std::uint32_t>(array.Int32Data()[i]);
+        }
+        h = MixHash(h ^ bits);
+    }
+    return h;
+}
+
+// The hash of obj other than its elements, and pushes the elements
+// still to be hashed while budget lasts
+std::uint64_t HashNode(const Object& obj, std::vector<const Object*>& pending, size_t& budget)
+{
+    std::uint64_t h = ShallowHash(obj);
+    switch (obj.Type()) {
+    case ObjectType::HashMapPtr: {
+        // Summed, as the order of the entries depends on their history
+        std::uint64_t sum = 0;
+        obj.GetHashMapPtrUnchecked()->ForEach([&](const Object& key, const Object& value) {
+            sum += MixHash(ShallowHash(key) ^ ShallowHash(value));
+        });
+        return h ^ sum;
+    }
+    case ObjectType::ListPtr:
+        for (const ListNode* next = obj.GetListPtrUnchecked().get(); next != nullptr && budget > 0; next = next->Rest().get()) {
+            pending.push_back(&next->First());
+            --budget;
+        }
+        return h;
+    case ObjectType::NumericArrayPtr:
+        return h ^ HashArray(*obj.GetNumericArrayPtrUnchecked());
+    case ObjectType::VectorPtr: {
+        const Vector& vec = *obj.GetVectorPtrUnchecked();
+        for (size_t i = 0; i < vec.Size() && budget > 0; ++i) {
+            pending.push_back(&vec.At(i));
+            --budget;
+        }
+        return h;
+    }
+    default:
+        return h;
+    }
+}
+
+} // namespace
+
+bool EqualObjects(const Object& a, const Object& b)
+{
+    std::vector<PendingPair>& pending = pendingPairs;
+    pending.push_back(PendingPair{&a, &b});
+    ComparedContainers compared;
+    bool equal = true;
+    while (equal && !pending.empty()) {
+        PendingPair pair = pending.back();
+        pending.pop_back();
+        equal = ComparePair(*pair.a, *pair.b, pending, compared);
+    }
+    pending.clear();
+    return equal;
+}
+
+std::uint64_t HashObject(const Object& obj)
+{
+    // The node hashes are combined in the order they are visited, which
+    // is fixed by the structure as each container's size is included. So
+    // the elements left out once the budget runs out are the same for
+    // equal objects.
+    std::vector<const Object*>& pending = pendingObjects;
+    pending.push_back(&obj);
+    size_t budget = maxHashedElements;
+    std::uint64_t h = 0;
+    while (!pending.empty()) {
+        const Object* next = pending.back();
+        pending.pop_back();
+        h = MixHash(h ^ HashNode(*next, pending, budget));
+    }
+    return h;
+}
+
+} // namespace Procdraw
@@ -0,0 +1,56 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROCDRAW_EQUALITY_H
+#define PROCDRAW_EQUALITY_H
+
+#include "InterpreterTypes.h"
+#include <cstdint>
+
+namespace Procdraw {
+
+// Structural equality and hashing. Lists, Vectors, HashMaps and
+// NumericArrays are equal if they have equal elements, strings if they
+// have the same characters, and atoms if they have the same value.
+// Closures, macros, signals, sequences and special forms are equal only
+// to themselves. Objects of different types are never equal, so 1 and
+// 1.0 are not.
+//
+// Both traverse nested objects with an explicit stack, kept per thread
+// and reused, so that they neither recurse on the C++ stack nor allocate
+// once the stack has grown to the size of the largest object traversed.
+// The exception is a comparison of more than a thousand containers,
+// which records the pairs it has compared. Shared parts, such as a
+// common tail of two lists, are compared by address without traversing
+// them.
+//
+// A Vector or HashMap can hold itself. EqualObjects() takes a pair of
+// containers that it reaches again to be equal, so two such containers
+// are equal if no difference is found by unrolling them. HashObject()
+// hashes at most about two million elements of lists and Vectors, in a
+// fixed order, so the hash of a container that holds itself is of a
+// finite part of its unrolling.
+//
+// Equal objects have equal hashes. HashObject() hashes the elements of
+// lists, Vectors and NumericArrays, and the keys of HashMaps with only
+// the type and size of any container values. Objects that are equal
+// only to themselves are hashed by address, and symbols by handle, so
+// hashes are stable only within one run.
+
+bool EqualObjects(const Object& a, const Object& b);
+std::uint64_t HashObject(const Object& obj);
+
+} // namespace Procdraw
+
+#endif
@@ -0,0 +1,515 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "EvalTask.h"
+#include "Compiler.h"
+#include "HeapUsage.h"
+#include <algorithm>
+#include <utility>
+
+namespace Procdraw {
+
+EvalTask::EvalTask(Interpreter* interpreter, Object expr)
+    : interpreter(interpreter),
+      expr(&heldExpr),
+      heldExpr(std::move(expr)),
+      val(Object::None()),
+      usage{0, HeapUsage::Bytes(), 1}
+{
+}
+
+EvalStatus EvalTask::Run(const EvalBudget& budget)
+{
+    // Reading the clock costs more than a step, so it is read only every
+    // stepsPerClockCheck steps
+    constexpr std::uint64_t stepsPerClockCheck = 64;
+    auto start = std::chrono::steady_clock::now();
+    // The task's usage and read log are the Interpreter's while it runs,
+    // so that evaluations made by builtins are counted and recorded with
+    // it
+    std::swap(interpreter->usage, usage);
+    std::swap(interpreter->readLog, readLog);
+    EvalStatus status = EvalStatus::Finished;
+    for (std::uint64_t n = 0; !finished; ++n) {
+        if (n == budget.maxSteps ||
+            (n > 0 && n % stepsPerClockCheck == 0 && std::chrono::steady_clock::now() - start >= budget.maxTime)) {
+            status = EvalStatus::Suspended;
+            break;
+        }
+        ++steps;
+        if (!evaluating) {
+            Resume();
+        }
+        else if (std::optional<ErrorKind> error = CheckQuotas()) {
+            Return(Object::MakeError(*error));
+        }
+        else {
+            EvalExpr();
+        }
+    }
+    std::swap(interpreter->readLog, readLog);
+    std::swap(interpreter->usage, usage);
+    return status;
+}
+
+std::optional<ErrorKind> EvalTask::CheckQuotas()
+{
+    if (continuations.size() >= static_cast<size_t>(interpreter->quotas.maxDepth)) {
+        return ErrorKind::DepthQuotaExceeded;
+    }
+    return interpreter->UseStep();
+}
+
+void EvalTask::Evaluate(const Object& next)
+{
+    expr = &next;
+    evaluating = true;
+}
+
+void EvalTask::Return(Object result)
+{
+    val = std::move(result);
+    evaluating = false;
+}
+
+const Object& EvalTask::Local(LocalRef ref) const
+{
+    if (ref.captured) {
+        return closure->Captured(ref.slot);
+    }
+    return slots[frameBase + ref.slot];
+}
+
+void EvalTask::PushFrame(size_t size, const Closure* frameClosure, Object owner)
+{
+    // Owner keeps frameClosure alive until the frame is popped
+    continuations.push_back(Continuation{ContinuationKind::Frame,
+                                         std::move(owner),
+                                         nullptr,
+                                         0,
+                                         slots.size(),
+                                         frameBase,
+                                         closure});
+    frameBase = slots.size();
+    slots.resize(frameBase + size, Object::None());
+    closure = frameClosure;
+}
+
+void EvalTask::PopFrame(const Continuation& frame)
+{
+    slots.erase(slots.begin() + frame.base, slots.end());
+    frameBase = frame.savedFrameBase;
+    closure = frame.savedClosure;
+}
+
+void EvalTask::StartList(ContinuationKind kind, Object form, const ListPtr& exprs)
+{
+    // Evaluates each of exprs in turn, which form must keep alive. The
+    // value of an empty list is none.
+    if (exprs == nullptr) {
+        Return(Object::None());
+        return;
+    }
+    const Object& first = exprs->First();
+    continuations.push_back(Continuation{kind, std::move(form), exprs->Rest().get(), 0, 0, 0, nullptr});
+    Evaluate(first);
+}
+
+void EvalTask::EvalExpr()
+{
+    switch (expr->Type()) {
+    case ObjectType::SymbolHandle:
+        if (interpreter->readLog.recording > 0) {
+            interpreter->readLog.symbols.push_back(expr->GetSymbolHandle());
+        }
+        Return(interpreter->SymbolValue(expr->GetSymbolHandle()));
+        break;
+    case ObjectType::LocalRef:
+        Return(Local(expr->GetLocalRefUnchecked()));
+        break;
+    case ObjectType::SpecialFormPtr:
+        EvalSpecialForm(expr->GetSpecialFormPtrUnchecked());
+        break;
+    case ObjectType::ListPtr: {
+        const ListPtr& lst = expr->GetListPtrUnchecked();
+        if (lst == nullptr) {
+            Return(*expr);
+            break;
+        }
+        std::optional<SymbolHandle> head = lst->First().TryGetSymbolHandle();
+        if (head && interpreter->compiler->IsSpecialFormSymbol(*head)) {
+            EvalCompiled(interpreter->Compiled(lst));
+            break;
+        }
+        // The function and args are evaluated onto the value stack. Macro
+        // calls are found once the function has been evaluated.
+        const Object& first = lst->First();
+        continuations.push_back(Continuation{ContinuationKind::Args,
+                                             Object{lst},
+                                             lst->Rest().get(),
+                                             0,
+                                             values.size(),
+                                             0,
+                                             nullptr});
+        Evaluate(first);
+        break;
+    }
+    case ObjectType::HashMapPtr: {
+        // The keys and value expressions are copied into a vector, as
+        // the map can only be walked with a callback
+        VectorPtr entries(new Vector());
+        expr->GetHashMapPtrUnchecked()->ForEach([&](const Object& key, const Object& value) {
+            entries->PushBack(key);
+            entries->PushBack(value);
+        });
+        if (entries->Size() == 0) {
+            Return(Object{HashMapPtr(new HashMap())});
+            break;
+        }
+        const Object& first = entries->At(1);
+        continuations.push_back(Continuation{ContinuationKind::HashMapValues,
+                                             Object{entries},
+                                             nullptr,
+                                             1,
+                                             values.size(),
+                                             0,
+                                             nullptr});
+        Evaluate(first);
+        break;
+    }
+    case ObjectType::VectorPtr: {
+        const VectorPtr& vec = expr->GetVectorPtrUnchecked();
+        if (vec->Size() == 0) {
+            Return(Object{VectorPtr(new Vector())});
+            break;
+        }
+        const Object& first = vec->At(0);
+        continuations.push_back(Continuation{ContinuationKind::VectorElements,
+                                             Object{vec},
+                                             nullptr,
+                                             0,
+                                             values.size(),
+                                             0,
+                                             nullptr});
+        Evaluate(first);
+        break;
+    }
+    default:
+        Return(*expr);
+        break;
+    }
+}
+
+void EvalTask::EvalCompiled(Object compiled)
+{
+    // Evaluates a compiled form, or returns the error from compiling it
+    if (compiled.Type() == ObjectType::Error) {
+        Return(std::move(compiled));
+    }
+    else {
+        heldExpr = std::move(compiled);
+        Evaluate(heldExpr);
+    }
+}
+
+void EvalTask::EvalSpecialForm(const SpecialFormPtr& form)
+{
+    switch (form->Kind()) {
+    case SpecialFormKind::Define:
+    case SpecialFormKind::Defmacro:
+    case SpecialFormKind::If: {
+        ContinuationKind kind = form->Kind() == SpecialFormKind::Define     ? ContinuationKind::Define
+                                : form->Kind() == SpecialFormKind::Defmacro ? ContinuationKind::Defmacro
+                                                                            : ContinuationKind::If;
+        // The value expression, or the test of an if
+        const Object& operand = form->Operands()[form->Kind() == SpecialFormKind::If ? 0 : 1];
+        continuations.push_back(Continuation{kind, Object{form}, nullptr, 0, 0, 0, nullptr});
+        // A top-level definition records the symbols it reads, from base,
+        // and is marked with an index of 1
+        if (kind == ContinuationKind::Define && closure == nullptr && slots.empty()) {
+            continuations.back().index = 1;
+            continuations.back().base = interpreter->BeginDefinition();
+        }
+        Evaluate(operand);
+        break;
+    }
+    case SpecialFormKind::Lambda: {
+        std::vector<Object> captured;
+        captured.reserve(form->Captures().size());
+        for (const Object& capture : form->Captures()) {
+            captured.push_back(Local(capture.GetLocalRef()));
+        }
+        Return(Object{ClosurePtr(new Closure(form, std::move(captured)))});
+        break;
+    }
+    case SpecialFormKind::Quote:
+        Return(form->Operands()[0]);
+        break;
+    case SpecialFormKind::Do:
+    case SpecialFormKind::Let:
+        if (form->FrameSize() > 0) {
+            PushFrame(form->FrameSize(), nullptr, Object{form});
+        }
+        if (form->Bindings().empty()) {
+            continuations.push_back(Continuation{ContinuationKind::Bindings, Object{form}, nullptr, 0, 0, 0, nullptr});
+            StartBody(continuations.back());
+        }
+        else {
+            continuations.push_back(Continuation{ContinuationKind::Bindings, Object{form}, nullptr, 0, 0, 0, nullptr});
+            Evaluate(form->Bindings()[0].init);
+        }
+        break;
+    default:
+        Return(Object::MakeError(ErrorKind::BadSyntax));
+        break;
+    }
+}
+
+void EvalTask::StartBody(Continuation& cont)
+{
+    // Starts the body of a let, or the first test of a do loop, once the
+    // bindings have been made
+    const SpecialForm& form = *cont.form.GetSpecialFormPtrUnchecked();
+    if (form.Kind() == SpecialFormKind::Do) {
+        cont.kind = ContinuationKind::DoTest;
+        Evaluate(form.Operands()[0]);
+        return;
+    }
+    const ListPtr& body = form.Body();
+    cont.kind = ContinuationKind::Body;
+    cont.next = body->Rest().get();
+    Evaluate(body->First());
+}
+
+void EvalTask::NextDoStep(Continuation& cont, size_t index)
+{
+    // Evaluates the next step from index, or once all of the steps have
+    // been evaluated, updates the variables and tests again
+    const std::vector<LocalBinding>& bindings = cont.form.GetSpecialFormPtrUnchecked()->Bindings();
+    for (; index < bindings.size(); ++index) {
+        if (bindings[index].step) {
+            cont.kind = ContinuationKind::DoStep;
+            cont.index = index;
+            Evaluate(*bindings[index].step);
+            return;
+        }
+    }
+    for (const LocalBinding& binding : bindings) {
+        if (binding.step) {
+            slots[frameBase + binding.slot] = std::move(slots[frameBase + binding.stepSlot]);
+        }
+    }
+    StartBody(cont);
+}
+
+void EvalTask::Apply(size_t base)
+{
+    // Calls the function at values[base] with the args above it. A
+    // closure's body is evaluated by the task, and anything else is
+    // called by the Interpreter as one step.
+    Object fun = std::move(values[base]);
+    const ClosurePtr* closurePtr = fun.TryGetClosurePtr();
+    if (closurePtr != nullptr && !interpreter->memoCache.IsPure(fun)) {
+        const Closure* called = closurePtr->get();
+        const SpecialForm& lambda = called->Lambda();
+        size_t numArgs = values.size() - base - 1;
+        if (numArgs != static_cast<size_t>(lambda.NumParams())) {
+            values.erase(values.begin() + base, values.end());
+            Return(Object::MakeError(ErrorKind::WrongNumberOfArgs));
+            return;
+        }
+        PushFrame(lambda.FrameSize(), called, fun);
+        std::move(values.begin() + base + 1, values.end(), slots.begin() + frameBase);
+        values.erase(values.begin() + base, values.end());
+        StartList(ContinuationKind::Body, std::move(fun), lambda.Body());
+        return;
+    }
+    ListBuilder builder(values.size() - base - 1);
+    for (size_t i = base + 1; i < values.size(); ++i) {
+        builder.Append(std::move(values[i]));
+    }
+    values.erase(values.begin() + base, values.end());
+    Return(interpreter->Apply(fun, builder.Finish()));
+}
+
+void EvalTask::Resume()
+{
+    // Passes val to the top continuation
+    if (continuations.empty()) {
+        finished = true;
+        return;
+    }
+    if (val.Type() == ObjectType::Error) {
+        // Errors end the evaluation
+        while (!continuations.empty()) {
+            const Continuation& top = continuations.back();
+            if (top.kind == ContinuationKind::Frame) {
+                PopFrame(top);
+            }
+            else if (top.kind == ContinuationKind::Define && top.index == 1) {
+                const SpecialFormPtr& form = top.form.GetSpecialFormPtrUnchecked();
+                interpreter->EndDefinition(form->Operands()[0].GetSymbolHandle(), form->Operands()[1], top.base, val);
+            }
+            continuations.pop_back();
+        }
+        values.clear();
+        finished = true;
+        return;
+    }
+    Continuation& cont = continuations.back();
+    switch (cont.kind) {
+    case ContinuationKind::Args:
+        if (values.size() == cont.base && val.Type() == ObjectType::MacroPtr) {
+            ListPtr form = cont.form.GetListPtrUnchecked();
+            continuations.pop_back();
+            EvalCompiled(interpreter->CompiledMacroCall(form));
+            break;
+        }
+        values.push_back(std::move(val));
+        if (cont.next != nullptr) {
+            const Object& arg = cont.next->First();
+            cont.next = cont.next->Rest().get();
+            Evaluate(arg);
+        }
+        else {
+            size_t base = cont.base;
+            continuations.pop_back();
+            Apply(base);
+        }
+        break;
+    case ContinuationKind::Bindings: {
+        const std::vector<LocalBinding>& bindings = cont.form.GetSpecialFormPtrUnchecked()->Bindings();
+        slots[frameBase + bindings[cont.index].slot] = std::move(val);
+        if (++cont.index < bindings.size()) {
+            Evaluate(bindings[cont.index].init);
+        }
+        else {
+            StartBody(cont);
+        }
+        break;
+    }
+    case ContinuationKind::Body:
+        if (cont.next != nullptr) {
+            const Object& next = cont.next->First();
+            cont.next = cont.next->Rest().get();
+            Evaluate(next);
+        }
+        else {
+            continuations.pop_back();
+        }
+        break;
+    case ContinuationKind::Define:
+    case ContinuationKind::Defmacro: {
+        SpecialFormPtr form = cont.form.GetSpecialFormPtrUnchecked();
+        SymbolHandle name = form->Operands()[0].GetSymbolHandle();
+        if (cont.kind == ContinuationKind::Defmacro) {
+            val = Object{MacroPtr(new Macro(val.GetClosurePtr()))};
+        }
+        ContinuationKind kind = cont.kind;
+        size_t index = cont.index;
+        size_t readsStart = cont.base;
+        continuations.pop_back();
+        if (kind == ContinuationKind::Define && index == 1) {
+            interpreter->EndDefinition(name, form->Operands()[1], readsStart, val);
+            break;
+        }
+        if (kind == ContinuationKind::Define) {
+            interpreter->definitions.Forget(name);
+        }
+        interpreter->SetSymbolValue(name, val);
+        break;
+    }
+    case ContinuationKind::DoBody:
+        if (cont.next != nullptr) {
+            const Object& next = cont.next->First();
+            cont.next = cont.next->Rest().get();
+            Evaluate(next);
+        }
+        else {
+            NextDoStep(cont, 0);
+        }
+        break;
+    case ContinuationKind::DoStep: {
+        const LocalBinding& binding = cont.form.GetSpecialFormPtrUnchecked()->Bindings()[cont.index];
+        slots[frameBase + binding.stepSlot] = std::move(val);
+        NextDoStep(cont, cont.index + 1);
+        break;
+    }
+    case ContinuationKind::DoTest: {
+        const SpecialForm& form = *cont.form.GetSpecialFormPtrUnchecked();
+        const ListPtr& exprs = IsTruthy(val) ? form.Operands()[1].GetListPtrUnchecked() : form.Body();
+        if (exprs == nullptr) {
+            if (IsTruthy(val)) {
+                continuations.pop_back();
+                Return(Object::None());
+            }
+            else {
+                NextDoStep(cont, 0);
+            }
+            break;
+        }
+        cont.kind = IsTruthy(val) ? ContinuationKind::Body : ContinuationKind::DoBody;
+        cont.next = exprs->Rest().get();
+        Evaluate(exprs->First());
+        break;
+    }
+    case ContinuationKind::Frame:
+        PopFrame(cont);
+        continuations.pop_back();
+        break;
+    case ContinuationKind::HashMapValues: {
+        values.push_back(std::move(val));
+        const Vector& entries = *cont.form.GetVectorPtrUnchecked();
+        cont.index += 2;
+        if (cont.index < entries.Size()) {
+            Evaluate(entries.At(cont.index));
+            break;
+        }
+        HashMapPtr map(new HashMap());
+        for (size_t i = cont.base; i < values.size(); ++i) {
+            map->Insert(entries.At((i - cont.base) * 2), std::move(values[i]));
+        }
+        values.erase(values.begin() + cont.base, values.end());
+        continuations.pop_back();
+        Return(Object{std::move(map)});
+        break;
+    }
+    case ContinuationKind::If: {
+        // The branch is evaluated in place of the if
+        heldExpr = std::move(cont.form);
+        continuations.pop_back();
+        Evaluate(heldExpr.GetSpecialFormPtrUnchecked()->Operands()[IsTruthy(val) ? 1 : 2]);
+        break;
+    }
+    case ContinuationKind::VectorElements: {
+        values.push_back(std::move(val));
+        const Vector& vec = *cont.form.GetVectorPtrUnchecked();
+        if (++cont.index < vec.Size()) {
+            Evaluate(vec.At(cont.index));
+            break;
+        }
+        VectorPtr result(new Vector());
+        result->Reserve(vec.Size());
+        for (size_t i = cont.base; i < values.size(); ++i) {
+            result->PushBack(std::move(values[i]));
+        }
+        values.erase(values.begin() + cont.base, values.end());
+        continuations.pop_back();
+        Return(Object{std::move(result)});
+        break;
+    }
+    }
+}
+
+} // namespace Procdraw
@@ -0,0 +1,149 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROCDRAW_EVALTASK_H
+#define PROCDRAW_EVALTASK_H
+
+#include "Interpreter.h"
+#include "InterpreterTypes.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace Procdraw {
+
+// Limits on the work done by one call to EvalTask::Run. The time is
+// checked every few steps, so a slice may run a little over.
+
+struct EvalBudget {
+    std::uint64_t maxSteps = UINT64_MAX;
+    std::chrono::steady_clock::duration maxTime = std::chrono::steady_clock::duration::max();
+};
+
+enum class EvalStatus {
+    Finished,
+    Suspended
+};
+
+// Evaluates an expression in slices that can be spread over several
+// frames. Run() evaluates until the expression is finished or the budget
+// runs out, and a later Run() carries on from where the last one
+// stopped.
+//
+// The evaluation state is held explicitly, in a stack of continuations
+// and a stack of local variable slots owned by the task, rather than on
+// the C++ stack, so a suspended task does not hold up the Interpreter:
+// other expressions may be evaluated, and other tasks run, between
+// slices. Recursion depth is limited only by memory.
+//
+// One step evaluates an atom, starts a special form or call, or resumes
+// the form waiting for a value. A call to a builtin, or to a pure
+// function, is one step however long it runs, so the closures called by
+// builtins such as map and reduce are not sliced.
+//
+// The task is one evaluation for the Interpreter's EvalQuotas, counted
+// across all of its slices. Its depth is the number of forms waiting for
+// a value.
+
+class EvalTask {
+public:
+    EvalTask(Interpreter* interpreter, Object expr);
+    EvalTask(const EvalTask&) = delete;
+    EvalTask& operator=(const EvalTask&) = delete;
+    bool Finished() const
+    {
+        return finished;
+    }
+    // The value of the expression, or the first error. None until the
+    // task has finished.
+    const Object& Result() const
+    {
+        return val;
+    }
+    EvalStatus Run(const EvalBudget& budget);
+    std::uint64_t Steps() const
+    {
+        return steps;
+    }
+
+private:
+    enum class ContinuationKind {
+        Args,
+        Bindings,
+        Body,
+        Define,
+        Defmacro,
+        DoBody,
+        DoStep,
+        DoTest,
+        Frame,
+        HashMapValues,
+        If,
+        VectorElements
+    };
+
+    // A form waiting for the value of one of its parts. Form keeps the
+    // form alive, Next is the next expression of a list to evaluate, and
+    // Index the next binding or element. Base is the start of the form's
+    // values on the value stack, or for a Frame the slot stack size to
+    // restore.
+    struct Continuation {
+        ContinuationKind kind;
+        Object form;
+        const ListNode* next;
+        size_t index;
+        size_t base;
+        size_t savedFrameBase;
+        const Closure* savedClosure;
+    };
+
+    Interpreter* interpreter;
+    std::vector<Continuation> continuations;
+    std::vector<Object> values;
+    std::vector<Object> slots;
+    size_t frameBase = 0;
+    const Closure* closure = nullptr;
+    // The expression to evaluate next, if evaluating, and the value
+    // returned to the top continuation otherwise. Expr points into a
+    // form held by a continuation, or by heldExpr when none holds it.
+    const Object* expr;
+    Object heldExpr;
+    Object val;
+    bool evaluating = true;
+    bool finished = false;
+    std::uint64_t steps = 0;
+    Interpreter::QuotaUsage usage;
+    Interpreter::ReadLog readLog;
+
+    void Apply(size_t base);
+    std::optional<ErrorKind> CheckQuotas();
+    void EvalCompiled(Object compiled);
+    void EvalExpr();
+    void EvalSpecialForm(const SpecialFormPtr& form);
+    void Evaluate(const Object& next);
+    const Object& Local(LocalRef ref) const;
+    void NextDoStep(Continuation& cont, size_t index);
+    void PopFrame(const Continuation& frame);
+    void PushFrame(size_t size, const Closure* frameClosure, Object owner);
+    void Resume();
+    void Return(Object result);
+    void StartBody(Continuation& cont);
+    void StartList(ContinuationKind kind, Object form, const ListPtr& exprs);
+};
+
+} // namespace Procdraw
+
+#endif
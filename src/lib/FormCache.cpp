@@ -0,0 +1,55 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "FormCache.h"
+#include <algorithm>
+#include <vector>
+
+namespace Procdraw {
+
+void FormCache::Clear()
+{
+    entries = OpenHashMap<const ListNode*, Entry, NodeHash>();
+    sweepThreshold = minSweepThreshold;
+}
+
+const Object* FormCache::Find(const ListPtr& form) const
+{
+    const Entry* entry = entries.Find(form.get());
+    return entry != nullptr ? &entry->value : nullptr;
+}
+
+void FormCache::Insert(const ListPtr& form, Object value)
+{
+    if (entries.Size() >= sweepThreshold) {
+        Sweep();
+    }
+    entries.Insert(form.get(), Entry{form, std::move(value)});
+}
+
+void FormCache::Sweep()
+{
+    std::vector<const ListNode*> unreferenced;
+    entries.ForEach([&](const ListNode* node, const Entry& entry) {
+        if (entry.form.use_count() == 1) {
+            unreferenced.push_back(node);
+        }
+    });
+    for (const ListNode* node : unreferenced) {
+        entries.Erase(node);
+    }
+    sweepThreshold = std::max(minSweepThreshold, entries.Size() * 2);
+}
+
+} // namespace Procdraw
@@ -0,0 +1,66 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROCDRAW_FORMCACHE_H
+#define PROCDRAW_FORMCACHE_H
+
+#include "InterpreterTypes.h"
+#include "OpenHashMap.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace Procdraw {
+
+// Holds a value derived from a list form, such as its compiled code,
+// keyed by the identity of the form's first node, so that the work is
+// done once per form however many times the form is evaluated.
+//
+// Cached forms must not be modified with SetFirst() or SetRest().
+//
+// The cache holds a reference to each form. Entries whose form is
+// referenced only by the cache are removed by Sweep(), which Insert()
+// runs each time the cache has doubled in size since the previous sweep.
+
+class FormCache {
+public:
+    void Clear();
+    const Object* Find(const ListPtr& form) const;
+    void Insert(const ListPtr& form, Object value);
+    size_t Size() const
+    {
+        return entries.Size();
+    }
+    void Sweep();
+
+private:
+    struct Entry {
+        ListPtr form;
+        Object value;
+    };
+    struct NodeHash {
+        size_t operator()(const ListNode* node) const
+        {
+            return static_cast<size_t>(MixHash(reinterpret_cast<std::uintptr_t>(node)));
+        }
+    };
+
+    static constexpr size_t minSweepThreshold = 256;
+
+    OpenHashMap<const ListNode*, Entry, NodeHash> entries;
+    size_t sweepThreshold = minSweepThreshold;
+};
+
+} // namespace Procdraw
+
+#endif
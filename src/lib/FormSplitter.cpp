@@ -0,0 +1,78 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "FormSplitter.h"
+#include <cctype>
+#include <utility>
+
+namespace Procdraw {
+
+void FormSplitter::Feed(const char* data, size_t size, std::vector<std::string>& forms)
+{
+    // Adds each form completed by data to forms, in order
+    for (size_t i = 0; i < size; ++i) {
+        char c = data[i];
+        if (inString) {
+            // Delimiters in a string are part of it
+            form += c;
+            if (escaped) {
+                escaped = false;
+            }
+            else if (c == '\\') {
+                escaped = true;
+            }
+            else if (c == '"') {
+                inString = false;
+                if (depth == 0) {
+                    forms.push_back(std::move(form));
+                    form.clear();
+                }
+            }
+            continue;
+        }
+        bool isSpace = std::isspace(static_cast<unsigned char>(c));
+        bool isOpen = c == '(' || c == '[' || c == '{';
+        bool isClose = c == ')' || c == ']' || c == '}';
+        bool isStringQuote = c == '"';
+        if (inAtom && (isSpace || isOpen || isClose || isStringQuote)) {
+            inAtom = false;
+            forms.push_back(std::move(form));
+            form.clear();
+        }
+        if (isSpace && form.empty()) {
+            continue;
+        }
+        form += c;
+        if (isStringQuote) {
+            inString = true;
+        }
+        else if (isOpen) {
+            ++depth;
+        }
+        else if (isClose) {
+            if (depth > 0) {
+                --depth;
+            }
+            if (depth == 0) {
+                forms.push_back(std::move(form));
+                form.clear();
+            }
+        }
+        else if (depth == 0 && !isSpace && c != '\'') {
+            inAtom = true;
+        }
+    }
+}
+
+} // namespace Procdraw
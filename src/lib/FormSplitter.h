@@ -0,0 +1,51 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROCDRAW_FORMSPLITTER_H
+#define PROCDRAW_FORMSPLITTER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Procdraw {
+
+// Splits a stream of text into top-level forms, for input that arrives
+// in arbitrary chunks, such as from a pipe. A form may be split across
+// chunks, and a chunk may hold several forms. Lists, vectors and hash
+// maps end at the delimiter that closes them, and a string at its closing
+// quote. A symbol or number at the top level ends at the next whitespace
+// or delimiter, so it is not complete until the character after it has
+// arrived.
+//
+// The splitter only tracks delimiters and does not check the syntax of
+// a form, which is left to the Reader. An unmatched closing delimiter is
+// returned as a form of its own.
+
+class FormSplitter {
+public:
+    void Feed(const char* data, size_t size, std::vector<std::string>& forms);
+
+private:
+    std::string form;
+    int depth = 0;
+    bool inAtom = false;
+    // In a string, and after a backslash in one
+    bool inString = false;
+    bool escaped = false;
+};
+
+} // namespace Procdraw
+
+#endif
@@ -0,0 +1,146 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "HashConsTable.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace Procdraw {
+
+size_t HashConsTable::KeyHash::operator()(const Key& key) const
+{
+    std::uint64_t h = MixHash(key.firstBits ^ static_cast<std::uint64_t>(key.firstType));
+    h = MixHash(h ^ reinterpret_cast<std::uintptr_t>(key.rest));
+    return static_cast<size_t>(h);
+}
+
+HashConsTable::Key HashConsTable::KeyOf(const Object& first, const ListNode* rest)
+{
+    std::uint64_t bits = 0;
+    switch (first.Type()) {
+    case ObjectType::Boolean:
+        bits = first.GetBooleanUnchecked();
+        break;
+    case ObjectType::CFunctionHandle:
+        bits = first.GetCFunctionHandle();
+        break;
+    case ObjectType::ClosurePtr:
+        bits = reinterpret_cast<std::uintptr_t>(first.GetClosurePtrUnchecked().get());
+        break;
+    case ObjectType::Error:
+        bits = static_cast<std::uint64_t>(first.GetError());
+        break;
+    case ObjectType::Float: {
+        // Compare bit patterns, so that 0.0 and -0.0 stay distinct
+        double val = first.GetFloatUnchecked();
+        std::memcpy(&bits, &val, sizeof(bits));
+        break;
+    }
+    case ObjectType::HashMapPtr:
+        bits = reinterpret_cast<std::uintptr_t>(first.GetHashMapPtrUnchecked().get());
+        break;
+    case ObjectType::Integer:
+        bits = static_cast<std::uint32_t>(first.GetIntegerUnchecked());
+        break;
+    case ObjectType::ListPtr:
+        bits = reinterpret_cast<std::uintptr_t>(first.GetListPtrUnchecked().get());
+        break;
+    case ObjectType::LocalRef: {
+        LocalRef ref = first.GetLocalRefUnchecked();
+        bits = (static_cast<std::uint64_t>(ref.captured) << 32) | ref.slot;
+        break;
+    }
+    case ObjectType::MacroPtr:
+        bits = reinterpret_cast<std::uintptr_t>(first.GetMacroPtrUnchecked().get());
+        break;
+    case ObjectType::None:
+        break;
+    case ObjectType::NumericArrayPtr:
+        bits = reinterpret_cast<std::uintptr_t>(first.GetNumericArrayPtrUnchecked().get());
+        break;
+    case ObjectType::SequencePtr:
+        bits = reinterpret_cast<std::uintptr_t>(first.GetSequencePtrUnchecked().get());
+        break;
+    case ObjectType::SignalPtr:
+        bits = reinterpret_cast<std::uintptr_t>(first.GetSignalPtrUnchecked().get());
+        break;
+    case ObjectType::SpecialFormPtr:
+        bits = reinterpret_cast<std::uintptr_t>(first.GetSpecialFormPtrUnchecked().get());
+        break;
+    case ObjectType::StringPtr:
+        // By address, which is by value for strings interned by the Reader
+        bits = reinterpret_cast<std::uintptr_t>(first.GetStringPtrUnchecked().get());
+        break;
+    case ObjectType::SymbolHandle:
+        bits = first.GetSymbolHandle();
+        break;
+    case ObjectType::VectorPtr:
+        bits = reinterpret_cast<std::uintptr_t>(first.GetVectorPtrUnchecked().get());
+        break;
+    }
+    return Key{first.Type(), bits, rest};
+}
+
+ListPtr HashConsTable::Cons(Object first, ListPtr rest)
+{
+    Key key = KeyOf(first, rest.get());
+    if (const ListPtr* node = nodes.Find(key)) {
+        return *node;
+    }
+    if (nodes.Size() >= sweepThreshold) {
+        Sweep();
+    }
+    ListPtr node = Procdraw::Cons(std::move(first), std::move(rest));
+    nodes.Insert(key, node);
+    return node;
+}
+
+bool HashConsTable::IsInterned(const ListNode* node) const
+{
+    const ListPtr* interned = nodes.Find(KeyOf(node->First(), node->Rest().get()));
+    return interned != nullptr && interned->get() == node;
+}
+
+void HashConsTable::Sweep()
+{
+    // Releasing a node may leave its rest, or a list in its first, with
+    // only the table's reference, so those are checked in turn rather
+    // than waiting for the next sweep
+    std::vector<ListPtr> unreferenced;
+    nodes.ForEach([&](const Key&, const ListPtr& node) {
+        if (node.use_count() == 1) {
+            unreferenced.push_back(node);
+        }
+    });
+    while (!unreferenced.empty()) {
+        ListPtr node = std::move(unreferenced.back());
+        unreferenced.pop_back();
+        nodes.Erase(KeyOf(node->First(), node->Rest().get()));
+        ListPtr children[2] = {node->Rest(), nullptr};
+        if (const ListPtr* first = node->First().TryGetListPtr()) {
+            children[1] = *first;
+        }
+        node = nullptr;
+        for (ListPtr& child : children) {
+            // Referenced by the table and by children only
+            if (child != nullptr && child.use_count() == 2 && IsInterned(child.get())) {
+                unreferenced.push_back(std::move(child));
+            }
+        }
+    }
+    sweepThreshold = std::max(minSweepThreshold, nodes.Size() * 2);
+}
+
+} // namespace Procdraw
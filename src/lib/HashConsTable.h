@@ -0,0 +1,72 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROCDRAW_HASHCONSTABLE_H
+#define PROCDRAW_HASHCONSTABLE_H
+
+#include "InterpreterTypes.h"
+#include "OpenHashMap.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace Procdraw {
+
+// Interns list nodes so that lists built with Cons() from interned parts
+// share structure: two such lists are equal if and only if they are the
+// same node, and each distinct sublist is stored once.
+//
+// Interned nodes are shared and must not be modified with SetFirst() or
+// SetRest().
+//
+// The table holds a reference to each node. Nodes that are referenced
+// only by the table are released by Sweep(), which Cons() runs each time
+// the table has doubled in size since the previous sweep.
+
+class HashConsTable {
+public:
+    ListPtr Cons(Object first, ListPtr rest);
+    size_t Size() const
+    {
+        return nodes.Size();
+    }
+    void Sweep();
+
+private:
+    // Atoms are keyed by value and heap objects by address, which is
+    // structural equality for interned lists
+    struct Key {
+        ObjectType firstType;
+        std::uint64_t firstBits;
+        const ListNode* rest;
+        bool operator==(const Key& other) const
+        {
+            return firstType == other.firstType && firstBits == other.firstBits && rest == other.rest;
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    static constexpr size_t minSweepThreshold = 1024;
+
+    OpenHashMap<Key, ListPtr, KeyHash> nodes;
+    size_t sweepThreshold = minSweepThreshold;
+
+    static Key KeyOf(const Object& first, const ListNode* rest);
+    bool IsInterned(const ListNode* node) const;
+};
+
+} // namespace Procdraw
+
+#endif
@@ -0,0 +1,51 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROCDRAW_HEAPUSAGE_H
+#define PROCDRAW_HEAPUSAGE_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Procdraw {
+
+// Counts the bytes held by interpreter heap objects allocated and freed
+// on the calling thread, so that an evaluation can be limited in the
+// memory it holds. List nodes, Vector and HashMap elements, NumericArray
+// data and Strings are counted; small fixed size objects such as
+// closures are not. The count goes down when objects are freed, so it may
+// go below zero on a thread that frees objects allocated by another.
+
+class HeapUsage {
+public:
+    static std::int64_t Bytes()
+    {
+        return bytes;
+    }
+    static void Allocated(size_t size)
+    {
+        bytes += static_cast<std::int64_t>(size);
+    }
+    static void Freed(size_t size)
+    {
+        bytes -= static_cast<std::int64_t>(size);
+    }
+
+private:
+    static inline thread_local std::int64_t bytes = 0;
+};
+
+} // namespace Procdraw
+
+#endif
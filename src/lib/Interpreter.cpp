@@ -13,66 +13,2012 @@
 // limitations under the License.
 
 #include "Interpreter.h"
+#include "Equality.h"
+#include "ProcdrawMath.h"
 #include <algorithm>
+#include <cmath>
+#include <functional>
 #include <string>
 
-#define FOLD_LEFT_INT(accumulator, operation, lst, initial)             \
-    int accumulator = initial;                                          \
-    ListPtr next = lst;                                                 \
-    while (next != nullptr) {                                           \
-        accumulator = accumulator operation next->First().GetInteger(); \
-        next = next->Rest();                                            \
+// FOLD_LEFT_INT and FOLD_LEFT_FLOAT do not check the element types, use
+// AllOfType or AllNumbers first
+
+#define FOLD_LEFT_INT(accumulator, operation, lst, initial)                      \
+    int accumulator = initial;                                                   \
+    const ListNode* next = lst.get();                                            \
+    while (next != nullptr) {                                                    \
+        accumulator = accumulator operation next->First().GetIntegerUnchecked(); \
+        next = next->Rest().get();                                               \
+    }
+
+#define FOLD_LEFT_FLOAT(accumulator, operation, lst, initial)               \
+    double accumulator = initial;                                           \
+    const ListNode* next = lst.get();                                       \
+    while (next != nullptr) {                                               \
+        accumulator = accumulator operation NumberUnchecked(next->First()); \
+        next = next->Rest().get();                                          \
+    }
+
+namespace Procdraw {
+
+bool AllOfType(const ListPtr& lst, ObjectType type)
+{
+    for (const ListNode* next = lst.get(); next != nullptr; next = next->Rest().get()) {
+        if (next->First().Type() != type) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool IsNumber(const Object& obj)
+{
+    return obj.Type() == ObjectType::Integer || obj.Type() == ObjectType::Float;
+}
+
+double NumberUnchecked(const Object& obj)
+{
+    if (obj.Type() == ObjectType::Integer) {
+        return obj.GetIntegerUnchecked();
+    }
+    return obj.GetFloatUnchecked();
+}
+
+bool AllNumbers(const ListPtr& lst)
+{
+    for (const ListNode* next = lst.get(); next != nullptr; next = next->Rest().get()) {
+        if (!IsNumber(next->First())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int ListLength(const ListPtr& lst)
+{
+    int length = 0;
+    for (const ListNode* next = lst.get(); next != nullptr; next = next->Rest().get()) {
+        ++length;
+    }
+    return length;
+}
+
+bool IsSelfEvaluating(const Object& obj)
+{
+    switch (obj.Type()) {
+    case ObjectType::Boolean:
+    case ObjectType::CFunctionHandle:
+    case ObjectType::ClosurePtr:
+    case ObjectType::Float:
+    case ObjectType::Integer:
+    case ObjectType::None:
+    case ObjectType::StringPtr:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool AllSelfEvaluating(const ListPtr& lst)
+{
+    for (const ListNode* next = lst.get(); next != nullptr; next = next->Rest().get()) {
+        if (!IsSelfEvaluating(next->First())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads exactly n numeric args into vals
+std::optional<ErrorKind> NumberArgs(const ListPtr& args, int n, double* vals)
+{
+    const ListNode* next = args.get();
+    for (int i = 0; i < n; ++i) {
+        if (next == nullptr) {
+            return ErrorKind::WrongNumberOfArgs;
+        }
+        if (!IsNumber(next->First())) {
+            return ErrorKind::TypeError;
+        }
+        vals[i] = NumberUnchecked(next->First());
+        next = next->Rest().get();
+    }
+    if (next != nullptr) {
+        return ErrorKind::WrongNumberOfArgs;
+    }
+    return std::nullopt;
+}
+
+// Sequences are consumed by pushing their elements, one at a time, into
+// a SequenceSink. Map, Filter and Take are sinks that pass elements on
+// to the next sink, so a whole pipeline runs as one loop driven by its
+// innermost source, and nothing is allocated per element other than the
+// results of the functions applied.
+
+class SequenceSink {
+public:
+    // Returns false to stop the sequence early
+    virtual bool Accept(Object val) = 0;
+    // Set to stop the sequence with an error
+    std::optional<Object> error;
+
+protected:
+    ~SequenceSink() = default;
+};
+
+bool IsSequenceSource(const Object& obj)
+{
+    switch (obj.Type()) {
+    case ObjectType::ListPtr:
+    case ObjectType::SequencePtr:
+    case ObjectType::VectorPtr:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Returns a one element argument list holding val, reusing args if
+// nothing else has kept a reference to it
+const ListPtr& ReuseArgs(ListPtr& args, Object val)
+{
+    if (args == nullptr || args.use_count() > 1) {
+        args = Cons(std::move(val), nullptr);
+    }
+    else {
+        args->SetFirst(std::move(val));
+    }
+    return args;
+}
+
+class MapSink : public SequenceSink {
+public:
+    MapSink(Interpreter* interpreter, const Object& fun, SequenceSink& downstream)
+        : interpreter(interpreter), fun(fun), downstream(downstream) {}
+    bool Accept(Object val) override
+    {
+        Object result = interpreter->Apply(fun, ReuseArgs(args, std::move(val)));
+        if (result.Type() == ObjectType::Error) {
+            error = std::move(result);
+            return false;
+        }
+        return downstream.Accept(std::move(result));
+    }
+
+private:
+    Interpreter* interpreter;
+    const Object& fun;
+    SequenceSink& downstream;
+    ListPtr args;
+};
+
+class FilterSink : public SequenceSink {
+public:
+    FilterSink(Interpreter* interpreter, const Object& fun, SequenceSink& downstream)
+        : interpreter(interpreter), fun(fun), downstream(downstream) {}
+    bool Accept(Object val) override
+    {
+        Object result = interpreter->Apply(fun, ReuseArgs(args, val));
+        if (result.Type() == ObjectType::Error) {
+            error = std::move(result);
+            return false;
+        }
+        return !IsTruthy(result) || downstream.Accept(std::move(val));
+    }
+
+private:
+    Interpreter* interpreter;
+    const Object& fun;
+    SequenceSink& downstream;
+    ListPtr args;
+};
+
+class TakeSink : public SequenceSink {
+public:
+    TakeSink(int count, SequenceSink& downstream)
+        : remaining(count), downstream(downstream) {}
+    bool Accept(Object val) override
+    {
+        --remaining;
+        return downstream.Accept(std::move(val)) && remaining > 0;
+    }
+
+private:
+    int remaining;
+    SequenceSink& downstream;
+};
+
+Object StreamRange(Interpreter* interpreter, const Sequence& range, SequenceSink& sink)
+{
+    // Integer bounds give Integer elements. Float elements are computed
+    // as start + i * step so that rounding errors do not accumulate. Each
+    // element is a step of the evaluation, as a range may run for a long
+    // time without evaluating anything.
+    const Object& start = range.Start();
+    const Object& stop = range.Stop();
+    const Object& step = range.Step();
+    if (start.Type() == ObjectType::Integer && stop.Type() == ObjectType::Integer && step.Type() == ObjectType::Integer) {
+        long long i = start.GetIntegerUnchecked();
+        long long end = stop.GetIntegerUnchecked();
+        long long delta = step.GetIntegerUnchecked();
+        for (; delta > 0 ? i < end : i > end; i += delta) {
+            if (std::optional<ErrorKind> error = interpreter->UseStep()) {
+                return Object::MakeError(*error);
+            }
+            if (!sink.Accept(Object{static_cast<int>(i)})) {
+                break;
+            }
+        }
+        return Object::None();
+    }
+    double first = NumberUnchecked(start);
+    double delta = NumberUnchecked(step);
+    double count = std::ceil((NumberUnchecked(stop) - first) / delta);
+    for (double i = 0; i < count; ++i) {
+        if (std::optional<ErrorKind> error = interpreter->UseStep()) {
+            return Object::MakeError(*error);
+        }
+        if (!sink.Accept(Object{first + i * delta})) {
+            break;
+        }
+    }
+    return Object::None();
+}
+
+Object ConsumeSequence(Interpreter* interpreter, const Object& source, SequenceSink& sink);
+
+// Pushes the elements of a Sequence, list or Vector into sink, and
+// returns None or the first error from the source. Errors set on sink
+// are left to ConsumeSequence.
+Object StreamElements(Interpreter* interpreter, const Object& source, SequenceSink& sink)
+{
+    if (const ListPtr* lst = source.TryGetListPtr()) {
+        for (const ListNode* next = lst->get(); next != nullptr; next = next->Rest().get()) {
+            if (!sink.Accept(next->First())) {
+                break;
+            }
+        }
+    }
+    else if (const VectorPtr* vec = source.TryGetVectorPtr()) {
+        for (size_t i = 0; i < (*vec)->Size(); ++i) {
+            if (!sink.Accept((*vec)->At(i))) {
+                break;
+            }
+        }
+    }
+    else if (const SequencePtr* seq = source.TryGetSequencePtr()) {
+        switch ((*seq)->Kind()) {
+        case SequenceKind::Filter: {
+            FilterSink filter(interpreter, (*seq)->Fun(), sink);
+            return ConsumeSequence(interpreter, (*seq)->Source(), filter);
+        }
+        case SequenceKind::Map: {
+            MapSink map(interpreter, (*seq)->Fun(), sink);
+            return ConsumeSequence(interpreter, (*seq)->Source(), map);
+        }
+        case SequenceKind::Range:
+            return StreamRange(interpreter, **seq, sink);
+        case SequenceKind::Take:
+            if ((*seq)->Count() > 0) {
+                TakeSink take((*seq)->Count(), sink);
+                return ConsumeSequence(interpreter, (*seq)->Source(), take);
+            }
+            break;
+        }
+    }
+    else {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    return Object::None();
+}
+
+Object ConsumeSequence(Interpreter* interpreter, const Object& source, SequenceSink& sink)
+{
+    Object result = StreamElements(interpreter, source, sink);
+    if (sink.error) {
+        return *sink.error;
+    }
+    return result;
+}
+
+// Folds numbers, and the elements of sequences, with + or *. The result
+// is Integer until a Float is seen.
+template <typename Op>
+class NumberFoldSink : public SequenceSink {
+public:
+    NumberFoldSink(int identity)
+        : intVal(identity), floatVal(identity), isFloat(false) {}
+    bool Accept(Object val) override
+    {
+        if (!isFloat && val.Type() == ObjectType::Integer) {
+            intVal = Op{}(intVal, val.GetIntegerUnchecked());
+            return true;
+        }
+        if (!IsNumber(val)) {
+            error = Object::MakeError(ErrorKind::TypeError);
+            return false;
+        }
+        if (!isFloat) {
+            floatVal = intVal;
+            isFloat = true;
+        }
+        floatVal = Op{}(floatVal, NumberUnchecked(val));
+        return true;
+    }
+    Object Result() const
+    {
+        return isFloat ? Object{floatVal} : Object{intVal};
+    }
+
+private:
+    int intVal;
+    double floatVal;
+    bool isFloat;
+};
+
+template <typename Op>
+Object FoldNumbersAndSequences(Interpreter* interpreter, const ListPtr& args, int identity)
+{
+    NumberFoldSink<Op> sink(identity);
+    for (const ListNode* next = args.get(); next != nullptr; next = next->Rest().get()) {
+        const Object& arg = next->First();
+        if (arg.Type() == ObjectType::SequencePtr) {
+            Object result = ConsumeSequence(interpreter, arg, sink);
+            if (result.Type() == ObjectType::Error) {
+                return result;
+            }
+        }
+        else if (!sink.Accept(arg)) {
+            return *sink.error;
+        }
+    }
+    return sink.Result();
+}
+
+// The arithmetic functions take an Integer only path when all args are
+// Integers, and otherwise promote to Float
+
+Object SubrDifference(Interpreter* interpreter, const ListPtr& args)
+{
+    if (args == nullptr) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const Object& first = args->First();
+    const ListPtr& rest = args->Rest();
+    if (AllOfType(args, ObjectType::Integer)) {
+        if (rest == nullptr) {
+            return Object{-first.GetIntegerUnchecked()};
+        }
+        FOLD_LEFT_INT(difference, -, rest, first.GetIntegerUnchecked())
+        return Object{difference};
+    }
+    if (!AllNumbers(args)) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    if (rest == nullptr) {
+        return Object{-NumberUnchecked(first)};
+    }
+    FOLD_LEFT_FLOAT(difference, -, rest, NumberUnchecked(first))
+    return Object{difference};
+}
+
+Object SubrProduct(Interpreter* interpreter, const ListPtr& args)
+{
+    if (AllOfType(args, ObjectType::Integer)) {
+        FOLD_LEFT_INT(product, *, args, 1)
+        return Object{product};
+    }
+    if (!AllNumbers(args)) {
+        return FoldNumbersAndSequences<std::multiplies<>>(interpreter, args, 1);
+    }
+    FOLD_LEFT_FLOAT(product, *, args, 1.0)
+    return Object{product};
+}
+
+Object SubrQuotient(Interpreter* interpreter, const ListPtr& args)
+{
+    // Division always produces a Float
+    if (args == nullptr) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    if (!AllNumbers(args)) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    const ListPtr& rest = args->Rest();
+    if (rest == nullptr) {
+        return Object{1.0 / NumberUnchecked(args->First())};
+    }
+    FOLD_LEFT_FLOAT(quotient, /, rest, NumberUnchecked(args->First()))
+    return Object{quotient};
+}
+
+Object SubrSum(Interpreter* interpreter, const ListPtr& args)
+{
+    if (AllOfType(args, ObjectType::Integer)) {
+        FOLD_LEFT_INT(sum, +, args, 0)
+        return Object{sum};
+    }
+    if (!AllNumbers(args)) {
+        return FoldNumbersAndSequences<std::plus<>>(interpreter, args, 0);
+    }
+    FOLD_LEFT_FLOAT(sum, +, args, 0.0)
+    return Object{sum};
+}
+
+Object SubrClamp(Interpreter* interpreter, const ListPtr& args)
+{
+    if (AllOfType(args, ObjectType::Integer) && ListLength(args) == 3) {
+        const ListNode* next = args.get();
+        int value = next->First().GetIntegerUnchecked();
+        next = next->Rest().get();
+        int lower = next->First().GetIntegerUnchecked();
+        next = next->Rest().get();
+        int upper = next->First().GetIntegerUnchecked();
+        return Object{Clamp(value, lower, upper)};
+    }
+    double vals[3];
+    if (auto error = NumberArgs(args, 3, vals)) {
+        return Object::MakeError(*error);
+    }
+    return Object{Clamp(vals[0], vals[1], vals[2])};
+}
+
+Object SubrLerp(Interpreter* interpreter, const ListPtr& args)
+{
+    double vals[3];
+    if (auto error = NumberArgs(args, 3, vals)) {
+        return Object::MakeError(*error);
+    }
+    return Object{Lerp(vals[0], vals[1], vals[2])};
+}
+
+Object SubrMapRange(Interpreter* interpreter, const ListPtr& args)
+{
+    double vals[5];
+    if (auto error = NumberArgs(args, 5, vals)) {
+        return Object::MakeError(*error);
+    }
+    return Object{MapRange(vals[0], vals[1], vals[2], vals[3], vals[4])};
+}
+
+Object SubrNorm(Interpreter* interpreter, const ListPtr& args)
+{
+    double vals[3];
+    if (auto error = NumberArgs(args, 3, vals)) {
+        return Object::MakeError(*error);
+    }
+    return Object{Norm(vals[0], vals[1], vals[2])};
+}
+
+Object SubrWrap(Interpreter* interpreter, const ListPtr& args)
+{
+    double vals[3];
+    if (auto error = NumberArgs(args, 3, vals)) {
+        return Object::MakeError(*error);
+    }
+    return Object{Wrap(vals[0], vals[1], vals[2])};
+}
+
+// Reads exactly n args that are each a number or a NumericArray, at
+// least one of them an array, and all arrays of the same size. An array
+// argument referenced only by the argument list is a temporary, such as
+// the result of a nested call, and is returned in reuse so that its
+// storage can be used for the result.
+std::optional<ErrorKind> ArrayOperandArgs(const ListPtr& args,
+                                          int n,
+                                          std::vector<NumericOperand>& operands,
+                                          NumericArrayPtr& reuse)
+{
+    const ListNode* next = args.get();
+    const NumericArray* first = nullptr;
+    for (int i = 0; i < n; ++i) {
+        if (next == nullptr) {
+            return ErrorKind::WrongNumberOfArgs;
+        }
+        const Object& arg = next->First();
+        if (const NumericArrayPtr* array = arg.TryGetNumericArrayPtr()) {
+            if (first == nullptr) {
+                first = array->get();
+            }
+            else if ((*array)->Size() != first->Size()) {
+                return ErrorKind::LengthMismatch;
+            }
+            if (!reuse && array->use_count() == 1) {
+                reuse = *array;
+            }
+            operands.emplace_back(array->get());
+        }
+        else if (arg.Type() == ObjectType::Integer) {
+            operands.emplace_back(arg.GetIntegerUnchecked());
+        }
+        else if (arg.Type() == ObjectType::Float) {
+            operands.emplace_back(arg.GetFloatUnchecked());
+        }
+        else {
+            return ErrorKind::TypeError;
+        }
+        next = next->Rest().get();
+    }
+    if (next != nullptr) {
+        return ErrorKind::WrongNumberOfArgs;
+    }
+    if (first == nullptr) {
+        return ErrorKind::TypeError;
+    }
+    return std::nullopt;
+}
+
+// Reads exactly one NumericArray arg
+std::optional<ErrorKind> ArrayArg(const ListPtr& args, const NumericArray*& array)
+{
+    if (args == nullptr || args->Rest() != nullptr) {
+        return ErrorKind::WrongNumberOfArgs;
+    }
+    const NumericArrayPtr* arg = args->First().TryGetNumericArrayPtr();
+    if (arg == nullptr) {
+        return ErrorKind::TypeError;
+    }
+    array = arg->get();
+    return std::nullopt;
+}
+
+Object ArrayElement(const NumericArray& array, size_t index)
+{
+    if (array.Type() == NumericArrayType::Int32) {
+        return Object{static_cast<int>(array.Int32Data()[index])};
+    }
+    return Object{static_cast<double>(array.Float32Data()[index])};
+}
+
+Object ArrayReduction(const NumericArray& array, double result)
+{
+    if (array.Type() == NumericArrayType::Int32) {
+        return Object{static_cast<int>(result)};
+    }
+    return Object{result};
+}
+
+Object MakeArray(NumericArrayType type, const ListPtr& args)
+{
+    int length = ListLength(args);
+    if (length < 1 || length > 2) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    std::optional<int> size = args->First().TryGetInteger();
+    if (!size || *size < 0) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    NumericArrayPtr array(new NumericArray(type, *size));
+    if (length == 2) {
+        const Object& fill = args->Rest()->First();
+        if (type == NumericArrayType::Int32) {
+            std::optional<int> val = fill.TryGetInteger();
+            if (!val) {
+                return Object::MakeError(ErrorKind::TypeError);
+            }
+            std::fill(array->Int32Data(), array->Int32Data() + *size, *val);
+        }
+        else {
+            if (!IsNumber(fill)) {
+                return Object::MakeError(ErrorKind::TypeError);
+            }
+            std::fill(array->Float32Data(), array->Float32Data() + *size, static_cast<float>(NumberUnchecked(fill)));
+        }
+    }
+    return Object{std::move(array)};
+}
+
+Object SubrArrayAdd(Interpreter* interpreter, const ListPtr& args)
+{
+    std::vector<NumericOperand> operands;
+    NumericArrayPtr reuse;
+    if (auto error = ArrayOperandArgs(args, 2, operands, reuse)) {
+        return Object::MakeError(*error);
+    }
+    return Object{ArrayAdd(operands[0], operands[1], std::move(reuse))};
+}
+
+Object SubrArrayClamp(Interpreter* interpreter, const ListPtr& args)
+{
+    std::vector<NumericOperand> operands;
+    NumericArrayPtr reuse;
+    if (auto error = ArrayOperandArgs(args, 3, operands, reuse)) {
+        return Object::MakeError(*error);
+    }
+    return Object{ArrayClamp(operands[0], operands[1], operands[2], std::move(reuse))};
+}
+
+Object SubrArrayLength(Interpreter* interpreter, const ListPtr& args)
+{
+    const NumericArray* array;
+    if (auto error = ArrayArg(args, array)) {
+        return Object::MakeError(*error);
+    }
+    return Object{static_cast<int>(array->Size())};
+}
+
+Object SubrArrayLerp(Interpreter* interpreter, const ListPtr& args)
+{
+    std::vector<NumericOperand> operands;
+    NumericArrayPtr reuse;
+    if (auto error = ArrayOperandArgs(args, 3, operands, reuse)) {
+        return Object::MakeError(*error);
+    }
+    return Object{ArrayLerp(operands[0], operands[1], operands[2], std::move(reuse))};
+}
+
+Object SubrArrayMapRange(Interpreter* interpreter, const ListPtr& args)
+{
+    std::vector<NumericOperand> operands;
+    NumericArrayPtr reuse;
+    if (auto error = ArrayOperandArgs(args, 5, operands, reuse)) {
+        return Object::MakeError(*error);
+    }
+    return Object{ArrayMapRange(operands[0], operands[1], operands[2], operands[3], operands[4], std::move(reuse))};
+}
+
+Object SubrArrayMax(Interpreter* interpreter, const ListPtr& args)
+{
+    const NumericArray* array;
+    if (auto error = ArrayArg(args, array)) {
+        return Object::MakeError(*error);
+    }
+    if (array->Size() == 0) {
+        return Object::MakeError(ErrorKind::IndexOutOfRange);
+    }
+    return ArrayReduction(*array, ArrayMax(*array));
+}
+
+Object SubrArrayMin(Interpreter* interpreter, const ListPtr& args)
+{
+    const NumericArray* array;
+    if (auto error = ArrayArg(args, array)) {
+        return Object::MakeError(*error);
+    }
+    if (array->Size() == 0) {
+        return Object::MakeError(ErrorKind::IndexOutOfRange);
+    }
+    return ArrayReduction(*array, ArrayMin(*array));
+}
+
+Object SubrArrayMultiply(Interpreter* interpreter, const ListPtr& args)
+{
+    std::vector<NumericOperand> operands;
+    NumericArrayPtr reuse;
+    if (auto error = ArrayOperandArgs(args, 2, operands, reuse)) {
+        return Object::MakeError(*error);
+    }
+    return Object{ArrayMultiply(operands[0], operands[1], std::move(reuse))};
+}
+
+Object SubrArrayRef(Interpreter* interpreter, const ListPtr& args)
+{
+    if (ListLength(args) != 2) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const NumericArrayPtr* array = args->First().TryGetNumericArrayPtr();
+    std::optional<int> index = args->Rest()->First().TryGetInteger();
+    if (array == nullptr || !index) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    if (*index < 0 || static_cast<size_t>(*index) >= (*array)->Size()) {
+        return Object::MakeError(ErrorKind::IndexOutOfRange);
+    }
+    return ArrayElement(**array, *index);
+}
+
+Object SubrArraySum(Interpreter* interpreter, const ListPtr& args)
+{
+    const NumericArray* array;
+    if (auto error = ArrayArg(args, array)) {
+        return Object::MakeError(*error);
+    }
+    return ArrayReduction(*array, ArraySum(*array));
+}
+
+Object SubrMakeFloatArray(Interpreter* interpreter, const ListPtr& args)
+{
+    return MakeArray(NumericArrayType::Float32, args);
+}
+
+Object SubrMakeIntArray(Interpreter* interpreter, const ListPtr& args)
+{
+    return MakeArray(NumericArrayType::Int32, args);
+}
+
+// Reads exactly n args, the first two being a HashMap and a key
+std::optional<ErrorKind> HashMapKeyArgs(const ListPtr& args, int n, const HashMapPtr*& map, const Object*& key)
+{
+    if (ListLength(args) != n) {
+        return ErrorKind::WrongNumberOfArgs;
+    }
+    map = args->First().TryGetHashMapPtr();
+    key = &args->Rest()->First();
+    if (map == nullptr || !IsHashMapKey(*key)) {
+        return ErrorKind::TypeError;
+    }
+    return std::nullopt;
+}
+
+Object SubrHashCount(Interpreter* interpreter, const ListPtr& args)
+{
+    if (ListLength(args) != 1) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const HashMapPtr* map = args->First().TryGetHashMapPtr();
+    if (map == nullptr) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    return Object{static_cast<int>((*map)->Size())};
+}
+
+Object SubrHashRef(Interpreter* interpreter, const ListPtr& args)
+{
+    // Returns the value for key, or the optional default if key is not
+    // in the map
+    const HashMapPtr* map;
+    const Object* key;
+    int length = ListLength(args);
+    if (auto error = HashMapKeyArgs(args, length == 3 ? 3 : 2, map, key)) {
+        return Object::MakeError(*error);
+    }
+    if (const Object* value = (*map)->Find(*key)) {
+        return *value;
+    }
+    if (length == 3) {
+        return args->Rest()->Rest()->First();
+    }
+    return Object::MakeError(ErrorKind::KeyNotFound);
+}
+
+Object SubrHashRemove(Interpreter* interpreter, const ListPtr& args)
+{
+    // Removes key from the map in place and returns the map
+    const HashMapPtr* map;
+    const Object* key;
+    if (auto error = HashMapKeyArgs(args, 2, map, key)) {
+        return Object::MakeError(*error);
+    }
+    (*map)->Erase(*key);
+    return Object{*map};
+}
+
+Object SubrHashSet(Interpreter* interpreter, const ListPtr& args)
+{
+    // Sets the value for key in place and returns the map
+    const HashMapPtr* map;
+    const Object* key;
+    if (auto error = HashMapKeyArgs(args, 3, map, key)) {
+        return Object::MakeError(*error);
+    }
+    (*map)->Insert(*key, args->Rest()->Rest()->First());
+    return Object{*map};
+}
+
+// Reads exactly n args, the first two being a Vector and an index into it
+std::optional<ErrorKind> VectorIndexArgs(const ListPtr& args, int n, const VectorPtr*& vec, size_t& index)
+{
+    if (ListLength(args) != n) {
+        return ErrorKind::WrongNumberOfArgs;
+    }
+    vec = args->First().TryGetVectorPtr();
+    std::optional<int> i = args->Rest()->First().TryGetInteger();
+    if (vec == nullptr || !i) {
+        return ErrorKind::TypeError;
+    }
+    if (*i < 0 || static_cast<size_t>(*i) >= (*vec)->Size()) {
+        return ErrorKind::IndexOutOfRange;
+    }
+    index = *i;
+    return std::nullopt;
+}
+
+Object SubrVectorLength(Interpreter* interpreter, const ListPtr& args)
+{
+    if (ListLength(args) != 1) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const VectorPtr* vec = args->First().TryGetVectorPtr();
+    if (vec == nullptr) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    return Object{static_cast<int>((*vec)->Size())};
+}
+
+Object SubrVectorPush(Interpreter* interpreter, const ListPtr& args)
+{
+    // Appends val to the vector in place and returns the vector
+    if (ListLength(args) != 2) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const VectorPtr* vec = args->First().TryGetVectorPtr();
+    if (vec == nullptr) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    (*vec)->PushBack(args->Rest()->First());
+    return Object{*vec};
+}
+
+Object SubrVectorRef(Interpreter* interpreter, const ListPtr& args)
+{
+    const VectorPtr* vec;
+    size_t index;
+    if (auto error = VectorIndexArgs(args, 2, vec, index)) {
+        return Object::MakeError(*error);
+    }
+    return (*vec)->At(index);
+}
+
+Object SubrVectorSet(Interpreter* interpreter, const ListPtr& args)
+{
+    // Sets the element at index in place and returns the vector
+    const VectorPtr* vec;
+    size_t index;
+    if (auto error = VectorIndexArgs(args, 3, vec, index)) {
+        return Object::MakeError(*error);
+    }
+    (*vec)->SetAt(index, args->Rest()->Rest()->First());
+    return Object{*vec};
+}
+
+// Compares each pair of adjacent args with pred
+template <typename Pred>
+Object CompareNumbers(const ListPtr& args, Pred pred)
+{
+    if (args == nullptr) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    if (!AllNumbers(args)) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    bool result = true;
+    for (const ListNode* next = args.get(); next->Rest() != nullptr; next = next->Rest().get()) {
+        if (!pred(NumberUnchecked(next->First()), NumberUnchecked(next->Rest()->First()))) {
+            result = false;
+        }
+    }
+    return Object{result};
+}
+
+Object SubrEqual(Interpreter* interpreter, const ListPtr& args)
+{
+    return CompareNumbers(args, [](double a, double b) { return a == b; });
+}
+
+Object SubrGreater(Interpreter* interpreter, const ListPtr& args)
+{
+    return CompareNumbers(args, [](double a, double b) { return a > b; });
+}
+
+Object SubrGreaterOrEqual(Interpreter* interpreter, const ListPtr& args)
+{
+    return CompareNumbers(args, [](double a, double b) { return a >= b; });
+}
+
+Object SubrLess(Interpreter* interpreter, const ListPtr& args)
+{
+    return CompareNumbers(args, [](double a, double b) { return a < b; });
+}
+
+Object SubrLessOrEqual(Interpreter* interpreter, const ListPtr& args)
+{
+    return CompareNumbers(args, [](double a, double b) { return a <= b; });
+}
+
+Object SubrIsEqual(Interpreter*, const ListPtr& args)
+{
+    // (equal? a b) compares structurally, where = compares numbers
+    if (ListLength(args) != 2) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    return Object{EqualObjects(args->First(), args->Rest()->First())};
+}
+
+Object SubrHash(Interpreter*, const ListPtr& args)
+{
+    // Integers are 32 bits, so the halves of the hash are combined
+    if (ListLength(args) != 1) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    std::uint64_t h = HashObject(args->First());
+    return Object{static_cast<int>(static_cast<std::uint32_t>(h ^ (h >> 32)))};
+}
+
+class ReduceSink : public SequenceSink {
+public:
+    ReduceSink(Interpreter* interpreter, const Object& fun, Object initial)
+        : interpreter(interpreter), fun(fun), accumulator(std::move(initial)) {}
+    bool Accept(Object val) override
+    {
+        // The two element argument list is reused unless something kept
+        // a reference to either node
+        if (args == nullptr || args.use_count() > 1 || args->Rest().use_count() > 1) {
+            args = Cons(std::move(accumulator), Cons(std::move(val), nullptr));
+        }
+        else {
+            args->SetFirst(std::move(accumulator));
+            args->Rest()->SetFirst(std::move(val));
+        }
+        accumulator = interpreter->Apply(fun, args);
+        if (accumulator.Type() == ObjectType::Error) {
+            error = accumulator;
+            return false;
+        }
+        return true;
+    }
+    const Object& Result() const
+    {
+        return accumulator;
+    }
+
+private:
+    Interpreter* interpreter;
+    const Object& fun;
+    Object accumulator;
+    ListPtr args;
+};
+
+class VectorSink : public SequenceSink {
+public:
+    VectorSink()
+        : vec(new Vector()) {}
+    bool Accept(Object val) override
+    {
+        vec->PushBack(std::move(val));
+        return true;
+    }
+    VectorPtr vec;
+};
+
+Object SubrFilter(Interpreter* interpreter, const ListPtr& args)
+{
+    if (ListLength(args) != 2) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const Object& source = args->Rest()->First();
+    if (!IsSequenceSource(source)) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    return Object{Sequence::MakeFilter(args->First(), source)};
+}
+
+Object SubrMap(Interpreter* interpreter, const ListPtr& args)
+{
+    if (ListLength(args) != 2) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const Object& source = args->Rest()->First();
+    if (!IsSequenceSource(source)) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    return Object{Sequence::MakeMap(args->First(), source)};
+}
+
+Object SubrRange(Interpreter* interpreter, const ListPtr& args)
+{
+    // (range stop), (range start stop) or (range start stop step)
+    int length = ListLength(args);
+    if (length < 1 || length > 3) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    if (!AllNumbers(args)) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    if (length == 1) {
+        return Object{Sequence::MakeRange(Object{0}, args->First(), Object{1})};
+    }
+    const Object& start = args->First();
+    const Object& stop = args->Rest()->First();
+    if (length == 2) {
+        return Object{Sequence::MakeRange(start, stop, Object{1})};
+    }
+    const Object& step = args->Rest()->Rest()->First();
+    if (NumberUnchecked(step) == 0.0) {
+        return Object::MakeError(ErrorKind::InvalidArgument);
+    }
+    return Object{Sequence::MakeRange(start, stop, step)};
+}
+
+Object SubrReduce(Interpreter* interpreter, const ListPtr& args)
+{
+    // (reduce f initial seq) folds the elements of seq from the left
+    if (ListLength(args) != 3) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const Object& source = args->Rest()->Rest()->First();
+    if (!IsSequenceSource(source)) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    ReduceSink sink(interpreter, args->First(), args->Rest()->First());
+    Object result = ConsumeSequence(interpreter, source, sink);
+    if (result.Type() == ObjectType::Error) {
+        return result;
+    }
+    return sink.Result();
+}
+
+Object SubrTake(Interpreter* interpreter, const ListPtr& args)
+{
+    if (ListLength(args) != 2) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    std::optional<int> count = args->First().TryGetInteger();
+    const Object& source = args->Rest()->First();
+    if (!count || *count < 0 || !IsSequenceSource(source)) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    return Object{Sequence::MakeTake(*count, source)};
+}
+
+Object SubrToVector(Interpreter* interpreter, const ListPtr& args)
+{
+    if (ListLength(args) != 1) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const Object& source = args->First();
+    if (!IsSequenceSource(source)) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    VectorSink sink;
+    Object result = ConsumeSequence(interpreter, source, sink);
+    if (result.Type() == ObjectType::Error) {
+        return result;
+    }
+    return Object{std::move(sink.vec)};
+}
+
+Object SubrCons(Interpreter* interpreter, const ListPtr& args)
+{
+    if (ListLength(args) != 2) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const ListPtr* rest = args->Rest()->First().TryGetListPtr();
+    if (rest == nullptr) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    return Object{Cons(args->First(), *rest)};
+}
+
+Object SubrList(Interpreter* interpreter, const ListPtr& args)
+{
+    // The args are copied, as they may be the nodes of the expression
+    ListBuilder builder(ListLength(args));
+    for (const ListNode* next = args.get(); next != nullptr; next = next->Rest().get()) {
+        builder.Append(next->First());
+    }
+    return Object{builder.Finish()};
+}
+
+bool IsFunction(const Object& obj)
+{
+    return obj.Type() == ObjectType::CFunctionHandle || obj.Type() == ObjectType::ClosurePtr;
+}
+
+Object SubrMacroExpand(Interpreter* interpreter, const ListPtr& args)
+{
+    if (ListLength(args) != 1) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const ListPtr* form = args->First().TryGetListPtr();
+    if (form == nullptr) {
+        return args->First();
+    }
+    return interpreter->MacroExpand(*form);
+}
+
+Object SubrMemoStats(Interpreter* interpreter, const ListPtr& args)
+{
+    // Returns a map of the memo cache counts, keyed by symbols
+    if (args != nullptr) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    MemoCache::Stats stats = interpreter->MemoStats();
+    HashMapPtr map(new HashMap());
+    map->Insert(Object::MakeSymbolHandle(interpreter->SymbolRef("capacity")), static_cast<int>(stats.capacity));
+    map->Insert(Object::MakeSymbolHandle(interpreter->SymbolRef("hits")), static_cast<int>(stats.hits));
+    map->Insert(Object::MakeSymbolHandle(interpreter->SymbolRef("misses")), static_cast<int>(stats.misses));
+    map->Insert(Object::MakeSymbolHandle(interpreter->SymbolRef("size")), static_cast<int>(stats.size));
+    return Object{std::move(map)};
+}
+
+Object SubrReloadFailed(Interpreter* interpreter, const ListPtr& args)
+{
+    // Returns a list of the definitions whose values evaluated to an
+    // error in the most recent reload, in the order they were evaluated
+    if (args != nullptr) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const std::vector<SymbolHandle>& failed = interpreter->ReloadFailed();
+    ListBuilder builder(failed.size());
+    for (SymbolHandle symbol : failed) {
+        builder.Append(Object::MakeSymbolHandle(symbol));
+    }
+    return Object{builder.Finish()};
+}
+
+Object SubrReloaded(Interpreter* interpreter, const ListPtr& args)
+{
+    // Returns a list of the definitions evaluated again by the most
+    // recent reload, in the order they were evaluated
+    if (args != nullptr) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const std::vector<SymbolHandle>& reloaded = interpreter->Reloaded();
+    ListBuilder builder(reloaded.size());
+    for (SymbolHandle symbol : reloaded) {
+        builder.Append(Object::MakeSymbolHandle(symbol));
+    }
+    return Object{builder.Finish()};
+}
+
+Object SubrSetPure(Interpreter* interpreter, const ListPtr& args)
+{
+    // (set-pure! fun) or (set-pure! fun pure). Returns fun.
+    int length = ListLength(args);
+    if (length < 1 || length > 2) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const Object& fun = args->First();
+    if (!IsFunction(fun)) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    bool pure = true;
+    if (length == 2) {
+        std::optional<bool> val = args->Rest()->First().TryGetBoolean();
+        if (!val) {
+            return Object::MakeError(ErrorKind::TypeError);
+        }
+        pure = *val;
+    }
+    interpreter->SetPure(fun, pure);
+    return fun;
+}
+
+// The scene builtins take numArgs numbers, and record a command in the
+// Interpreter's Scene
+
+Object AddSceneCommand(Interpreter* interpreter, const ListPtr& args, SceneCommandKind kind, int numArgs)
+{
+    double vals[3] = {0.0, 0.0, 0.0};
+    if (auto error = NumberArgs(args, numArgs, vals)) {
+        return Object::MakeError(*error);
+    }
+    if (Scene* scene = interpreter->CurrentScene()) {
+        scene->Add(kind, static_cast<float>(vals[0]), static_cast<float>(vals[1]), static_cast<float>(vals[2]));
+    }
+    return Object::None();
+}
+
+Object SubrAmbientLightColor(Interpreter* interpreter, const ListPtr& args)
+{
+    return AddSceneCommand(interpreter, args, SceneCommandKind::AmbientLightColor, 3);
+}
+
+Object SubrBackground(Interpreter* interpreter, const ListPtr& args)
+{
+    return AddSceneCommand(interpreter, args, SceneCommandKind::Background, 3);
+}
+
+Object SubrColor(Interpreter* interpreter, const ListPtr& args)
+{
+    return AddSceneCommand(interpreter, args, SceneCommandKind::Color, 3);
+}
+
+Object SubrCube(Interpreter* interpreter, const ListPtr& args)
+{
+    return AddSceneCommand(interpreter, args, SceneCommandKind::Cube, 0);
+}
+
+Object SubrLightColor(Interpreter* interpreter, const ListPtr& args)
+{
+    return AddSceneCommand(interpreter, args, SceneCommandKind::LightColor, 3);
+}
+
+Object SubrRotateX(Interpreter* interpreter, const ListPtr& args)
+{
+    return AddSceneCommand(interpreter, args, SceneCommandKind::RotateX, 1);
+}
+
+Object SubrRotateY(Interpreter* interpreter, const ListPtr& args)
+{
+    return AddSceneCommand(interpreter, args, SceneCommandKind::RotateY, 1);
+}
+
+Object SubrRotateZ(Interpreter* interpreter, const ListPtr& args)
+{
+    return AddSceneCommand(interpreter, args, SceneCommandKind::RotateZ, 1);
+}
+
+Object SubrScale(Interpreter* interpreter, const ListPtr& args)
+{
+    return AddSceneCommand(interpreter, args, SceneCommandKind::Scale, 3);
+}
+
+Object SubrTetrahedron(Interpreter* interpreter, const ListPtr& args)
+{
+    return AddSceneCommand(interpreter, args, SceneCommandKind::Tetrahedron, 0);
+}
+
+Object SubrTranslate(Interpreter* interpreter, const ListPtr& args)
+{
+    return AddSceneCommand(interpreter, args, SceneCommandKind::Translate, 3);
+}
+
+// Signals
+
+Object SubrComputed(Interpreter*, const ListPtr& args)
+{
+    // (computed fun) makes a signal whose value is (fun)
+    if (ListLength(args) != 1) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
     }
+    if (!IsFunction(args->First())) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    return Object{Signal::MakeComputed(args->First())};
+}
 
-namespace Procdraw {
+Object SubrSetSignal(Interpreter*, const ListPtr& args)
+{
+    // (set-signal! signal val) sets an input signal. Returns val.
+    if (ListLength(args) != 2) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const SignalPtr* signal = args->First().TryGetSignalPtr();
+    if (signal == nullptr) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    if (!(*signal)->IsInput()) {
+        return Object::MakeError(ErrorKind::InvalidArgument);
+    }
+    const Object& val = args->Rest()->First();
+    (*signal)->SetValue(val);
+    return val;
+}
 
-Object SubrProduct(Interpreter* interpreter, ListPtr args)
+Object SubrSignal(Interpreter*, const ListPtr& args)
 {
-    FOLD_LEFT_INT(product, *, args, 1)
-    return Object{product};
+    // (signal val) makes an input signal
+    if (ListLength(args) != 1) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    return Object{Signal::MakeInput(args->First())};
 }
 
-Object SubrSum(Interpreter* interpreter, ListPtr args)
+Object SubrSignalValue(Interpreter* interpreter, const ListPtr& args)
 {
-    FOLD_LEFT_INT(sum, +, args, 0)
-    return Object{sum};
+    if (ListLength(args) != 1) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const SignalPtr* signal = args->First().TryGetSignalPtr();
+    if (signal == nullptr) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    return interpreter->SignalValue(*signal);
+}
+
+// Strings
+
+Object SubrIntern(Interpreter* interpreter, const ListPtr& args)
+{
+    if (ListLength(args) != 1) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const StringPtr* str = args->First().TryGetStringPtr();
+    if (str == nullptr) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    return Object{interpreter->Intern(*str)};
+}
+
+Object SubrStringAppend(Interpreter*, const ListPtr& args)
+{
+    // Appends from the left, so that each arg extends the buffer of the
+    // result so far in place
+    if (!AllOfType(args, ObjectType::StringPtr)) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    if (args == nullptr) {
+        return Object{String::Make("")};
+    }
+    StringPtr result = args->First().GetStringPtrUnchecked();
+    for (const ListNode* next = args->Rest().get(); next != nullptr; next = next->Rest().get()) {
+        result = Concat(result, next->First().GetStringPtrUnchecked());
+    }
+    return Object{std::move(result)};
+}
+
+Object SubrStringLength(Interpreter*, const ListPtr& args)
+{
+    if (ListLength(args) != 1) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const StringPtr* str = args->First().TryGetStringPtr();
+    if (str == nullptr) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    return Object{static_cast<int>((*str)->Size())};
+}
+
+Object SubrSubstring(Interpreter*, const ListPtr& args)
+{
+    // (substring str start) or (substring str start end). Shares the
+    // characters of str rather than copying them.
+    int length = ListLength(args);
+    if (length < 2 || length > 3) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    const StringPtr* str = args->First().TryGetStringPtr();
+    if (str == nullptr) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    std::optional<int> start = args->Rest()->First().TryGetInteger();
+    std::optional<int> end = static_cast<int>((*str)->Size());
+    if (length == 3) {
+        end = args->Rest()->Rest()->First().TryGetInteger();
+    }
+    if (!start || !end) {
+        return Object::MakeError(ErrorKind::TypeError);
+    }
+    if (*start < 0 || *start > *end || static_cast<size_t>(*end) > (*str)->Size()) {
+        return Object::MakeError(ErrorKind::IndexOutOfRange);
+    }
+    return Object{Slice(*str, *start, *end)};
 }
 
+// Pushes a frame of size slots, initialised to None, and makes it the
+// running frame of closure until destroyed
+
+class Interpreter::FrameScope {
+public:
+    FrameScope(Interpreter* interpreter, size_t size, const Closure* closure)
+        : interpreter(interpreter),
+          base(interpreter->frames.size()),
+          savedBase(interpreter->frameBase),
+          savedClosure(interpreter->closure)
+    {
+        interpreter->frames.resize(base + size, Object::None());
+        interpreter->frameBase = base;
+        interpreter->closure = closure;
+    }
+    FrameScope(const FrameScope&) = delete;
+    FrameScope& operator=(const FrameScope&) = delete;
+    ~FrameScope()
+    {
+        interpreter->frames.resize(base, Object::None());
+        interpreter->frameBase = savedBase;
+        interpreter->closure = savedClosure;
+    }
+
+private:
+    Interpreter* interpreter;
+    size_t base;
+    size_t savedBase;
+    const Closure* savedClosure;
+};
+
+// Counts an Eval() call in the depth of the running evaluation until
+// destroyed
+
+class Interpreter::DepthScope {
+public:
+    explicit DepthScope(Interpreter* interpreter)
+        : interpreter(interpreter)
+    {
+        ++interpreter->usage.depth;
+    }
+    DepthScope(const DepthScope&) = delete;
+    DepthScope& operator=(const DepthScope&) = delete;
+    ~DepthScope()
+    {
+        --interpreter->usage.depth;
+    }
+
+private:
+    Interpreter* interpreter;
+};
+
+// Stops the definitions set during a reload from starting another reload
+class Interpreter::ReloadScope {
+public:
+    explicit ReloadScope(Interpreter* interpreter)
+        : interpreter(interpreter)
+    {
+        interpreter->reloading = true;
+    }
+    ReloadScope(const ReloadScope&) = delete;
+    ReloadScope& operator=(const ReloadScope&) = delete;
+    ~ReloadScope()
+    {
+        interpreter->reloading = false;
+    }
+
+private:
+    Interpreter* interpreter;
+};
+
 Interpreter::Interpreter()
 {
+    compiler = std::make_unique<Compiler>(this);
     printer = std::make_unique<Printer>(this);
     reader = std::make_unique<Reader>(this);
+    functions = std::make_shared<std::vector<CFunction>>();
+
+    DefineCFunction("*", SubrProduct);
+    DefineCFunction("+", SubrSum);
+    DefineCFunction("-", SubrDifference);
+    DefineCFunction("/", SubrQuotient);
+    DefineCFunction("<", SubrLess);
+    DefineCFunction("<=", SubrLessOrEqual);
+    DefineCFunction("=", SubrEqual);
+    DefineCFunction(">", SubrGreater);
+    DefineCFunction(">=", SubrGreaterOrEqual);
+    DefineCFunction("ambient-light-color", SubrAmbientLightColor);
+    DefineCFunction("array-add", SubrArrayAdd);
+    DefineCFunction("array-clamp", SubrArrayClamp);
+    DefineCFunction("array-length", SubrArrayLength);
+    DefineCFunction("array-lerp", SubrArrayLerp);
+    DefineCFunction("array-map-range", SubrArrayMapRange);
+    DefineCFunction("array-max", SubrArrayMax);
+    DefineCFunction("array-min", SubrArrayMin);
+    DefineCFunction("array-mul", SubrArrayMultiply);
+    DefineCFunction("array-ref", SubrArrayRef);
+    DefineCFunction("array-sum", SubrArraySum);
+    DefineCFunction("background", SubrBackground);
+    DefineCFunction("clamp", SubrClamp);
+    DefineCFunction("color", SubrColor);
+    DefineCFunction("computed", SubrComputed);
+    DefineCFunction("cons", SubrCons);
+    DefineCFunction("cube", SubrCube);
+    DefineCFunction("equal?", SubrIsEqual);
+    DefineCFunction("filter", SubrFilter);
+    DefineCFunction("hash", SubrHash);
+    DefineCFunction("hash-count", SubrHashCount);
+    DefineCFunction("hash-ref", SubrHashRef);
+    DefineCFunction("hash-remove!", SubrHashRemove);
+    DefineCFunction("hash-set!", SubrHashSet);
+    DefineCFunction("intern", SubrIntern);
+    DefineCFunction("lerp", SubrLerp);
+    DefineCFunction("light-color", SubrLightColor);
+    DefineCFunction("list", SubrList);
+    DefineCFunction("macroexpand", SubrMacroExpand);
+    DefineCFunction("make-float-array", SubrMakeFloatArray);
+    DefineCFunction("make-int-array", SubrMakeIntArray);
+    DefineCFunction("map", SubrMap);
+    DefineCFunction("map-range", SubrMapRange);
+    DefineCFunction("memo-stats", SubrMemoStats);
+    DefineCFunction("norm", SubrNorm);
+    DefineCFunction("range", SubrRange);
+    DefineCFunction("reduce", SubrReduce);
+    DefineCFunction("reload-failed", SubrReloadFailed);
+    DefineCFunction("reloaded", SubrReloaded);
+    DefineCFunction("rotate-x", SubrRotateX);
+    DefineCFunction("rotate-y", SubrRotateY);
+    DefineCFunction("rotate-z", SubrRotateZ);
+    DefineCFunction("scale", SubrScale);
+    DefineCFunction("set-pure!", SubrSetPure);
+    DefineCFunction("set-signal!", SubrSetSignal);
+    DefineCFunction("signal", SubrSignal);
+    DefineCFunction("signal-value", SubrSignalValue);
+    DefineCFunction("string-append", SubrStringAppend);
+    DefineCFunction("string-length", SubrStringLength);
+    DefineCFunction("substring", SubrSubstring);
+    DefineCFunction("take", SubrTake);
+    DefineCFunction("tetrahedron", SubrTetrahedron);
+    DefineCFunction("to-vector", SubrToVector);
+    DefineCFunction("translate", SubrTranslate);
+    DefineCFunction("vector-length", SubrVectorLength);
+    DefineCFunction("vector-push", SubrVectorPush);
+    DefineCFunction("vector-ref", SubrVectorRef);
+    DefineCFunction("vector-set!", SubrVectorSet);
+    DefineCFunction("wrap", SubrWrap);
+}
+
+Interpreter::Interpreter(const Interpreter& parent)
+    : symbolNames(parent.symbolNames),
+      symbolHandles(parent.symbolHandles),
+      symbolValues(parent.symbolValues),
+      functions(parent.functions),
+      hashConsing(parent.hashConsing),
+      memoCache(parent.memoCache),
+      quotas(parent.quotas)
+{
+    compiler = std::make_unique<Compiler>(this);
+    printer = std::make_unique<Printer>(this);
+    reader = std::make_unique<Reader>(this);
+}
+
+Object Interpreter::Apply(const Object& fun, const ListPtr& args)
+{
+    if (memoCache.IsPure(fun) && MemoCache::CanCache(args)) {
+        if (const Object* cached = memoCache.Find(fun, args)) {
+            return *cached;
+        }
+        Object result = Call(fun, args);
+        memoCache.Insert(fun, args, result);
+        return result;
+    }
+    return Call(fun, args);
+}
+
+Object Interpreter::ApplyClosure(const Closure& fun, const ListPtr& args)
+{
+    // The args are copied into the first slots of a new frame
+    const SpecialForm& lambda = fun.Lambda();
+    if (ListLength(args) != lambda.NumParams()) {
+        return Object::MakeError(ErrorKind::WrongNumberOfArgs);
+    }
+    FrameScope frame(this, lambda.FrameSize(), &fun);
+    Object* slot = frames.data() + frameBase;
+    for (const ListNode* next = args.get(); next != nullptr; next = next->Rest().get()) {
+        *slot++ = next->First();
+    }
+    return EvalBody(lambda.Body());
+}
+
+Object Interpreter::Call(const Object& fun, const ListPtr& args)
+{
+    if (const ClosurePtr* closurePtr = fun.TryGetClosurePtr()) {
+        return ApplyClosure(**closurePtr, args);
+    }
+    std::optional<CFunctionHandle> handle = fun.TryGetCFunctionHandle();
+    if (!handle) {
+        return Object::MakeError(ErrorKind::NotAFunction);
+    }
+    return functions->at(*handle)(this, args);
+}
+
+std::vector<SymbolHandle> Interpreter::ChangedSymbols(const EnvironmentSnapshot& from,
+                                                      const EnvironmentSnapshot& to) const
+{
+    std::vector<SymbolHandle> changed;
+    from.ForEachUnsharedIndex(to, [&](size_t handle) {
+        Object none = Object::None();
+        const Object& a = handle < from.Size() ? from.At(handle) : none;
+        const Object& b = handle < to.Size() ? to.At(handle) : none;
+        if (!IdenticalObjects(a, b)) {
+            changed.push_back(handle);
+        }
+    });
+    return changed;
+}
+
+size_t Interpreter::BeginDefinition()
+{
+    // Starts recording the symbols read by a top-level definition, and
+    // returns the index of its first read
+    ++readLog.recording;
+    return readLog.symbols.size();
+}
+
+void Interpreter::CheckSignal(Signal& signal)
+{
+    // Brings a computed signal up to date. Its dependencies are checked
+    // in the order they were read, and it is recomputed if it has never
+    // been computed or one of them has changed.
+    std::uint64_t epoch = Signal::Epoch();
+    if (signal.IsInput() || signal.Updating() || signal.CheckedEpoch() == epoch) {
+        return;
+    }
+    signal.SetUpdating(true);
+    bool changed = signal.CheckedEpoch() == 0;
+    for (const Signal::Dependency& dependency : signal.Dependencies()) {
+        CheckSignal(*dependency.signal);
+        if (dependency.signal->Version() != dependency.version) {
+            changed = true;
+            break;
+        }
+    }
+    if (changed) {
+        ComputeSignal(signal);
+    }
+    signal.SetCheckedEpoch(epoch);
+    signal.SetUpdating(false);
+}
+
+Scene* Interpreter::CurrentScene() const
+{
+    return scene;
+}
+
+Object Interpreter::Compiled(const ListPtr& form)
+{
+    // Compiles a special form expression or macro call the first time it
+    // is evaluated
+    if (const Object* cached = compiledForms.Find(form)) {
+        return *cached;
+    }
+    Object compiled = compiler->Compile(form);
+    if (compiled.Type() != ObjectType::Error) {
+        compiledForms.Insert(form, compiled);
+    }
+    return compiled;
+}
+
+Object Interpreter::CompiledMacroCall(const ListPtr& form)
+{
+    // Compiles a call whose function evaluated to a macro. Only a call
+    // whose head names a global macro is expanded by the Compiler; a macro
+    // reached any other way, such as through a local variable, is not a
+    // function.
+    if (!form->First().TryGetSymbolHandle()) {
+        return Object::MakeError(ErrorKind::NotAFunction);
+    }
+    return Compiled(form);
+}
+
+void Interpreter::ComputeSignal(Signal& signal)
+{
+    // Calls the signal's function with the signal recording the signals
+    // it reads, and with a Scene of its own, so that its drawing can be
+    // replayed without calling it again
+    signal.ClearDependencies();
+    Signal* outerSignal = computingSignal;
+    Scene* outerScene = scene;
+    Scene recorded;
+    computingSignal = &signal;
+    scene = &recorded;
+    Object value = Apply(signal.Fun(), nullptr);
+    computingSignal = outerSignal;
+    scene = outerScene;
+    std::vector<SceneCommand> commands;
+    recorded.SwapCommands(commands);
+    signal.SetComputed(std::move(value), commands);
+}
 
-    functions.resize(2);
-    functions.at(0) = SubrProduct;
-    SetSymbolValue(SymbolRef("*"), Object::MakeCFunctionHandle(0));
-    functions.at(1) = SubrSum;
-    SetSymbolValue(SymbolRef("+"), Object::MakeCFunctionHandle(1));
+void Interpreter::DefineCFunction(const std::string& name, CFunction fun)
+{
+    functions->push_back(fun);
+    SetSymbolValue(SymbolRef(name), Object::MakeCFunctionHandle(functions->size() - 1));
 }
 
-Object Interpreter::Apply(const Object& fun, ListPtr args)
+void Interpreter::EndDefinition(SymbolHandle name, const Object& valueExpr, size_t readsStart, const Object& val)
 {
-    return functions.at(fun.GetCFunctionHandle())(this, args);
+    // Records the definition with the symbols read since readsStart, and
+    // sets its value. The reads are kept while an enclosing definition is
+    // recording, as its value depends on them too.
+    --readLog.recording;
+    if (val.Type() != ObjectType::Error) {
+        std::vector<SymbolHandle> reads(readLog.symbols.begin() + readsStart, readLog.symbols.end());
+        definitions.Define(name, valueExpr, std::move(reads));
+    }
+    if (readLog.recording == 0) {
+        readLog.symbols.clear();
+    }
+    if (val.Type() != ObjectType::Error) {
+        SetSymbolValue(name, val);
+    }
 }
 
 Object Interpreter::Eval(const Object& expr)
 {
+    // The outermost call starts a new evaluation
+    if (usage.depth == 0) {
+        usage = QuotaUsage{0, HeapUsage::Bytes(), 0};
+    }
+    if (usage.depth >= quotas.maxDepth) {
+        return Object::MakeError(ErrorKind::DepthQuotaExceeded);
+    }
+    if (std::optional<ErrorKind> error = UseStep()) {
+        return Object::MakeError(*error);
+    }
+    DepthScope depthScope(this);
     switch (expr.Type()) {
     case ObjectType::Boolean:
+    case ObjectType::CFunctionHandle:
+    case ObjectType::ClosurePtr:
+    case ObjectType::Error:
+    case ObjectType::Float:
     case ObjectType::Integer:
+    case ObjectType::MacroPtr:
     case ObjectType::None:
+    case ObjectType::NumericArrayPtr:
+    case ObjectType::SequencePtr:
+    case ObjectType::SignalPtr:
+    case ObjectType::StringPtr:
         return expr;
     case ObjectType::SymbolHandle:
+        if (readLog.recording > 0) {
+            readLog.symbols.push_back(expr.GetSymbolHandle());
+        }
         return SymbolValue(expr.GetSymbolHandle());
+    case ObjectType::LocalRef:
+        return Local(expr.GetLocalRefUnchecked());
+    case ObjectType::SpecialFormPtr:
+        return EvalSpecialForm(expr.GetSpecialFormPtrUnchecked());
     case ObjectType::ListPtr: {
-        Object first = expr.GetListPtr()->First();
-        return Apply(Eval(first), expr.GetListPtr()->Rest());
+        const ListPtr& lst = expr.GetListPtrUnchecked();
+        if (lst == nullptr) {
+            return expr;
+        }
+        std::optional<SymbolHandle> head = lst->First().TryGetSymbolHandle();
+        if (head && compiler->IsSpecialFormSymbol(*head)) {
+            return EvalCompiled(lst);
+        }
+        Object fun = Eval(lst->First());
+        if (fun.Type() == ObjectType::Error) {
+            return fun;
+        }
+        if (fun.Type() == ObjectType::MacroPtr) {
+            // The expansion is compiled, and cached, with the call
+            Object compiled = CompiledMacroCall(lst);
+            if (compiled.Type() == ObjectType::Error) {
+                return compiled;
+            }
+            return Eval(compiled);
+        }
+        const ListPtr& args = lst->Rest();
+        if (AllSelfEvaluating(args)) {
+            return Apply(fun, args);
+        }
+        Object evaluatedArgs = EvalArgs(args);
+        if (evaluatedArgs.Type() == ObjectType::Error) {
+            return evaluatedArgs;
+        }
+        return Apply(fun, evaluatedArgs.GetListPtrUnchecked());
     }
+    case ObjectType::HashMapPtr:
+        return EvalHashMap(*expr.GetHashMapPtrUnchecked());
+    case ObjectType::VectorPtr:
+        return EvalVector(*expr.GetVectorPtrUnchecked());
     default:
         throw std::exception{"Unhandled type in Eval"};
     }
 }
 
+Object Interpreter::EvalArgs(const ListPtr& args)
+{
+    // Returns a new list of the evaluated args, allocated in one block,
+    // or the first error
+    ListBuilder builder(ListLength(args));
+    for (const ListNode* next = args.get(); next != nullptr; next = next->Rest().get()) {
+        Object val = Eval(next->First());
+        if (val.Type() == ObjectType::Error) {
+            return val;
+        }
+        builder.Append(std::move(val));
+    }
+    return Object{builder.Finish()};
+}
+
+Object Interpreter::EvalBody(const ListPtr& body)
+{
+    // Evaluates each expression in turn and returns the value of the
+    // last, or the first error
+    Object val = Object::None();
+    for (const ListNode* next = body.get(); next != nullptr; next = next->Rest().get()) {
+        val = Eval(next->First());
+        if (val.Type() == ObjectType::Error) {
+            break;
+        }
+    }
+    return val;
+}
+
+Object Interpreter::EvalCompiled(const ListPtr& form)
+{
+    Object compiled = Compiled(form);
+    if (compiled.Type() == ObjectType::Error) {
+        return compiled;
+    }
+    return Eval(compiled);
+}
+
+Object Interpreter::EvalHashMap(const HashMap& map)
+{
+    // A map expression evaluates to a new map with the values evaluated.
+    // The keys are not evaluated, so that symbols may be used as keys.
+    HashMapPtr result(new HashMap());
+    std::optional<Object> error;
+    map.ForEach([&](const Object& key, const Object& value) {
+        if (error) {
+            return;
+        }
+        Object val = Eval(value);
+        if (val.Type() == ObjectType::Error) {
+            error = std::move(val);
+            return;
+        }
+        result->Insert(key, std::move(val));
+    });
+    if (error) {
+        return *error;
+    }
+    return Object{std::move(result)};
+}
+
+Object Interpreter::EvalVector(const Vector& vec)
+{
+    // A vector expression evaluates to a new vector of the evaluated
+    // elements, so that the expression itself is never modified by
+    // vector-set! or vector-push
+    VectorPtr result(new Vector());
+    result->Reserve(vec.Size());
+    for (size_t i = 0; i < vec.Size(); ++i) {
+        Object val = Eval(vec.At(i));
+        if (val.Type() == ObjectType::Error) {
+            return val;
+        }
+        result->PushBack(std::move(val));
+    }
+    return Object{std::move(result)};
+}
+
+Object Interpreter::EvalDo(const SpecialForm& form)
+{
+    // The loop runs here rather than by recursion, and each pass only
+    // reads and writes frame slots, so a loop runs in constant stack and
+    // allocates nothing that its body and steps do not
+    const Object& test = form.Operands()[0];
+    const ListPtr& result = form.Operands()[1].GetListPtrUnchecked();
+    const std::vector<LocalBinding>& bindings = form.Bindings();
+    for (;;) {
+        Object done = Eval(test);
+        if (done.Type() == ObjectType::Error) {
+            return done;
+        }
+        if (IsTruthy(done)) {
+            return EvalBody(result);
+        }
+        Object val = EvalBody(form.Body());
+        if (val.Type() == ObjectType::Error) {
+            return val;
+        }
+        for (const LocalBinding& binding : bindings) {
+            if (binding.step) {
+                Object step = Eval(*binding.step);
+                if (step.Type() == ObjectType::Error) {
+                    return step;
+                }
+                frames[frameBase + binding.stepSlot] = std::move(step);
+            }
+        }
+        for (const LocalBinding& binding : bindings) {
+            if (binding.step) {
+                frames[frameBase + binding.slot] = std::move(frames[frameBase + binding.stepSlot]);
+            }
+        }
+    }
+}
+
+Object Interpreter::EvalSpecialForm(const SpecialFormPtr& form)
+{
+    switch (form->Kind()) {
+    case SpecialFormKind::Define: {
+        SymbolHandle name = form->Operands()[0].GetSymbolHandle();
+        const Object& valueExpr = form->Operands()[1];
+        // Outside of any lambda or let, the value expression reads no
+        // locals, and can be evaluated again on its own
+        if (closure == nullptr && frames.empty()) {
+            size_t readsStart = BeginDefinition();
+            Object val = Eval(valueExpr);
+            EndDefinition(name, valueExpr, readsStart, val);
+            return val;
+        }
+        Object val = Eval(valueExpr);
+        if (val.Type() != ObjectType::Error) {
+            definitions.Forget(name);
+            SetSymbolValue(name, val);
+        }
+        return val;
+    }
+    case SpecialFormKind::Defmacro: {
+        Object expander = Eval(form->Operands()[1]);
+        if (expander.Type() == ObjectType::Error) {
+            return expander;
+        }
+        Object macro{MacroPtr(new Macro(expander.GetClosurePtr()))};
+        SetSymbolValue(form->Operands()[0].GetSymbolHandle(), macro);
+        return macro;
+    }
+    case SpecialFormKind::If: {
+        Object test = Eval(form->Operands()[0]);
+        if (test.Type() == ObjectType::Error) {
+            return test;
+        }
+        return Eval(form->Operands()[IsTruthy(test) ? 1 : 2]);
+    }
+    case SpecialFormKind::Lambda: {
+        std::vector<Object> captured;
+        captured.reserve(form->Captures().size());
+        for (const Object& capture : form->Captures()) {
+            captured.push_back(Local(capture.GetLocalRefUnchecked()));
+        }
+        return Object{ClosurePtr(new Closure(form, std::move(captured)))};
+    }
+    case SpecialFormKind::Quote:
+        return form->Operands()[0];
+    default:
+        break;
+    }
+    // A let or do
+    std::optional<FrameScope> frame;
+    if (form->FrameSize() > 0) {
+        frame.emplace(this, form->FrameSize(), nullptr);
+    }
+    for (const LocalBinding& binding : form->Bindings()) {
+        Object val = Eval(binding.init);
+        if (val.Type() == ObjectType::Error) {
+            return val;
+        }
+        frames[frameBase + binding.slot] = std::move(val);
+    }
+    if (form->Kind() == SpecialFormKind::Do) {
+        return EvalDo(*form);
+    }
+    return EvalBody(form->Body());
+}
+
+std::unique_ptr<Interpreter> Interpreter::Fork() const
+{
+    return std::unique_ptr<Interpreter>(new Interpreter(*this));
+}
+
+ListPtr Interpreter::HashCons(Object first, ListPtr rest)
+{
+    return hashConsTable.Cons(std::move(first), std::move(rest));
+}
+
+bool Interpreter::HashConsing() const
+{
+    return hashConsing;
+}
+
+StringPtr Interpreter::Intern(const StringPtr& str)
+{
+    return strings.Intern(str);
+}
+
+Object Interpreter::MacroExpand(const ListPtr& form)
+{
+    // Returns the expansion of a call to a macro, or form itself if it is
+    // not one. Each form is expanded once, and the expansion is cached
+    // until a macro is redefined.
+    if (form == nullptr) {
+        return Object{form};
+    }
+    if (const Object* cached = macroExpansions.Find(form)) {
+        return *cached;
+    }
+    std::optional<SymbolHandle> head = form->First().TryGetSymbolHandle();
+    const MacroPtr* macro = nullptr;
+    Object headValue = Object::None();
+    if (head) {
+        headValue = SymbolValue(*head);
+        macro = headValue.TryGetMacroPtr();
+    }
+    if (macro == nullptr) {
+        return Object{form};
+    }
+    Object expansion = ApplyClosure(*(*macro)->Expander(), form->Rest());
+    if (expansion.Type() != ObjectType::Error) {
+        macroExpansions.Insert(form, expansion);
+    }
+    return expansion;
+}
+
+const Object& Interpreter::Local(LocalRef ref) const
+{
+    // The value of a slot of the running frame, or of the running closure
+    if (ref.captured) {
+        return closure->Captured(ref.slot);
+    }
+    return frames[frameBase + ref.slot];
+}
+
+void Interpreter::MacrosChanged()
+{
+    // Expansions, and compiled forms that may contain them, are made
+    // again the next time they are needed
+    macroExpansions.Clear();
+    compiledForms.Clear();
+}
+
+MemoCache::Stats Interpreter::MemoStats() const
+{
+    return memoCache.GetStats();
+}
+
 std::string Interpreter::Print(const Object& obj) const
 {
     return this->printer->Print(obj);
@@ -83,35 +2029,170 @@ Object Interpreter::Read(const std::string& text)
     return this->reader->Read(text);
 }
 
+const std::vector<SymbolHandle>& Interpreter::ReloadFailed() const
+{
+    // The definitions whose values evaluated to an error in the most
+    // recent reload
+    return reloadFailed;
+}
+
+const std::vector<SymbolHandle>& Interpreter::Reloaded() const
+{
+    // The definitions evaluated again by the most recent reload
+    return reloaded;
+}
+
+void Interpreter::Reload(SymbolHandle changed)
+{
+    // Evaluates again, in dependency order, each definition that depends
+    // on changed and read a symbol that has changed in this reload. The
+    // definitions it sets are not reloaded again from here, as their
+    // dependents are already in the list.
+    reloaded.clear();
+    reloadFailed.clear();
+    std::vector<SymbolHandle> dependents = definitions.Dependents(changed);
+    if (dependents.empty()) {
+        return;
+    }
+    ReloadScope scope(this);
+    SymbolSet changedSymbols;
+    changedSymbols.Insert(changed, true);
+    for (SymbolHandle symbol : dependents) {
+        const DefinitionGraph::Definition* definition = definitions.Find(symbol);
+        if (definition == nullptr ||
+            std::none_of(definition->reads.begin(), definition->reads.end(), [&](SymbolHandle read) {
+                return changedSymbols.Find(read) != nullptr;
+            })) {
+            continue;
+        }
+        Object valueExpr = definition->valueExpr;
+        Object before = symbolValues.At(symbol);
+        size_t readsStart = BeginDefinition();
+        Object val = Eval(valueExpr);
+        EndDefinition(symbol, valueExpr, readsStart, val);
+        if (val.Type() == ObjectType::Error) {
+            reloadFailed.push_back(symbol);
+            continue;
+        }
+        reloaded.push_back(symbol);
+        if (!IdenticalObjects(before, symbolValues.At(symbol))) {
+            changedSymbols.Insert(symbol, true);
+        }
+    }
+}
+
+void Interpreter::Restore(const EnvironmentSnapshot& snapshot)
+{
+    // Symbols created since the snapshot was taken keep their handles but
+    // revert to None. Only symbol values are restored: a Vector, HashMap
+    // or Signal is the same object in the snapshot, so vector-set!,
+    // hash-set! and set-signal! since the snapshot are not undone.
+    EnvironmentSnapshot values = snapshot;
+    while (values.Size() < symbolNames.Size()) {
+        values = values.PushBack(Object::None());
+    }
+    for (SymbolHandle handle : ChangedSymbols(symbolValues, values)) {
+        if (symbolValues.At(handle).Type() == ObjectType::MacroPtr || values.At(handle).Type() == ObjectType::MacroPtr) {
+            MacrosChanged();
+            break;
+        }
+    }
+    symbolValues = values;
+}
+
+void Interpreter::SetHashConsing(bool enabled)
+{
+    hashConsing = enabled;
+}
+
+void Interpreter::SetMemoCapacity(size_t capacity)
+{
+    memoCache.SetCapacity(capacity);
+}
+
+void Interpreter::SetPure(const Object& fun, bool pure)
+{
+    memoCache.SetPure(fun, pure);
+}
+
+void Interpreter::SetQuotas(const EvalQuotas& quotas)
+{
+    this->quotas = quotas;
+}
+
+Object Interpreter::SignalValue(const SignalPtr& signal)
+{
+    if (signal->Updating()) {
+        return Object::MakeError(ErrorKind::InvalidArgument);
+    }
+    CheckSignal(*signal);
+    if (computingSignal != nullptr) {
+        computingSignal->AddDependency(signal);
+    }
+    if (scene != nullptr) {
+        scene->Append(signal->Commands());
+    }
+    return signal->Value();
+}
+
+void Interpreter::SetScene(Scene* scene)
+{
+    this->scene = scene;
+}
+
 void Interpreter::SetSymbolValue(SymbolHandle handle, const Object& value)
 {
-    symbols.at(handle).value = value;
+    const Object& old = symbolValues.At(handle);
+    if (value.Type() == ObjectType::MacroPtr || old.Type() == ObjectType::MacroPtr) {
+        MacrosChanged();
+    }
+    bool changed = !IdenticalObjects(old, value);
+    symbolValues = symbolValues.Set(handle, value);
+    if (changed && !reloading) {
+        Reload(handle);
+    }
 }
 
 std::string Interpreter::SymbolName(SymbolHandle handle) const
 {
-    return symbols.at(handle).name;
+    return symbolNames.At(handle);
 }
 
 Object Interpreter::SymbolValue(SymbolHandle handle) const
 {
-    return symbols.at(handle).value;
+    return symbolValues.At(handle);
 }
 
 SymbolHandle Interpreter::SymbolRef(const std::string& name)
 {
-    auto it = std::find_if(
-        symbols.begin(),
-        symbols.end(),
-        [name](const Symbol& s) -> bool { return s.name == name; });
+    if (const SymbolHandle* handle = symbolHandles.Find(name)) {
+        return *handle;
+    }
+
+    SymbolHandle handle = symbolNames.Size();
+    symbolNames = symbolNames.PushBack(name);
+    symbolValues = symbolValues.PushBack(Object::None());
+    symbolHandles.Insert(name, handle);
+    return handle;
+}
+
+EnvironmentSnapshot Interpreter::Snapshot() const
+{
+    return symbolValues;
+}
 
-    if (it == symbols.end()) {
-        symbols.emplace_back(name);
-        return symbols.size() - 1;
+std::optional<ErrorKind> Interpreter::UseStep()
+{
+    // Counts a step of the running evaluation. Returns an error if the
+    // evaluation has no steps left or holds more heap than its quota.
+    if (usage.steps >= quotas.maxSteps) {
+        return ErrorKind::StepQuotaExceeded;
     }
-    else {
-        return std::distance(symbols.begin(), it);
+    ++usage.steps;
+    if (HeapUsage::Bytes() - usage.heapBase > quotas.maxHeapBytes) {
+        return ErrorKind::HeapQuotaExceeded;
     }
+    return std::nullopt;
 }
 
 } // namespace Procdraw
@@ -15,47 +15,215 @@
 #ifndef PROCDRAW_INTERPRETER_H
 #define PROCDRAW_INTERPRETER_H
 
+#include "Compiler.h"
+#include "DefinitionGraph.h"
+#include "FormCache.h"
+#include "HashConsTable.h"
 #include "InterpreterTypes.h"
+#include "MemoCache.h"
+#include "OpenHashMap.h"
+#include "PersistentVector.h"
 #include "Printer.h"
 #include "Reader.h"
+#include "Scene.h"
+#include <climits>
+#include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
 // Note: It is not safe to share Objects between Interpreter instances as
 //       Objects may have handles into Interpreter-specific data structures,
-//       such as a symbol table.
+//       such as a symbol table. The exception is an Interpreter created with
+//       Fork(), which starts with the same symbol handles as its parent.
+//
+// Note: Symbol values are held in a persistent vector, so Fork() and
+//       Snapshot() are O(1) and share all unchanged entries. A forked
+//       Interpreter may be used on a different thread from its parent. Each
+//       Interpreter instance itself must only be used by one thread at a time.
+//
+// Note: Vectors and HashMaps are mutable and are shared, not copied, by
+//       Fork() and Snapshot(). One reachable from Interpreters on different
+//       threads must not be modified while they are running, and Restore()
+//       does not undo changes made to one after a snapshot was taken.
+//
+// Note: With hash consing enabled, the Reader builds lists with HashCons(),
+//       so structurally equal lists read by one Interpreter are the same
+//       node. Each Interpreter has its own table, which a forked Interpreter
+//       starts empty.
+//
+// Note: Strings are immutable, and are shared freely between Interpreters.
+//       Intern() returns one String for all equal strings interned by an
+//       Interpreter, so that they can be compared and cached by address.
+//       Each Interpreter has its own table, which a forked Interpreter
+//       starts empty. String literals are interned when hash consing is
+//       enabled.
+//
+// Note: Special form expressions are compiled the first time they are
+//       evaluated, and the compiled form is cached against the expression's
+//       list, which must not be modified afterwards. Local variables live in
+//       frames on a stack owned by the Interpreter, so a Closure may be
+//       called by any Interpreter that shares its symbols.
+//
+// Note: A call to a macro is expanded the first time it is evaluated or
+//       compiled, and the expansion is cached against the call's list.
+//       Setting the value of a symbol that is or becomes a macro discards
+//       all cached expansions and compiled forms.
+//
+// Note: Calls to functions marked as pure with SetPure() are cached, and
+//       a repeated call with the same atom args returns the cached result.
+//       A pure function's result must depend only on its args. A forked
+//       Interpreter has the same pure functions and starts with an empty
+//       cache.
+//
+// Note: An EvalTask evaluates an expression in slices, and may be
+//       suspended between slices while the Interpreter is used for other
+//       evaluations.
+//
+// Note: Each evaluation, from a call of Eval() that is not nested in
+//       another or from an EvalTask, is limited by the EvalQuotas set with
+//       SetQuotas(). Once a quota is exceeded every further step of the
+//       evaluation returns an error, which stops it. The next evaluation
+//       starts with fresh counts.
+//
+// Note: The scene builtins, such as cube and rotate-x, record commands in
+//       the Scene set with SetScene(), and do nothing when there is none.
+//
+// Note: A computed signal is recomputed by SignalValue() only when a signal
+//       it read last time has changed. Its scene commands are recorded with
+//       its value, and added to the current Scene each time it is read.
+//       Signals are mutable, and shared by Fork() and Snapshot(), like
+//       Vectors.
+//
+// Note: A define outside of any lambda or let is a top-level definition,
+//       and the symbols read while evaluating its value are recorded. When
+//       SetSymbolValue() changes the value of a symbol, the definitions that
+//       read it, directly or through other definitions, are evaluated again
+//       in dependency order, and Reloaded() lists them. A definition is
+//       skipped if none of the symbols it read changed. A definition whose
+//       value evaluates to an error keeps its previous value, and is listed
+//       by ReloadFailed() instead. A forked Interpreter starts with no
+//       recorded definitions.
 
 namespace Procdraw {
 
-struct Symbol {
-    explicit Symbol(const std::string& name)
-        : name(name), value(Object::None()) {}
-    std::string name;
-    Object value;
-};
+using EnvironmentSnapshot = PersistentVector<Object>;
 
+class EvalTask;
 class Interpreter;
 
-typedef Object (*CFunction)(Interpreter* interpreter, ListPtr args);
+typedef Object (*CFunction)(Interpreter* interpreter, const ListPtr& args);
+
+// Limits on one evaluation. A step is one evaluation of an expression, or
+// one element produced by a range. Heap bytes are the growth in
+// HeapUsage, and depth is the nesting of expressions being evaluated.
+
+struct EvalQuotas {
+    std::uint64_t maxSteps = UINT64_MAX;
+    std::int64_t maxHeapBytes = INT64_MAX;
+    int maxDepth = INT_MAX;
+};
 
 class Interpreter {
 public:
     Interpreter();
-    Object Apply(const Object& fun, ListPtr args);
+    Object Apply(const Object& fun, const ListPtr& args);
+    std::vector<SymbolHandle> ChangedSymbols(const EnvironmentSnapshot& from,
+                                             const EnvironmentSnapshot& to) const;
+    Scene* CurrentScene() const;
     Object Eval(const Object& expr);
+    std::unique_ptr<Interpreter> Fork() const;
+    ListPtr HashCons(Object first, ListPtr rest);
+    bool HashConsing() const;
+    StringPtr Intern(const StringPtr& str);
+    Object MacroExpand(const ListPtr& form);
+    MemoCache::Stats MemoStats() const;
     std::string Print(const Object& obj) const;
     Object Read(const std::string& text);
+    const std::vector<SymbolHandle>& ReloadFailed() const;
+    const std::vector<SymbolHandle>& Reloaded() const;
+    void Restore(const EnvironmentSnapshot& snapshot);
+    void SetHashConsing(bool enabled);
+    void SetMemoCapacity(size_t capacity);
+    void SetPure(const Object& fun, bool pure);
+    void SetQuotas(const EvalQuotas& quotas);
+    void SetScene(Scene* scene);
     void SetSymbolValue(SymbolHandle handle, const Object& value);
+    Object SignalValue(const SignalPtr& signal);
     std::string SymbolName(SymbolHandle handle) const;
     SymbolHandle SymbolRef(const std::string& name);
     Object SymbolValue(SymbolHandle handle) const;
+    EnvironmentSnapshot Snapshot() const;
+    std::optional<ErrorKind> UseStep();
 
 private:
+    // The counts of the running evaluation
+    struct QuotaUsage {
+        std::uint64_t steps = 0;
+        std::int64_t heapBase = 0;
+        int depth = 0;
+    };
+
+    // The symbols read by the top-level definitions being evaluated, and
+    // the number of those definitions that are still being evaluated
+    struct ReadLog {
+        std::vector<SymbolHandle> symbols;
+        int recording = 0;
+    };
+
+    friend class EvalTask;
+    std::unique_ptr<Compiler> compiler;
     std::unique_ptr<Printer> printer;
     std::unique_ptr<Reader> reader;
-    std::vector<Symbol> symbols;
-    std::vector<CFunction> functions;
+    PersistentVector<std::string> symbolNames;
+    OpenHashMap<std::string, SymbolHandle, std::hash<std::string>> symbolHandles;
+    EnvironmentSnapshot symbolValues;
+    std::shared_ptr<std::vector<CFunction>> functions;
+    HashConsTable hashConsTable;
+    StringTable strings;
+    bool hashConsing = false;
+    FormCache compiledForms;
+    FormCache macroExpansions;
+    MemoCache memoCache;
+    // The slots of the active frames, the start of the running frame, and
+    // the running closure
+    std::vector<Object> frames;
+    size_t frameBase = 0;
+    const Closure* closure = nullptr;
+    EvalQuotas quotas;
+    QuotaUsage usage;
+    Scene* scene = nullptr;
+    // The signal being computed, which records the signals read
+    Signal* computingSignal = nullptr;
+    DefinitionGraph definitions;
+    ReadLog readLog;
+    bool reloading = false;
+    std::vector<SymbolHandle> reloaded;
+    std::vector<SymbolHandle> reloadFailed;
+    class DepthScope;
+    class FrameScope;
+    class ReloadScope;
+    explicit Interpreter(const Interpreter& parent);
+    Object ApplyClosure(const Closure& fun, const ListPtr& args);
+    size_t BeginDefinition();
+    Object Call(const Object& fun, const ListPtr& args);
+    void CheckSignal(Signal& signal);
+    Object Compiled(const ListPtr& form);
+    Object CompiledMacroCall(const ListPtr& form);
+    void ComputeSignal(Signal& signal);
+    void DefineCFunction(const std::string& name, CFunction fun);
+    void EndDefinition(SymbolHandle name, const Object& valueExpr, size_t readsStart, const Object& val);
+    Object EvalArgs(const ListPtr& args);
+    Object EvalBody(const ListPtr& body);
+    Object EvalCompiled(const ListPtr& form);
+    Object EvalDo(const SpecialForm& form);
+    Object EvalHashMap(const HashMap& map);
+    Object EvalSpecialForm(const SpecialFormPtr& form);
+    Object EvalVector(const Vector& vec);
+    const Object& Local(LocalRef ref) const;
+    void MacrosChanged();
+    void Reload(SymbolHandle changed);
 };
 
 } // namespace Procdraw
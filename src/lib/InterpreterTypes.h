@@ -15,27 +15,102 @@
 #ifndef PROCDRAW_INTERPRETERTYPES_H
 #define PROCDRAW_INTERPRETERTYPES_H
 
+#include "HeapUsage.h"
+#include "NumericArray.h"
+#include "OpenHashMap.h"
+#include "RefPtr.h"
+#include "Scene.h"
+#include "Strings.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <exception>
 #include <memory>
+#include <optional>
 #include <variant>
+#include <vector>
 
 namespace Procdraw {
 
 enum class ObjectType {
     Boolean,
     CFunctionHandle,
+    ClosurePtr,
+    Error,
+    Float,
+    HashMapPtr,
     Integer,
     ListPtr,
+    LocalRef,
+    MacroPtr,
     None,
-    SymbolHandle
+    NumericArrayPtr,
+    SequencePtr,
+    SignalPtr,
+    SpecialFormPtr,
+    StringPtr,
+    SymbolHandle,
+    VectorPtr
 };
 
 using CFunctionHandle = size_t;
 using SymbolHandle = size_t;
 
+// A local variable of a lambda or let, resolved when the form is
+// compiled. It is either a slot in the frame of the running lambda, or
+// one of the values captured by the running closure.
+struct LocalRef {
+    bool captured;
+    std::uint32_t slot;
+};
+
+enum class ErrorKind {
+    BadSyntax,
+    DepthQuotaExceeded,
+    HeapQuotaExceeded,
+    IndexOutOfRange,
+    InvalidArgument,
+    KeyNotFound,
+    LengthMismatch,
+    NotAFunction,
+    StepQuotaExceeded,
+    TypeError,
+    WrongNumberOfArgs
+};
+
+class Closure;
+
+using ClosurePtr = RefPtr<Closure>;
+
+class HashMap;
+
+using HashMapPtr = RefPtr<HashMap>;
+
 class ListNode;
 
-using ListPtr = std::shared_ptr<ListNode>;
+using ListPtr = RefPtr<ListNode>;
+
+void DeleteRefCounted(ListNode* node);
+
+class Macro;
+
+using MacroPtr = RefPtr<Macro>;
+
+class Sequence;
+
+using SequencePtr = RefPtr<Sequence>;
+
+class Signal;
+
+using SignalPtr = RefPtr<Signal>;
+
+class SpecialForm;
+
+using SpecialFormPtr = RefPtr<SpecialForm>;
+
+class Vector;
+
+using VectorPtr = RefPtr<Vector>;
 
 class BadObjectAccess : public std::exception {
 public:
@@ -46,181 +121,1256 @@ class Object {
 public:
     Object(bool val);
     Object(int val);
+    Object(double val);
+    Object(ClosurePtr val);
+    Object(HashMapPtr val);
     Object(ListPtr val);
+    Object(MacroPtr val);
+    Object(NumericArrayPtr val);
+    Object(SequencePtr val);
+    Object(SignalPtr val);
+    Object(SpecialFormPtr val);
+    Object(StringPtr val);
+    Object(VectorPtr val);
     Object(const Object& o);
+    Object(Object&& o) noexcept;
     Object& operator=(const Object& o);
+    Object& operator=(Object&& o) noexcept;
     ~Object();
     static Object EmptyList();
     static Object MakeCFunctionHandle(CFunctionHandle handle);
+    static Object MakeError(ErrorKind kind);
+    static Object MakeLocalRef(LocalRef ref);
     static Object MakeSymbolHandle(SymbolHandle handle);
     static Object None();
     ObjectType Type() const;
     bool GetBoolean() const;
     CFunctionHandle GetCFunctionHandle() const;
+    ErrorKind GetError() const;
+    double GetFloat() const;
+    const ClosurePtr& GetClosurePtr() const;
+    const HashMapPtr& GetHashMapPtr() const;
     int GetInteger() const;
-    ListPtr GetListPtr() const;
+    const ListPtr& GetListPtr() const;
+    LocalRef GetLocalRef() const;
+    const MacroPtr& GetMacroPtr() const;
+    const NumericArrayPtr& GetNumericArrayPtr() const;
+    const SequencePtr& GetSequencePtr() const;
+    const SignalPtr& GetSignalPtr() const;
+    const SpecialFormPtr& GetSpecialFormPtr() const;
+    const StringPtr& GetStringPtr() const;
     SymbolHandle GetSymbolHandle() const;
+    const VectorPtr& GetVectorPtr() const;
+    // TryGet functions return no value, rather than throwing, if the
+    // Object is not of the requested type
+    std::optional<bool> TryGetBoolean() const;
+    std::optional<CFunctionHandle> TryGetCFunctionHandle() const;
+    std::optional<double> TryGetFloat() const;
+    const ClosurePtr* TryGetClosurePtr() const;
+    const HashMapPtr* TryGetHashMapPtr() const;
+    std::optional<int> TryGetInteger() const;
+    const ListPtr* TryGetListPtr() const;
+    std::optional<LocalRef> TryGetLocalRef() const;
+    const MacroPtr* TryGetMacroPtr() const;
+    const NumericArrayPtr* TryGetNumericArrayPtr() const;
+    const SequencePtr* TryGetSequencePtr() const;
+    const SignalPtr* TryGetSignalPtr() const;
+    const SpecialFormPtr* TryGetSpecialFormPtr() const;
+    const StringPtr* TryGetStringPtr() const;
+    std::optional<SymbolHandle> TryGetSymbolHandle() const;
+    const VectorPtr* TryGetVectorPtr() const;
+    // Unchecked functions are for use after the type has been checked,
+    // such as by a builtin validating all of its arguments up front
+    bool GetBooleanUnchecked() const;
+    double GetFloatUnchecked() const;
+    const ClosurePtr& GetClosurePtrUnchecked() const;
+    const HashMapPtr& GetHashMapPtrUnchecked() const;
+    int GetIntegerUnchecked() const;
+    const ListPtr& GetListPtrUnchecked() const;
+    LocalRef GetLocalRefUnchecked() const;
+    const MacroPtr& GetMacroPtrUnchecked() const;
+    const NumericArrayPtr& GetNumericArrayPtrUnchecked() const;
+    const SequencePtr& GetSequencePtrUnchecked() const;
+    const SignalPtr& GetSignalPtrUnchecked() const;
+    const SpecialFormPtr& GetSpecialFormPtrUnchecked() const;
+    const StringPtr& GetStringPtrUnchecked() const;
+    const VectorPtr& GetVectorPtrUnchecked() const;
 
 private:
     ObjectType type;
     union {
         bool booleanVal;
         CFunctionHandle cfunctionHandleVal;
+        ErrorKind errorVal;
+        double floatVal;
+        ClosurePtr closurePtrVal;
+        HashMapPtr hashMapPtrVal;
         int integerVal;
         ListPtr listPtrVal;
+        LocalRef localRefVal;
+        MacroPtr macroPtrVal;
+        NumericArrayPtr numericArrayPtrVal;
+        SequencePtr sequencePtrVal;
+        SignalPtr signalPtrVal;
+        SpecialFormPtr specialFormPtrVal;
+        StringPtr stringPtrVal;
         SymbolHandle symbolHandleVal;
+        VectorPtr vectorPtrVal;
     };
     Object(ObjectType type)
         : type(type) {}
+    void CopyValue(const Object& o);
+    void MoveValue(Object& o);
+    void DestroyValue();
 };
 
-class ListNode {
+class ListBlock;
+
+class ListNode : public RefCounted {
 public:
     ListNode(Object first, ListPtr rest)
-        : first(first), rest(rest) {}
-    Object First()
+        : first(std::move(first)), rest(std::move(rest)), block(nullptr)
+    {
+        HeapUsage::Allocated(sizeof(ListNode));
+    }
+    ~ListNode();
+    const Object& First() const
     {
         return first;
     }
     void SetFirst(Object obj)
     {
-        first = obj;
+        first = std::move(obj);
     }
-    ListPtr Rest()
+    const ListPtr& Rest() const
     {
         return rest;
     }
     void SetRest(ListPtr lst)
     {
-        rest = lst;
+        rest = std::move(lst);
     }
 
 private:
     Object first;
     ListPtr rest;
+    // The block holding this node, or null if it was allocated alone
+    ListBlock* block;
+    friend class ListBuilder;
+    friend void DeleteRefCounted(ListNode* node);
 };
 
-inline ListPtr Cons(Object first, ListPtr rest)
-{
-    return std::make_shared<ListNode>(first, rest);
-}
+// Storage for the nodes of a list allocated together, so that they are
+// adjacent in memory. The block is freed when all of its nodes have been
+// freed. Each node holds a reference to its block, and a ListBuilder
+// holds one while it is filling the block.
+//
+// Freed blocks of up to ListBlockPool::maxCapacity nodes are kept by the
+// freeing thread for reuse, so that the short argument lists made for
+// each function call do not allocate once a loop has warmed up.
 
-inline Object::Object(bool val)
-    : type(ObjectType::Boolean), booleanVal(val) {}
+class ListBlock : public RefCounted {
+public:
+    static ListBlock* Allocate(size_t capacity);
+    static void Free(ListBlock* block);
+    size_t Capacity() const
+    {
+        return capacity;
+    }
+    void* Slot(size_t index)
+    {
+        return reinterpret_cast<ListNode*>(this + 1) + index;
+    }
 
-inline Object::Object(int val)
-    : type(ObjectType::Integer), integerVal(val) {}
+private:
+    explicit ListBlock(size_t capacity)
+        : capacity(capacity) {}
+    size_t capacity;
+};
 
-inline Object::Object(ListPtr val)
-    : type(ObjectType::ListPtr), listPtrVal(val) {}
+static_assert(sizeof(ListBlock) % alignof(ListNode) == 0);
 
-inline Object::Object(const Object& o)
-    : type(o.type)
+class ListBlockPool {
+public:
+    static constexpr size_t maxCapacity = 8;
+    static constexpr size_t maxBlocks = 64;
+    ListBlockPool() = default;
+    ListBlockPool(const ListBlockPool&) = delete;
+    ListBlockPool& operator=(const ListBlockPool&) = delete;
+    ~ListBlockPool();
+    // Returns the calling thread's pool, or null once it has been
+    // destroyed at thread exit
+    static ListBlockPool* ForThread();
+    void* Take(size_t capacity);
+    bool Put(void* mem, size_t capacity);
+
+private:
+    void* blocks[maxCapacity + 1][maxBlocks];
+    size_t counts[maxCapacity + 1] = {};
+    static inline thread_local bool destroyed = false;
+};
+
+// Builds a list front to back. Up to capacity elements are placed in one
+// ListBlock, which replaces one allocation per node with one per list and
+// means that walking the list reads memory sequentially. Elements beyond
+// capacity are allocated individually.
+
+class ListBuilder {
+public:
+    explicit ListBuilder(size_t capacity);
+    ListBuilder(const ListBuilder&) = delete;
+    ListBuilder& operator=(const ListBuilder&) = delete;
+    ~ListBuilder();
+    void Append(Object obj);
+    ListPtr Finish();
+
+private:
+    ListBlock* block;
+    size_t used;
+    ListPtr head;
+    ListNode* last;
+    void ReleaseBlock();
+};
+
+// A growable array of Objects with O(1) indexing. Vectors are mutable:
+// SetAt and PushBack modify the Vector in place.
+
+class Vector : public RefCounted {
+public:
+    Vector() = default;
+    explicit Vector(std::vector<Object> elements)
+        : elements(std::move(elements))
+    {
+        HeapUsage::Allocated(this->elements.capacity() * sizeof(Object));
+    }
+    ~Vector()
+    {
+        HeapUsage::Freed(elements.capacity() * sizeof(Object));
+    }
+    const Object& At(size_t index) const
+    {
+        return elements[index];
+    }
+    void PushBack(Object obj)
+    {
+        size_t oldCapacity = elements.capacity();
+        elements.push_back(std::move(obj));
+        CountGrowth(oldCapacity);
+    }
+    void Reserve(size_t capacity)
+    {
+        size_t oldCapacity = elements.capacity();
+        elements.reserve(capacity);
+        CountGrowth(oldCapacity);
+    }
+    void SetAt(size_t index, Object obj)
+    {
+        elements[index] = std::move(obj);
+    }
+    size_t Size() const
+    {
+        return elements.size();
+    }
+
+private:
+    std::vector<Object> elements;
+    void CountGrowth(size_t oldCapacity)
+    {
+        HeapUsage::Allocated((elements.capacity() - oldCapacity) * sizeof(Object));
+    }
+};
+
+enum class SequenceKind {
+    Filter,
+    Map,
+    Range,
+    Take
+};
+
+// A lazy sequence. Nothing is computed when a Sequence is created: its
+// elements are produced one at a time when it is consumed, such as by a
+// reduction, and a pipeline of maps and filters over a range is run as
+// one loop with no intermediate lists.
+//
+// A Range has Start, Stop and Step numbers. Map and Filter apply Fun to
+// the elements of Source, and Take has the first Count elements of
+// Source. Source may be a Sequence, a list or a Vector.
+
+class Sequence : public RefCounted {
+public:
+    static RefPtr<Sequence> MakeFilter(Object fun, Object source);
+    static RefPtr<Sequence> MakeMap(Object fun, Object source);
+    static RefPtr<Sequence> MakeRange(Object start, Object stop, Object step);
+    static RefPtr<Sequence> MakeTake(int count, Object source);
+    SequenceKind Kind() const
+    {
+        return kind;
+    }
+    const Object& Fun() const
+    {
+        return fun;
+    }
+    const Object& Source() const
+    {
+        return source;
+    }
+    const Object& Start() const
+    {
+        return start;
+    }
+    const Object& Stop() const
+    {
+        return stop;
+    }
+    const Object& Step() const
+    {
+        return step;
+    }
+    int Count() const
+    {
+        return count;
+    }
+
+private:
+    Sequence(SequenceKind kind, Object fun, Object source, Object start, Object stop, Object step, int count)
+        : kind(kind),
+          fun(std::move(fun)),
+          source(std::move(source)),
+          start(std::move(start)),
+          stop(std::move(stop)),
+          step(std::move(step)),
+          count(count) {}
+    SequenceKind kind;
+    Object fun;
+    Object source;
+    Object start;
+    Object stop;
+    Object step;
+    int count;
+};
+
+enum class SpecialFormKind {
+    Define,
+    Defmacro,
+    Do,
+    If,
+    Lambda,
+    Let,
+    Quote
+};
+
+// A local variable of a let or do: its frame slot, and the compiled
+// expression for its initial value. A do variable with a step expression
+// also has a slot that holds its next value while the steps of all of
+// the variables are evaluated.
+struct LocalBinding {
+    std::uint32_t slot;
+    Object init;
+    std::optional<Object> step;
+    std::uint32_t stepSlot;
+};
+
+// The compiled form of a special form expression. References to local
+// variables are replaced by LocalRefs when the form is compiled, so no
+// names are looked up when it runs.
+//
+// Each call to a Lambda gets a frame of FrameSize slots, holding its
+// NumParams parameters and then the variables of any lets and do loops
+// in its Body. Captures has the expressions, in the enclosing scope, for
+// the values captured by a Closure made from the Lambda: only the
+// variables of enclosing forms that the body uses are captured.
+//
+// A Let or Do stores its Bindings in the frame of the enclosing Lambda,
+// or in a frame of its own of FrameSize slots if it is not inside a
+// Lambda. The Operands of a Do are its test and its list of result
+// expressions, and its Body is run on each pass of the loop.
+//
+// The Operands of an If are its test, then and else expressions; of a
+// Define the symbol and value expression; of a Defmacro the symbol and
+// the compiled lambda of its expander; and of a Quote the quoted Object.
+
+class SpecialForm : public RefCounted {
+public:
+    static RefPtr<SpecialForm> MakeDefine(SymbolHandle name, Object value);
+    static RefPtr<SpecialForm> MakeDefmacro(SymbolHandle name, Object expander);
+    static RefPtr<SpecialForm> MakeDo(int frameSize,
+                                      std::vector<LocalBinding> bindings,
+                                      Object test,
+                                      ListPtr result,
+                                      ListPtr body);
+    static RefPtr<SpecialForm> MakeIf(Object test, Object then, Object otherwise);
+    static RefPtr<SpecialForm> MakeLambda(int numParams,
+                                          int frameSize,
+                                          std::vector<Object> captures,
+                                          ListPtr body);
+    static RefPtr<SpecialForm> MakeLet(int frameSize,
+                                       std::vector<LocalBinding> bindings,
+                                       ListPtr body);
+    static RefPtr<SpecialForm> MakeQuote(Object datum);
+    SpecialFormKind Kind() const
+    {
+        return kind;
+    }
+    int NumParams() const
+    {
+        return numParams;
+    }
+    int FrameSize() const
+    {
+        return frameSize;
+    }
+    const std::vector<LocalBinding>& Bindings() const
+    {
+        return bindings;
+    }
+    const std::vector<Object>& Captures() const
+    {
+        return captures;
+    }
+    const std::vector<Object>& Operands() const
+    {
+        return operands;
+    }
+    const ListPtr& Body() const
+    {
+        return body;
+    }
+
+private:
+    explicit SpecialForm(SpecialFormKind kind)
+        : kind(kind), numParams(0), frameSize(0) {}
+    SpecialFormKind kind;
+    int numParams;
+    int frameSize;
+    std::vector<LocalBinding> bindings;
+    std::vector<Object> captures;
+    std::vector<Object> operands;
+    ListPtr body;
+};
+
+// A function made by evaluating a lambda expression, with the values of
+// the variables that it captured
+
+class Closure : public RefCounted {
+public:
+    Closure(SpecialFormPtr lambda, std::vector<Object> captured)
+        : lambda(std::move(lambda)), captured(std::move(captured)) {}
+    const SpecialForm& Lambda() const
+    {
+        return *lambda;
+    }
+    const Object& Captured(size_t index) const
+    {
+        return captured[index];
+    }
+
+private:
+    SpecialFormPtr lambda;
+    std::vector<Object> captured;
+};
+
+// A macro made by defmacro. A call to a macro is replaced by the result
+// of applying its Expander to the call's unevaluated args.
+
+class Macro : public RefCounted {
+public:
+    explicit Macro(ClosurePtr expander)
+        : expander(std::move(expander)) {}
+    const ClosurePtr& Expander() const
+    {
+        return expander;
+    }
+
+private:
+    ClosurePtr expander;
+};
+
+// A value that is only recomputed when the signals it depends on change.
+// An input signal's value is set with SetValue(). A computed signal calls
+// Fun, a function of no args, and keeps its result, the scene commands
+// the call recorded, and the version of each signal the call read. The
+// Version() of a signal is incremented whenever its value or commands
+// change, so a dependent can tell it is out of date by comparing the
+// versions it read with the current ones.
+//
+// Setting an input to a new value advances the global Epoch(). A computed
+// signal checked in the current epoch is up to date without looking at
+// its dependencies, so while no input changes, reading any signal is O(1).
+
+class Signal : public RefCounted {
+public:
+    struct Dependency {
+        RefPtr<Signal> signal;
+        std::uint64_t version;
+    };
+    static RefPtr<Signal> MakeComputed(Object fun)
+    {
+        return RefPtr<Signal>(new Signal(std::move(fun), Object::None()));
+    }
+    static RefPtr<Signal> MakeInput(Object value)
+    {
+        return RefPtr<Signal>(new Signal(Object::None(), std::move(value)));
+    }
+    static std::uint64_t Epoch()
+    {
+        return epoch.load(std::memory_order_relaxed);
+    }
+    bool IsInput() const
+    {
+        return fun.Type() == ObjectType::None;
+    }
+    const Object& Fun() const
+    {
+        return fun;
+    }
+    const Object& Value() const
+    {
+        return value;
+    }
+    std::uint64_t Version() const
+    {
+        return version;
+    }
+    const std::vector<SceneCommand>& Commands() const
+    {
+        return commands;
+    }
+    const std::vector<Dependency>& Dependencies() const
+    {
+        return dependencies;
+    }
+    // The epoch in which a computed signal was last found to be up to
+    // date, or 0 if it has not been computed
+    std::uint64_t CheckedEpoch() const
+    {
+        return checkedEpoch;
+    }
+    void SetCheckedEpoch(std::uint64_t epoch)
+    {
+        checkedEpoch = epoch;
+    }
+    // True while the signal is being brought up to date, to detect a
+    // signal that depends on itself
+    bool Updating() const
+    {
+        return updating;
+    }
+    void SetUpdating(bool updating)
+    {
+        this->updating = updating;
+    }
+    void AddDependency(const RefPtr<Signal>& signal);
+    void ClearDependencies()
+    {
+        dependencies.clear();
+    }
+    void SetValue(Object value);
+    void SetComputed(Object value, std::vector<SceneCommand>& commands);
+
+private:
+    Signal(Object fun, Object value)
+        : fun(std::move(fun)), value(std::move(value)) {}
+    inline static std::atomic<std::uint64_t> epoch{1};
+    Object fun;
+    Object value;
+    std::uint64_t version = 0;
+    std::uint64_t checkedEpoch = 0;
+    bool updating = false;
+    std::vector<SceneCommand> commands;
+    std::vector<Dependency> dependencies;
+};
+
+inline bool IsTruthy(const Object& obj)
 {
-    switch (o.type) {
+    // Everything other than false and none counts as true
+    switch (obj.Type()) {
     case ObjectType::Boolean:
-        booleanVal = o.booleanVal;
-        break;
-    case ObjectType::CFunctionHandle:
-        cfunctionHandleVal = o.cfunctionHandleVal;
-        break;
-    case ObjectType::Integer:
-        integerVal = o.integerVal;
-        break;
-    case ObjectType::ListPtr:
-        new (&listPtrVal) ListPtr(o.listPtrVal);
-        break;
-    case ObjectType::SymbolHandle:
-        symbolHandleVal = o.symbolHandleVal;
-        break;
+        return obj.GetBooleanUnchecked();
+    case ObjectType::None:
+        return false;
+    default:
+        return true;
     }
 }
 
-inline Object& Object::operator=(const Object& o)
-{
-    if (type == ObjectType::ListPtr && o.type == ObjectType::ListPtr) {
-        listPtrVal = o.listPtrVal;
-        return *this;
-    }
+// Atoms and strings are identical if they have the same value, and other
+// heap objects if they are the same object. Floats are identical if they
+// have the same bit pattern, so that 0.0 and -0.0 are not, and a NaN is
+// identical to itself.
 
-    if (type == ObjectType::ListPtr) {
-        listPtrVal.~ListPtr();
+inline bool IdenticalObjects(const Object& a, const Object& b)
+{
+    if (a.Type() != b.Type()) {
+        return false;
     }
-
-    switch (o.type) {
+    switch (a.Type()) {
     case ObjectType::Boolean:
-        booleanVal = o.booleanVal;
-        break;
+        return a.GetBoolean() == b.GetBoolean();
     case ObjectType::CFunctionHandle:
-        cfunctionHandleVal = o.cfunctionHandleVal;
-        break;
+        return a.GetCFunctionHandle() == b.GetCFunctionHandle();
+    case ObjectType::ClosurePtr:
+        return a.GetClosurePtr() == b.GetClosurePtr();
+    case ObjectType::Error:
+        return a.GetError() == b.GetError();
+    case ObjectType::Float: {
+        double x = a.GetFloatUnchecked();
+        double y = b.GetFloatUnchecked();
+        return std::memcmp(&x, &y, sizeof(x)) == 0;
+    }
+    case ObjectType::HashMapPtr:
+        return a.GetHashMapPtr() == b.GetHashMapPtr();
     case ObjectType::Integer:
-        integerVal = o.integerVal;
-        break;
+        return a.GetInteger() == b.GetInteger();
     case ObjectType::ListPtr:
-        new (&listPtrVal) ListPtr(o.listPtrVal);
-        break;
+        return a.GetListPtr() == b.GetListPtr();
+    case ObjectType::LocalRef:
+        return a.GetLocalRef().captured == b.GetLocalRef().captured && a.GetLocalRef().slot == b.GetLocalRef().slot;
+    case ObjectType::MacroPtr:
+        return a.GetMacroPtr() == b.GetMacroPtr();
+    case ObjectType::None:
+        return true;
+    case ObjectType::NumericArrayPtr:
+        return a.GetNumericArrayPtr() == b.GetNumericArrayPtr();
+    case ObjectType::SequencePtr:
+        return a.GetSequencePtr() == b.GetSequencePtr();
+    case ObjectType::SignalPtr:
+        return a.GetSignalPtr() == b.GetSignalPtr();
+    case ObjectType::SpecialFormPtr:
+        return a.GetSpecialFormPtr() == b.GetSpecialFormPtr();
+    case ObjectType::StringPtr:
+        return a.GetStringPtr() == b.GetStringPtr() || a.GetStringPtr()->View() == b.GetStringPtr()->View();
     case ObjectType::SymbolHandle:
-        symbolHandleVal = o.symbolHandleVal;
-        break;
+        return a.GetSymbolHandle() == b.GetSymbolHandle();
+    case ObjectType::VectorPtr:
+        return a.GetVectorPtr() == b.GetVectorPtr();
+    default:
+        return false;
     }
-
-    type = o.type;
-    return *this;
 }
 
-inline Object::~Object()
+inline void Signal::AddDependency(const RefPtr<Signal>& signal)
 {
-    if (type == ObjectType::ListPtr) {
-        listPtrVal.~ListPtr();
+    // A signal read more than once is recorded once
+    for (const Dependency& dependency : dependencies) {
+        if (dependency.signal == signal) {
+            return;
+        }
     }
+    dependencies.push_back(Dependency{signal, signal->version});
 }
 
-inline Object Object::EmptyList()
+inline void Signal::SetValue(Object value)
 {
-    Object obj{ObjectType::ListPtr};
-    new (&obj.listPtrVal) ListPtr(nullptr);
-    return obj;
+    if (!IdenticalObjects(this->value, value)) {
+        this->value = std::move(value);
+        ++version;
+        epoch.fetch_add(1, std::memory_order_relaxed);
+    }
 }
 
-inline Object Object::MakeCFunctionHandle(CFunctionHandle handle)
+inline void Signal::SetComputed(Object value, std::vector<SceneCommand>& commands)
 {
-    Object obj{ObjectType::CFunctionHandle};
-    obj.cfunctionHandleVal = handle;
-    return obj;
+    // Takes the commands, leaving the previous ones in their place
+    if (!IdenticalObjects(this->value, value) || this->commands != commands) {
+        ++version;
+    }
+    this->value = std::move(value);
+    this->commands.swap(commands);
 }
 
-inline Object Object::MakeSymbolHandle(SymbolHandle handle)
+// Only Integers, SymbolHandles and Strings may be HashMap keys. String
+// keys are compared by their characters.
+
+inline bool IsHashMapKey(const Object& obj)
 {
-    Object obj{ObjectType::SymbolHandle};
-    obj.symbolHandleVal = handle;
-    return obj;
+    return obj.Type() == ObjectType::Integer || obj.Type() == ObjectType::SymbolHandle || obj.Type() == ObjectType::StringPtr;
 }
 
-inline Object Object::None()
+inline std::uint64_t MixHash(std::uint64_t x)
 {
-    return Object{ObjectType::None};
+    // Spreads consecutive values, such as symbol handles, across the low
+    // bits used to choose a slot
+    x *= 0x9e3779b97f4a7c15;
+    return x ^ (x >> 32);
 }
 
-inline ObjectType Object::Type() const
+// A mutable map from keys to Objects. Symbol keys, the common case for
+// parameter tables, are held in their own table keyed directly by
+// SymbolHandle, so their lookups do not dispatch on the key type.
+
+class HashMap : public RefCounted {
+public:
+    HashMap() = default;
+    ~HashMap()
+    {
+        HeapUsage::Freed(Size() * entryBytes);
+    }
+    const Object* Find(const Object& key) const;
+    void Insert(const Object& key, Object value);
+    bool Erase(const Object& key);
+    size_t Size() const
+    {
+        return symbolEntries.Size() + otherEntries.Size();
+    }
+    template <typename F>
+    void ForEach(F callback) const;
+
+private:
+    // The heap usage counted for each entry
+    static constexpr size_t entryBytes = 2 * sizeof(Object);
+    struct SymbolHash {
+        size_t operator()(SymbolHandle handle) const
+        {
+            return static_cast<size_t>(MixHash(handle));
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Object& key) const;
+    };
+    struct KeyEqual {
+        bool operator()(const Object& a, const Object& b) const;
+    };
+    OpenHashMap<SymbolHandle, Object, SymbolHash> symbolEntries;
+    OpenHashMap<Object, Object, KeyHash, KeyEqual> otherEntries;
+};
+
+inline ListPtr Cons(Object first, ListPtr rest)
 {
-    return type;
+    return ListPtr(new ListNode(std::move(first), std::move(rest)));
 }
 
-inline bool Object::GetBoolean() const
+inline ListNode::~ListNode()
 {
-    if (type != ObjectType::Boolean) {
-        throw BadObjectAccess{};
+    HeapUsage::Freed(sizeof(ListNode));
+    // Unlink the rest of the list one node at a time, so that freeing a
+    // long list does not recurse once per element
+    ListPtr next = std::move(rest);
+    while (next != nullptr && next.use_count() == 1) {
+        ListPtr after = std::move(next->rest);
+        next = std::move(after);
     }
-    return booleanVal;
 }
 
-inline CFunctionHandle Object::GetCFunctionHandle() const
+inline ListBlockPool::~ListBlockPool()
 {
-    if (type != ObjectType::CFunctionHandle) {
-        throw BadObjectAccess{};
+    destroyed = true;
+    for (size_t capacity = 0; capacity <= maxCapacity; ++capacity) {
+        for (size_t i = 0; i < counts[capacity]; ++i) {
+            ::operator delete(blocks[capacity][i]);
+        }
     }
-    return cfunctionHandleVal;
+}
+
+inline ListBlockPool* ListBlockPool::ForThread()
+{
+    if (destroyed) {
+        return nullptr;
+    }
+    static thread_local ListBlockPool pool;
+    return &pool;
+}
+
+inline void* ListBlockPool::Take(size_t capacity)
+{
+    // Returns a free block of capacity nodes, or null if there is none
+    if (capacity > maxCapacity || counts[capacity] == 0) {
+        return nullptr;
+    }
+    return blocks[capacity][--counts[capacity]];
+}
+
+inline bool ListBlockPool::Put(void* mem, size_t capacity)
+{
+    // Returns false if the block was not kept
+    if (capacity > maxCapacity || counts[capacity] == maxBlocks) {
+        return false;
+    }
+    blocks[capacity][counts[capacity]++] = mem;
+    return true;
+}
+
+inline ListBlock* ListBlock::Allocate(size_t capacity)
+{
+    ListBlockPool* pool = ListBlockPool::ForThread();
+    void* mem = pool != nullptr ? pool->Take(capacity) : nullptr;
+    if (mem == nullptr) {
+        mem = ::operator new(sizeof(ListBlock) + capacity * sizeof(ListNode));
+    }
+    return new (mem) ListBlock(capacity);
+}
+
+inline void ListBlock::Free(ListBlock* block)
+{
+    size_t capacity = block->capacity;
+    block->~ListBlock();
+    ListBlockPool* pool = ListBlockPool::ForThread();
+    if (pool == nullptr || !pool->Put(block, capacity)) {
+        ::operator delete(block);
+    }
+}
+
+inline void DeleteRefCounted(ListNode* node)
+{
+    ListBlock* block = node->block;
+    if (block == nullptr) {
+        delete node;
+        return;
+    }
+    node->~ListNode();
+    if (block->Release()) {
+        ListBlock::Free(block);
+    }
+}
+
+inline ListBuilder::ListBuilder(size_t capacity)
+    : block(nullptr), used(0), head(nullptr), last(nullptr)
+{
+    if (capacity > 0) {
+        block = ListBlock::Allocate(capacity);
+        block->AddRef();
+    }
+}
+
+inline ListBuilder::~ListBuilder()
+{
+    ReleaseBlock();
+}
+
+inline void ListBuilder::ReleaseBlock()
+{
+    // The nodes' references to the block are added in one step when the
+    // builder is done with it. Until then the nodes are kept alive by head.
+    if (block == nullptr) {
+        return;
+    }
+    if (used > 0) {
+        block->AddRefs(static_cast<long>(used));
+    }
+    if (block->Release()) {
+        ListBlock::Free(block);
+    }
+    block = nullptr;
+}
+
+inline void ListBuilder::Append(Object obj)
+{
+    ListNode* node;
+    if (block != nullptr && used < block->Capacity()) {
+        node = new (block->Slot(used++)) ListNode(std::move(obj), nullptr);
+        node->block = block;
+    }
+    else {
+        node = new ListNode(std::move(obj), nullptr);
+    }
+    ListPtr nodePtr(node);
+    if (last == nullptr) {
+        head = std::move(nodePtr);
+    }
+    else {
+        last->SetRest(std::move(nodePtr));
+    }
+    last = node;
+}
+
+inline ListPtr ListBuilder::Finish()
+{
+    ReleaseBlock();
+    last = nullptr;
+    return std::move(head);
+}
+
+inline SpecialFormPtr SpecialForm::MakeDefine(SymbolHandle name, Object value)
+{
+    SpecialFormPtr form(new SpecialForm(SpecialFormKind::Define));
+    form->operands = {Object::MakeSymbolHandle(name), std::move(value)};
+    return form;
+}
+
+inline SpecialFormPtr SpecialForm::MakeDefmacro(SymbolHandle name, Object expander)
+{
+    SpecialFormPtr form(new SpecialForm(SpecialFormKind::Defmacro));
+    form->operands = {Object::MakeSymbolHandle(name), std::move(expander)};
+    return form;
+}
+
+inline SpecialFormPtr SpecialForm::MakeDo(int frameSize,
+                                          std::vector<LocalBinding> bindings,
+                                          Object test,
+                                          ListPtr result,
+                                          ListPtr body)
+{
+    SpecialFormPtr form(new SpecialForm(SpecialFormKind::Do));
+    form->frameSize = frameSize;
+    form->bindings = std::move(bindings);
+    form->operands = {std::move(test), Object{std::move(result)}};
+    form->body = std::move(body);
+    return form;
+}
+
+inline SpecialFormPtr SpecialForm::MakeIf(Object test, Object then, Object otherwise)
+{
+    SpecialFormPtr form(new SpecialForm(SpecialFormKind::If));
+    form->operands = {std::move(test), std::move(then), std::move(otherwise)};
+    return form;
+}
+
+inline SpecialFormPtr SpecialForm::MakeLambda(int numParams,
+                                              int frameSize,
+                                              std::vector<Object> captures,
+                                              ListPtr body)
+{
+    SpecialFormPtr form(new SpecialForm(SpecialFormKind::Lambda));
+    form->numParams = numParams;
+    form->frameSize = frameSize;
+    form->captures = std::move(captures);
+    form->body = std::move(body);
+    return form;
+}
+
+inline SpecialFormPtr SpecialForm::MakeLet(int frameSize,
+                                           std::vector<LocalBinding> bindings,
+                                           ListPtr body)
+{
+    SpecialFormPtr form(new SpecialForm(SpecialFormKind::Let));
+    form->frameSize = frameSize;
+    form->bindings = std::move(bindings);
+    form->body = std::move(body);
+    return form;
+}
+
+inline SpecialFormPtr SpecialForm::MakeQuote(Object datum)
+{
+    SpecialFormPtr form(new SpecialForm(SpecialFormKind::Quote));
+    form->operands = {std::move(datum)};
+    return form;
+}
+
+inline SequencePtr Sequence::MakeFilter(Object fun, Object source)
+{
+    return SequencePtr(new Sequence(SequenceKind::Filter, std::move(fun), std::move(source), Object::None(), Object::None(), Object::None(), 0));
+}
+
+inline SequencePtr Sequence::MakeMap(Object fun, Object source)
+{
+    return SequencePtr(new Sequence(SequenceKind::Map, std::move(fun), std::move(source), Object::None(), Object::None(), Object::None(), 0));
+}
+
+inline SequencePtr Sequence::MakeRange(Object start, Object stop, Object step)
+{
+    return SequencePtr(new Sequence(SequenceKind::Range, Object::None(), Object::None(), std::move(start), std::move(stop), std::move(step), 0));
+}
+
+inline SequencePtr Sequence::MakeTake(int count, Object source)
+{
+    return SequencePtr(new Sequence(SequenceKind::Take, Object::None(), std::move(source), Object::None(), Object::None(), Object::None(), count));
+}
+
+inline Object::Object(bool val)
+    : type(ObjectType::Boolean), booleanVal(val) {}
+
+inline Object::Object(int val)
+    : type(ObjectType::Integer), integerVal(val) {}
+
+inline Object::Object(double val)
+    : type(ObjectType::Float), floatVal(val) {}
+
+inline Object::Object(ClosurePtr val)
+    : type(ObjectType::ClosurePtr), closurePtrVal(std::move(val)) {}
+
+inline Object::Object(HashMapPtr val)
+    : type(ObjectType::HashMapPtr), hashMapPtrVal(std::move(val)) {}
+
+inline Object::Object(ListPtr val)
+    : type(ObjectType::ListPtr), listPtrVal(std::move(val)) {}
+
+inline Object::Object(MacroPtr val)
+    : type(ObjectType::MacroPtr), macroPtrVal(std::move(val)) {}
+
+inline Object::Object(NumericArrayPtr val)
+    : type(ObjectType::NumericArrayPtr), numericArrayPtrVal(std::move(val)) {}
+
+inline Object::Object(SequencePtr val)
+    : type(ObjectType::SequencePtr), sequencePtrVal(std::move(val)) {}
+
+inline Object::Object(SignalPtr val)
+    : type(ObjectType::SignalPtr), signalPtrVal(std::move(val)) {}
+
+inline Object::Object(SpecialFormPtr val)
+    : type(ObjectType::SpecialFormPtr), specialFormPtrVal(std::move(val)) {}
+
+inline Object::Object(StringPtr val)
+    : type(ObjectType::StringPtr), stringPtrVal(std::move(val)) {}
+
+inline Object::Object(VectorPtr val)
+    : type(ObjectType::VectorPtr), vectorPtrVal(std::move(val)) {}
+
+inline Object::Object(const Object& o)
+    : type(o.type)
+{
+    CopyValue(o);
+}
+
+inline Object::Object(Object&& o) noexcept
+    : type(o.type)
+{
+    MoveValue(o);
+}
+
+inline Object& Object::operator=(const Object& o)
+{
+    // Copy first, as o may be owned by the value being replaced
+    Object copy{o};
+    *this = std::move(copy);
+    return *this;
+}
+
+inline Object& Object::operator=(Object&& o) noexcept
+{
+    if (this == &o) {
+        return *this;
+    }
+
+    // Take o first, as it may be owned by the value being replaced
+    Object taken{ObjectType::None};
+    taken.type = o.type;
+    taken.MoveValue(o);
+
+    DestroyValue();
+    type = taken.type;
+    MoveValue(taken);
+    return *this;
+}
+
+inline Object::~Object()
+{
+    DestroyValue();
+}
+
+inline void Object::CopyValue(const Object& o)
+{
+    switch (o.type) {
+    case ObjectType::Boolean:
+        booleanVal = o.booleanVal;
+        break;
+    case ObjectType::CFunctionHandle:
+        cfunctionHandleVal = o.cfunctionHandleVal;
+        break;
+    case ObjectType::ClosurePtr:
+        new (&closurePtrVal) ClosurePtr(o.closurePtrVal);
+        break;
+    case ObjectType::Error:
+        errorVal = o.errorVal;
+        break;
+    case ObjectType::Float:
+        floatVal = o.floatVal;
+        break;
+    case ObjectType::HashMapPtr:
+        new (&hashMapPtrVal) HashMapPtr(o.hashMapPtrVal);
+        break;
+    case ObjectType::Integer:
+        integerVal = o.integerVal;
+        break;
+    case ObjectType::ListPtr:
+        new (&listPtrVal) ListPtr(o.listPtrVal);
+        break;
+    case ObjectType::LocalRef:
+        localRefVal = o.localRefVal;
+        break;
+    case ObjectType::MacroPtr:
+        new (&macroPtrVal) MacroPtr(o.macroPtrVal);
+        break;
+    case ObjectType::NumericArrayPtr:
+        new (&numericArrayPtrVal) NumericArrayPtr(o.numericArrayPtrVal);
+        break;
+    case ObjectType::SequencePtr:
+        new (&sequencePtrVal) SequencePtr(o.sequencePtrVal);
+        break;
+    case ObjectType::SignalPtr:
+        new (&signalPtrVal) SignalPtr(o.signalPtrVal);
+        break;
+    case ObjectType::SpecialFormPtr:
+        new (&specialFormPtrVal) SpecialFormPtr(o.specialFormPtrVal);
+        break;
+    case ObjectType::StringPtr:
+        new (&stringPtrVal) StringPtr(o.stringPtrVal);
+        break;
+    case ObjectType::SymbolHandle:
+        symbolHandleVal = o.symbolHandleVal;
+        break;
+    case ObjectType::VectorPtr:
+        new (&vectorPtrVal) VectorPtr(o.vectorPtrVal);
+        break;
+    }
+}
+
+inline void Object::MoveValue(Object& o)
+{
+    switch (o.type) {
+    case ObjectType::ClosurePtr:
+        new (&closurePtrVal) ClosurePtr(std::move(o.closurePtrVal));
+        break;
+    case ObjectType::HashMapPtr:
+        new (&hashMapPtrVal) HashMapPtr(std::move(o.hashMapPtrVal));
+        break;
+    case ObjectType::ListPtr:
+        new (&listPtrVal) ListPtr(std::move(o.listPtrVal));
+        break;
+    case ObjectType::MacroPtr:
+        new (&macroPtrVal) MacroPtr(std::move(o.macroPtrVal));
+        break;
+    case ObjectType::NumericArrayPtr:
+        new (&numericArrayPtrVal) NumericArrayPtr(std::move(o.numericArrayPtrVal));
+        break;
+    case ObjectType::SequencePtr:
+        new (&sequencePtrVal) SequencePtr(std::move(o.sequencePtrVal));
+        break;
+    case ObjectType::SignalPtr:
+        new (&signalPtrVal) SignalPtr(std::move(o.signalPtrVal));
+        break;
+    case ObjectType::SpecialFormPtr:
+        new (&specialFormPtrVal) SpecialFormPtr(std::move(o.specialFormPtrVal));
+        break;
+    case ObjectType::StringPtr:
+        new (&stringPtrVal) StringPtr(std::move(o.stringPtrVal));
+        break;
+    case ObjectType::VectorPtr:
+        new (&vectorPtrVal) VectorPtr(std::move(o.vectorPtrVal));
+        break;
+    default:
+        CopyValue(o);
+        break;
+    }
+}
+
+inline void Object::DestroyValue()
+{
+    switch (type) {
+    case ObjectType::ClosurePtr:
+        closurePtrVal.~ClosurePtr();
+        break;
+    case ObjectType::HashMapPtr:
+        hashMapPtrVal.~HashMapPtr();
+        break;
+    case ObjectType::ListPtr:
+        listPtrVal.~ListPtr();
+        break;
+    case ObjectType::MacroPtr:
+        macroPtrVal.~MacroPtr();
+        break;
+    case ObjectType::NumericArrayPtr:
+        numericArrayPtrVal.~NumericArrayPtr();
+        break;
+    case ObjectType::SequencePtr:
+        sequencePtrVal.~SequencePtr();
+        break;
+    case ObjectType::SignalPtr:
+        signalPtrVal.~SignalPtr();
+        break;
+    case ObjectType::SpecialFormPtr:
+        specialFormPtrVal.~SpecialFormPtr();
+        break;
+    case ObjectType::StringPtr:
+        stringPtrVal.~StringPtr();
+        break;
+    case ObjectType::VectorPtr:
+        vectorPtrVal.~VectorPtr();
+        break;
+    default:
+        break;
+    }
+}
+
+inline Object Object::EmptyList()
+{
+    Object obj{ObjectType::ListPtr};
+    new (&obj.listPtrVal) ListPtr(nullptr);
+    return obj;
+}
+
+inline Object Object::MakeCFunctionHandle(CFunctionHandle handle)
+{
+    Object obj{ObjectType::CFunctionHandle};
+    obj.cfunctionHandleVal = handle;
+    return obj;
+}
+
+inline Object Object::MakeError(ErrorKind kind)
+{
+    Object obj{ObjectType::Error};
+    obj.errorVal = kind;
+    return obj;
+}
+
+inline Object Object::MakeLocalRef(LocalRef ref)
+{
+    Object obj{ObjectType::LocalRef};
+    obj.localRefVal = ref;
+    return obj;
+}
+
+inline Object Object::MakeSymbolHandle(SymbolHandle handle)
+{
+    Object obj{ObjectType::SymbolHandle};
+    obj.symbolHandleVal = handle;
+    return obj;
+}
+
+inline Object Object::None()
+{
+    return Object{ObjectType::None};
+}
+
+inline ObjectType Object::Type() const
+{
+    return type;
+}
+
+inline bool Object::GetBoolean() const
+{
+    if (type != ObjectType::Boolean) {
+        throw BadObjectAccess{};
+    }
+    return booleanVal;
+}
+
+inline CFunctionHandle Object::GetCFunctionHandle() const
+{
+    if (type != ObjectType::CFunctionHandle) {
+        throw BadObjectAccess{};
+    }
+    return cfunctionHandleVal;
+}
+
+inline ErrorKind Object::GetError() const
+{
+    if (type != ObjectType::Error) {
+        throw BadObjectAccess{};
+    }
+    return errorVal;
+}
+
+inline double Object::GetFloat() const
+{
+    if (type != ObjectType::Float) {
+        throw BadObjectAccess{};
+    }
+    return floatVal;
+}
+
+inline const ClosurePtr& Object::GetClosurePtr() const
+{
+    if (type != ObjectType::ClosurePtr) {
+        throw BadObjectAccess{};
+    }
+    return closurePtrVal;
+}
+
+inline const HashMapPtr& Object::GetHashMapPtr() const
+{
+    if (type != ObjectType::HashMapPtr) {
+        throw BadObjectAccess{};
+    }
+    return hashMapPtrVal;
 }
 
 inline int Object::GetInteger() const
@@ -231,7 +1381,7 @@ inline int Object::GetInteger() const
     return integerVal;
 }
 
-inline ListPtr Object::GetListPtr() const
+inline const ListPtr& Object::GetListPtr() const
 {
     if (type != ObjectType::ListPtr) {
         throw BadObjectAccess{};
@@ -239,6 +1389,62 @@ inline ListPtr Object::GetListPtr() const
     return listPtrVal;
 }
 
+inline LocalRef Object::GetLocalRef() const
+{
+    if (type != ObjectType::LocalRef) {
+        throw BadObjectAccess{};
+    }
+    return localRefVal;
+}
+
+inline const MacroPtr& Object::GetMacroPtr() const
+{
+    if (type != ObjectType::MacroPtr) {
+        throw BadObjectAccess{};
+    }
+    return macroPtrVal;
+}
+
+inline const NumericArrayPtr& Object::GetNumericArrayPtr() const
+{
+    if (type != ObjectType::NumericArrayPtr) {
+        throw BadObjectAccess{};
+    }
+    return numericArrayPtrVal;
+}
+
+inline const SequencePtr& Object::GetSequencePtr() const
+{
+    if (type != ObjectType::SequencePtr) {
+        throw BadObjectAccess{};
+    }
+    return sequencePtrVal;
+}
+
+inline const SignalPtr& Object::GetSignalPtr() const
+{
+    if (type != ObjectType::SignalPtr) {
+        throw BadObjectAccess{};
+    }
+    return signalPtrVal;
+}
+
+inline const SpecialFormPtr& Object::GetSpecialFormPtr() const
+{
+    if (type != ObjectType::SpecialFormPtr) {
+        throw BadObjectAccess{};
+    }
+    return specialFormPtrVal;
+}
+
+inline const StringPtr& Object::GetStringPtr() const
+{
+    if (type != ObjectType::StringPtr) {
+        throw BadObjectAccess{};
+    }
+    return stringPtrVal;
+}
+
 inline SymbolHandle Object::GetSymbolHandle() const
 {
     if (type != ObjectType::SymbolHandle) {
@@ -247,6 +1453,273 @@ inline SymbolHandle Object::GetSymbolHandle() const
     return symbolHandleVal;
 }
 
+inline const VectorPtr& Object::GetVectorPtr() const
+{
+    if (type != ObjectType::VectorPtr) {
+        throw BadObjectAccess{};
+    }
+    return vectorPtrVal;
+}
+
+inline std::optional<bool> Object::TryGetBoolean() const
+{
+    if (type != ObjectType::Boolean) {
+        return std::nullopt;
+    }
+    return booleanVal;
+}
+
+inline std::optional<CFunctionHandle> Object::TryGetCFunctionHandle() const
+{
+    if (type != ObjectType::CFunctionHandle) {
+        return std::nullopt;
+    }
+    return cfunctionHandleVal;
+}
+
+inline std::optional<double> Object::TryGetFloat() const
+{
+    if (type != ObjectType::Float) {
+        return std::nullopt;
+    }
+    return floatVal;
+}
+
+inline const ClosurePtr* Object::TryGetClosurePtr() const
+{
+    if (type != ObjectType::ClosurePtr) {
+        return nullptr;
+    }
+    return &closurePtrVal;
+}
+
+inline const HashMapPtr* Object::TryGetHashMapPtr() const
+{
+    if (type != ObjectType::HashMapPtr) {
+        return nullptr;
+    }
+    return &hashMapPtrVal;
+}
+
+inline std::optional<int> Object::TryGetInteger() const
+{
+    if (type != ObjectType::Integer) {
+        return std::nullopt;
+    }
+    return integerVal;
+}
+
+inline const ListPtr* Object::TryGetListPtr() const
+{
+    if (type != ObjectType::ListPtr) {
+        return nullptr;
+    }
+    return &listPtrVal;
+}
+
+inline std::optional<LocalRef> Object::TryGetLocalRef() const
+{
+    if (type != ObjectType::LocalRef) {
+        return std::nullopt;
+    }
+    return localRefVal;
+}
+
+inline const MacroPtr* Object::TryGetMacroPtr() const
+{
+    if (type != ObjectType::MacroPtr) {
+        return nullptr;
+    }
+    return &macroPtrVal;
+}
+
+inline const NumericArrayPtr* Object::TryGetNumericArrayPtr() const
+{
+    if (type != ObjectType::NumericArrayPtr) {
+        return nullptr;
+    }
+    return &numericArrayPtrVal;
+}
+
+inline const SequencePtr* Object::TryGetSequencePtr() const
+{
+    if (type != ObjectType::SequencePtr) {
+        return nullptr;
+    }
+    return &sequencePtrVal;
+}
+
+inline const SignalPtr* Object::TryGetSignalPtr() const
+{
+    if (type != ObjectType::SignalPtr) {
+        return nullptr;
+    }
+    return &signalPtrVal;
+}
+
+inline const SpecialFormPtr* Object::TryGetSpecialFormPtr() const
+{
+    if (type != ObjectType::SpecialFormPtr) {
+        return nullptr;
+    }
+    return &specialFormPtrVal;
+}
+
+inline const StringPtr* Object::TryGetStringPtr() const
+{
+    if (type != ObjectType::StringPtr) {
+        return nullptr;
+    }
+    return &stringPtrVal;
+}
+
+inline std::optional<SymbolHandle> Object::TryGetSymbolHandle() const
+{
+    if (type != ObjectType::SymbolHandle) {
+        return std::nullopt;
+    }
+    return symbolHandleVal;
+}
+
+inline const VectorPtr* Object::TryGetVectorPtr() const
+{
+    if (type != ObjectType::VectorPtr) {
+        return nullptr;
+    }
+    return &vectorPtrVal;
+}
+
+inline bool Object::GetBooleanUnchecked() const
+{
+    return booleanVal;
+}
+
+inline double Object::GetFloatUnchecked() const
+{
+    return floatVal;
+}
+
+inline const ClosurePtr& Object::GetClosurePtrUnchecked() const
+{
+    return closurePtrVal;
+}
+
+inline const HashMapPtr& Object::GetHashMapPtrUnchecked() const
+{
+    return hashMapPtrVal;
+}
+
+inline int Object::GetIntegerUnchecked() const
+{
+    return integerVal;
+}
+
+inline const ListPtr& Object::GetListPtrUnchecked() const
+{
+    return listPtrVal;
+}
+
+inline LocalRef Object::GetLocalRefUnchecked() const
+{
+    return localRefVal;
+}
+
+inline const MacroPtr& Object::GetMacroPtrUnchecked() const
+{
+    return macroPtrVal;
+}
+
+inline const NumericArrayPtr& Object::GetNumericArrayPtrUnchecked() const
+{
+    return numericArrayPtrVal;
+}
+
+inline const SequencePtr& Object::GetSequencePtrUnchecked() const
+{
+    return sequencePtrVal;
+}
+
+inline const SignalPtr& Object::GetSignalPtrUnchecked() const
+{
+    return signalPtrVal;
+}
+
+inline const SpecialFormPtr& Object::GetSpecialFormPtrUnchecked() const
+{
+    return specialFormPtrVal;
+}
+
+inline const StringPtr& Object::GetStringPtrUnchecked() const
+{
+    return stringPtrVal;
+}
+
+inline const VectorPtr& Object::GetVectorPtrUnchecked() const
+{
+    return vectorPtrVal;
+}
+
+inline size_t HashMap::KeyHash::operator()(const Object& key) const
+{
+    if (key.Type() == ObjectType::StringPtr) {
+        return static_cast<size_t>(StringHash(key.GetStringPtrUnchecked()->View()));
+    }
+    return static_cast<size_t>(MixHash(static_cast<std::uint32_t>(key.GetIntegerUnchecked())));
+}
+
+inline bool HashMap::KeyEqual::operator()(const Object& a, const Object& b) const
+{
+    if (a.Type() != b.Type()) {
+        return false;
+    }
+    if (a.Type() == ObjectType::StringPtr) {
+        return a.GetStringPtrUnchecked()->View() == b.GetStringPtrUnchecked()->View();
+    }
+    return a.GetIntegerUnchecked() == b.GetIntegerUnchecked();
+}
+
+// Find, Insert and Erase require that key satisfies IsHashMapKey
+
+inline const Object* HashMap::Find(const Object& key) const
+{
+    if (key.Type() == ObjectType::SymbolHandle) {
+        return symbolEntries.Find(key.GetSymbolHandle());
+    }
+    return otherEntries.Find(key);
+}
+
+inline void HashMap::Insert(const Object& key, Object value)
+{
+    size_t oldSize = Size();
+    if (key.Type() == ObjectType::SymbolHandle) {
+        symbolEntries.Insert(key.GetSymbolHandle(), std::move(value));
+    }
+    else {
+        otherEntries.Insert(key, std::move(value));
+    }
+    HeapUsage::Allocated((Size() - oldSize) * entryBytes);
+}
+
+inline bool HashMap::Erase(const Object& key)
+{
+    bool erased = key.Type() == ObjectType::SymbolHandle ? symbolEntries.Erase(key.GetSymbolHandle())
+                                                         : otherEntries.Erase(key);
+    if (erased) {
+        HeapUsage::Freed(entryBytes);
+    }
+    return erased;
+}
+
+template <typename F>
+void HashMap::ForEach(F callback) const
+{
+    // Calls callback(key, value) for each entry, symbol keys first
+    symbolEntries.ForEach([&](SymbolHandle handle, const Object& value) {
+        callback(Object::MakeSymbolHandle(handle), value);
+    });
+    otherEntries.ForEach(callback);
+}
+
 } // namespace Procdraw
 
 #endif
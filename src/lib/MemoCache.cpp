@@ -0,0 +1,235 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "MemoCache.h"
+#include <cstring>
+#include <utility>
+
+namespace Procdraw {
+
+namespace {
+
+// The value of an atom as bits, or false if obj is not an atom
+bool AtomBits(const Object& obj, std::uint64_t* bits)
+{
+    switch (obj.Type()) {
+    case ObjectType::Boolean:
+        *bits = obj.GetBooleanUnchecked();
+        return true;
+    case ObjectType::CFunctionHandle:
+        *bits = obj.GetCFunctionHandle();
+        return true;
+    case ObjectType::ClosurePtr:
+        // Compared by identity. The cached args keep the closure alive,
+        // so its address is not reused while it is in the cache.
+        *bits = reinterpret_cast<std::uintptr_t>(obj.GetClosurePtrUnchecked().get());
+        return true;
+    case ObjectType::Float: {
+        // Compare bit patterns, so that 0.0 and -0.0 stay distinct
+        double val = obj.GetFloatUnchecked();
+        std::memcpy(bits, &val, sizeof(*bits));
+        return true;
+    }
+    case ObjectType::Integer:
+        *bits = static_cast<std::uint32_t>(obj.GetIntegerUnchecked());
+        return true;
+    case ObjectType::None:
+        *bits = 0;
+        return true;
+    case ObjectType::StringPtr:
+        // Compared by identity, like closures, so equal strings share
+        // entries only if they are interned
+        *bits = reinterpret_cast<std::uintptr_t>(obj.GetStringPtrUnchecked().get());
+        return true;
+    case ObjectType::SymbolHandle:
+        *bits = obj.GetSymbolHandle();
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool IsMutable(const Object& obj)
+{
+    switch (obj.Type()) {
+    case ObjectType::HashMapPtr:
+    case ObjectType::NumericArrayPtr:
+    case ObjectType::SignalPtr:
+    case ObjectType::VectorPtr:
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+MemoCache::MemoCache() = default;
+
+MemoCache::MemoCache(const MemoCache& other)
+    : pureFunctions(other.pureFunctions), capacity(other.capacity)
+{
+}
+
+bool MemoCache::CanCache(const ListPtr& args)
+{
+    std::uint64_t bits;
+    for (const ListNode* next = args.get(); next != nullptr; next = next->Rest().get()) {
+        if (!AtomBits(next->First(), &bits)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void MemoCache::Clear()
+{
+    index = OpenHashMap<Key, size_t, KeyHash, KeyEqual>();
+    entries.clear();
+    head = noEntry;
+    tail = noEntry;
+}
+
+MemoCache::Function MemoCache::FunctionKey(const Object& fun)
+{
+    std::uint64_t bits = 0;
+    AtomBits(fun, &bits);
+    return Function{fun.Type(), bits};
+}
+
+MemoCache::Key MemoCache::KeyOf(const Object& fun, const ListPtr& args)
+{
+    Function function = FunctionKey(fun);
+    std::uint64_t h = FunctionHash{}(function);
+    for (const ListNode* next = args.get(); next != nullptr; next = next->Rest().get()) {
+        std::uint64_t bits = 0;
+        AtomBits(next->First(), &bits);
+        h = MixHash(h ^ bits ^ (static_cast<std::uint64_t>(next->First().Type()) << 56));
+    }
+    return Key{function, args.get(), h};
+}
+
+bool MemoCache::KeyEqual::operator()(const Key& a, const Key& b) const
+{
+    if (a.hash != b.hash || !(a.fun == b.fun)) {
+        return false;
+    }
+    const ListNode* x = a.args;
+    const ListNode* y = b.args;
+    for (; x != nullptr && y != nullptr; x = x->Rest().get(), y = y->Rest().get()) {
+        std::uint64_t xBits = 0;
+        std::uint64_t yBits = 0;
+        AtomBits(x->First(), &xBits);
+        AtomBits(y->First(), &yBits);
+        if (x->First().Type() != y->First().Type() || xBits != yBits) {
+            return false;
+        }
+    }
+    return x == y;
+}
+
+const Object* MemoCache::Find(const Object& fun, const ListPtr& args)
+{
+    // Counts a hit or a miss, and makes a found entry the most recent
+    const size_t* i = index.Find(KeyOf(fun, args));
+    if (i == nullptr) {
+        ++misses;
+        return nullptr;
+    }
+    ++hits;
+    size_t found = *i;
+    Unlink(found);
+    PushFront(found);
+    return &entries[found].result;
+}
+
+void MemoCache::Insert(const Object& fun, const ListPtr& args, Object result)
+{
+    if (capacity == 0 || result.Type() == ObjectType::Error || IsMutable(result)) {
+        return;
+    }
+    Key key = KeyOf(fun, args);
+    if (const size_t* existing = index.Find(key)) {
+        entries[*existing].result = std::move(result);
+        return;
+    }
+    size_t i;
+    if (entries.size() < capacity) {
+        i = entries.size();
+        entries.push_back(Entry{fun, args, std::move(result), key, noEntry, noEntry});
+    }
+    else {
+        // Reuse the least recently used entry
+        i = tail;
+        Unlink(i);
+        index.Erase(entries[i].key);
+        entries[i] = Entry{fun, args, std::move(result), key, noEntry, noEntry};
+    }
+    index.Insert(key, i);
+    PushFront(i);
+}
+
+void MemoCache::PushFront(size_t i)
+{
+    entries[i].prev = noEntry;
+    entries[i].next = head;
+    if (head != noEntry) {
+        entries[head].prev = i;
+    }
+    head = i;
+    if (tail == noEntry) {
+        tail = i;
+    }
+}
+
+void MemoCache::SetCapacity(size_t capacity)
+{
+    Clear();
+    this->capacity = capacity;
+}
+
+void MemoCache::SetPure(const Object& fun, bool pure)
+{
+    if (pure) {
+        pureFunctions.Insert(FunctionKey(fun), fun);
+    }
+    else if (pureFunctions.Erase(FunctionKey(fun))) {
+        // Drop the results of the function's earlier calls
+        Clear();
+    }
+}
+
+MemoCache::Stats MemoCache::GetStats() const
+{
+    return Stats{hits, misses, entries.size(), capacity};
+}
+
+void MemoCache::Unlink(size_t i)
+{
+    Entry& entry = entries[i];
+    if (entry.prev != noEntry) {
+        entries[entry.prev].next = entry.next;
+    }
+    else {
+        head = entry.next;
+    }
+    if (entry.next != noEntry) {
+        entries[entry.next].prev = entry.prev;
+    }
+    else {
+        tail = entry.prev;
+    }
+}
+
+} // namespace Procdraw
@@ -0,0 +1,128 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROCDRAW_MEMOCACHE_H
+#define PROCDRAW_MEMOCACHE_H
+
+#include "InterpreterTypes.h"
+#include "OpenHashMap.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Procdraw {
+
+// Holds the results of calls to functions that have been marked as pure,
+// keyed by the function and its arguments, so that a repeated call
+// returns the earlier result without running the function.
+//
+// Only calls whose arguments are all atoms (booleans, numbers, none,
+// symbols and functions) or strings are cached, as the other types are
+// mutable or expensive to compare. Strings are keyed by address. Errors
+// and mutable results (hash maps, numeric arrays, signals and vectors)
+// are not cached.
+//
+// The number of entries is limited to the capacity set with
+// SetCapacity(), and the least recently used entry is evicted to make
+// room for a new one.
+
+class MemoCache {
+public:
+    struct Stats {
+        std::uint64_t hits;
+        std::uint64_t misses;
+        size_t size;
+        size_t capacity;
+    };
+
+    static constexpr size_t defaultCapacity = 4096;
+
+    MemoCache();
+    // A copy has the same pure functions and capacity, and no entries
+    MemoCache(const MemoCache& other);
+    MemoCache& operator=(const MemoCache&) = delete;
+    static bool CanCache(const ListPtr& args);
+    void Clear();
+    const Object* Find(const Object& fun, const ListPtr& args);
+    void Insert(const Object& fun, const ListPtr& args, Object result);
+    bool IsPure(const Object& fun) const
+    {
+        return pureFunctions.Find(FunctionKey(fun)) != nullptr;
+    }
+    void SetCapacity(size_t capacity);
+    void SetPure(const Object& fun, bool pure);
+    Stats GetStats() const;
+
+private:
+    // Functions are keyed by type and handle or address
+    struct Function {
+        ObjectType type;
+        std::uint64_t bits;
+        bool operator==(const Function& other) const
+        {
+            return type == other.type && bits == other.bits;
+        }
+    };
+    struct FunctionHash {
+        size_t operator()(const Function& fun) const
+        {
+            return static_cast<size_t>(MixHash(fun.bits ^ static_cast<std::uint64_t>(fun.type)));
+        }
+    };
+    // The args of a key are compared element by element, so that a call
+    // can be looked up without copying its args
+    struct Key {
+        Function fun;
+        const ListNode* args;
+        std::uint64_t hash;
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const
+        {
+            return static_cast<size_t>(key.hash);
+        }
+    };
+    struct KeyEqual {
+        bool operator()(const Key& a, const Key& b) const;
+    };
+    // Entries are linked in order of use, most recent first
+    struct Entry {
+        Object fun;
+        ListPtr args;
+        Object result;
+        Key key;
+        size_t prev;
+        size_t next;
+    };
+
+    static constexpr size_t noEntry = SIZE_MAX;
+
+    OpenHashMap<Function, Object, FunctionHash> pureFunctions;
+    OpenHashMap<Key, size_t, KeyHash, KeyEqual> index;
+    std::vector<Entry> entries;
+    size_t head = noEntry;
+    size_t tail = noEntry;
+    size_t capacity = defaultCapacity;
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+
+    static Function FunctionKey(const Object& fun);
+    static Key KeyOf(const Object& fun, const ListPtr& args);
+    void Unlink(size_t i);
+    void PushFront(size_t i);
+};
+
+} // namespace Procdraw
+
+#endif
@@ -0,0 +1,324 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "NumericArray.h"
+#include "HeapUsage.h"
+#include "ProcdrawMath.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <initializer_list>
+#include <new>
+#include <type_traits>
+
+// The elementwise kernels are plain loops over contiguous, aligned data
+// with no calls or branches on the array type inside the loop, so that
+// the compiler can vectorise them. A separate loop is instantiated for
+// each combination of array and scalar operands.
+
+namespace Procdraw {
+
+NumericArray::NumericArray(NumericArrayType type, size_t size)
+    : type(type), size(size)
+{
+    static_assert(sizeof(float) == sizeof(std::int32_t));
+    size_t bytes = std::max(size, size_t{1}) * sizeof(float);
+    data = ::operator new(bytes, std::align_val_t{alignment});
+    std::memset(data, 0, bytes);
+    HeapUsage::Allocated(bytes);
+}
+
+NumericArray::~NumericArray()
+{
+    HeapUsage::Freed(std::max(size, size_t{1}) * sizeof(float));
+    ::operator delete(data, std::align_val_t{alignment});
+}
+
+namespace {
+
+template <typename T>
+const T* Elements(const NumericArray& array)
+{
+    if constexpr (std::is_same_v<T, float>) {
+        return array.Float32Data();
+    }
+    else {
+        return array.Int32Data();
+    }
+}
+
+template <typename T>
+T* Elements(NumericArray& array)
+{
+    if constexpr (std::is_same_v<T, float>) {
+        return array.Float32Data();
+    }
+    else {
+        return array.Int32Data();
+    }
+}
+
+template <typename T>
+constexpr NumericArrayType ElementType()
+{
+    return std::is_same_v<T, float> ? NumericArrayType::Float32 : NumericArrayType::Int32;
+}
+
+template <typename T>
+struct ArrayInput {
+    const T* data;
+    T operator[](size_t i) const
+    {
+        return data[i];
+    }
+};
+
+template <typename T>
+struct ScalarInput {
+    T value;
+    T operator[](size_t) const
+    {
+        return value;
+    }
+};
+
+template <typename T, typename F, typename... Inputs>
+void RunKernel(T* out, size_t n, const F& f, const Inputs&... inputs)
+{
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = f(inputs[i]...);
+    }
+}
+
+template <typename T, size_t I, size_t N, typename F, typename... Inputs>
+void Dispatch(T* out,
+              size_t n,
+              const F& f,
+              const std::array<NumericOperand, N>& operands,
+              const Inputs&... inputs)
+{
+    if constexpr (I == N) {
+        RunKernel(out, n, f, inputs...);
+    }
+    else {
+        const NumericArray* array = operands[I].Array();
+        if (array != nullptr) {
+            Dispatch<T, I + 1, N>(out, n, f, operands, inputs..., ArrayInput<T>{Elements<T>(*array)});
+        }
+        else {
+            Dispatch<T, I + 1, N>(out, n, f, operands, inputs..., ScalarInput<T>{static_cast<T>(operands[I].Scalar())});
+        }
+    }
+}
+
+NumericArrayPtr ToFloat32(const NumericArray& array)
+{
+    NumericArrayPtr result(new NumericArray(NumericArrayType::Float32, array.Size()));
+    const std::int32_t* in = array.Int32Data();
+    float* out = result->Float32Data();
+    for (size_t i = 0; i < array.Size(); ++i) {
+        out[i] = static_cast<float>(in[i]);
+    }
+    return result;
+}
+
+template <typename T, size_t N, typename F>
+NumericArrayPtr Elementwise(std::array<NumericOperand, N> operands, NumericArrayPtr reuse, const F& f)
+{
+    constexpr NumericArrayType resultType = ElementType<T>();
+    size_t n = 0;
+    // Holds Int32 operands converted for a Float32 result
+    std::array<NumericArrayPtr, N> converted;
+    for (size_t i = 0; i < N; ++i) {
+        const NumericArray* array = operands[i].Array();
+        if (array != nullptr) {
+            n = array->Size();
+            if (array->Type() != resultType) {
+                converted[i] = ToFloat32(*array);
+                operands[i] = NumericOperand(converted[i].get());
+            }
+        }
+    }
+    NumericArrayPtr result = std::move(reuse);
+    if (!result || result->Type() != resultType || result->Size() != n) {
+        result = NumericArrayPtr(new NumericArray(resultType, n));
+    }
+    Dispatch<T, 0, N>(Elements<T>(*result), n, f, operands);
+    return result;
+}
+
+bool AllIntegers(std::initializer_list<const NumericOperand*> operands)
+{
+    return std::all_of(operands.begin(), operands.end(), [](const NumericOperand* op) {
+        return op->IsInteger();
+    });
+}
+
+// Signed overflow wraps rather than being undefined behaviour
+
+std::int32_t WrappingAdd(std::int32_t a, std::int32_t b)
+{
+    return static_cast<std::int32_t>(static_cast<std::uint32_t>(a) + static_cast<std::uint32_t>(b));
+}
+
+std::int32_t WrappingMultiply(std::int32_t a, std::int32_t b)
+{
+    return static_cast<std::int32_t>(static_cast<std::uint32_t>(a) * static_cast<std::uint32_t>(b));
+}
+
+// The reductions keep several independent accumulators so that the loop
+// carried dependency does not prevent vectorisation
+
+constexpr size_t reductionLanes = 8;
+
+template <typename T>
+double SumOf(const T* data, size_t n)
+{
+    double partial[reductionLanes] = {};
+    size_t i = 0;
+    for (; i + reductionLanes <= n; i += reductionLanes) {
+        for (size_t lane = 0; lane < reductionLanes; ++lane) {
+            partial[lane] += data[i + lane];
+        }
+    }
+    double sum = 0.0;
+    for (size_t lane = 0; lane < reductionLanes; ++lane) {
+        sum += partial[lane];
+    }
+    for (; i < n; ++i) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+template <typename T, typename F>
+T Reduce(const T* data, size_t n, const F& f)
+{
+    T partial[reductionLanes];
+    std::fill(partial, partial + reductionLanes, data[0]);
+    size_t i = 0;
+    for (; i + reductionLanes <= n; i += reductionLanes) {
+        for (size_t lane = 0; lane < reductionLanes; ++lane) {
+            partial[lane] = f(partial[lane], data[i + lane]);
+        }
+    }
+    T result = partial[0];
+    for (size_t lane = 1; lane < reductionLanes; ++lane) {
+        result = f(result, partial[lane]);
+    }
+    for (; i < n; ++i) {
+        result = f(result, data[i]);
+    }
+    return result;
+}
+
+template <typename F>
+double ReduceArray(const NumericArray& array, const F& f)
+{
+    if (array.Type() == NumericArrayType::Float32) {
+        return Reduce(array.Float32Data(), array.Size(), f);
+    }
+    return Reduce(array.Int32Data(), array.Size(), f);
+}
+
+} // namespace
+
+NumericArrayPtr ArrayAdd(const NumericOperand& a,
+                         const NumericOperand& b,
+                         NumericArrayPtr reuse)
+{
+    if (AllIntegers({&a, &b})) {
+        return Elementwise<std::int32_t, 2>({a, b}, std::move(reuse), [](std::int32_t x, std::int32_t y) {
+            return WrappingAdd(x, y);
+        });
+    }
+    return Elementwise<float, 2>({a, b}, std::move(reuse), [](float x, float y) {
+        return x + y;
+    });
+}
+
+NumericArrayPtr ArrayClamp(const NumericOperand& val,
+                           const NumericOperand& lower,
+                           const NumericOperand& upper,
+                           NumericArrayPtr reuse)
+{
+    if (AllIntegers({&val, &lower, &upper})) {
+        return Elementwise<std::int32_t, 3>({val, lower, upper}, std::move(reuse), [](std::int32_t v, std::int32_t lo, std::int32_t hi) {
+            return Clamp(v, lo, hi);
+        });
+    }
+    return Elementwise<float, 3>({val, lower, upper}, std::move(reuse), [](float v, float lo, float hi) {
+        return Clamp(v, lo, hi);
+    });
+}
+
+NumericArrayPtr ArrayLerp(const NumericOperand& start,
+                          const NumericOperand& stop,
+                          const NumericOperand& val,
+                          NumericArrayPtr reuse)
+{
+    return Elementwise<float, 3>({start, stop, val}, std::move(reuse), [](float a, float b, float v) {
+        return Lerp(a, b, v);
+    });
+}
+
+NumericArrayPtr ArrayMapRange(const NumericOperand& start1,
+                              const NumericOperand& stop1,
+                              const NumericOperand& start2,
+                              const NumericOperand& stop2,
+                              const NumericOperand& val,
+                              NumericArrayPtr reuse)
+{
+    return Elementwise<float, 5>({start1, stop1, start2, stop2, val}, std::move(reuse), [](float a1, float b1, float a2, float b2, float v) {
+        return MapRange(a1, b1, a2, b2, v);
+    });
+}
+
+NumericArrayPtr ArrayMultiply(const NumericOperand& a,
+                              const NumericOperand& b,
+                              NumericArrayPtr reuse)
+{
+    if (AllIntegers({&a, &b})) {
+        return Elementwise<std::int32_t, 2>({a, b}, std::move(reuse), [](std::int32_t x, std::int32_t y) {
+            return WrappingMultiply(x, y);
+        });
+    }
+    return Elementwise<float, 2>({a, b}, std::move(reuse), [](float x, float y) {
+        return x * y;
+    });
+}
+
+double ArrayMax(const NumericArray& array)
+{
+    return ReduceArray(array, [](auto x, auto y) {
+        return x > y ? x : y;
+    });
+}
+
+double ArrayMin(const NumericArray& array)
+{
+    return ReduceArray(array, [](auto x, auto y) {
+        return x < y ? x : y;
+    });
+}
+
+double ArraySum(const NumericArray& array)
+{
+    if (array.Type() == NumericArrayType::Float32) {
+        return SumOf(array.Float32Data(), array.Size());
+    }
+    return SumOf(array.Int32Data(), array.Size());
+}
+
+} // namespace Procdraw
@@ -0,0 +1,137 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROCDRAW_NUMERICARRAY_H
+#define PROCDRAW_NUMERICARRAY_H
+
+#include "RefPtr.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace Procdraw {
+
+enum class NumericArrayType {
+    Float32,
+    Int32
+};
+
+// A fixed size array of float32 or int32 elements, stored contiguously
+// and aligned for SIMD loads.
+
+class NumericArray : public RefCounted {
+public:
+    static constexpr size_t alignment = 32;
+    NumericArray(NumericArrayType type, size_t size);
+    ~NumericArray();
+    NumericArrayType Type() const
+    {
+        return type;
+    }
+    size_t Size() const
+    {
+        return size;
+    }
+    float* Float32Data()
+    {
+        return static_cast<float*>(data);
+    }
+    const float* Float32Data() const
+    {
+        return static_cast<const float*>(data);
+    }
+    std::int32_t* Int32Data()
+    {
+        return static_cast<std::int32_t*>(data);
+    }
+    const std::int32_t* Int32Data() const
+    {
+        return static_cast<const std::int32_t*>(data);
+    }
+
+private:
+    NumericArrayType type;
+    size_t size;
+    void* data;
+};
+
+using NumericArrayPtr = RefPtr<NumericArray>;
+
+// An argument to an elementwise operation: either an array, or a scalar
+// that is broadcast across all elements.
+
+class NumericOperand {
+public:
+    NumericOperand(const NumericArray* array)
+        : array(array), scalar(0.0), isInteger(array->Type() == NumericArrayType::Int32) {}
+    NumericOperand(int scalar)
+        : array(nullptr), scalar(scalar), isInteger(true) {}
+    NumericOperand(double scalar)
+        : array(nullptr), scalar(scalar), isInteger(false) {}
+    const NumericArray* Array() const
+    {
+        return array;
+    }
+    double Scalar() const
+    {
+        return scalar;
+    }
+    bool IsInteger() const
+    {
+        return isInteger;
+    }
+
+private:
+    const NumericArray* array;
+    double scalar;
+    bool isInteger;
+};
+
+// Elementwise operations. All array operands must have the same size,
+// and at least one operand must be an array. The result is Int32 when
+// the operation is closed over integers and all operands are integers,
+// and Float32 otherwise. If reuse is not null, and has the size and type
+// of the result, it is used for the result rather than allocating a new
+// array.
+
+NumericArrayPtr ArrayAdd(const NumericOperand& a,
+                         const NumericOperand& b,
+                         NumericArrayPtr reuse);
+NumericArrayPtr ArrayClamp(const NumericOperand& val,
+                           const NumericOperand& lower,
+                           const NumericOperand& upper,
+                           NumericArrayPtr reuse);
+NumericArrayPtr ArrayLerp(const NumericOperand& start,
+                          const NumericOperand& stop,
+                          const NumericOperand& val,
+                          NumericArrayPtr reuse);
+NumericArrayPtr ArrayMapRange(const NumericOperand& start1,
+                              const NumericOperand& stop1,
+                              const NumericOperand& start2,
+                              const NumericOperand& stop2,
+                              const NumericOperand& val,
+                              NumericArrayPtr reuse);
+NumericArrayPtr ArrayMultiply(const NumericOperand& a,
+                              const NumericOperand& b,
+                              NumericArrayPtr reuse);
+
+// Reductions over all elements. ArrayMax and ArrayMin require a
+// non-empty array.
+
+double ArrayMax(const NumericArray& array);
+double ArrayMin(const NumericArray& array);
+double ArraySum(const NumericArray& array);
+
+} // namespace Procdraw
+
+#endif
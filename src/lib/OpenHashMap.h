@@ -0,0 +1,176 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROCDRAW_OPENHASHMAP_H
+#define PROCDRAW_OPENHASHMAP_H
+
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace Procdraw {
+
+// A hash map using open addressing with linear probing. Entries are
+// stored inline in a single array whose size is a power of 2, so a
+// lookup is usually one hash and one or two adjacent slot reads.
+// Erase() shifts later entries of the probe sequence back rather than
+// leaving tombstones, so lookups never slow down after deletions.
+//
+// Pointers returned by Find() are invalidated by Insert() and Erase().
+
+template <typename K, typename V, typename Hash, typename KeyEqual = std::equal_to<K>>
+class OpenHashMap {
+public:
+    OpenHashMap()
+        : size(0) {}
+    V* Find(const K& key);
+    const V* Find(const K& key) const;
+    void Insert(K key, V value);
+    bool Erase(const K& key);
+    size_t Size() const
+    {
+        return size;
+    }
+    template <typename F>
+    void ForEach(F callback) const;
+
+private:
+    struct Entry {
+        K key;
+        V value;
+    };
+
+    // Grow when more than 7/8 of the slots are full
+    static constexpr size_t maxLoadNumerator = 7;
+    static constexpr size_t maxLoadDenominator = 8;
+    static constexpr size_t minCapacity = 8;
+
+    std::vector<std::optional<Entry>> slots;
+    size_t size;
+
+    size_t Mask() const
+    {
+        return slots.size() - 1;
+    }
+    size_t FindSlot(const K& key) const;
+    void Grow();
+};
+
+template <typename K, typename V, typename Hash, typename KeyEqual>
+size_t OpenHashMap<K, V, Hash, KeyEqual>::FindSlot(const K& key) const
+{
+    // Returns the slot holding key, or the empty slot where it would be
+    // inserted. There is always at least one empty slot.
+    size_t i = Hash{}(key) & Mask();
+    while (slots[i] && !KeyEqual{}(slots[i]->key, key)) {
+        i = (i + 1) & Mask();
+    }
+    return i;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual>
+V* OpenHashMap<K, V, Hash, KeyEqual>::Find(const K& key)
+{
+    if (size == 0) {
+        return nullptr;
+    }
+    auto& slot = slots[FindSlot(key)];
+    return slot ? &slot->value : nullptr;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual>
+const V* OpenHashMap<K, V, Hash, KeyEqual>::Find(const K& key) const
+{
+    if (size == 0) {
+        return nullptr;
+    }
+    const auto& slot = slots[FindSlot(key)];
+    return slot ? &slot->value : nullptr;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual>
+void OpenHashMap<K, V, Hash, KeyEqual>::Insert(K key, V value)
+{
+    // Inserts key, or replaces its value if it is already present
+    if ((size + 1) * maxLoadDenominator > slots.size() * maxLoadNumerator) {
+        Grow();
+    }
+    auto& slot = slots[FindSlot(key)];
+    if (slot) {
+        slot->value = std::move(value);
+    }
+    else {
+        slot.emplace(Entry{std::move(key), std::move(value)});
+        ++size;
+    }
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual>
+bool OpenHashMap<K, V, Hash, KeyEqual>::Erase(const K& key)
+{
+    if (size == 0) {
+        return false;
+    }
+    size_t hole = FindSlot(key);
+    if (!slots[hole]) {
+        return false;
+    }
+    slots[hole].reset();
+    --size;
+
+    // Move back any following entries that can no longer be reached
+    // from their home slot across the hole
+    size_t i = (hole + 1) & Mask();
+    while (slots[i]) {
+        size_t home = Hash{}(slots[i]->key) & Mask();
+        bool reachable = ((i - home) & Mask()) < ((i - hole) & Mask());
+        if (!reachable) {
+            slots[hole] = std::move(slots[i]);
+            slots[i].reset();
+            hole = i;
+        }
+        i = (i + 1) & Mask();
+    }
+    return true;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual>
+template <typename F>
+void OpenHashMap<K, V, Hash, KeyEqual>::ForEach(F callback) const
+{
+    // Calls callback(key, value) for each entry, in slot order
+    for (const auto& slot : slots) {
+        if (slot) {
+            callback(slot->key, slot->value);
+        }
+    }
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual>
+void OpenHashMap<K, V, Hash, KeyEqual>::Grow()
+{
+    std::vector<std::optional<Entry>> old = std::move(slots);
+    slots = std::vector<std::optional<Entry>>(old.empty() ? minCapacity : old.size() * 2);
+    for (auto& slot : old) {
+        if (slot) {
+            slots[FindSlot(slot->key)] = std::move(slot);
+        }
+    }
+}
+
+} // namespace Procdraw
+
+#endif
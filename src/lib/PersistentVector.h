@@ -0,0 +1,193 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROCDRAW_PERSISTENTVECTOR_H
+#define PROCDRAW_PERSISTENTVECTOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace Procdraw {
+
+// An immutable vector implemented as a 32-way trie. Set() and PushBack()
+// return a new vector that shares all unchanged nodes with the original,
+// so copying a PersistentVector is O(1) and each update allocates only
+// the O(log n) nodes on the path to the changed element.
+//
+// Nodes are never modified after construction, so PersistentVector
+// values may be read from several threads at once.
+
+template <typename T>
+class PersistentVector {
+public:
+    PersistentVector()
+        : root(nullptr), shift(0), size(0) {}
+    const T& At(size_t index) const;
+    PersistentVector PushBack(const T& value) const;
+    PersistentVector Set(size_t index, const T& value) const;
+    size_t Size() const
+    {
+        return size;
+    }
+    template <typename F>
+    void ForEachUnsharedIndex(const PersistentVector& other, F callback) const;
+
+private:
+    static constexpr int bits = 5;
+    static constexpr size_t width = 1 << bits;
+    static constexpr size_t mask = width - 1;
+
+    struct Node;
+    using NodePtr = std::shared_ptr<const Node>;
+
+    struct Node {
+        std::vector<NodePtr> children;
+        std::vector<T> values;
+    };
+
+    NodePtr root;
+    int shift;
+    size_t size;
+
+    PersistentVector(NodePtr root, int shift, size_t size)
+        : root(root), shift(shift), size(size) {}
+    static NodePtr PushBack(const Node* node, int shift, size_t index, const T& value);
+    static NodePtr Set(const Node* node, int shift, size_t index, const T& value);
+    template <typename F>
+    static void ForEachUnsharedIndex(const Node* a, const Node* b, int shift, size_t base, F& callback);
+};
+
+template <typename T>
+const T& PersistentVector<T>::At(size_t index) const
+{
+    if (index >= size) {
+        throw std::out_of_range("PersistentVector index out of range");
+    }
+    const Node* node = root.get();
+    for (int level = shift; level > 0; level -= bits) {
+        node = node->children[(index >> level) & mask].get();
+    }
+    return node->values[index & mask];
+}
+
+template <typename T>
+PersistentVector<T> PersistentVector<T>::PushBack(const T& value) const
+{
+    if (root == nullptr) {
+        auto leaf = std::make_shared<Node>();
+        leaf->values.push_back(value);
+        return PersistentVector(leaf, 0, 1);
+    }
+
+    if (size == (size_t{1} << (shift + bits))) {
+        // The trie is full, add a level
+        auto newRoot = std::make_shared<Node>();
+        newRoot->children.push_back(root);
+        return PersistentVector(PushBack(newRoot.get(), shift + bits, size, value),
+                                shift + bits,
+                                size + 1);
+    }
+
+    return PersistentVector(PushBack(root.get(), shift, size, value), shift, size + 1);
+}
+
+template <typename T>
+PersistentVector<T> PersistentVector<T>::Set(size_t index, const T& value) const
+{
+    if (index >= size) {
+        throw std::out_of_range("PersistentVector index out of range");
+    }
+    return PersistentVector(Set(root.get(), shift, index, value), shift, size);
+}
+
+template <typename T>
+template <typename F>
+void PersistentVector<T>::ForEachUnsharedIndex(const PersistentVector& other, F callback) const
+{
+    // Calls callback(index) for each index that is not stored in a node
+    // shared by both vectors, including indexes present in only one of them
+    if (shift == other.shift) {
+        ForEachUnsharedIndex(root.get(), other.root.get(), shift, 0, callback);
+    }
+    else {
+        ForEachUnsharedIndex(root.get(), nullptr, shift, 0, callback);
+        ForEachUnsharedIndex(nullptr, other.root.get(), other.shift, 0, callback);
+    }
+}
+
+template <typename T>
+typename PersistentVector<T>::NodePtr
+PersistentVector<T>::PushBack(const Node* node, int shift, size_t index, const T& value)
+{
+    auto copy = node != nullptr ? std::make_shared<Node>(*node) : std::make_shared<Node>();
+    if (shift == 0) {
+        copy->values.push_back(value);
+    }
+    else {
+        size_t i = (index >> shift) & mask;
+        if (i < copy->children.size()) {
+            copy->children[i] = PushBack(copy->children[i].get(), shift - bits, index, value);
+        }
+        else {
+            copy->children.push_back(PushBack(nullptr, shift - bits, index, value));
+        }
+    }
+    return copy;
+}
+
+template <typename T>
+typename PersistentVector<T>::NodePtr
+PersistentVector<T>::Set(const Node* node, int shift, size_t index, const T& value)
+{
+    auto copy = std::make_shared<Node>(*node);
+    if (shift == 0) {
+        copy->values[index & mask] = value;
+    }
+    else {
+        size_t i = (index >> shift) & mask;
+        copy->children[i] = Set(copy->children[i].get(), shift - bits, index, value);
+    }
+    return copy;
+}
+
+template <typename T>
+template <typename F>
+void PersistentVector<T>::ForEachUnsharedIndex(const Node* a, const Node* b, int shift, size_t base, F& callback)
+{
+    if (a == b) {
+        return;
+    }
+    if (shift == 0) {
+        size_t n = std::max(a != nullptr ? a->values.size() : 0,
+                            b != nullptr ? b->values.size() : 0);
+        for (size_t i = 0; i < n; ++i) {
+            callback(base + i);
+        }
+        return;
+    }
+    size_t n = std::max(a != nullptr ? a->children.size() : 0,
+                        b != nullptr ? b->children.size() : 0);
+    for (size_t i = 0; i < n; ++i) {
+        const Node* childA = (a != nullptr && i < a->children.size()) ? a->children[i].get() : nullptr;
+        const Node* childB = (b != nullptr && i < b->children.size()) ? b->children[i].get() : nullptr;
+        ForEachUnsharedIndex(childA, childB, shift - bits, base + (i << shift), callback);
+    }
+}
+
+} // namespace Procdraw
+
+#endif
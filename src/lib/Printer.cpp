@@ -14,21 +14,204 @@
 
 #include "Printer.h"
 #include "Interpreter.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
 #include <iterator>
 #include <sstream>
 
 namespace Procdraw {
 
+// Records a container as being printed for the lifetime of the scope
+class Printer::PrintingScope {
+public:
+    PrintingScope(Printer* printer, const void* container)
+        : printer(printer)
+    {
+        printer->printing.push_back(container);
+    }
+    PrintingScope(const PrintingScope&) = delete;
+    PrintingScope& operator=(const PrintingScope&) = delete;
+    ~PrintingScope()
+    {
+        printer->printing.pop_back();
+    }
+
+private:
+    Printer* printer;
+};
+
 Printer::Printer(Interpreter* interpreter)
 {
     this->interpreter = interpreter;
 }
 
+bool Printer::IsPrinting(const void* container) const
+{
+    return std::find(printing.begin(), printing.end(), container) != printing.end();
+}
+
+std::string Printer::PrintErrorKind(ErrorKind kind)
+{
+    switch (kind) {
+    case ErrorKind::BadSyntax:
+        return "bad-syntax";
+    case ErrorKind::DepthQuotaExceeded:
+        return "depth-quota-exceeded";
+    case ErrorKind::HeapQuotaExceeded:
+        return "heap-quota-exceeded";
+    case ErrorKind::IndexOutOfRange:
+        return "index-out-of-range";
+    case ErrorKind::InvalidArgument:
+        return "invalid-argument";
+    case ErrorKind::KeyNotFound:
+        return "key-not-found";
+    case ErrorKind::LengthMismatch:
+        return "length-mismatch";
+    case ErrorKind::NotAFunction:
+        return "not-a-function";
+    case ErrorKind::StepQuotaExceeded:
+        return "step-quota-exceeded";
+    case ErrorKind::TypeError:
+        return "type-error";
+    case ErrorKind::WrongNumberOfArgs:
+        return "wrong-number-of-args";
+    default:
+        throw std::exception{"Unhandled ErrorKind in Print"};
+    }
+}
+
+template <typename T>
+std::string Printer::PrintFloat(T val)
+{
+    // Shortest representation that reads back as the same value, always
+    // with a decimal point so that it reads back as a Float. Infinities
+    // and NaNs have no such representation, and print as inf, -inf and
+    // nan, which read back as symbols.
+    if (std::isnan(val)) {
+        return "nan";
+    }
+    if (std::isinf(val)) {
+        return val < 0 ? "-inf" : "inf";
+    }
+    char buf[32];
+    auto result = std::to_chars(buf, buf + sizeof(buf), val);
+    std::string s(buf, result.ptr);
+    if (s.find_first_of(".en") == std::string::npos) {
+        s.append(".0");
+    }
+    return s;
+}
+
+std::string Printer::PrintNumericArray(const NumericArray& array)
+{
+    // Float32 elements are printed at float precision, so 0.1 prints as
+    // 0.1 rather than as the nearest double to the stored float
+    bool isFloat = array.Type() == NumericArrayType::Float32;
+    std::string s{isFloat ? "#f32(" : "#i32("};
+    for (size_t i = 0; i < array.Size(); ++i) {
+        if (i > 0) {
+            s.push_back(' ');
+        }
+        if (isFloat) {
+            s.append(PrintFloat(array.Float32Data()[i]));
+        }
+        else {
+            s.append(std::to_string(array.Int32Data()[i]));
+        }
+    }
+    s.append(")");
+    return s;
+}
+
+std::string Printer::PrintSpecialFormKind(SpecialFormKind kind)
+{
+    switch (kind) {
+    case SpecialFormKind::Define:
+        return "define";
+    case SpecialFormKind::Defmacro:
+        return "defmacro";
+    case SpecialFormKind::Do:
+        return "do";
+    case SpecialFormKind::If:
+        return "if";
+    case SpecialFormKind::Lambda:
+        return "lambda";
+    case SpecialFormKind::Let:
+        return "let";
+    case SpecialFormKind::Quote:
+        return "quote";
+    default:
+        throw std::exception{"Unhandled SpecialFormKind in Print"};
+    }
+}
+
+std::string Printer::PrintString(const String& str)
+{
+    // Escapes the characters that the Reader reads escaped
+    std::string s{"\""};
+    s.reserve(str.Size() + 2);
+    for (char ch : str.View()) {
+        switch (ch) {
+        case '"':
+            s.append("\\\"");
+            break;
+        case '\\':
+            s.append("\\\\");
+            break;
+        case '\n':
+            s.append("\\n");
+            break;
+        case '\r':
+            s.append("\\r");
+            break;
+        case '\t':
+            s.append("\\t");
+            break;
+        default:
+            s.push_back(ch);
+            break;
+        }
+    }
+    s.push_back('"');
+    return s;
+}
+
 std::string Printer::Print(const Object& obj)
 {
     switch (obj.Type()) {
     case ObjectType::Boolean:
         return obj.GetBoolean() ? "true" : "false";
+    case ObjectType::CFunctionHandle:
+        return "#<builtin>";
+    case ObjectType::ClosurePtr:
+        return "#<closure>";
+    case ObjectType::Error:
+        return "#<error " + PrintErrorKind(obj.GetError()) + ">";
+    case ObjectType::Float:
+        return PrintFloat(obj.GetFloat());
+    case ObjectType::HashMapPtr: {
+        const HashMap& map = *obj.GetHashMapPtr();
+        if (IsPrinting(&map)) {
+            return "{...}";
+        }
+        PrintingScope scope(this, &map);
+        std::string s{"{"};
+        bool firstEntry{true};
+        map.ForEach([&](const Object& key, const Object& value) {
+            if (firstEntry) {
+                firstEntry = false;
+            }
+            else {
+                s.push_back(' ');
+            }
+            s.append(Print(key));
+            s.push_back(' ');
+            s.append(Print(value));
+        });
+        s.append("}");
+        return s;
+    }
     case ObjectType::Integer: {
         std::ostringstream s;
         s << obj.GetInteger();
@@ -36,7 +219,7 @@ std::string Printer::Print(const Object& obj)
     }
     case ObjectType::ListPtr: {
         std::string s{"("};
-        ListPtr next{obj.GetListPtr()};
+        const ListNode* next = obj.GetListPtr().get();
         bool firstChild{true};
         while (next != nullptr) {
             if (firstChild) {
@@ -46,15 +229,47 @@ std::string Printer::Print(const Object& obj)
                 s.push_back(' ');
             }
             s.append(Print(next->First()));
-            next = next->Rest();
+            next = next->Rest().get();
         }
         s.append(")");
         return s;
     }
+    case ObjectType::LocalRef: {
+        LocalRef ref = obj.GetLocalRef();
+        return std::string(ref.captured ? "#<captured " : "#<local ") + std::to_string(ref.slot) + ">";
+    }
+    case ObjectType::MacroPtr:
+        return "#<macro>";
     case ObjectType::None:
         return "none";
+    case ObjectType::NumericArrayPtr:
+        return PrintNumericArray(*obj.GetNumericArrayPtr());
+    case ObjectType::SequencePtr:
+        return "#<sequence>";
+    case ObjectType::SignalPtr:
+        return "#<signal>";
+    case ObjectType::SpecialFormPtr:
+        return "#<" + PrintSpecialFormKind(obj.GetSpecialFormPtr()->Kind()) + ">";
+    case ObjectType::StringPtr:
+        return PrintString(*obj.GetStringPtr());
     case ObjectType::SymbolHandle:
         return interpreter->SymbolName(obj.GetSymbolHandle());
+    case ObjectType::VectorPtr: {
+        const Vector& vec = *obj.GetVectorPtr();
+        if (IsPrinting(&vec)) {
+            return "[...]";
+        }
+        PrintingScope scope(this, &vec);
+        std::string s{"["};
+        for (size_t i = 0; i < vec.Size(); ++i) {
+            if (i > 0) {
+                s.push_back(' ');
+            }
+            s.append(Print(vec.At(i)));
+        }
+        s.append("]");
+        return s;
+    }
     default:
         throw std::exception{"Unhandled type in Print"};
     }
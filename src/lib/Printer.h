@@ -17,6 +17,7 @@
 
 #include "InterpreterTypes.h"
 #include <string>
+#include <vector>
 
 namespace Procdraw {
 
@@ -29,6 +30,18 @@ public:
 
 private:
     Interpreter* interpreter;
+    // The Vectors and HashMaps being printed, outermost first. A
+    // container can hold itself, so one already being printed is printed
+    // as [...] or {...} rather than again.
+    std::vector<const void*> printing;
+    class PrintingScope;
+    bool IsPrinting(const void* container) const;
+    std::string PrintErrorKind(ErrorKind kind);
+    template <typename T>
+    std::string PrintFloat(T val);
+    std::string PrintNumericArray(const NumericArray& array);
+    std::string PrintSpecialFormKind(SpecialFormKind kind);
+    std::string PrintString(const String& str);
 };
 
 } // namespace Procdraw
@@ -15,9 +15,22 @@
 #include "ProcdrawApp.h"
 #include "ProcdrawMath.h"
 #include <stdexcept>
+#include <utility>
 
 namespace Procdraw {
 
+namespace {
+
+const char* defaultDraw =
+    "(define draw (lambda ()"
+    "  (background 200 0.6 0.9)"
+    "  (rotate-x (lerp 1 -1 mouse-y))"
+    "  (rotate-y (lerp 1 -1 mouse-x))"
+    "  (color 7 0.7 0.7)"
+    "  (cube)))";
+
+} // namespace
+
 ProcdrawApp::ProcdrawApp(HINSTANCE hInstance, int nCmdShow)
     : hInstance_(hInstance),
       nCmdShow_(nCmdShow),
@@ -25,6 +38,10 @@ ProcdrawApp::ProcdrawApp(HINSTANCE hInstance, int nCmdShow)
 {
     CreateAppWindow();
     graphics_ = std::unique_ptr<D3D11Graphics>(new D3D11Graphics(hWnd_));
+    auto interpreter = std::make_unique<Interpreter>();
+    interpreter->Eval(interpreter->Read(defaultDraw));
+    sceneThread_ = std::make_unique<SceneThread>(std::move(interpreter));
+    replServer_ = std::make_unique<ReplServer>(sceneThread_.get(), ReplServer::defaultPipeName);
 }
 
 int ProcdrawApp::MainLoop()
@@ -41,6 +58,9 @@ int ProcdrawApp::MainLoop()
             }
         }
 
+        // Forms received this frame are evaluated before it is drawn
+        replServer_->Poll();
+        sceneThread_->SetInput(FrameInput{MouseX(), MouseY()});
         Draw();
         graphics_->Present();
         // TODO: frameCounter_.RecordFrame();
@@ -138,10 +158,45 @@ LRESULT CALLBACK ProcdrawApp::WindowProc(HWND hWnd, UINT message, WPARAM wParam,
 
 void ProcdrawApp::Draw()
 {
-    graphics_->Background(200, 0.6f, 0.9f);
-    graphics_->RotateX(static_cast<float>(Lerp(1.0, -1.0, MouseY())));
-    graphics_->RotateY(static_cast<float>(Lerp(1.0, -1.0, MouseX())));
-    graphics_->Color(7, 0.7f, 0.7f);
-    graphics_->Cube();
+    // Replays the latest Scene from the scene thread, which may be the
+    // one drawn last frame
+    for (const SceneCommand& command : sceneThread_->LatestScene().Commands()) {
+        const float* args = command.args;
+        switch (command.kind) {
+        case SceneCommandKind::AmbientLightColor:
+            graphics_->AmbientLightColor(args[0], args[1], args[2]);
+            break;
+        case SceneCommandKind::Background:
+            graphics_->Background(args[0], args[1], args[2]);
+            break;
+        case SceneCommandKind::Color:
+            graphics_->Color(args[0], args[1], args[2]);
+            break;
+        case SceneCommandKind::Cube:
+            graphics_->Cube();
+            break;
+        case SceneCommandKind::LightColor:
+            graphics_->LightColor(args[0], args[1], args[2]);
+            break;
+        case SceneCommandKind::RotateX:
+            graphics_->RotateX(args[0]);
+            break;
+        case SceneCommandKind::RotateY:
+            graphics_->RotateY(args[0]);
+            break;
+        case SceneCommandKind::RotateZ:
+            graphics_->RotateZ(args[0]);
+            break;
+        case SceneCommandKind::Scale:
+            graphics_->Scale(args[0], args[1], args[2]);
+            break;
+        case SceneCommandKind::Tetrahedron:
+            graphics_->Tetrahedron();
+            break;
+        case SceneCommandKind::Translate:
+            graphics_->Translate(args[0], args[1], args[2]);
+            break;
+        }
+    }
 }
 } // namespace Procdraw
@@ -16,6 +16,8 @@
 #define PROCDRAW_PROCDRAWAPP_H
 
 #include "D3D11Graphics.h"
+#include "ReplServer.h"
+#include "SceneThread.h"
 #include <Windows.h>
 #include <memory>
 
@@ -36,6 +38,8 @@ private:
     int nCmdShow_;
     HWND hWnd_;
     std::unique_ptr<D3D11Graphics> graphics_;
+    std::unique_ptr<SceneThread> sceneThread_;
+    std::unique_ptr<ReplServer> replServer_;
     void CreateAppWindow();
     void Draw();
 };
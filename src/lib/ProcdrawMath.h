@@ -29,10 +29,22 @@ T Clamp(T value, T lower, T upper)
     return value;
 }
 
+// Lerp and MapRange are templates so that the float32 array kernels can
+// use the same formulas, inlined into their loops
+
+template <typename T>
+T Lerp(T start, T stop, T val)
+{
+    return (1 - val) * start + val * stop;
+}
+
+template <typename T>
+T MapRange(T start1, T stop1, T start2, T stop2, T val)
+{
+    return start2 + ((val - start1) * (stop2 - start2)) / (stop1 - start1);
+}
+
 bool ApproximatelyEqual(double a, double b, double epsilon);
-double Lerp(double start, double stop, double val);
-double
-MapRange(double start1, double stop1, double start2, double stop2, double val);
 double Norm(double start, double stop, double val);
 int PowerOf2Gte(int n);
 double Wrap(double start, double stop, double val);
@@ -16,6 +16,7 @@
 #include "Interpreter.h"
 #include <cctype>
 #include <string>
+#include <vector>
 
 namespace Procdraw {
 
@@ -34,6 +35,7 @@ void Reader::SetInput(const std::string& text)
 {
     input.str(text);
     input.clear();
+    elements.clear();
     GetCh();
     GetToken();
 }
@@ -48,15 +50,86 @@ bool Reader::IsStartOfNumber()
     return isdigit(ch) != 0;
 }
 
-void Reader::GetNumber()
+void Reader::GetNumber(bool negative)
 {
     std::string number;
+    if (negative) {
+        number += '-';
+    }
     while (isdigit(ch)) {
         number += ch;
         GetCh();
     }
-    token = ReaderTokenType::Integer;
-    intVal = atoi(number.c_str());
+    bool isFloat = false;
+    if (ch == '.') {
+        isFloat = true;
+        number += ch;
+        GetCh();
+        while (isdigit(ch)) {
+            number += ch;
+            GetCh();
+        }
+    }
+    if (ch == 'e' || ch == 'E') {
+        isFloat = true;
+        number += ch;
+        GetCh();
+        if (ch == '+' || ch == '-') {
+            number += ch;
+            GetCh();
+        }
+        while (isdigit(ch)) {
+            number += ch;
+            GetCh();
+        }
+    }
+    if (isFloat) {
+        token = ReaderTokenType::Float;
+        floatVal = atof(number.c_str());
+    }
+    else {
+        token = ReaderTokenType::Integer;
+        intVal = atoi(number.c_str());
+    }
+}
+
+void Reader::GetString()
+{
+    // Reads the characters up to the closing quote, with \" \\ \n \r and
+    // \t escapes. An unknown escape or a missing closing quote is an
+    // Undefined token.
+    GetCh();
+    stringVal.clear();
+    while (ch != '"') {
+        if (ch == EOF) {
+            token = ReaderTokenType::Undefined;
+            return;
+        }
+        if (ch == '\\') {
+            GetCh();
+            switch (ch) {
+            case '"':
+            case '\\':
+                break;
+            case 'n':
+                ch = '\n';
+                break;
+            case 'r':
+                ch = '\r';
+                break;
+            case 't':
+                ch = '\t';
+                break;
+            default:
+                token = ReaderTokenType::Undefined;
+                return;
+            }
+        }
+        stringVal += static_cast<char>(ch);
+        GetCh();
+    }
+    GetCh();
+    token = ReaderTokenType::String;
 }
 
 void Reader::GetToken()
@@ -74,32 +147,79 @@ void Reader::GetToken()
         token = ReaderTokenType::RParen;
         GetCh();
         break;
+    case '[':
+        token = ReaderTokenType::LBracket;
+        GetCh();
+        break;
+    case ']':
+        token = ReaderTokenType::RBracket;
+        GetCh();
+        break;
+    case '{':
+        token = ReaderTokenType::LBrace;
+        GetCh();
+        break;
+    case '}':
+        token = ReaderTokenType::RBrace;
+        GetCh();
+        break;
+    case '\'':
+        token = ReaderTokenType::Quote;
+        GetCh();
+        break;
+    case '"':
+        GetString();
+        break;
     case '+':
         GetCh();
         if (IsStartOfNumber()) {
-            GetNumber();
+            GetNumber(false);
         }
         else {
             token = ReaderTokenType::Symbol;
             symbolVal = "+";
         }
         break;
+    case '-':
+        GetCh();
+        if (IsStartOfNumber()) {
+            GetNumber(true);
+        }
+        else {
+            token = ReaderTokenType::Symbol;
+            symbolVal = "-";
+        }
+        break;
     // Single char symbols
     case '*':
+    case '/':
         token = ReaderTokenType::Symbol;
         symbolVal = std::string(1, ch);
         GetCh();
         break;
+    // Comparison symbols
+    case '<':
+    case '=':
+    case '>': {
+        std::string str;
+        while (ch == '<' || ch == '=' || ch == '>') {
+            str += ch;
+            GetCh();
+        }
+        token = ReaderTokenType::Symbol;
+        symbolVal = str;
+        break;
+    }
     case EOF:
         token = ReaderTokenType::EndOfInput;
         break;
     default:
         if (IsStartOfNumber()) {
-            GetNumber();
+            GetNumber(false);
         }
         else if (isalpha(ch)) {
             std::string str;
-            while (isalnum(ch) || ch == '-') {
+            while (isalnum(ch) || ch == '-' || ch == '!' || ch == '?') {
                 str += ch;
                 GetCh();
             }
@@ -119,11 +239,30 @@ Object Reader::Read()
     switch (token) {
     case ReaderTokenType::LParen:
         return ReadCons();
+    case ReaderTokenType::LBracket:
+        return ReadVector();
+    case ReaderTokenType::LBrace:
+        return ReadHashMap();
+    case ReaderTokenType::Quote:
+        return ReadQuote();
+    case ReaderTokenType::Float: {
+        Object obj{floatVal};
+        GetToken();
+        return obj;
+    }
     case ReaderTokenType::Integer: {
         Object obj{intVal};
         GetToken();
         return obj;
     }
+    case ReaderTokenType::String: {
+        // Strings in hash consed forms are interned, so that equal forms
+        // share their nodes
+        StringPtr str = String::Make(stringVal);
+        Object obj{interpreter->HashConsing() ? interpreter->Intern(str) : std::move(str)};
+        GetToken();
+        return obj;
+    }
     case ReaderTokenType::Symbol:
         if (symbolVal == "true") {
             GetToken();
@@ -152,27 +291,98 @@ ListPtr Reader::ReadCons()
     // Consume LParen
     GetToken();
 
-    if (token == ReaderTokenType::RParen) {
-        GetToken();
-        // Empty list
-        return nullptr;
-    }
-
-    ListPtr head = Cons(Read(), nullptr);
-    ListPtr prev = head;
+    // The elements are gathered on a stack shared with nested lists, so
+    // that the list can be built once its length is known
+    size_t base = elements.size();
 
     while (token != ReaderTokenType::EndOfInput) {
         if (token == ReaderTokenType::RParen) {
             GetToken();
-            return head;
+            ListPtr lst = interpreter->HashConsing() ? HashConsElements(base) : BuildElements(base);
+            elements.erase(elements.begin() + base, elements.end());
+            return lst;
         }
-        ListPtr next = Cons(Read(), nullptr);
-        prev->SetRest(next);
-        prev = next;
+        elements.push_back(Read());
     }
 
     // Unterminated list
     throw SyntaxError{};
 }
 
+ListPtr Reader::ReadQuote()
+{
+    // 'x reads as (quote x)
+    GetToken();
+    size_t base = elements.size();
+    elements.push_back(Object::MakeSymbolHandle(interpreter->SymbolRef("quote")));
+    elements.push_back(Read());
+    ListPtr lst = interpreter->HashConsing() ? HashConsElements(base) : BuildElements(base);
+    elements.erase(elements.begin() + base, elements.end());
+    return lst;
+}
+
+ListPtr Reader::BuildElements(size_t base)
+{
+    // All of the nodes are allocated in one block
+    ListBuilder builder(elements.size() - base);
+    for (size_t i = base; i < elements.size(); ++i) {
+        builder.Append(std::move(elements[i]));
+    }
+    return builder.Finish();
+}
+
+ListPtr Reader::HashConsElements(size_t base)
+{
+    // Hash consed lists are built from the end, as each node is interned
+    // with its rest already interned
+    ListPtr lst = nullptr;
+    for (size_t i = elements.size(); i > base; --i) {
+        lst = interpreter->HashCons(std::move(elements[i - 1]), std::move(lst));
+    }
+    return lst;
+}
+
+HashMapPtr Reader::ReadHashMap()
+{
+    // Consume LBrace
+    GetToken();
+
+    HashMapPtr map(new HashMap());
+
+    while (token != ReaderTokenType::EndOfInput) {
+        if (token == ReaderTokenType::RBrace) {
+            GetToken();
+            return map;
+        }
+        Object key = Read();
+        if (!IsHashMapKey(key) || token == ReaderTokenType::RBrace) {
+            // Unsupported key type or missing value
+            throw SyntaxError{};
+        }
+        map->Insert(key, Read());
+    }
+
+    // Unterminated map
+    throw SyntaxError{};
+}
+
+VectorPtr Reader::ReadVector()
+{
+    // Consume LBracket
+    GetToken();
+
+    VectorPtr vec(new Vector());
+
+    while (token != ReaderTokenType::EndOfInput) {
+        if (token == ReaderTokenType::RBracket) {
+            GetToken();
+            return vec;
+        }
+        vec->PushBack(Read());
+    }
+
+    // Unterminated vector
+    throw SyntaxError{};
+}
+
 } // namespace Procdraw
@@ -18,6 +18,7 @@
 #include "InterpreterTypes.h"
 #include <sstream>
 #include <string>
+#include <vector>
 
 namespace Procdraw {
 
@@ -26,7 +27,14 @@ class Interpreter;
 enum class ReaderTokenType {
     LParen,
     RParen,
+    LBracket,
+    RBracket,
+    LBrace,
+    RBrace,
+    Quote,
+    Float,
     Integer,
+    String,
     Symbol,
     EndOfInput,
     Undefined
@@ -48,14 +56,23 @@ private:
     int ch;
     ReaderTokenType token;
     int intVal;
+    double floatVal;
+    std::string stringVal;
     std::string symbolVal;
+    std::vector<Object> elements;
     void SetInput(const std::string& text);
     void GetCh();
     bool IsStartOfNumber();
-    void GetNumber();
+    void GetNumber(bool negative);
+    void GetString();
     void GetToken();
     Object Read();
     ListPtr ReadCons();
+    ListPtr ReadQuote();
+    ListPtr BuildElements(size_t base);
+    ListPtr HashConsElements(size_t base);
+    HashMapPtr ReadHashMap();
+    VectorPtr ReadVector();
 };
 
 } // namespace Procdraw
@@ -0,0 +1,243 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROCDRAW_REFPTR_H
+#define PROCDRAW_REFPTR_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Intrusive reference counting for interpreter heap objects.
+//
+// By default reference counts are atomic, so that Objects may be shared
+// between forked Interpreters on different threads. Defining
+// PROCDRAW_SINGLE_THREADED makes them plain integers, which is faster but
+// requires that all Interpreters sharing Objects run on one thread.
+//
+// Defining PROCDRAW_REFCOUNT_STATS counts reference count operations per
+// thread, for benchmarking.
+
+namespace Procdraw {
+
+#ifdef PROCDRAW_REFCOUNT_STATS
+struct RefCountStats {
+    static inline thread_local std::uint64_t increments = 0;
+    static inline thread_local std::uint64_t decrements = 0;
+    static void Reset()
+    {
+        increments = 0;
+        decrements = 0;
+    }
+};
+#endif
+
+class RefCounted {
+public:
+    RefCounted()
+        : refCount(0) {}
+    RefCounted(const RefCounted&) = delete;
+    RefCounted& operator=(const RefCounted&) = delete;
+    void AddRef() const;
+    void AddRefs(long count) const;
+    bool Release() const;
+    long UseCount() const;
+
+private:
+#ifdef PROCDRAW_SINGLE_THREADED
+    mutable long refCount;
+#else
+    mutable std::atomic<long> refCount;
+#endif
+};
+
+inline void RefCounted::AddRef() const
+{
+#ifdef PROCDRAW_REFCOUNT_STATS
+    ++RefCountStats::increments;
+#endif
+#ifdef PROCDRAW_SINGLE_THREADED
+    ++refCount;
+#else
+    refCount.fetch_add(1, std::memory_order_relaxed);
+#endif
+}
+
+inline void RefCounted::AddRefs(long count) const
+{
+#ifdef PROCDRAW_REFCOUNT_STATS
+    RefCountStats::increments += count;
+#endif
+#ifdef PROCDRAW_SINGLE_THREADED
+    refCount += count;
+#else
+    refCount.fetch_add(count, std::memory_order_relaxed);
+#endif
+}
+
+// Returns true when the last reference has been released
+inline bool RefCounted::Release() const
+{
+#ifdef PROCDRAW_REFCOUNT_STATS
+    ++RefCountStats::decrements;
+#endif
+#ifdef PROCDRAW_SINGLE_THREADED
+    return --refCount == 0;
+#else
+    if (refCount.fetch_sub(1, std::memory_order_release) == 1) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
+    }
+    return false;
+#endif
+}
+
+inline long RefCounted::UseCount() const
+{
+#ifdef PROCDRAW_SINGLE_THREADED
+    return refCount;
+#else
+    return refCount.load(std::memory_order_acquire);
+#endif
+}
+
+// Frees an object when its last reference has been released. Types that
+// manage their own storage provide an overload, found by argument
+// dependent lookup.
+
+template <typename T>
+void DeleteRefCounted(T* p)
+{
+    delete p;
+}
+
+// A smart pointer to a RefCounted object. The interface follows
+// std::shared_ptr so that it may be used in the same way.
+
+template <typename T>
+class RefPtr {
+public:
+    RefPtr()
+        : ptr(nullptr) {}
+    RefPtr(std::nullptr_t)
+        : ptr(nullptr) {}
+    explicit RefPtr(T* p)
+        : ptr(p)
+    {
+        if (ptr != nullptr) {
+            ptr->AddRef();
+        }
+    }
+    RefPtr(const RefPtr& other)
+        : ptr(other.ptr)
+    {
+        if (ptr != nullptr) {
+            ptr->AddRef();
+        }
+    }
+    RefPtr(RefPtr&& other) noexcept
+        : ptr(other.ptr)
+    {
+        other.ptr = nullptr;
+    }
+    ~RefPtr()
+    {
+        if (ptr != nullptr && ptr->Release()) {
+            DeleteRefCounted(ptr);
+        }
+    }
+    RefPtr& operator=(const RefPtr& other)
+    {
+        RefPtr(other).swap(*this);
+        return *this;
+    }
+    RefPtr& operator=(RefPtr&& other) noexcept
+    {
+        RefPtr(std::move(other)).swap(*this);
+        return *this;
+    }
+    RefPtr& operator=(std::nullptr_t)
+    {
+        RefPtr().swap(*this);
+        return *this;
+    }
+    void swap(RefPtr& other) noexcept
+    {
+        std::swap(ptr, other.ptr);
+    }
+    T* get() const
+    {
+        return ptr;
+    }
+    T& operator*() const
+    {
+        return *ptr;
+    }
+    T* operator->() const
+    {
+        return ptr;
+    }
+    explicit operator bool() const
+    {
+        return ptr != nullptr;
+    }
+    long use_count() const
+    {
+        return ptr != nullptr ? ptr->UseCount() : 0;
+    }
+
+private:
+    T* ptr;
+};
+
+template <typename T, typename U>
+inline bool operator==(const RefPtr<T>& a, const RefPtr<U>& b)
+{
+    return a.get() == b.get();
+}
+
+template <typename T, typename U>
+inline bool operator!=(const RefPtr<T>& a, const RefPtr<U>& b)
+{
+    return a.get() != b.get();
+}
+
+template <typename T>
+inline bool operator==(const RefPtr<T>& a, std::nullptr_t)
+{
+    return a.get() == nullptr;
+}
+
+template <typename T>
+inline bool operator==(std::nullptr_t, const RefPtr<T>& a)
+{
+    return a.get() == nullptr;
+}
+
+template <typename T>
+inline bool operator!=(const RefPtr<T>& a, std::nullptr_t)
+{
+    return a.get() != nullptr;
+}
+
+template <typename T>
+inline bool operator!=(std::nullptr_t, const RefPtr<T>& a)
+{
+    return a.get() != nullptr;
+}
+
+} // namespace Procdraw
+
+#endif
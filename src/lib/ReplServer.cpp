@@ -0,0 +1,211 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ReplServer.h"
+#include <algorithm>
+#include <utility>
+#include <wil/result.h>
+
+namespace Procdraw {
+
+namespace {
+
+constexpr DWORD pipeBufferSize = 4096;
+
+enum class IoState {
+    Pending,
+    Completed,
+    Failed
+};
+
+IoState CheckIo(HANDLE pipe, OVERLAPPED* overlapped, DWORD* bytes)
+{
+    // Does not wait for the operation to complete
+    if (GetOverlappedResult(pipe, overlapped, bytes, FALSE)) {
+        return IoState::Completed;
+    }
+    return GetLastError() == ERROR_IO_INCOMPLETE ? IoState::Pending : IoState::Failed;
+}
+
+} // namespace
+
+ReplServer::ReplServer(SceneThread* sceneThread, std::wstring pipeName)
+    : sceneThread(sceneThread), pipeName(std::move(pipeName))
+{
+    Listen();
+}
+
+ReplServer::~ReplServer()
+{
+    Close(*listener);
+    for (auto& client : clients) {
+        Close(*client);
+    }
+}
+
+void ReplServer::Listen()
+{
+    // Creates a pipe instance and starts waiting for a client to connect
+    // to it. Remote clients are rejected.
+    auto client = std::make_unique<Client>();
+    client->id = ++lastClientId;
+    client->pipe.reset(CreateNamedPipeW(pipeName.c_str(),
+                                        PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+                                        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                                        PIPE_UNLIMITED_INSTANCES,
+                                        pipeBufferSize,
+                                        pipeBufferSize,
+                                        0,
+                                        nullptr));
+    THROW_LAST_ERROR_IF(!client->pipe);
+    client->read.event.create(wil::EventOptions::ManualReset);
+    client->read.overlapped.hEvent = client->read.event.get();
+    client->write.event.create(wil::EventOptions::ManualReset);
+    client->write.overlapped.hEvent = client->write.event.get();
+    if (!ConnectNamedPipe(client->pipe.get(), &client->read.overlapped)) {
+        DWORD error = GetLastError();
+        if (error == ERROR_IO_PENDING) {
+            client->read.pending = true;
+        }
+        else if (error != ERROR_PIPE_CONNECTED) {
+            THROW_WIN32(error);
+        }
+    }
+    listener = std::move(client);
+}
+
+void ReplServer::Poll()
+{
+    // Called by the render thread
+    DWORD bytes = 0;
+    if (!listener->read.pending || CheckIo(listener->pipe.get(), &listener->read.overlapped, &bytes) != IoState::Pending) {
+        listener->read.pending = false;
+        clients.push_back(std::move(listener));
+        Listen();
+    }
+
+    for (auto& client : clients) {
+        Read(*client);
+    }
+
+    responses.clear();
+    sceneThread->TakeResponses(responses);
+    for (ReplResponse& response : responses) {
+        auto client = std::find_if(clients.begin(), clients.end(), [&](const auto& c) {
+            return c->id == response.client;
+        });
+        // The results for a client that has disconnected are dropped
+        if (client != clients.end()) {
+            (*client)->outgoing += response.text;
+            (*client)->outgoing += '\n';
+        }
+    }
+
+    for (auto& client : clients) {
+        Write(*client);
+        if (client->closed) {
+            Close(*client);
+        }
+    }
+    clients.erase(std::remove_if(clients.begin(), clients.end(), [](const auto& c) {
+                      return c->closed;
+                  }),
+                  clients.end());
+}
+
+void ReplServer::Read(Client& client)
+{
+    // Submits the forms in all data that has arrived, leaving a read
+    // pending for more
+    while (!client.closed) {
+        if (client.read.pending) {
+            DWORD bytes = 0;
+            IoState state = CheckIo(client.pipe.get(), &client.read.overlapped, &bytes);
+            if (state == IoState::Pending) {
+                return;
+            }
+            client.read.pending = false;
+            if (state == IoState::Failed) {
+                // Usually ERROR_BROKEN_PIPE, when the client disconnects
+                client.closed = true;
+                return;
+            }
+            forms.clear();
+            client.splitter.Feed(client.readBuffer, bytes, forms);
+            for (std::string& form : forms) {
+                sceneThread->Submit(ReplRequest{client.id, std::move(form)});
+            }
+        }
+        if (!ReadFile(client.pipe.get(), client.readBuffer, sizeof(client.readBuffer), nullptr, &client.read.overlapped)
+            && GetLastError() != ERROR_IO_PENDING) {
+            client.closed = true;
+            return;
+        }
+        client.read.pending = true;
+    }
+}
+
+void ReplServer::Write(Client& client)
+{
+    // Starts writing the queued results if the previous write has
+    // completed
+    if (client.write.pending) {
+        DWORD bytes = 0;
+        IoState state = CheckIo(client.pipe.get(), &client.write.overlapped, &bytes);
+        if (state == IoState::Pending) {
+            return;
+        }
+        client.write.pending = false;
+        if (state == IoState::Failed) {
+            client.closed = true;
+            return;
+        }
+        if (bytes < client.writing.size()) {
+            client.outgoing.insert(0, client.writing, bytes);
+        }
+    }
+    if (client.closed || client.outgoing.empty()) {
+        return;
+    }
+    client.writing.swap(client.outgoing);
+    client.outgoing.clear();
+    if (!WriteFile(client.pipe.get(), client.writing.data(), static_cast<DWORD>(client.writing.size()), nullptr, &client.write.overlapped)
+        && GetLastError() != ERROR_IO_PENDING) {
+        client.closed = true;
+        return;
+    }
+    client.write.pending = true;
+}
+
+void ReplServer::Close(Client& client)
+{
+    // Pending operations still refer to the Client's OVERLAPPEDs and
+    // buffers, so they are cancelled, and waited for, before it is
+    // destroyed. Cancelled operations complete promptly.
+    if (client.read.pending || client.write.pending) {
+        CancelIoEx(client.pipe.get(), nullptr);
+        DWORD bytes = 0;
+        if (client.read.pending) {
+            GetOverlappedResult(client.pipe.get(), &client.read.overlapped, &bytes, TRUE);
+            client.read.pending = false;
+        }
+        if (client.write.pending) {
+            GetOverlappedResult(client.pipe.get(), &client.write.overlapped, &bytes, TRUE);
+            client.write.pending = false;
+        }
+    }
+    DisconnectNamedPipe(client.pipe.get());
+}
+
+} // namespace Procdraw
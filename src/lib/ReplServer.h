@@ -0,0 +1,90 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROCDRAW_REPLSERVER_H
+#define PROCDRAW_REPLSERVER_H
+
+#include "FormSplitter.h"
+#include "SceneThread.h"
+#include <Windows.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <wil/resource.h>
+
+namespace Procdraw {
+
+// Accepts REPL clients on a local named pipe. Each top-level form that a
+// client writes is submitted to the SceneThread, and its printed result
+// is written back followed by a newline. Results are returned in the
+// order the forms were sent, and a client may send more forms without
+// waiting for the results of earlier ones.
+//
+// The render thread calls Poll() once a frame. All pipe I/O is
+// overlapped, and Poll() only starts it and checks whether it has
+// completed, so a slow or stalled client never delays a frame.
+//
+// The SceneThread must outlive the ReplServer.
+
+class ReplServer {
+public:
+    static constexpr const wchar_t* defaultPipeName = L"\\\\.\\pipe\\procdraw";
+    ReplServer(SceneThread* sceneThread, std::wstring pipeName);
+    ReplServer(const ReplServer&) = delete;
+    ReplServer& operator=(const ReplServer&) = delete;
+    ~ReplServer();
+    void Poll();
+
+private:
+    // An overlapped operation on a pipe. The OVERLAPPED must stay at the
+    // same address until the operation completes.
+    struct PipeIo {
+        OVERLAPPED overlapped{};
+        wil::unique_event event;
+        bool pending = false;
+    };
+
+    // A pipe instance. The read operation is also used to wait for a
+    // client to connect.
+    struct Client {
+        std::uint64_t id = 0;
+        wil::unique_hfile pipe;
+        PipeIo read;
+        PipeIo write;
+        char readBuffer[4096];
+        FormSplitter splitter;
+        // The data being written, and the results waiting to be written
+        // once that completes
+        std::string writing;
+        std::string outgoing;
+        bool closed = false;
+    };
+
+    SceneThread* sceneThread;
+    std::wstring pipeName;
+    std::uint64_t lastClientId = 0;
+    std::unique_ptr<Client> listener;
+    std::vector<std::unique_ptr<Client>> clients;
+    std::vector<std::string> forms;
+    std::vector<ReplResponse> responses;
+    void Listen();
+    void Read(Client& client);
+    void Write(Client& client);
+    void Close(Client& client);
+};
+
+} // namespace Procdraw
+
+#endif
@@ -0,0 +1,96 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROCDRAW_SCENE_H
+#define PROCDRAW_SCENE_H
+
+#include <cstdint>
+#include <vector>
+
+namespace Procdraw {
+
+enum class SceneCommandKind {
+    AmbientLightColor,
+    Background,
+    Color,
+    Cube,
+    LightColor,
+    RotateX,
+    RotateY,
+    RotateZ,
+    Scale,
+    Tetrahedron,
+    Translate
+};
+
+// A call of the D3D11Graphics method of the same name. Colours are hue,
+// saturation and value, rotations are in turns, and unused args are 0.
+
+struct SceneCommand {
+    SceneCommandKind kind;
+    float args[3];
+    bool operator==(const SceneCommand& other) const
+    {
+        return kind == other.kind && args[0] == other.args[0] && args[1] == other.args[1] && args[2] == other.args[2];
+    }
+    bool operator!=(const SceneCommand& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+// The drawing for one frame, recorded by the scene builtins and replayed
+// by the renderer in order. Clear() keeps the capacity, so a Scene that
+// is reused from frame to frame stops allocating once it has grown.
+
+class Scene {
+public:
+    void Add(SceneCommandKind kind, float a, float b, float c)
+    {
+        commands.push_back(SceneCommand{kind, {a, b, c}});
+    }
+    void Append(const std::vector<SceneCommand>& more)
+    {
+        commands.insert(commands.end(), more.begin(), more.end());
+    }
+    void Clear()
+    {
+        commands.clear();
+    }
+    const std::vector<SceneCommand>& Commands() const
+    {
+        return commands;
+    }
+    // The number of the frame the Scene was drawn for
+    std::uint64_t Frame() const
+    {
+        return frame;
+    }
+    void SetFrame(std::uint64_t frame)
+    {
+        this->frame = frame;
+    }
+    void SwapCommands(std::vector<SceneCommand>& other)
+    {
+        commands.swap(other);
+    }
+
+private:
+    std::vector<SceneCommand> commands;
+    std::uint64_t frame = 0;
+};
+
+} // namespace Procdraw
+
+#endif
@@ -0,0 +1,141 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "SceneThread.h"
+#include "Reader.h"
+#include <exception>
+#include <string>
+#include <utility>
+
+namespace Procdraw {
+
+SceneThread::SceneThread(std::unique_ptr<Interpreter> interpreter)
+    : interpreter(std::move(interpreter)),
+      mouseXSignal(Signal::MakeInput(0.0)),
+      mouseYSignal(Signal::MakeInput(0.0))
+{
+    this->interpreter->SetSymbolValue(this->interpreter->SymbolRef("mouse-x-signal"), Object{mouseXSignal});
+    this->interpreter->SetSymbolValue(this->interpreter->SymbolRef("mouse-y-signal"), Object{mouseYSignal});
+    thread = std::thread(&SceneThread::Run, this);
+}
+
+SceneThread::~SceneThread()
+{
+    stopping.store(true, std::memory_order_release);
+    wake.notify_one();
+    thread.join();
+}
+
+const Scene& SceneThread::LatestScene()
+{
+    // Called by the render thread
+    scenes.Update();
+    return scenes.Front();
+}
+
+void SceneThread::SetInput(const FrameInput& input)
+{
+    // Called by the render thread
+    inputs.Back() = input;
+    inputs.Publish();
+    wake.notify_one();
+}
+
+void SceneThread::Submit(ReplRequest request)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.push_back(std::move(request));
+    }
+    wake.notify_one();
+}
+
+void SceneThread::TakeResponses(std::vector<ReplResponse>& taken)
+{
+    // Appends the responses ready since the last call to taken
+    std::lock_guard<std::mutex> lock(mutex);
+    for (ReplResponse& response : responses) {
+        taken.push_back(std::move(response));
+    }
+    responses.clear();
+}
+
+void SceneThread::EvalRequests()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        evaluating.swap(requests);
+    }
+    for (ReplRequest& request : evaluating) {
+        ReplResponse response{request.client, ""};
+        try {
+            Object result = Object::MakeError(ErrorKind::BadSyntax);
+            try {
+                result = interpreter->Eval(interpreter->Read(request.text));
+            }
+            catch (const SyntaxError&) {
+                // The result stays bad-syntax
+            }
+            response.text = interpreter->Print(result);
+        }
+        catch (const std::exception& e) {
+            // Reported to the client, rather than ending the scene thread
+            response.text = std::string("#<exception ") + e.what() + ">";
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        responses.push_back(std::move(response));
+    }
+    evaluating.clear();
+}
+
+void SceneThread::Run()
+{
+    SymbolHandle mouseX = interpreter->SymbolRef("mouse-x");
+    SymbolHandle mouseY = interpreter->SymbolRef("mouse-y");
+    Object drawCall{Cons(Object::MakeSymbolHandle(interpreter->SymbolRef("draw")), nullptr)};
+    std::uint64_t frame = 0;
+    while (!stopping.load(std::memory_order_acquire)) {
+        // Requests submitted before an input was set are evaluated before
+        // that input is drawn
+        bool haveInput = inputs.Update();
+        EvalRequests();
+        if (!haveInput) {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait_for(lock, idleWait, [this] {
+                return !requests.empty();
+            });
+            continue;
+        }
+        const FrameInput& input = inputs.Front();
+        interpreter->SetSymbolValue(mouseX, input.mouseX);
+        interpreter->SetSymbolValue(mouseY, input.mouseY);
+        mouseXSignal->SetValue(input.mouseX);
+        mouseYSignal->SetValue(input.mouseY);
+        Scene& scene = scenes.Back();
+        scene.Clear();
+        scene.SetFrame(++frame);
+        // An error leaves the Scene as far as it was drawn
+        interpreter->SetScene(&scene);
+        try {
+            interpreter->Eval(drawCall);
+        }
+        catch (const std::exception&) {
+            // As does an exception, which must not end the scene thread
+        }
+        interpreter->SetScene(nullptr);
+        scenes.Publish();
+    }
+}
+
+} // namespace Procdraw
@@ -0,0 +1,116 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROCDRAW_SCENETHREAD_H
+#define PROCDRAW_SCENETHREAD_H
+
+#include "Interpreter.h"
+#include "Scene.h"
+#include "TripleBuffer.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Procdraw {
+
+// The input to a frame, passed from the render thread to the scene
+// thread. The mouse position is normalised to [0, 1].
+
+struct FrameInput {
+    double mouseX = 0.0;
+    double mouseY = 0.0;
+};
+
+// A form to evaluate for a REPL client, and the printed result. The
+// client is an id chosen by the submitter to route the result back.
+
+struct ReplRequest {
+    std::uint64_t client;
+    std::string text;
+};
+
+struct ReplResponse {
+    std::uint64_t client;
+    std::string text;
+};
+
+// Evaluates the draw function on its own thread, so that the render
+// thread's message handling and presentation never wait for a script.
+//
+// For each FrameInput set by the render thread, the scene thread sets
+// mouse-x and mouse-y, and the input signals mouse-x-signal and
+// mouse-y-signal, evaluates (draw) as one evaluation, and publishes
+// the Scene it recorded. LatestScene() returns the most recent complete
+// Scene, which is the previous frame's again if drawing the next has not
+// finished. Inputs and Scenes are exchanged through TripleBuffers, so
+// neither thread takes a lock. If frames are set faster than they are
+// drawn, the scene thread skips to the latest input.
+//
+// Forms passed to Submit() are queued and evaluated in order before the
+// next frame is drawn, so a definition takes effect in the next Scene.
+// The printed result of each, or bad-syntax if it could not be read, is
+// queued for TakeResponses(). An exception thrown while evaluating or
+// printing a form is returned as #<exception message>, and one thrown
+// while drawing ends the frame, so a client cannot stop the thread. Only these queues are guarded by a lock,
+// which is held just long to move requests and responses in or out.
+//
+// The SceneThread owns the Interpreter and is the only thread to use it
+// until the SceneThread is destroyed.
+//
+// Setting a signal to the value it already has does not change it, so
+// while the mouse is still, a draw function that reads computed signals
+// replays their recorded commands rather than recomputing them.
+
+class SceneThread {
+public:
+    explicit SceneThread(std::unique_ptr<Interpreter> interpreter);
+    SceneThread(const SceneThread&) = delete;
+    SceneThread& operator=(const SceneThread&) = delete;
+    ~SceneThread();
+    const Scene& LatestScene();
+    void SetInput(const FrameInput& input);
+    void Submit(ReplRequest request);
+    void TakeResponses(std::vector<ReplResponse>& taken);
+
+private:
+    std::unique_ptr<Interpreter> interpreter;
+    SignalPtr mouseXSignal;
+    SignalPtr mouseYSignal;
+    TripleBuffer<FrameInput> inputs;
+    TripleBuffer<Scene> scenes;
+    std::atomic<bool> stopping{false};
+    // Guards requests and responses. Wakes the scene thread when an input
+    // is set or a request submitted. SetInput() notifies without the
+    // lock, so that wakeup may be missed, and the scene thread waits for
+    // at most idleWait before checking again.
+    std::mutex mutex;
+    std::condition_variable wake;
+    static constexpr std::chrono::milliseconds idleWait{2};
+    std::vector<ReplRequest> requests;
+    std::vector<ReplResponse> responses;
+    // Owned by the scene thread, and reused to keep their capacity
+    std::vector<ReplRequest> evaluating;
+    std::thread thread;
+    void EvalRequests();
+    void Run();
+};
+
+} // namespace Procdraw
+
+#endif
@@ -0,0 +1,193 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Strings.h"
+#include "HeapUsage.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <vector>
+
+namespace Procdraw {
+
+namespace {
+
+// Buffers made by Concat() have room for at least this many characters
+constexpr size_t minGrowthCapacity = 64;
+
+} // namespace
+
+StringBuffer* StringBuffer::Allocate(size_t capacity)
+{
+    void* mem = ::operator new(sizeof(StringBuffer) + capacity);
+    HeapUsage::Allocated(sizeof(StringBuffer) + capacity);
+    return new (mem) StringBuffer(capacity);
+}
+
+void StringBuffer::Free(StringBuffer* buffer)
+{
+    size_t capacity = buffer->capacity;
+    buffer->~StringBuffer();
+    ::operator delete(buffer);
+    HeapUsage::Freed(sizeof(StringBuffer) + capacity);
+}
+
+bool StringBuffer::TryExtend(size_t end, size_t count)
+{
+    // Claims the count characters from end, if end is the end of the used
+    // characters and they fit. Strings on other threads may be extending
+    // the same buffer, so only one of them can succeed.
+    if (count > capacity - end) {
+        return false;
+    }
+    size_t expected = end;
+    return used.compare_exchange_strong(expected, end + count, std::memory_order_relaxed);
+}
+
+String::String(StringBuffer* buffer, const char* data, size_t size)
+    : data(buffer != nullptr ? data : inlineChars), size(size), buffer(buffer)
+{
+    if (buffer != nullptr) {
+        buffer->AddRef();
+    }
+    HeapUsage::Allocated(sizeof(String));
+}
+
+String::~String()
+{
+    if (buffer != nullptr && buffer->Release()) {
+        StringBuffer::Free(buffer);
+    }
+    HeapUsage::Freed(sizeof(String));
+}
+
+StringPtr String::Make(std::string_view chars)
+{
+    if (chars.size() <= inlineCapacity) {
+        return MakeInline(chars, std::string_view());
+    }
+    StringBuffer* buffer = StringBuffer::Allocate(chars.size());
+    buffer->TryExtend(0, chars.size());
+    std::memcpy(buffer->Chars(), chars.data(), chars.size());
+    return StringPtr(new String(buffer, buffer->Chars(), chars.size()));
+}
+
+StringPtr String::MakeInline(std::string_view first, std::string_view second)
+{
+    StringPtr str(new String(nullptr, nullptr, first.size() + second.size()));
+    // An empty view may have a null data(), which memcpy does not allow
+    // even for a size of 0
+    if (!first.empty()) {
+        std::memcpy(str->inlineChars, first.data(), first.size());
+    }
+    if (!second.empty()) {
+        std::memcpy(str->inlineChars + first.size(), second.data(), second.size());
+    }
+    return str;
+}
+
+StringPtr Concat(const StringPtr& a, const StringPtr& b)
+{
+    if (b->size == 0) {
+        return a;
+    }
+    if (a->size == 0) {
+        return b;
+    }
+    size_t size = a->size + b->size;
+    if (size <= String::inlineCapacity) {
+        return String::MakeInline(a->View(), b->View());
+    }
+    if (StringBuffer* buffer = a->buffer) {
+        size_t end = (a->data - buffer->Chars()) + a->size;
+        // Adjacent slices of one buffer, such as the halves of a string
+        if (b->buffer == buffer && b->data == a->data + a->size) {
+            return StringPtr(new String(buffer, a->data, size));
+        }
+        if (buffer->TryExtend(end, b->size)) {
+            std::memcpy(buffer->Chars() + end, b->data, b->size);
+            return StringPtr(new String(buffer, a->data, size));
+        }
+    }
+    StringBuffer* buffer = StringBuffer::Allocate(std::max(size * 2, minGrowthCapacity));
+    buffer->TryExtend(0, size);
+    std::memcpy(buffer->Chars(), a->data, a->size);
+    std::memcpy(buffer->Chars() + a->size, b->data, b->size);
+    return StringPtr(new String(buffer, buffer->Chars(), size));
+}
+
+StringPtr Slice(const StringPtr& str, size_t start, size_t end)
+{
+    if (start == 0 && end == str->size) {
+        return str;
+    }
+    // Short slices are copied, rather than keeping a buffer alive
+    std::string_view chars = str->View().substr(start, end - start);
+    if (chars.size() <= String::inlineCapacity) {
+        return String::MakeInline(chars, std::string_view());
+    }
+    return StringPtr(new String(str->buffer, chars.data(), chars.size()));
+}
+
+std::uint64_t StringHash(std::string_view chars)
+{
+    // Mixes in eight characters at a time, then the rest
+    constexpr std::uint64_t multiplier = 0x9e3779b97f4a7c15;
+    std::uint64_t h = chars.size() * multiplier;
+    size_t i = 0;
+    for (; i + sizeof(std::uint64_t) <= chars.size(); i += sizeof(std::uint64_t)) {
+        std::uint64_t word;
+        std::memcpy(&word, chars.data() + i, sizeof(word));
+        h = (h ^ word) * multiplier;
+        h ^= h >> 32;
+    }
+    std::uint64_t rest = 0;
+    std::memcpy(&rest, chars.data() + i, chars.size() - i);
+    h = (h ^ rest) * multiplier;
+    return h ^ (h >> 32);
+}
+
+StringPtr StringTable::Intern(const StringPtr& str)
+{
+    if (const StringPtr* interned = strings.Find(str->View())) {
+        return *interned;
+    }
+    if (strings.Size() >= sweepThreshold) {
+        Sweep();
+    }
+    // A slice of a larger buffer is copied, so that the table does not
+    // keep the rest of the buffer alive
+    StringPtr interned = str;
+    if (str->Buffer() != nullptr && str->Size() < str->Buffer()->Capacity()) {
+        interned = String::Make(str->View());
+    }
+    strings.Insert(interned->View(), interned);
+    return interned;
+}
+
+void StringTable::Sweep()
+{
+    std::vector<std::string_view> unreferenced;
+    strings.ForEach([&](std::string_view chars, const StringPtr& str) {
+        if (str.use_count() == 1) {
+            unreferenced.push_back(chars);
+        }
+    });
+    for (std::string_view chars : unreferenced) {
+        strings.Erase(chars);
+    }
+    sweepThreshold = std::max(minSweepThreshold, strings.Size() * 2);
+}
+
+} // namespace Procdraw
@@ -0,0 +1,144 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROCDRAW_STRINGS_H
+#define PROCDRAW_STRINGS_H
+
+#include "OpenHashMap.h"
+#include "RefPtr.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace Procdraw {
+
+// The characters of long Strings, stored after the buffer in the same
+// allocation. A buffer is shared by the strings sliced from it. The
+// capacity after its used characters is claimed by the first string to
+// be extended from the end of them, so that appending to a string
+// repeatedly builds it in place.
+
+class StringBuffer : public RefCounted {
+public:
+    static StringBuffer* Allocate(size_t capacity);
+    static void Free(StringBuffer* buffer);
+    size_t Capacity() const
+    {
+        return capacity;
+    }
+    char* Chars()
+    {
+        return reinterpret_cast<char*>(this + 1);
+    }
+    bool TryExtend(size_t end, size_t count);
+
+private:
+    explicit StringBuffer(size_t capacity)
+        : capacity(capacity), used(0) {}
+    size_t capacity;
+    std::atomic<size_t> used;
+};
+
+class String;
+
+using StringPtr = RefPtr<String>;
+
+// An immutable string of bytes. Strings of up to inlineCapacity bytes
+// are stored in the String itself, so that they take one allocation.
+// Longer strings are a range of the characters of a StringBuffer, which
+// Slice() and Concat() share rather than copying.
+
+class String : public RefCounted {
+public:
+    static constexpr size_t inlineCapacity = 16;
+    static StringPtr Make(std::string_view chars);
+    ~String();
+    const char* Data() const
+    {
+        return data;
+    }
+    size_t Size() const
+    {
+        return size;
+    }
+    std::string_view View() const
+    {
+        return std::string_view(data, size);
+    }
+    // The buffer holding the characters, or null if they are inline
+    const StringBuffer* Buffer() const
+    {
+        return buffer;
+    }
+
+private:
+    const char* data;
+    size_t size;
+    StringBuffer* buffer;
+    char inlineChars[inlineCapacity];
+
+    String(StringBuffer* buffer, const char* data, size_t size);
+    static StringPtr MakeInline(std::string_view first, std::string_view second);
+    friend StringPtr Concat(const StringPtr& a, const StringPtr& b);
+    friend StringPtr Slice(const StringPtr& str, size_t start, size_t end);
+};
+
+// Returns a followed by b. The result shares the buffer of a when b
+// follows a in it, or when a ends at the end of the buffer's used
+// characters and b fits in the rest. Otherwise a new buffer is made with
+// room for the result to grow to twice its size.
+StringPtr Concat(const StringPtr& a, const StringPtr& b);
+
+// Returns the characters of str from start up to end, which must
+// satisfy start <= end <= str->Size()
+StringPtr Slice(const StringPtr& str, size_t start, size_t end);
+
+std::uint64_t StringHash(std::string_view chars);
+
+// Interns Strings, so that there is one String for each sequence of
+// characters interned. Interned strings with the same characters can
+// then be compared, hashed and cached by address.
+//
+// The table holds a reference to each String. Strings that are referenced
+// only by the table are released by Sweep(), which Intern() runs each
+// time the table has doubled in size since the previous sweep.
+
+class StringTable {
+public:
+    StringPtr Intern(const StringPtr& str);
+    size_t Size() const
+    {
+        return strings.Size();
+    }
+    void Sweep();
+
+private:
+    struct ViewHash {
+        size_t operator()(std::string_view chars) const
+        {
+            return static_cast<size_t>(StringHash(chars));
+        }
+    };
+
+    static constexpr size_t minSweepThreshold = 1024;
+
+    // The keys view the characters of the interned Strings
+    OpenHashMap<std::string_view, StringPtr, ViewHash> strings;
+    size_t sweepThreshold = minSweepThreshold;
+};
+
+} // namespace Procdraw
+
+#endif
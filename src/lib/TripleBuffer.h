@@ -0,0 +1,89 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROCDRAW_TRIPLEBUFFER_H
+#define PROCDRAW_TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+
+namespace Procdraw {
+
+// Passes values, such as each frame's Scene, from one writer thread to
+// one reader thread without locks and without either side waiting for
+// the other. The writer fills Back() and calls Publish(). The reader
+// calls Update() and reads Front(), which is the most recently published
+// value.
+//
+// The writer and the reader each own one buffer. A third, spare buffer
+// holds the latest published value until the reader swaps it for its
+// own, or the writer publishes again and swaps it back. The spare's index
+// is the only state shared by the two threads, and each swap is a single
+// atomic exchange. Buffers are reused, not cleared, so a writer that
+// reuses the storage in Back() stops allocating.
+
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() = default;
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+    T& Back()
+    {
+        return buffers[back];
+    }
+    void Publish();
+    bool Update();
+    const T& Front() const
+    {
+        return buffers[front];
+    }
+
+private:
+    // The spare index is tagged while it holds a value the reader has not
+    // taken
+    static constexpr unsigned indexMask = 3;
+    static constexpr unsigned fresh = 4;
+    // The indexes are on separate cache lines so that the two threads do
+    // not contend for them
+    static constexpr size_t cacheLineSize = 64;
+
+    T buffers[3];
+    alignas(cacheLineSize) unsigned back = 0;
+    alignas(cacheLineSize) std::atomic<unsigned> spare{1};
+    alignas(cacheLineSize) unsigned front = 2;
+};
+
+template <typename T>
+void TripleBuffer<T>::Publish()
+{
+    // Makes Back() the latest value, and takes the spare as the new Back()
+    back = spare.exchange(back | fresh, std::memory_order_acq_rel) & indexMask;
+}
+
+template <typename T>
+bool TripleBuffer<T>::Update()
+{
+    // Makes the latest value Front(), if one has been published since the
+    // last Update(). Returns false, leaving Front() as it was, otherwise.
+    if ((spare.load(std::memory_order_relaxed) & fresh) == 0) {
+        return false;
+    }
+    front = spare.exchange(front, std::memory_order_acq_rel) & indexMask;
+    return true;
+}
+
+} // namespace Procdraw
+
+#endif
@@ -0,0 +1,136 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../lib/Compiler.h"
+#include "../lib/Interpreter.h"
+#include <catch.hpp>
+
+using namespace Procdraw;
+
+namespace {
+
+Object Compile(Interpreter& interpreter, const std::string& text)
+{
+    Compiler compiler(&interpreter);
+    return compiler.Compile(interpreter.Read(text).GetListPtr());
+}
+
+const SpecialForm& LambdaOf(const Object& compiled)
+{
+    if (const ClosurePtr* closure = compiled.TryGetClosurePtr()) {
+        return (*closure)->Lambda();
+    }
+    return *compiled.GetSpecialFormPtr();
+}
+
+} // namespace
+
+TEST_CASE("Compile resolves parameters to frame slots")
+{
+    Interpreter interpreter;
+    Object compiled = Compile(interpreter, "(lambda (x y) (foo x y))");
+    // A lambda that captures nothing compiles to a closure
+    REQUIRE(compiled.Type() == ObjectType::ClosurePtr);
+    const SpecialForm& lambda = LambdaOf(compiled);
+    REQUIRE(lambda.NumParams() == 2);
+    REQUIRE(lambda.FrameSize() == 2);
+    REQUIRE(interpreter.Print(lambda.Body()) == "((foo #<local 0> #<local 1>))");
+}
+
+TEST_CASE("Compile captures only the variables a lambda uses")
+{
+    Interpreter interpreter;
+    Object compiled = Compile(interpreter, "(lambda (a b c) (lambda (x) (+ x c)))");
+    const ListPtr& outerBody = LambdaOf(compiled).Body();
+    const SpecialFormPtr& inner = outerBody->First().GetSpecialFormPtr();
+    REQUIRE(inner->Captures().size() == 1);
+    REQUIRE(inner->Captures()[0].GetLocalRef().slot == 2);
+    REQUIRE_FALSE(inner->Captures()[0].GetLocalRef().captured);
+    REQUIRE(interpreter.Print(inner->Body()) == "((+ #<local 0> #<captured 0>))");
+}
+
+TEST_CASE("Compile captures through intermediate lambdas")
+{
+    Interpreter interpreter;
+    Object compiled = Compile(interpreter, "(lambda (a) (lambda () (lambda () a)))");
+    const SpecialFormPtr& middle = LambdaOf(compiled).Body()->First().GetSpecialFormPtr();
+    REQUIRE(interpreter.Print(middle->Captures()[0]) == "#<local 0>");
+    const SpecialFormPtr& inner = middle->Body()->First().GetSpecialFormPtr();
+    REQUIRE(interpreter.Print(inner->Captures()[0]) == "#<captured 0>");
+    REQUIRE(interpreter.Print(inner->Body()) == "(#<captured 0>)");
+}
+
+TEST_CASE("Compile let allocates slots in the enclosing frame")
+{
+    Interpreter interpreter;
+    Object compiled = Compile(interpreter, "(lambda (x) (let ((y x) (x 2)) (+ x y)) (let ((z 3)) z))");
+    const SpecialForm& lambda = LambdaOf(compiled);
+    REQUIRE(lambda.FrameSize() == 3);
+    const SpecialFormPtr& first = lambda.Body()->First().GetSpecialFormPtr();
+    REQUIRE(first->FrameSize() == 0);
+    REQUIRE(interpreter.Print(first->Bindings()[0].init) == "#<local 0>");
+    REQUIRE(interpreter.Print(first->Body()) == "((+ #<local 2> #<local 1>))");
+    // The second let reuses the slots of the first
+    const SpecialFormPtr& second = lambda.Body()->Rest()->First().GetSpecialFormPtr();
+    REQUIRE(second->Bindings()[0].slot == 1);
+}
+
+TEST_CASE("Compile let outside a lambda has its own frame")
+{
+    Interpreter interpreter;
+    Object compiled = Compile(interpreter, "(let ((a 1) (b 2)) (let ((c 3)) (+ a b c)))");
+    REQUIRE(compiled.GetSpecialFormPtr()->FrameSize() == 3);
+}
+
+TEST_CASE("Compile do allocates a slot for each step")
+{
+    Interpreter interpreter;
+    Object compiled = Compile(interpreter, "(do ((i 0 (+ i 1)) (v [] )) ((= i 3) v) (vector-push v i))");
+    const SpecialFormPtr& loop = compiled.GetSpecialFormPtr();
+    REQUIRE(loop->Kind() == SpecialFormKind::Do);
+    REQUIRE(loop->FrameSize() == 3);
+    const std::vector<LocalBinding>& bindings = loop->Bindings();
+    REQUIRE(bindings[0].slot == 0);
+    REQUIRE(interpreter.Print(*bindings[0].step) == "(+ #<local 0> 1)");
+    REQUIRE(bindings[0].stepSlot == 2);
+    REQUIRE_FALSE(bindings[1].step);
+    REQUIRE(interpreter.Print(loop->Operands()[0]) == "(= #<local 0> 3)");
+    REQUIRE(interpreter.Print(loop->Body()) == "((vector-push #<local 1> #<local 0>))");
+}
+
+TEST_CASE("Compile leaves quoted data as it is")
+{
+    Interpreter interpreter;
+    Object compiled = Compile(interpreter, "(lambda (x) (quote (x 1)))");
+    const SpecialFormPtr& quote = LambdaOf(compiled).Body()->First().GetSpecialFormPtr();
+    REQUIRE(quote->Kind() == SpecialFormKind::Quote);
+    REQUIRE(interpreter.Print(quote->Operands()[0]) == "(x 1)");
+}
+
+TEST_CASE("Compile rejects malformed lambda and let forms")
+{
+    Interpreter interpreter;
+    for (const char* text : {"(lambda x x)",
+                             "(lambda (1) 1)",
+                             "(lambda (x))",
+                             "(lambda)",
+                             "(let (x) x)",
+                             "(let ((x)) x)",
+                             "(let ((1 2)) 1)",
+                             "(let ((x 1)))",
+                             "(+ 1 (lambda (x)))"}) {
+        INFO(text);
+        REQUIRE(Compile(interpreter, text).GetError() == ErrorKind::BadSyntax);
+    }
+}
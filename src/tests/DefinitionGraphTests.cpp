@@ -0,0 +1,73 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../lib/DefinitionGraph.h"
+#include <algorithm>
+#include <catch.hpp>
+#include <vector>
+
+using namespace Procdraw;
+
+TEST_CASE("DefinitionGraph dependents are in dependency order")
+{
+    // b and c read a, d reads b and c, and e reads d
+    DefinitionGraph graph;
+    graph.Define(2, Object::None(), {1});
+    graph.Define(3, Object::None(), {1, 1});
+    graph.Define(4, Object::None(), {3, 2});
+    graph.Define(5, Object::None(), {4});
+    REQUIRE(graph.Size() == 4);
+    REQUIRE(graph.Find(3)->reads == std::vector<SymbolHandle>{1});
+
+    std::vector<SymbolHandle> dependents = graph.Dependents(1);
+    REQUIRE(dependents.size() == 4);
+    auto position = [&](SymbolHandle symbol) {
+        return std::find(dependents.begin(), dependents.end(), symbol) - dependents.begin();
+    };
+    REQUIRE(position(2) < position(4));
+    REQUIRE(position(3) < position(4));
+    REQUIRE(position(4) < position(5));
+
+    REQUIRE(graph.Dependents(4) == std::vector<SymbolHandle>{5});
+    REQUIRE(graph.Dependents(5).empty());
+    REQUIRE(graph.Dependents(6).empty());
+}
+
+TEST_CASE("DefinitionGraph replaces and forgets definitions")
+{
+    DefinitionGraph graph;
+    graph.Define(2, Object::None(), {1});
+    graph.Define(3, Object::None(), {2});
+
+    // 2 no longer reads 1
+    graph.Define(2, Object::None(), {4});
+    REQUIRE(graph.Dependents(1).empty());
+    REQUIRE(graph.Dependents(4) == std::vector<SymbolHandle>{2, 3});
+
+    graph.Forget(3);
+    REQUIRE(graph.Find(3) == nullptr);
+    REQUIRE(graph.Dependents(2).empty());
+    REQUIRE(graph.Size() == 1);
+}
+
+TEST_CASE("DefinitionGraph dependents include each definition of a cycle once")
+{
+    // A definition may read itself, and two definitions may read each
+    // other
+    DefinitionGraph graph;
+    graph.Define(1, Object::None(), {1, 2});
+    graph.Define(2, Object::None(), {1});
+    REQUIRE(graph.Dependents(1) == std::vector<SymbolHandle>{2});
+    REQUIRE(graph.Dependents(2) == std::vector<SymbolHandle>{1});
+}
@@ -0,0 +1,175 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../lib/Equality.h"
+#include "../lib/Interpreter.h"
+#include <catch.hpp>
+#include <cmath>
+#include <string>
+
+using namespace Procdraw;
+
+namespace {
+
+void RequireEqual(const Object& a, const Object& b)
+{
+    REQUIRE(EqualObjects(a, b));
+    REQUIRE(EqualObjects(b, a));
+    REQUIRE(HashObject(a) == HashObject(b));
+}
+
+// A list nested depth deep in the first of each node, ending in leaf
+ListPtr NestedList(int depth, Object leaf)
+{
+    ListPtr lst = Cons(std::move(leaf), nullptr);
+    for (int i = 1; i < depth; ++i) {
+        lst = Cons(Object{std::move(lst)}, nullptr);
+    }
+    return lst;
+}
+
+// Frees a nested list one level at a time, as freeing the outer node
+// would otherwise free each level recursively
+void FreeNestedList(ListPtr lst)
+{
+    while (lst != nullptr) {
+        const ListPtr* inner = lst->First().TryGetListPtr();
+        ListPtr next = inner != nullptr ? *inner : nullptr;
+        lst = std::move(next);
+    }
+}
+
+} // namespace
+
+TEST_CASE("EqualObjects compares structure")
+{
+    Interpreter interpreter;
+    auto read = [&](const std::string& text) {
+        return interpreter.Read(text);
+    };
+    RequireEqual(read("(1 (2.5 \"s\") [a {b 1 2 [3]}] none true)"), read("(1 (2.5 \"s\") [a {b 1 2 [3]}] none true)"));
+    RequireEqual(read("0.0"), read("-0.0"));
+    RequireEqual(read("()"), read("()"));
+    RequireEqual(read("{}"), read("{}"));
+
+    REQUIRE_FALSE(EqualObjects(read("(1 2)"), read("(1 2 3)")));
+    REQUIRE_FALSE(EqualObjects(read("(1 2 3)"), read("(1 2)")));
+    REQUIRE_FALSE(EqualObjects(read("(1 (2))"), read("(1 (3))")));
+    REQUIRE_FALSE(EqualObjects(read("1"), read("1.0")));
+    REQUIRE_FALSE(EqualObjects(read("(1)"), read("[1]")));
+    REQUIRE_FALSE(EqualObjects(read("[1 2]"), read("[1 3]")));
+    REQUIRE_FALSE(EqualObjects(read("{a 1}"), read("{a 2}")));
+    REQUIRE_FALSE(EqualObjects(read("{a 1}"), read("{b 1}")));
+    REQUIRE_FALSE(EqualObjects(read("{a 1}"), read("{a 1 b 2}")));
+    REQUIRE_FALSE(EqualObjects(read("\"ab\""), read("\"abc\"")));
+}
+
+TEST_CASE("EqualObjects compares numeric arrays by element")
+{
+    NumericArrayPtr a(new NumericArray(NumericArrayType::Float32, 3));
+    NumericArrayPtr b(new NumericArray(NumericArrayType::Float32, 3));
+    a->Float32Data()[1] = 0.5f;
+    b->Float32Data()[1] = 0.5f;
+    b->Float32Data()[2] = -0.0f;
+    RequireEqual(a, b);
+    b->Float32Data()[0] = 1.0f;
+    REQUIRE_FALSE(EqualObjects(a, b));
+    REQUIRE_FALSE(EqualObjects(a, NumericArrayPtr(new NumericArray(NumericArrayType::Int32, 3))));
+}
+
+TEST_CASE("EqualObjects compares functions and signals by identity")
+{
+    Interpreter interpreter;
+    Object f = interpreter.Eval(interpreter.Read("(lambda (x) x)"));
+    Object g = interpreter.Eval(interpreter.Read("(lambda (x) x)"));
+    RequireEqual(f, f);
+    REQUIRE_FALSE(EqualObjects(f, g));
+    REQUIRE_FALSE(EqualObjects(Object{Signal::MakeInput(1)}, Object{Signal::MakeInput(1)}));
+}
+
+TEST_CASE("EqualObjects does not traverse shared parts")
+{
+    // The lists share a tail that is not itself equal to anything, as
+    // it holds a NaN, so only the heads are compared
+    ListPtr tail = Cons(std::nan(""), nullptr);
+    REQUIRE(EqualObjects(Cons(1, tail), Cons(1, tail)));
+    REQUIRE_FALSE(EqualObjects(Cons(1, tail), Cons(1, Cons(std::nan(""), nullptr))));
+    Object vec{VectorPtr(new Vector({Object{std::nan("")}}))};
+    REQUIRE(EqualObjects(vec, vec));
+}
+
+TEST_CASE("HashObject distinguishes different structures")
+{
+    Interpreter interpreter;
+    auto hash = [&](const std::string& text) {
+        return HashObject(interpreter.Read(text));
+    };
+    REQUIRE(hash("((1 2) 3)") != hash("(1 (2 3))"));
+    REQUIRE(hash("(1 2 3)") != hash("(3 2 1)"));
+    REQUIRE(hash("(1 2)") != hash("[1 2]"));
+    REQUIRE(hash("1") != hash("1.0"));
+    REQUIRE(hash("{a 1 b 2}") != hash("{a 2 b 1}"));
+    REQUIRE(hash("{a 1 b 2}") == hash("{b 2 a 1}"));
+    REQUIRE(hash("\"abc\"") != hash("abc"));
+}
+
+TEST_CASE("EqualObjects and HashObject end on containers that hold themselves")
+{
+    Interpreter interpreter;
+    auto eval = [&](const std::string& text) {
+        return interpreter.Eval(interpreter.Read(text));
+    };
+    eval("(define v [1 2])");
+    eval("(vector-set! v 0 v)");
+    eval("(define w [1 2])");
+    eval("(vector-set! w 0 w)");
+    eval("(define u [1 3])");
+    eval("(vector-set! u 0 u)");
+    RequireEqual(eval("v"), eval("w"));
+    REQUIRE_FALSE(EqualObjects(eval("v"), eval("u")));
+    REQUIRE(eval("(equal? v w)").GetBoolean());
+    REQUIRE(eval("(= (hash v) (hash w))").GetBoolean());
+
+    // x and y hold each other, so unroll to the same structure as v
+    eval("(define x [1 2])");
+    eval("(define y [x 2])");
+    eval("(vector-set! x 0 y)");
+    RequireEqual(eval("v"), eval("x"));
+
+    eval("(define m {})");
+    eval("(hash-set! m 1 [m])");
+    eval("(define n {})");
+    eval("(hash-set! n 1 [n])");
+    RequireEqual(eval("m"), eval("n"));
+
+    // Breaks the reference cycles so that the containers are freed
+    for (const char* name : {"v", "w", "u", "x"}) {
+        eval(std::string("(vector-set! ") + name + " 0 1)");
+    }
+    eval("(hash-set! m 1 1)");
+    eval("(hash-set! n 1 1)");
+}
+
+TEST_CASE("EqualObjects and HashObject do not recurse on deeply nested lists")
+{
+    ListPtr a = NestedList(1000000, 1);
+    ListPtr b = NestedList(1000000, 1);
+    ListPtr c = NestedList(1000000, 2);
+    RequireEqual(a, b);
+    REQUIRE_FALSE(EqualObjects(a, c));
+    REQUIRE(HashObject(a) != HashObject(c));
+    FreeNestedList(std::move(a));
+    FreeNestedList(std::move(b));
+    FreeNestedList(std::move(c));
+}
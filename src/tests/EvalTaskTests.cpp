@@ -0,0 +1,204 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../lib/EvalTask.h"
+#include "../lib/Interpreter.h"
+#include <catch.hpp>
+#include <chrono>
+#include <string>
+
+using namespace Procdraw;
+
+namespace {
+
+// Runs a task for expr to the end, in slices of sliceSteps
+std::string RunInSlices(Interpreter& interpreter, const std::string& expr, std::uint64_t sliceSteps)
+{
+    EvalTask task(&interpreter, interpreter.Read(expr));
+    EvalBudget budget;
+    budget.maxSteps = sliceSteps;
+    while (task.Run(budget) == EvalStatus::Suspended) {
+        REQUIRE_FALSE(task.Finished());
+    }
+    REQUIRE(task.Finished());
+    return interpreter.Print(task.Result());
+}
+
+} // namespace
+
+TEST_CASE("EvalTask gives the same results as Eval")
+{
+    const char* exprs[] = {
+        "42",
+        "(+ 1 2)",
+        "[1 (+ 1 1) (* 3 1)]",
+        "{a (+ 1 2)}",
+        "(quote (a b))",
+        "(if (< 1 2) 10 20)",
+        "(if false 10)",
+        "(let ((x 2) (y 3)) (* x y))",
+        "(let ((f (lambda (x) (lambda (y) (+ x y))))) ((f 1) 2))",
+        "(do ((i 0 (+ i 1)) (sum 0 (+ sum i))) ((= i 10) sum))",
+        "(do ((i 0 (+ i 1))) ((= i 3)))",
+        "(to-vector (map (lambda (x) (* x x)) (range 4)))",
+        "(undefined-fun 1)",
+        "((lambda (x) x))",
+    };
+    for (const char* expr : exprs) {
+        Interpreter interpreter;
+        std::string expected = interpreter.Print(interpreter.Eval(interpreter.Read(expr)));
+        Interpreter sliced;
+        REQUIRE(RunInSlices(sliced, expr, UINT64_MAX) == expected);
+        REQUIRE(RunInSlices(sliced, expr, 1) == expected);
+    }
+}
+
+TEST_CASE("EvalTask resumes where the last slice stopped")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define fact (lambda (n) (if (< n 2) 1 (* n (fact (- n 1))))))"));
+    EvalTask task(&interpreter, interpreter.Read("(fact 10)"));
+    EvalBudget budget;
+    budget.maxSteps = 5;
+    int slices = 1;
+    while (task.Run(budget) == EvalStatus::Suspended) {
+        // Other evaluation may happen between slices
+        REQUIRE(interpreter.Eval(interpreter.Read("(fact 3)")).GetInteger() == 6);
+        ++slices;
+    }
+    REQUIRE(task.Result().GetInteger() == 3628800);
+    REQUIRE(slices > 10);
+    REQUIRE(task.Steps() <= static_cast<std::uint64_t>(slices) * budget.maxSteps);
+}
+
+TEST_CASE("EvalTask defines globals and macros")
+{
+    Interpreter interpreter;
+    REQUIRE(RunInSlices(interpreter, "(define x (+ 1 2))", 1) == "3");
+    REQUIRE(RunInSlices(interpreter, "(defmacro unless (c e) (list (quote if) c false e))", 1) == "#<macro>");
+    REQUIRE(RunInSlices(interpreter, "(unless (= x 4) x)", 1) == "3");
+    REQUIRE(interpreter.Eval(interpreter.Read("(unless false x)")).GetInteger() == 3);
+
+    // A macro called other than by its global name is not a function
+    REQUIRE(RunInSlices(interpreter, "(let ((n unless)) (n false 1))", 1) == "#<error not-a-function>");
+    REQUIRE(RunInSlices(interpreter, "((if true unless unless) false 1)", 1) == "#<error not-a-function>");
+}
+
+TEST_CASE("EvalTask records the symbols read by top-level definitions")
+{
+    Interpreter interpreter;
+    REQUIRE(RunInSlices(interpreter, "(define a 2)", 1) == "2");
+    REQUIRE(RunInSlices(interpreter, "(define b (* a a))", 1) == "4");
+    // A definition that fails is not recorded
+    REQUIRE(RunInSlices(interpreter, "(define c (+ a false))", 1) == "#<error type-error>");
+    // Evaluations between slices do not add to the task's reads
+    EvalTask task(&interpreter, interpreter.Read("(define c (+ b 1))"));
+    EvalBudget budget;
+    budget.maxSteps = 1;
+    while (task.Run(budget) == EvalStatus::Suspended) {
+        interpreter.Eval(interpreter.Read("a"));
+    }
+    REQUIRE(task.Result().GetInteger() == 5);
+
+    REQUIRE(RunInSlices(interpreter, "(define a 3)", 1) == "3");
+    REQUIRE(interpreter.Eval(interpreter.Read("c")).GetInteger() == 10);
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(reloaded)"))) == "(b c)");
+}
+
+TEST_CASE("EvalTask keeps its forms when the compiled forms are cleared")
+{
+    Interpreter interpreter;
+    EvalTask task(&interpreter, interpreter.Read("(let ((x 1)) (if (< x 2) (do ((i 0 (+ i 1))) ((= i 20) (+ x i))) 0))"));
+    EvalBudget budget;
+    budget.maxSteps = 1;
+    while (task.Run(budget) == EvalStatus::Suspended) {
+        // Defining a macro clears the Interpreter's compiled forms
+        interpreter.Eval(interpreter.Read("(defmacro m (x) x)"));
+    }
+    REQUIRE(task.Result().GetInteger() == 21);
+}
+
+TEST_CASE("EvalTask does not use the C++ stack for recursion")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define count (lambda (n) (if (= n 0) 0 (+ 1 (count (- n 1))))))"));
+    REQUIRE(RunInSlices(interpreter, "(count 100000)", 10000) == "100000");
+}
+
+TEST_CASE("EvalTask ends at the first error")
+{
+    Interpreter interpreter;
+    EvalTask task(&interpreter, interpreter.Read("(let ((x (+ 1 false))) (define y 1))"));
+    REQUIRE(task.Run(EvalBudget{}) == EvalStatus::Finished);
+    REQUIRE(task.Result().GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.SymbolValue(interpreter.SymbolRef("y")).Type() == ObjectType::None);
+}
+
+TEST_CASE("EvalTask suspends when the time budget runs out")
+{
+    Interpreter interpreter;
+    EvalTask task(&interpreter, interpreter.Read("(do ((i 0 (+ i 1))) (false))"));
+    EvalBudget budget;
+    budget.maxTime = std::chrono::milliseconds(1);
+    REQUIRE(task.Run(budget) == EvalStatus::Suspended);
+    REQUIRE(task.Run(budget) == EvalStatus::Suspended);
+    REQUIRE(task.Steps() > 0);
+}
+
+TEST_CASE("EvalTask and Eval capture variables without using steps")
+{
+    // Under each step quota both give the same result, and a closure
+    // never captures the error from running out of steps
+    Interpreter interpreter;
+    Object expr = interpreter.Read("(let ((a 1) (b 2) (c 3)) (lambda () (+ a b c)))");
+    for (std::uint64_t maxSteps = 1; maxSteps < 20; ++maxSteps) {
+        EvalQuotas quotas;
+        quotas.maxSteps = maxSteps;
+        interpreter.SetQuotas(quotas);
+        Object fun = interpreter.Eval(expr);
+        EvalTask task(&interpreter, expr);
+        REQUIRE(task.Run(EvalBudget{}) == EvalStatus::Finished);
+        REQUIRE(interpreter.Print(task.Result()) == interpreter.Print(fun));
+        if (fun.Type() == ObjectType::ClosurePtr) {
+            interpreter.SetQuotas(EvalQuotas{});
+            REQUIRE(interpreter.Apply(fun, nullptr).GetInteger() == 6);
+        }
+    }
+}
+
+TEST_CASE("EvalTask counts quotas across slices")
+{
+    Interpreter interpreter;
+    EvalQuotas quotas;
+    quotas.maxSteps = 1000;
+    interpreter.SetQuotas(quotas);
+    EvalTask task(&interpreter, interpreter.Read("(do ((i 0 (+ i 1))) (false))"));
+    EvalBudget budget;
+    budget.maxSteps = 100;
+    int slices = 0;
+    while (task.Run(budget) == EvalStatus::Suspended) {
+        REQUIRE(interpreter.Eval(interpreter.Read("(+ 1 2)")).GetInteger() == 3);
+        ++slices;
+    }
+    REQUIRE(task.Result().GetError() == ErrorKind::StepQuotaExceeded);
+    REQUIRE(slices > 10);
+
+    quotas = EvalQuotas{};
+    quotas.maxDepth = 100;
+    interpreter.SetQuotas(quotas);
+    interpreter.Eval(interpreter.Read("(define count (lambda (n) (if (= n 0) 0 (+ 1 (count (- n 1))))))"));
+    EvalTask deep(&interpreter, interpreter.Read("(count 1000)"));
+    REQUIRE(deep.Run(EvalBudget{}) == EvalStatus::Finished);
+    REQUIRE(deep.Result().GetError() == ErrorKind::DepthQuotaExceeded);
+}
@@ -0,0 +1,85 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../lib/FormSplitter.h"
+#include <catch.hpp>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace Procdraw;
+
+namespace {
+
+void Feed(FormSplitter& splitter, const char* text, std::vector<std::string>& forms)
+{
+    splitter.Feed(text, std::strlen(text), forms);
+}
+
+} // namespace
+
+TEST_CASE("FormSplitter splits text into top-level forms")
+{
+    FormSplitter splitter;
+    std::vector<std::string> forms;
+    Feed(splitter, "(define a 1) [1 (2)] {a {b 2}}\n  'x '(1 2) 42\n", forms);
+    REQUIRE(forms == std::vector<std::string>{"(define a 1)", "[1 (2)]", "{a {b 2}}", "'x", "'(1 2)", "42"});
+}
+
+TEST_CASE("FormSplitter joins forms split across chunks")
+{
+    FormSplitter splitter;
+    std::vector<std::string> forms;
+    Feed(splitter, "(define draw (lambda ()", forms);
+    REQUIRE(forms.empty());
+    Feed(splitter, "\n  (cube)))(+ 1", forms);
+    REQUIRE(forms == std::vector<std::string>{"(define draw (lambda ()\n  (cube)))"});
+    Feed(splitter, " 2)", forms);
+    REQUIRE(forms.size() == 2);
+    REQUIRE(forms[1] == "(+ 1 2)");
+}
+
+TEST_CASE("FormSplitter ends a top-level atom at the next whitespace or delimiter")
+{
+    FormSplitter splitter;
+    std::vector<std::string> forms;
+    Feed(splitter, "12", forms);
+    REQUIRE(forms.empty());
+    Feed(splitter, "3", forms);
+    REQUIRE(forms.empty());
+    Feed(splitter, "(a)b", forms);
+    REQUIRE(forms == std::vector<std::string>{"123", "(a)"});
+    Feed(splitter, "\n", forms);
+    REQUIRE(forms == std::vector<std::string>{"123", "(a)", "b"});
+}
+
+TEST_CASE("FormSplitter keeps delimiters in strings")
+{
+    FormSplitter splitter;
+    std::vector<std::string> forms;
+    Feed(splitter, "(print \"a) [\\\"b\") \"c\"x", forms);
+    REQUIRE(forms == std::vector<std::string>{"(print \"a) [\\\"b\")", "\"c\""});
+    // A string split across chunks, ending with an escaped quote
+    Feed(splitter, " \"d \\", forms);
+    Feed(splitter, "\"\" ", forms);
+    REQUIRE(forms == std::vector<std::string>{"(print \"a) [\\\"b\")", "\"c\"", "x", "\"d \\\"\""});
+}
+
+TEST_CASE("FormSplitter leaves checking syntax to the Reader")
+{
+    FormSplitter splitter;
+    std::vector<std::string> forms;
+    Feed(splitter, "(a]) ' b ", forms);
+    REQUIRE(forms == std::vector<std::string>{"(a]", ")", "' b"});
+}
@@ -17,7 +17,7 @@
 
 TEST_CASE("FunctionDocsTests")
 {
-    const int expectedNumTests = 10;
+    const int expectedNumTests = 147;
 
     Procdraw::Tests::DocsTester tester;
     bool passed = tester.RunTests(PROCDRAW_DOCS_FILE,
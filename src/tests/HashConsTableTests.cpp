@@ -0,0 +1,70 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../lib/HashConsTable.h"
+#include <catch.hpp>
+
+using namespace Procdraw;
+
+TEST_CASE("HashConsTable shares structurally equal lists")
+{
+    HashConsTable table;
+    ListPtr a = table.Cons(1, table.Cons(2.5, table.Cons(Object::MakeSymbolHandle(3), nullptr)));
+    ListPtr b = table.Cons(1, table.Cons(2.5, table.Cons(Object::MakeSymbolHandle(3), nullptr)));
+    REQUIRE(a == b);
+    REQUIRE(table.Size() == 3);
+
+    // Nested lists are compared by their interned address
+    ListPtr c = table.Cons(a, nullptr);
+    ListPtr d = table.Cons(b, nullptr);
+    REQUIRE(c == d);
+    REQUIRE(table.Size() == 4);
+}
+
+TEST_CASE("HashConsTable distinguishes different values")
+{
+    HashConsTable table;
+    REQUIRE(table.Cons(1, nullptr) != table.Cons(2, nullptr));
+    REQUIRE(table.Cons(1, nullptr) != table.Cons(1.0, nullptr));
+    REQUIRE(table.Cons(0.0, nullptr) != table.Cons(-0.0, nullptr));
+    REQUIRE(table.Cons(true, nullptr) != table.Cons(1, nullptr));
+    REQUIRE(table.Cons(Object::MakeSymbolHandle(1), nullptr) != table.Cons(1, nullptr));
+}
+
+TEST_CASE("HashConsTable Sweep releases unreferenced lists")
+{
+    HashConsTable table;
+    ListPtr kept = table.Cons(1, table.Cons(2, nullptr));
+    {
+        ListPtr lst = nullptr;
+        for (int i = 0; i < 100; ++i) {
+            lst = table.Cons(i, lst);
+        }
+        table.Cons(lst, nullptr);
+    }
+    REQUIRE(table.Size() == 103);
+
+    table.Sweep();
+    REQUIRE(table.Size() == 2);
+    REQUIRE(table.Cons(1, table.Cons(2, nullptr)) == kept);
+}
+
+TEST_CASE("HashConsTable sweeps as it grows")
+{
+    HashConsTable table;
+    for (int i = 0; i < 100000; ++i) {
+        table.Cons(i, nullptr);
+    }
+    REQUIRE(table.Size() < 2048);
+}
@@ -14,6 +14,8 @@
 
 #include "../lib/Interpreter.h"
 #include <catch.hpp>
+#include <cmath>
+#include <string>
 
 using namespace Procdraw;
 
@@ -24,6 +26,30 @@ TEST_CASE("Print Bool")
     REQUIRE(interpreter.Print(false) == "false");
 }
 
+TEST_CASE("Print Error")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Print(Object::MakeError(ErrorKind::TypeError)) == "#<error type-error>");
+    REQUIRE(interpreter.Print(Object::MakeError(ErrorKind::NotAFunction)) == "#<error not-a-function>");
+    REQUIRE(interpreter.Print(Object::MakeError(ErrorKind::StepQuotaExceeded)) == "#<error step-quota-exceeded>");
+}
+
+TEST_CASE("Print Float")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Print(1.5) == "1.5");
+    REQUIRE(interpreter.Print(2.0) == "2.0");
+    REQUIRE(interpreter.Print(-0.1) == "-0.1");
+    REQUIRE(interpreter.Print(1e100) == "1e+100");
+    REQUIRE(interpreter.Read(interpreter.Print(0.1)).GetFloat() == 0.1);
+    // Non-finite values do not read back as Floats
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(/ 1.0 0.0)"))) == "inf");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(/ -1.0 0.0)"))) == "-inf");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(/ 0.0 0.0)"))) == "nan");
+    REQUIRE(interpreter.Print(-std::nan("")) == "nan");
+    REQUIRE(interpreter.Read("inf").Type() == ObjectType::SymbolHandle);
+}
+
 TEST_CASE("Print Int")
 {
     Interpreter interpreter;
@@ -46,12 +72,83 @@ TEST_CASE("Print List")
             == "((1) (2))");
 }
 
+TEST_CASE("Print NumericArray")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(make-int-array 3 7)"))) == "#i32(7 7 7)");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(make-float-array 2 0.1)"))) == "#f32(0.1 0.1)");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(make-float-array 0)"))) == "#f32()");
+}
+
+TEST_CASE("Print CFunction")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("+"))) == "#<builtin>");
+}
+
+TEST_CASE("Print Closure")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(lambda (x) x)"))) == "#<closure>");
+}
+
+TEST_CASE("Print HashMap")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Print(HashMapPtr(new HashMap())) == "{}");
+    REQUIRE(interpreter.Print(interpreter.Read("{a 1}")) == "{a 1}");
+    REQUIRE(interpreter.Print(interpreter.Read("{1 (2 3)}")) == "{1 (2 3)}");
+}
+
+TEST_CASE("Print HashMap that holds itself")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define m {})"));
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(hash-set! m 1 [m])"))) == "{1 [{...}]}");
+    // Breaks the reference cycle so that m is freed
+    interpreter.Eval(interpreter.Read("(hash-set! m 1 2)"));
+}
+
 TEST_CASE("Print None")
 {
     Interpreter interpreter;
     REQUIRE(interpreter.Print(Object::None()) == "none");
 }
 
+TEST_CASE("Print Vector")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Print(VectorPtr(new Vector())) == "[]");
+    REQUIRE(interpreter.Print(interpreter.Read("[1 [2 3] (4)]")) == "[1 [2 3] (4)]");
+}
+
+TEST_CASE("Print Vector that holds itself")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define v [1 2])"));
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(vector-set! v 0 v)"))) == "[[...] 2]");
+    interpreter.Eval(interpreter.Read("(define w [v v])"));
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("w"))) == "[[[...] 2] [[...] 2]]");
+    // Breaks the reference cycle so that v is freed
+    interpreter.Eval(interpreter.Read("(vector-set! v 0 1)"));
+}
+
+TEST_CASE("Print Sequence")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(range 10)"))) == "#<sequence>");
+}
+
+TEST_CASE("Print String")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Print(String::Make("")) == "\"\"");
+    REQUIRE(interpreter.Print(String::Make("a\"b\\c\nd\re\tf")) == "\"a\\\"b\\\\c\\nd\\re\\tf\"");
+    // Printed strings read back as equal strings
+    std::string printed = interpreter.Print(String::Make("say \"hi\"\n"));
+    REQUIRE(interpreter.Read(printed).GetStringPtr()->View() == "say \"hi\"\n");
+}
+
 TEST_CASE("Print Symbol")
 {
     Interpreter interpreter;
@@ -56,6 +56,39 @@ TEST_CASE("Read integer with positive sign")
     REQUIRE(obj.GetInteger() == 42);
 }
 
+TEST_CASE("Read integer with negative sign")
+{
+    Interpreter interpreter;
+    Object obj = interpreter.Read("-42");
+    REQUIRE(obj.Type() == ObjectType::Integer);
+    REQUIRE(obj.GetInteger() == -42);
+}
+
+TEST_CASE("Read float")
+{
+    Interpreter interpreter;
+
+    Object obj = interpreter.Read("1.5");
+    REQUIRE(obj.Type() == ObjectType::Float);
+    REQUIRE(obj.GetFloat() == 1.5);
+
+    obj = interpreter.Read("+2.");
+    REQUIRE(obj.Type() == ObjectType::Float);
+    REQUIRE(obj.GetFloat() == 2.0);
+
+    obj = interpreter.Read("-0.25");
+    REQUIRE(obj.Type() == ObjectType::Float);
+    REQUIRE(obj.GetFloat() == -0.25);
+
+    obj = interpreter.Read("1e3");
+    REQUIRE(obj.Type() == ObjectType::Float);
+    REQUIRE(obj.GetFloat() == 1000.0);
+
+    obj = interpreter.Read("2.5e-1");
+    REQUIRE(obj.Type() == ObjectType::Float);
+    REQUIRE(obj.GetFloat() == 0.25);
+}
+
 TEST_CASE("Read empty list")
 {
     Interpreter interpreter;
@@ -109,6 +142,93 @@ TEST_CASE("Read a list with an embedded list")
     REQUIRE(lst->Rest()->Rest()->Rest() == nullptr);
 }
 
+TEST_CASE("Read vectors")
+{
+    Interpreter interpreter;
+
+    VectorPtr vec = interpreter.Read("[]").GetVectorPtr();
+    REQUIRE(vec->Size() == 0);
+
+    vec = interpreter.Read("[1 [2.5] (foo)]").GetVectorPtr();
+    REQUIRE(vec->Size() == 3);
+    REQUIRE(vec->At(0).GetInteger() == 1);
+    REQUIRE(vec->At(1).GetVectorPtr()->At(0).GetFloat() == 2.5);
+    REQUIRE(interpreter.SymbolName(vec->At(2).GetListPtr()->First().GetSymbolHandle()) == "foo");
+
+    REQUIRE_THROWS_AS(interpreter.Read("[1 2"), SyntaxError);
+}
+
+TEST_CASE("Read hash maps")
+{
+    Interpreter interpreter;
+
+    HashMapPtr map = interpreter.Read("{}").GetHashMapPtr();
+    REQUIRE(map->Size() == 0);
+
+    map = interpreter.Read("{size 2.5 1 [3]}").GetHashMapPtr();
+    REQUIRE(map->Size() == 2);
+    REQUIRE(map->Find(Object::MakeSymbolHandle(interpreter.SymbolRef("size")))->GetFloat() == 2.5);
+    REQUIRE(map->Find(1)->GetVectorPtr()->At(0).GetInteger() == 3);
+
+    // String keys are found by their characters
+    map = interpreter.Read("{\"a\" 1 \"b\" 2}").GetHashMapPtr();
+    REQUIRE(map->Size() == 2);
+    REQUIRE(map->Find(String::Make("b"))->GetInteger() == 2);
+
+    REQUIRE_THROWS_AS(interpreter.Read("{a 1"), SyntaxError);
+    REQUIRE_THROWS_AS(interpreter.Read("{a}"), SyntaxError);
+    REQUIRE_THROWS_AS(interpreter.Read("{1.5 1}"), SyntaxError);
+}
+
+TEST_CASE("Read with hash consing shares equal lists")
+{
+    Interpreter interpreter;
+    interpreter.SetHashConsing(true);
+
+    ListPtr lst = interpreter.Read("((box 1 2) (box 1 2) (box 1 3))").GetListPtr();
+    const ListPtr& first = lst->First().GetListPtr();
+    const ListPtr& second = lst->Rest()->First().GetListPtr();
+    const ListPtr& third = lst->Rest()->Rest()->First().GetListPtr();
+    REQUIRE(first == second);
+    REQUIRE(first != third);
+    REQUIRE(first->Rest() != third->Rest());
+    REQUIRE(interpreter.Print(lst) == "((box 1 2) (box 1 2) (box 1 3))");
+
+    REQUIRE(interpreter.Read("(box 1 2)").GetListPtr() == first);
+    REQUIRE(interpreter.Read("()").GetListPtr() == nullptr);
+    REQUIRE_THROWS_AS(interpreter.Read("(box 1"), SyntaxError);
+}
+
+TEST_CASE("Read strings")
+{
+    Interpreter interpreter;
+    Object obj = interpreter.Read("\"hello world\"");
+    REQUIRE(obj.Type() == ObjectType::StringPtr);
+    REQUIRE(obj.GetStringPtr()->View() == "hello world");
+    REQUIRE(interpreter.Read("\"\"").GetStringPtr()->Size() == 0);
+    REQUIRE(interpreter.Read("\"a\\\"b\\\\c\\nd\\re\\tf\"").GetStringPtr()->View() == "a\"b\\c\nd\re\tf");
+    REQUIRE(interpreter.Print(interpreter.Read("(\"a b\" x)")) == "(\"a b\" x)");
+    REQUIRE_THROWS_AS(interpreter.Read("\"abc"), SyntaxError);
+    REQUIRE_THROWS_AS(interpreter.Read("\"a\\qb\""), SyntaxError);
+}
+
+TEST_CASE("Read with hash consing interns strings")
+{
+    Interpreter interpreter;
+    interpreter.SetHashConsing(true);
+    ListPtr lst = interpreter.Read("((label \"a\") (label \"a\"))").GetListPtr();
+    REQUIRE(lst->First().GetListPtr() == lst->Rest()->First().GetListPtr());
+}
+
+TEST_CASE("Read quote char as a quote form")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Print(interpreter.Read("'a")) == "(quote a)");
+    REQUIRE(interpreter.Print(interpreter.Read("'(1 'b)")) == "(quote (1 (quote b)))");
+    REQUIRE_THROWS_AS(interpreter.Read("'"), SyntaxError);
+    REQUIRE_THROWS_AS(interpreter.Read("(a ')"), SyntaxError);
+}
+
 TEST_CASE("Read star char as symbol")
 {
     Interpreter interpreter;
@@ -126,3 +246,29 @@ TEST_CASE("Read plus char as Symbol")
     REQUIRE(lst->Rest()->First().Type() == ObjectType::Integer);
     REQUIRE(lst->Rest()->First().GetInteger() == 42);
 }
+
+TEST_CASE("Read minus and slash chars as Symbols")
+{
+    Interpreter interpreter;
+    ListPtr lst = interpreter.Read("(- / 1)").GetListPtr();
+    REQUIRE(interpreter.SymbolName(lst->First().GetSymbolHandle()) == "-");
+    REQUIRE(interpreter.SymbolName(lst->Rest()->First().GetSymbolHandle()) == "/");
+    REQUIRE(lst->Rest()->Rest()->First().GetInteger() == 1);
+}
+
+TEST_CASE("Read comparison chars as Symbols")
+{
+    Interpreter interpreter;
+    ListPtr lst = interpreter.Read("(<= = >)").GetListPtr();
+    REQUIRE(interpreter.SymbolName(lst->First().GetSymbolHandle()) == "<=");
+    REQUIRE(interpreter.SymbolName(lst->Rest()->First().GetSymbolHandle()) == "=");
+    REQUIRE(interpreter.SymbolName(lst->Rest()->Rest()->First().GetSymbolHandle()) == ">");
+}
+
+TEST_CASE("Read question mark in a symbol")
+{
+    Interpreter interpreter;
+    Object obj = interpreter.Read("equal?");
+    REQUIRE(obj.Type() == ObjectType::SymbolHandle);
+    REQUIRE(interpreter.SymbolName(obj.GetSymbolHandle()) == "equal?");
+}
@@ -14,6 +14,10 @@
 
 #include "../lib/Interpreter.h"
 #include <catch.hpp>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
 
 using namespace Procdraw;
 
@@ -80,3 +84,967 @@ TEST_CASE("Eval sum function")
     REQUIRE(interpreter.Eval(interpreter.Read("(+ 2 3)")).GetInteger() == 5);
     REQUIRE(interpreter.Eval(interpreter.Read("(+ 2 3 4)")).GetInteger() == 9);
 }
+
+TEST_CASE("Arithmetic promotes to Float only when needed")
+{
+    Interpreter interpreter;
+
+    Object val = interpreter.Eval(interpreter.Read("(+ 1 2)"));
+    REQUIRE(val.Type() == ObjectType::Integer);
+    REQUIRE(val.GetInteger() == 3);
+
+    val = interpreter.Eval(interpreter.Read("(+ 1 2.5)"));
+    REQUIRE(val.Type() == ObjectType::Float);
+    REQUIRE(val.GetFloat() == 3.5);
+
+    val = interpreter.Eval(interpreter.Read("(* 2 (- 3 0.5))"));
+    REQUIRE(val.Type() == ObjectType::Float);
+    REQUIRE(val.GetFloat() == 5.0);
+
+    val = interpreter.Eval(interpreter.Read("(- 10 3 2)"));
+    REQUIRE(val.Type() == ObjectType::Integer);
+    REQUIRE(val.GetInteger() == 5);
+
+    val = interpreter.Eval(interpreter.Read("(/ 1 4)"));
+    REQUIRE(val.Type() == ObjectType::Float);
+    REQUIRE(val.GetFloat() == 0.25);
+}
+
+TEST_CASE("Arithmetic errors")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Eval(interpreter.Read("(-)")).GetError() == ErrorKind::WrongNumberOfArgs);
+    REQUIRE(interpreter.Eval(interpreter.Read("(/)")).GetError() == ErrorKind::WrongNumberOfArgs);
+    REQUIRE(interpreter.Eval(interpreter.Read("(+ 1.5 true)")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(lerp 0 1)")).GetError() == ErrorKind::WrongNumberOfArgs);
+    REQUIRE(interpreter.Eval(interpreter.Read("(lerp 0 1 0.5 1)")).GetError() == ErrorKind::WrongNumberOfArgs);
+    REQUIRE(interpreter.Eval(interpreter.Read("(lerp 0 none 0.5)")).GetError() == ErrorKind::TypeError);
+}
+
+TEST_CASE("Numeric array builtins")
+{
+    Interpreter interpreter;
+    interpreter.SetSymbolValue(interpreter.SymbolRef("a"),
+                               interpreter.Eval(interpreter.Read("(make-int-array 4 3)")));
+
+    REQUIRE(interpreter.Eval(interpreter.Read("(array-length a)")).GetInteger() == 4);
+    REQUIRE(interpreter.Eval(interpreter.Read("(array-sum (array-mul a 2))")).GetInteger() == 24);
+    REQUIRE(interpreter.Eval(interpreter.Read("(array-ref (array-add a 0.5) 0)")).GetFloat() == 3.5);
+    REQUIRE(interpreter.Eval(interpreter.Read("(array-max (array-lerp 0 10 (make-float-array 3 0.5)))")).GetFloat() == 5.0);
+
+    // Arrays held by symbols are not modified by the operations
+    REQUIRE(interpreter.Eval(interpreter.Read("(array-sum a)")).GetInteger() == 12);
+}
+
+TEST_CASE("Nested numeric array operations")
+{
+    Interpreter interpreter;
+    Object val = interpreter.Eval(interpreter.Read("(array-add (array-mul (make-float-array 8 1) 3) 1)"));
+    REQUIRE(val.GetNumericArrayPtr()->Float32Data()[0] == 4.0f);
+    REQUIRE(val.GetNumericArrayPtr()->Float32Data()[7] == 4.0f);
+}
+
+TEST_CASE("Numeric array errors")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Eval(interpreter.Read("(array-add 1 2)")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(array-add (make-int-array 2) (make-int-array 3))")).GetError() == ErrorKind::LengthMismatch);
+    REQUIRE(interpreter.Eval(interpreter.Read("(array-ref (make-int-array 2) 2)")).GetError() == ErrorKind::IndexOutOfRange);
+    REQUIRE(interpreter.Eval(interpreter.Read("(array-min (make-int-array 0))")).GetError() == ErrorKind::IndexOutOfRange);
+    REQUIRE(interpreter.Eval(interpreter.Read("(make-int-array 2 0.5)")).GetError() == ErrorKind::TypeError);
+}
+
+TEST_CASE("Eval Vector evaluates the elements into a new Vector")
+{
+    Interpreter interpreter;
+    interpreter.SetSymbolValue(interpreter.SymbolRef("foo"), 10);
+    Object expr = interpreter.Read("[foo (+ foo 1)]");
+    Object val = interpreter.Eval(expr);
+    REQUIRE(val.GetVectorPtr() != expr.GetVectorPtr());
+    REQUIRE(interpreter.Print(val) == "[10 11]");
+    REQUIRE(interpreter.Eval(interpreter.Read("[1 (+ 1 true)]")).GetError() == ErrorKind::TypeError);
+}
+
+TEST_CASE("Vector builtins")
+{
+    Interpreter interpreter;
+    SymbolHandle v = interpreter.SymbolRef("v");
+    interpreter.SetSymbolValue(v, interpreter.Eval(interpreter.Read("[1 2 3]")));
+
+    REQUIRE(interpreter.Eval(interpreter.Read("(vector-ref v 1)")).GetInteger() == 2);
+    interpreter.Eval(interpreter.Read("(vector-set! v 1 20)"));
+    interpreter.Eval(interpreter.Read("(vector-push v 4)"));
+    REQUIRE(interpreter.Print(interpreter.SymbolValue(v)) == "[1 20 3 4]");
+    REQUIRE(interpreter.Eval(interpreter.Read("(vector-length v)")).GetInteger() == 4);
+
+    REQUIRE(interpreter.Eval(interpreter.Read("(vector-ref v 4)")).GetError() == ErrorKind::IndexOutOfRange);
+    REQUIRE(interpreter.Eval(interpreter.Read("(vector-ref v -1)")).GetError() == ErrorKind::IndexOutOfRange);
+    REQUIRE(interpreter.Eval(interpreter.Read("(vector-ref 1 0)")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(vector-push v)")).GetError() == ErrorKind::WrongNumberOfArgs);
+}
+
+TEST_CASE("Eval HashMap evaluates the values into a new HashMap")
+{
+    Interpreter interpreter;
+    interpreter.SetSymbolValue(interpreter.SymbolRef("foo"), 10);
+    Object expr = interpreter.Read("{foo (+ foo 1)}");
+    Object val = interpreter.Eval(expr);
+    REQUIRE(val.GetHashMapPtr() != expr.GetHashMapPtr());
+    REQUIRE(interpreter.Print(val) == "{foo 11}");
+    REQUIRE(interpreter.Eval(interpreter.Read("{a (+ 1 true)}")).GetError() == ErrorKind::TypeError);
+}
+
+TEST_CASE("HashMap builtins")
+{
+    Interpreter interpreter;
+    SymbolHandle m = interpreter.SymbolRef("m");
+    interpreter.SetSymbolValue(m, interpreter.Eval(interpreter.Read("{size 2 1 true}")));
+    // Args are evaluated, so a symbol key is passed as the value of key
+    interpreter.SetSymbolValue(interpreter.SymbolRef("key"),
+                               Object::MakeSymbolHandle(interpreter.SymbolRef("size")));
+
+    REQUIRE(interpreter.Eval(interpreter.Read("(hash-count m)")).GetInteger() == 2);
+    REQUIRE(interpreter.Eval(interpreter.Read("(hash-ref m 1)")).GetBoolean());
+    interpreter.Eval(interpreter.Read("(hash-set! m key 3)"));
+    interpreter.Eval(interpreter.Read("(hash-set! m 2 4)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(hash-ref m key)")).GetInteger() == 3);
+    REQUIRE(interpreter.Eval(interpreter.Read("(hash-ref m 2)")).GetInteger() == 4);
+    interpreter.Eval(interpreter.Read("(hash-remove! m 1)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(hash-count m)")).GetInteger() == 2);
+
+    REQUIRE(interpreter.Eval(interpreter.Read("(hash-ref m 1)")).GetError() == ErrorKind::KeyNotFound);
+    REQUIRE(interpreter.Eval(interpreter.Read("(hash-ref m 1 0)")).GetInteger() == 0);
+    REQUIRE(interpreter.Eval(interpreter.Read("(hash-ref m 1.5)")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(hash-set! m 1)")).GetError() == ErrorKind::WrongNumberOfArgs);
+
+    // String keys are compared by value, and are distinct from other keys
+    interpreter.Eval(interpreter.Read("(hash-set! m \"colour\" 5)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(hash-ref m (string-append \"col\" \"our\"))")).GetInteger() == 5);
+    REQUIRE(interpreter.Eval(interpreter.Read("(hash-ref m \"2\")")).GetError() == ErrorKind::KeyNotFound);
+    REQUIRE(interpreter.Eval(interpreter.Read("(hash-count m)")).GetInteger() == 3);
+}
+
+TEST_CASE("Comparison builtins")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Eval(interpreter.Read("(< 1 2 3)")).GetBoolean());
+    REQUIRE_FALSE(interpreter.Eval(interpreter.Read("(< 1 3 2)")).GetBoolean());
+    REQUIRE(interpreter.Eval(interpreter.Read("(<= 1 1 2.5)")).GetBoolean());
+    REQUIRE(interpreter.Eval(interpreter.Read("(= 2 2.0)")).GetBoolean());
+    REQUIRE(interpreter.Eval(interpreter.Read("(> 3 2 1)")).GetBoolean());
+    REQUIRE_FALSE(interpreter.Eval(interpreter.Read("(>= 1 2)")).GetBoolean());
+    REQUIRE(interpreter.Eval(interpreter.Read("(< 1 true)")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(=)")).GetError() == ErrorKind::WrongNumberOfArgs);
+}
+
+TEST_CASE("Ranges")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(to-vector (range 5))"))) == "[0 1 2 3 4]");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(to-vector (range 2 5))"))) == "[2 3 4]");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(to-vector (range 5 0 -2))"))) == "[5 3 1]");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(to-vector (range 1 2 0.25))"))) == "[1.0 1.25 1.5 1.75]");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(to-vector (range 0))"))) == "[]");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(to-vector (range 3 0))"))) == "[]");
+    REQUIRE(interpreter.Eval(interpreter.Read("(range 0 1 0)")).GetError() == ErrorKind::InvalidArgument);
+    REQUIRE(interpreter.Eval(interpreter.Read("(range true)")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(range)")).GetError() == ErrorKind::WrongNumberOfArgs);
+}
+
+TEST_CASE("Sequence pipelines")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(to-vector (map - [1 2]))"))) == "[-1 -2]");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(to-vector (map - ()))"))) == "[]");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(to-vector (filter = (range 3)))"))) == "[0 1 2]");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(to-vector (take 3 (map - (range 1000000000))))"))) == "[0 -1 -2]");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(to-vector (take 0 (range 10)))"))) == "[]");
+    REQUIRE(interpreter.Eval(interpreter.Read("(reduce + 0 (range 5))")).GetInteger() == 10);
+    REQUIRE(interpreter.Eval(interpreter.Read("(reduce + 0 [])")).GetInteger() == 0);
+
+    // A sequence can be consumed more than once
+    SymbolHandle s = interpreter.SymbolRef("s");
+    interpreter.SetSymbolValue(s, interpreter.Eval(interpreter.Read("(map - (range 3))")));
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(to-vector s)"))) == "[0 -1 -2]");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(to-vector s)"))) == "[0 -1 -2]");
+}
+
+TEST_CASE("Arithmetic reduces sequence arguments")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Eval(interpreter.Read("(+ (range 101))")).GetInteger() == 5050);
+    REQUIRE(interpreter.Eval(interpreter.Read("(* (range 1 6))")).GetInteger() == 120);
+    REQUIRE(interpreter.Eval(interpreter.Read("(+ 1 (range 1 4) 0.5)")).GetFloat() == 7.5);
+    REQUIRE(interpreter.Eval(interpreter.Read("(+ (range 0 1 0.5))")).GetFloat() == 0.5);
+    REQUIRE(interpreter.Eval(interpreter.Read("(+ (take 4 (map - (range 1000000))))")).GetInteger() == -6);
+    REQUIRE(interpreter.Eval(interpreter.Read("(+ (range 0))")).GetInteger() == 0);
+}
+
+TEST_CASE("Sequence errors")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Eval(interpreter.Read("(+ (map - [1 true]))")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(+ (map vector-length [1]))")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(+ (map 1 [1]))")).GetError() == ErrorKind::NotAFunction);
+    REQUIRE(interpreter.Eval(interpreter.Read("(+ (to-vector (range 2)) (range 2))")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(+ (map vector-ref [1]) true)")).GetError() == ErrorKind::WrongNumberOfArgs);
+    REQUIRE(interpreter.Eval(interpreter.Read("(to-vector (filter - [1 true]))")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(map - 1)")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(take -1 [1])")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(reduce - 0 [1 true])")).GetError() == ErrorKind::TypeError);
+}
+
+TEST_CASE("Eval lambda")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Eval(interpreter.Read("((lambda (x y) (+ x y)) 1 2)")).GetInteger() == 3);
+    REQUIRE(interpreter.Eval(interpreter.Read("((lambda () 1 2))")).GetInteger() == 2);
+    REQUIRE(interpreter.Eval(interpreter.Read("(((lambda (a) (lambda (b) (- a b))) 10) 3)")).GetInteger() == 7);
+    REQUIRE(interpreter.Eval(interpreter.Read("((lambda (x) x) 1 2)")).GetError() == ErrorKind::WrongNumberOfArgs);
+    REQUIRE(interpreter.Eval(interpreter.Read("((lambda (x) (+ x true)) 1)")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(lambda (x))")).GetError() == ErrorKind::BadSyntax);
+}
+
+TEST_CASE("Closures keep their captured values")
+{
+    Interpreter interpreter;
+    SymbolHandle f = interpreter.SymbolRef("f");
+    interpreter.SetSymbolValue(f, interpreter.Eval(interpreter.Read("(let ((n 10)) (lambda (x) (+ x n)))")));
+    REQUIRE(interpreter.Eval(interpreter.Read("(f 5)")).GetInteger() == 15);
+    REQUIRE(interpreter.Eval(interpreter.Read("(let ((n 1)) (f n))")).GetInteger() == 11);
+}
+
+TEST_CASE("Closures look up free variables as globals when called")
+{
+    Interpreter interpreter;
+    SymbolHandle g = interpreter.SymbolRef("g");
+    SymbolHandle f = interpreter.SymbolRef("f");
+    interpreter.SetSymbolValue(f, interpreter.Eval(interpreter.Read("(lambda (x) (* x g))")));
+    interpreter.SetSymbolValue(g, 2);
+    REQUIRE(interpreter.Eval(interpreter.Read("(f 3)")).GetInteger() == 6);
+    interpreter.SetSymbolValue(g, 3);
+    REQUIRE(interpreter.Eval(interpreter.Read("(f 3)")).GetInteger() == 9);
+}
+
+TEST_CASE("Eval let")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Eval(interpreter.Read("(let ((x 1) (y 2)) (+ x y))")).GetInteger() == 3);
+    REQUIRE(interpreter.Eval(interpreter.Read("(let ((x 1)) (let ((x 2) (y x)) y))")).GetInteger() == 1);
+    REQUIRE(interpreter.Eval(interpreter.Read("(let () 1)")).GetInteger() == 1);
+    REQUIRE(interpreter.Eval(interpreter.Read("(+ 1 (let ((x 2)) x) (let ((y 3)) y))")).GetInteger() == 6);
+    REQUIRE(interpreter.Eval(interpreter.Read("(let ((x (+ 1 true))) x)")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(let (x) x)")).GetError() == ErrorKind::BadSyntax);
+}
+
+TEST_CASE("Closures work as sequence functions")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Eval(interpreter.Read("(+ (map (lambda (x) (* x x)) (range 4)))")).GetInteger() == 14);
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(to-vector (filter (lambda (x) (> x 2)) (range 5)))"))) == "[3 4]");
+    REQUIRE(interpreter.Eval(interpreter.Read("(let ((k 3)) (reduce (lambda (acc x) (+ acc (* k x))) 0 (range 4)))")).GetInteger() == 18);
+}
+
+TEST_CASE("A lambda expression is compiled once")
+{
+    Interpreter interpreter;
+    Object expr = interpreter.Read("(lambda (x) x)");
+    Object a = interpreter.Eval(expr);
+    Object b = interpreter.Eval(expr);
+    // A lambda that captures nothing evaluates to the same closure
+    REQUIRE(a.GetClosurePtr() == b.GetClosurePtr());
+    Object capturing = interpreter.Read("(let ((n 1)) (lambda () n))");
+    REQUIRE(interpreter.Eval(capturing).GetClosurePtr() != interpreter.Eval(capturing).GetClosurePtr());
+}
+
+TEST_CASE("Deeply nested closure calls")
+{
+    Interpreter interpreter;
+    SymbolHandle inc = interpreter.SymbolRef("inc");
+    interpreter.SetSymbolValue(inc, interpreter.Eval(interpreter.Read("(lambda (x) (let ((y 1)) (+ x y)))")));
+    std::string text = "0";
+    for (int i = 0; i < 200; ++i) {
+        text = "(inc " + text + ")";
+    }
+    REQUIRE(interpreter.Eval(interpreter.Read(text)).GetInteger() == 200);
+}
+
+TEST_CASE("Eval quote")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.SymbolName(interpreter.Eval(interpreter.Read("'a")).GetSymbolHandle()) == "a");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("'(+ 1 2)"))) == "(+ 1 2)");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("((lambda (x) '(x lambda)) 1)"))) == "(x lambda)");
+    REQUIRE(interpreter.Eval(interpreter.Read("(quote)")).GetError() == ErrorKind::BadSyntax);
+    REQUIRE(interpreter.Eval(interpreter.Read("(quote a b)")).GetError() == ErrorKind::BadSyntax);
+}
+
+TEST_CASE("Eval if")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Eval(interpreter.Read("(if true 1 2)")).GetInteger() == 1);
+    REQUIRE(interpreter.Eval(interpreter.Read("(if false 1 2)")).GetInteger() == 2);
+    REQUIRE(interpreter.Eval(interpreter.Read("(if 0 1 2)")).GetInteger() == 1);
+    REQUIRE(interpreter.Eval(interpreter.Read("(if false 1)")).Type() == ObjectType::None);
+    // Only the chosen branch is evaluated
+    REQUIRE(interpreter.Eval(interpreter.Read("(if true 1 (+ 1 true))")).GetInteger() == 1);
+    REQUIRE(interpreter.Eval(interpreter.Read("(if (+ 1 true) 1 2)")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(if true)")).GetError() == ErrorKind::BadSyntax);
+    REQUIRE(interpreter.Eval(interpreter.Read("(if true 1 2 3)")).GetError() == ErrorKind::BadSyntax);
+}
+
+TEST_CASE("Eval define")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Eval(interpreter.Read("(define x 3)")).GetInteger() == 3);
+    REQUIRE(interpreter.Eval(interpreter.Read("(* x x)")).GetInteger() == 9);
+    // A defined function may call itself, as it is looked up when called
+    interpreter.Eval(interpreter.Read("(define fact (lambda (n) (if (<= n 1) 1 (* n (fact (- n 1))))))"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(fact 10)")).GetInteger() == 3628800);
+    REQUIRE(interpreter.Eval(interpreter.Read("(let ((y 2)) (define z (+ y 1)))")).GetInteger() == 3);
+    REQUIRE(interpreter.Eval(interpreter.Read("z")).GetInteger() == 3);
+    REQUIRE(interpreter.Eval(interpreter.Read("(define x (+ 1 true))")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("x")).GetInteger() == 3);
+    REQUIRE(interpreter.Eval(interpreter.Read("(define 1 2)")).GetError() == ErrorKind::BadSyntax);
+    REQUIRE(interpreter.Eval(interpreter.Read("(define x)")).GetError() == ErrorKind::BadSyntax);
+}
+
+TEST_CASE("Redefining a symbol reloads the definitions that depend on it")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define a 1)"));
+    interpreter.Eval(interpreter.Read("(define b (* a 2))"));
+    interpreter.Eval(interpreter.Read("(define c (+ a 10))"));
+    interpreter.Eval(interpreter.Read("(define d (+ b c))"));
+    interpreter.Eval(interpreter.Read("(define other 7)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("d")).GetInteger() == 13);
+
+    interpreter.Eval(interpreter.Read("(define a 5)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("b")).GetInteger() == 10);
+    REQUIRE(interpreter.Eval(interpreter.Read("c")).GetInteger() == 15);
+    REQUIRE(interpreter.Eval(interpreter.Read("d")).GetInteger() == 25);
+    // Each dependent is evaluated once, after the definitions it reads
+    std::vector<SymbolHandle> reloaded = interpreter.Reloaded();
+    REQUIRE(reloaded.size() == 3);
+    REQUIRE(reloaded.back() == interpreter.SymbolRef("d"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(reloaded)")).GetListPtr() != nullptr);
+
+    // Only the definitions reading b are reloaded
+    interpreter.Eval(interpreter.Read("(define b 0)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("d")).GetInteger() == 15);
+    REQUIRE(interpreter.Reloaded() == std::vector<SymbolHandle>{interpreter.SymbolRef("d")});
+
+    // b is no longer computed from a
+    interpreter.Eval(interpreter.Read("(define a 6)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("b")).GetInteger() == 0);
+    REQUIRE(interpreter.Eval(interpreter.Read("d")).GetInteger() == 16);
+}
+
+TEST_CASE("A reloaded definition whose value is unchanged stops the reload")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define a 1)"));
+    interpreter.Eval(interpreter.Read("(define positive (> a 0))"));
+    interpreter.Eval(interpreter.Read("(define size (if positive 10 20))"));
+    interpreter.Eval(interpreter.Read("(define a 2)"));
+    REQUIRE(interpreter.Reloaded() == std::vector<SymbolHandle>{interpreter.SymbolRef("positive")});
+
+    interpreter.Eval(interpreter.Read("(define a -1)"));
+    REQUIRE(interpreter.Reloaded() == std::vector<SymbolHandle>{interpreter.SymbolRef("positive"), interpreter.SymbolRef("size")});
+    REQUIRE(interpreter.Eval(interpreter.Read("size")).GetInteger() == 20);
+}
+
+TEST_CASE("A reloaded definition that fails keeps its value and is reported")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define a 1)"));
+    interpreter.Eval(interpreter.Read("(define b (+ a 1))"));
+    interpreter.Eval(interpreter.Read("(define c (* b 10))"));
+    interpreter.Eval(interpreter.Read("(define a (quote x))"));
+    REQUIRE(interpreter.Eval(interpreter.Read("b")).GetInteger() == 2);
+    REQUIRE(interpreter.Eval(interpreter.Read("c")).GetInteger() == 20);
+    REQUIRE(interpreter.Reloaded().empty());
+    REQUIRE(interpreter.ReloadFailed() == std::vector<SymbolHandle>{interpreter.SymbolRef("b")});
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(reload-failed)"))) == "(b)");
+
+    // The definition is kept, so a later change reloads it again
+    interpreter.Eval(interpreter.Read("(define a 4)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("c")).GetInteger() == 50);
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(reloaded)"))) == "(b c)");
+    REQUIRE(interpreter.ReloadFailed().empty());
+}
+
+TEST_CASE("A change with no dependents clears the reloaded definitions")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define a 1)"));
+    interpreter.Eval(interpreter.Read("(define b (+ a 1))"));
+    interpreter.Eval(interpreter.Read("(define a 2)"));
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(reloaded)"))) == "(b)");
+    interpreter.Eval(interpreter.Read("(define z 9)"));
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(reloaded)"))) == "()");
+}
+
+TEST_CASE("Definitions inside a lambda or let are not reloaded")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define a 1)"));
+    interpreter.Eval(interpreter.Read("(let ((y 2)) (define b (+ a y)))"));
+    interpreter.Eval(interpreter.Read("(define set-c (lambda () (define c (* a 3))))"));
+    interpreter.Eval(interpreter.Read("(set-c)"));
+    interpreter.Eval(interpreter.Read("(define a 10)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("b")).GetInteger() == 3);
+    REQUIRE(interpreter.Eval(interpreter.Read("c")).GetInteger() == 3);
+
+    // A definition that fails keeps the previous one
+    interpreter.Eval(interpreter.Read("(define d (+ a 1))"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(define d (+ a true))")).GetError() == ErrorKind::TypeError);
+    interpreter.Eval(interpreter.Read("(define a 20)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("d")).GetInteger() == 21);
+}
+
+TEST_CASE("Eval do")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Eval(interpreter.Read("(do ((i 0 (+ i 1)) (sum 0 (+ sum i))) ((= i 5) sum))")).GetInteger() == 10);
+    // The steps see the values from the previous pass
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(do ((a 1 b) (b 2 a) (n 0 (+ n 1))) ((= n 3) [a b]))"))) == "[2 1]");
+    // Variables without a step keep their value, and may be set by the body
+    REQUIRE(interpreter.Eval(interpreter.Read("(do ((v [] v) (i 0 (+ i 1))) ((= i 3) (vector-length v)) (vector-push v i))")).GetInteger() == 3);
+    REQUIRE(interpreter.Eval(interpreter.Read("(do () (true))")).Type() == ObjectType::None);
+    REQUIRE(interpreter.Eval(interpreter.Read("((lambda (n) (do ((i 0 (+ i 1)) (p 1 (* p 2))) ((= i n) p))) 8)")).GetInteger() == 256);
+    REQUIRE(interpreter.Eval(interpreter.Read("(do ((i 0 (+ i true))) ((= i 5)))")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(do ((i 0)) ((= i true)))")).GetError() == ErrorKind::TypeError);
+    for (const char* text : {"(do)", "(do ())", "(do () ())", "(do (i) (true))", "(do ((i 0 1 2)) (true))", "(do ((1 0)) (true))"}) {
+        INFO(text);
+        REQUIRE(interpreter.Eval(interpreter.Read(text)).GetError() == ErrorKind::BadSyntax);
+    }
+}
+
+TEST_CASE("A do loop runs in constant stack")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Eval(interpreter.Read("(do ((i 0 (+ i 1))) ((= i 1000000) i))")).GetInteger() == 1000000);
+}
+
+TEST_CASE("Calls to pure functions are cached")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define calls 0)"));
+    interpreter.Eval(interpreter.Read("(define f (lambda (x) (define calls (+ calls 1)) (* x x)))"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(set-pure! f)")).Type() == ObjectType::ClosurePtr);
+    REQUIRE(interpreter.Eval(interpreter.Read("(+ (f 3) (f 3) (f 4))")).GetInteger() == 34);
+    REQUIRE(interpreter.Eval(interpreter.Read("calls")).GetInteger() == 2);
+    MemoCache::Stats stats = interpreter.MemoStats();
+    REQUIRE(stats.hits == 1);
+    REQUIRE(stats.misses == 2);
+    REQUIRE(interpreter.Eval(interpreter.Read("(hash-ref (memo-stats) 'hits)")).GetInteger() == 1);
+
+    // Calls with args that are not atoms are not cached
+    interpreter.Eval(interpreter.Read("(define g (set-pure! (lambda (v) (vector-length v))))"));
+    interpreter.Eval(interpreter.Read("(g [1 2])"));
+    REQUIRE(interpreter.MemoStats().misses == 2);
+
+    interpreter.Eval(interpreter.Read("(set-pure! f false)"));
+    interpreter.Eval(interpreter.Read("(f 3)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("calls")).GetInteger() == 3);
+
+    REQUIRE(interpreter.Eval(interpreter.Read("(set-pure! 1)")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(set-pure! f 1)")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(set-pure!)")).GetError() == ErrorKind::WrongNumberOfArgs);
+}
+
+TEST_CASE("Pure recursive functions reuse shared subcalls")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define fib (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))))"));
+    interpreter.Eval(interpreter.Read("(set-pure! fib)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(fib 40)")).GetInteger() == 102334155);
+    // Each of (fib 0) to (fib 40) is computed once
+    REQUIRE(interpreter.MemoStats().misses == 41);
+}
+
+TEST_CASE("Eval defmacro")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Eval(interpreter.Read("(defmacro unless (test then) (list 'if test none then))")).Type() == ObjectType::MacroPtr);
+    REQUIRE(interpreter.Eval(interpreter.Read("(unless false 1)")).GetInteger() == 1);
+    REQUIRE(interpreter.Eval(interpreter.Read("(unless true (+ 1 true))")).Type() == ObjectType::None);
+    REQUIRE(interpreter.Print(interpreter.MacroExpand(interpreter.Read("(unless a b)").GetListPtr())) == "(if a none b)");
+
+    interpreter.Eval(interpreter.Read("(defmacro swap-args (f a b) (list f b a))"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(swap-args - 1 10)")).GetInteger() == 9);
+    REQUIRE(interpreter.Eval(interpreter.Read("((lambda (x) (swap-args - x 10)) 4)")).GetInteger() == 6);
+    // Macros may expand into calls to other macros
+    interpreter.Eval(interpreter.Read("(defmacro unless-zero (x then) (list 'unless (list '= x 0) then))"));
+    REQUIRE(interpreter.Eval(interpreter.Read("((lambda (n) (unless-zero n (/ 1 n))) 4)")).GetFloat() == 0.25);
+    // A local variable hides a macro of the same name
+    REQUIRE(interpreter.Eval(interpreter.Read("((lambda (unless) (unless 2)) (lambda (x) (* x x)))")).GetInteger() == 4);
+
+    REQUIRE(interpreter.Eval(interpreter.Read("(defmacro)")).GetError() == ErrorKind::BadSyntax);
+    REQUIRE(interpreter.Eval(interpreter.Read("(defmacro m x x)")).GetError() == ErrorKind::BadSyntax);
+    REQUIRE(interpreter.Eval(interpreter.Read("(swap-args 1 2)")).GetError() == ErrorKind::WrongNumberOfArgs);
+}
+
+TEST_CASE("A macro called other than by its global name is not a function")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(defmacro m (x) x)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(let ((n m)) (n 1))")).GetError() == ErrorKind::NotAFunction);
+    REQUIRE(interpreter.Eval(interpreter.Read("((if true m m) 1)")).GetError() == ErrorKind::NotAFunction);
+    REQUIRE(interpreter.Eval(interpreter.Read("(m 1)")).GetInteger() == 1);
+}
+
+TEST_CASE("A macro call is expanded once")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define expansions 0)"));
+    interpreter.Eval(interpreter.Read("(defmacro twice (x) (define expansions (+ expansions 1)) (list '* 2 x))"));
+    Object call = interpreter.Read("(twice 5)");
+    Object lambda = interpreter.Eval(interpreter.Read("(lambda (y) (twice y))"));
+    for (int i = 0; i < 3; ++i) {
+        REQUIRE(interpreter.Eval(call).GetInteger() == 10);
+        REQUIRE(interpreter.Apply(lambda, Cons(3, nullptr)).GetInteger() == 6);
+    }
+    REQUIRE(interpreter.Eval(interpreter.Read("expansions")).GetInteger() == 2);
+}
+
+TEST_CASE("Redefining a macro discards its expansions")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(defmacro scale (x) (list '* 2 x))"));
+    Object call = interpreter.Read("(scale 5)");
+    Object body = interpreter.Read("((lambda (y) (scale y)) 5)");
+    REQUIRE(interpreter.Eval(call).GetInteger() == 10);
+    REQUIRE(interpreter.Eval(body).GetInteger() == 10);
+    EnvironmentSnapshot snapshot = interpreter.Snapshot();
+
+    interpreter.Eval(interpreter.Read("(defmacro scale (x) (list '* 3 x))"));
+    REQUIRE(interpreter.Eval(call).GetInteger() == 15);
+    REQUIRE(interpreter.Eval(body).GetInteger() == 15);
+
+    interpreter.Restore(snapshot);
+    REQUIRE(interpreter.Eval(call).GetInteger() == 10);
+
+    // Redefined as a function, the call is no longer expanded
+    interpreter.SetSymbolValue(interpreter.SymbolRef("scale"), interpreter.Eval(interpreter.Read("(lambda (x) (+ x 1))")));
+    REQUIRE(interpreter.Eval(call).GetInteger() == 6);
+    REQUIRE(interpreter.Eval(body).GetInteger() == 6);
+}
+
+TEST_CASE("List builtins")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(list 1 'a (+ 1 2))"))) == "(1 a 3)");
+    REQUIRE(interpreter.Eval(interpreter.Read("(list)")).GetListPtr() == nullptr);
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(cons 1 '(2 3))"))) == "(1 2 3)");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(cons 1 (list))"))) == "(1)");
+    REQUIRE(interpreter.Eval(interpreter.Read("(cons 1 2)")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(cons 1)")).GetError() == ErrorKind::WrongNumberOfArgs);
+}
+
+TEST_CASE("String builtins")
+{
+    Interpreter interpreter;
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("\"abc\""))) == "\"abc\"");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(string-append \"ab\" \"cd\" \"\" \"e\")"))) == "\"abcde\"");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(string-append)"))) == "\"\"");
+    REQUIRE(interpreter.Eval(interpreter.Read("(string-length \"hello\")")).GetInteger() == 5);
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(substring \"hello\" 1 3)"))) == "\"el\"");
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(substring \"hello\" 2)"))) == "\"llo\"");
+
+    // A long result is built in one buffer, which its substrings share
+    interpreter.Eval(interpreter.Read("(define s (string-append \"one two three \" \"four five six\"))"));
+    StringPtr str = interpreter.SymbolValue(interpreter.SymbolRef("s")).GetStringPtr();
+    StringPtr tail = interpreter.Eval(interpreter.Read("(substring s 4)")).GetStringPtr();
+    REQUIRE(tail->View() == "two three four five six");
+    REQUIRE(tail->Buffer() == str->Buffer());
+
+    // Interned strings with the same characters are the same String
+    Object a = interpreter.Eval(interpreter.Read("(intern (substring s 0 3))"));
+    Object b = interpreter.Eval(interpreter.Read("(intern \"one\")"));
+    REQUIRE(a.GetStringPtr() == b.GetStringPtr());
+    // Strings are identical when their characters are equal
+    REQUIRE(IdenticalObjects(interpreter.Read("\"one\""), a));
+
+    REQUIRE(interpreter.Eval(interpreter.Read("(string-append \"a\" 1)")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(string-length 1)")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(substring \"abc\" 2 1)")).GetError() == ErrorKind::IndexOutOfRange);
+    REQUIRE(interpreter.Eval(interpreter.Read("(substring \"abc\" 0 4)")).GetError() == ErrorKind::IndexOutOfRange);
+    REQUIRE(interpreter.Eval(interpreter.Read("(substring \"abc\" -1)")).GetError() == ErrorKind::IndexOutOfRange);
+    REQUIRE(interpreter.Eval(interpreter.Read("(substring \"abc\")")).GetError() == ErrorKind::WrongNumberOfArgs);
+    REQUIRE(interpreter.Eval(interpreter.Read("(intern 'a)")).GetError() == ErrorKind::TypeError);
+}
+
+TEST_CASE("Equal and hash builtins")
+{
+    Interpreter interpreter;
+    auto eval = [&](const std::string& text) {
+        return interpreter.Eval(interpreter.Read(text));
+    };
+    REQUIRE(eval("(equal? '(1 [2 \"three\"] {a (4)}) '(1 [2 \"three\"] {a (4)}))").GetBoolean());
+    REQUIRE_FALSE(eval("(equal? '(1 2) '(1 2 3))").GetBoolean());
+    REQUIRE_FALSE(eval("(equal? 1 1.0)").GetBoolean());
+    REQUIRE(eval("(= (hash '(1 [2 3])) (hash '(1 [2 3])))").GetBoolean());
+    REQUIRE_FALSE(eval("(= (hash '(1 2)) (hash '(2 1)))").GetBoolean());
+    REQUIRE(eval("(equal? 1)").GetError() == ErrorKind::WrongNumberOfArgs);
+    REQUIRE(eval("(hash)").GetError() == ErrorKind::WrongNumberOfArgs);
+}
+
+TEST_CASE("Eval empty list")
+{
+    Interpreter interpreter;
+    Object val = interpreter.Eval(Object::EmptyList());
+    REQUIRE(val.Type() == ObjectType::ListPtr);
+    REQUIRE(val.GetListPtr() == nullptr);
+}
+
+TEST_CASE("Eval evaluates function arguments")
+{
+    Interpreter interpreter;
+    interpreter.SetSymbolValue(interpreter.SymbolRef("foo"), 10);
+    REQUIRE(interpreter.Eval(interpreter.Read("(+ 1 (* 2 3))")).GetInteger() == 7);
+    REQUIRE(interpreter.Eval(interpreter.Read("(* foo (+ foo 1))")).GetInteger() == 110);
+}
+
+TEST_CASE("Type errors are returned as error values")
+{
+    Interpreter interpreter;
+    Object val = interpreter.Eval(interpreter.Read("(+ 1 true)"));
+    REQUIRE(val.Type() == ObjectType::Error);
+    REQUIRE(val.GetError() == ErrorKind::TypeError);
+
+    val = interpreter.Eval(interpreter.Read("(* 2 (+ 1 none) 3)"));
+    REQUIRE(val.Type() == ObjectType::Error);
+    REQUIRE(val.GetError() == ErrorKind::TypeError);
+
+    val = interpreter.Eval(interpreter.Read("(1 2)"));
+    REQUIRE(val.Type() == ObjectType::Error);
+    REQUIRE(val.GetError() == ErrorKind::NotAFunction);
+
+    val = interpreter.Eval(interpreter.Read("(undefined 2)"));
+    REQUIRE(val.Type() == ObjectType::Error);
+    REQUIRE(val.GetError() == ErrorKind::NotAFunction);
+}
+
+TEST_CASE("Evaluations are limited by the step quota")
+{
+    Interpreter interpreter;
+    EvalQuotas quotas;
+    quotas.maxSteps = 10000;
+    interpreter.SetQuotas(quotas);
+    Object loop = interpreter.Read("(do ((i 0 (+ i 1))) (false))");
+    REQUIRE(interpreter.Eval(loop).GetError() == ErrorKind::StepQuotaExceeded);
+    REQUIRE(interpreter.Eval(interpreter.Read("(reduce + 0 (range 1000000))")).GetError() == ErrorKind::StepQuotaExceeded);
+    // Each evaluation has its own steps
+    REQUIRE(interpreter.Eval(interpreter.Read("(do ((i 0 (+ i 1))) ((= i 100) i))")).GetInteger() == 100);
+    REQUIRE(interpreter.Eval(loop).GetError() == ErrorKind::StepQuotaExceeded);
+    REQUIRE(interpreter.Eval(interpreter.Read("(reduce + 0 (range 100))")).GetInteger() == 4950);
+}
+
+TEST_CASE("Evaluations are limited by the heap quota")
+{
+    Interpreter interpreter;
+    EvalQuotas quotas;
+    quotas.maxHeapBytes = 1 << 20;
+    interpreter.SetQuotas(quotas);
+    REQUIRE(interpreter.Eval(interpreter.Read("(do ((l (list) (cons 1 l))) (false))")).GetError() == ErrorKind::HeapQuotaExceeded);
+    REQUIRE(interpreter.Eval(interpreter.Read("(to-vector (range 1000000))")).GetError() == ErrorKind::HeapQuotaExceeded);
+    // The quota is checked at each step
+    REQUIRE(interpreter.Eval(interpreter.Read("(make-float-array 1000000)")).Type() == ObjectType::NumericArrayPtr);
+    REQUIRE(interpreter.Eval(interpreter.Read("(let ((a (make-float-array 1000000))) a)")).GetError() == ErrorKind::HeapQuotaExceeded);
+    // Memory freed by the evaluation does not count against it
+    REQUIRE(interpreter.Eval(interpreter.Read("(do ((i 0 (+ i 1))) ((= i 100000) i) (list i i i))")).GetInteger() == 100000);
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(to-vector (range 3))"))) == "[0 1 2]");
+}
+
+TEST_CASE("Evaluations are limited by the depth quota")
+{
+    Interpreter interpreter;
+    EvalQuotas quotas;
+    quotas.maxDepth = 200;
+    interpreter.SetQuotas(quotas);
+    interpreter.Eval(interpreter.Read("(define count (lambda (n) (if (= n 0) 0 (+ 1 (count (- n 1))))))"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(count 10)")).GetInteger() == 10);
+    REQUIRE(interpreter.Eval(interpreter.Read("(count 1000)")).GetError() == ErrorKind::DepthQuotaExceeded);
+    REQUIRE(interpreter.Eval(interpreter.Read("(count 20)")).GetInteger() == 20);
+    REQUIRE(interpreter.Fork()->Eval(interpreter.Read("(count 1000)")).GetError() == ErrorKind::DepthQuotaExceeded);
+}
+
+TEST_CASE("Scene builtins record commands in the current Scene")
+{
+    Interpreter interpreter;
+    Object draw = interpreter.Read("((lambda () (background 200 0.5 1) (rotate-y 0.25) (cube)))");
+    REQUIRE(interpreter.Eval(draw).Type() == ObjectType::None);
+
+    Scene scene;
+    interpreter.SetScene(&scene);
+    interpreter.Eval(draw);
+    interpreter.SetScene(nullptr);
+    interpreter.Eval(draw);
+    REQUIRE(scene.Commands().size() == 3);
+    REQUIRE(scene.Commands()[0].kind == SceneCommandKind::Background);
+    REQUIRE(scene.Commands()[0].args[0] == 200.0f);
+    REQUIRE(scene.Commands()[0].args[1] == 0.5f);
+    REQUIRE(scene.Commands()[1].kind == SceneCommandKind::RotateY);
+    REQUIRE(scene.Commands()[1].args[0] == 0.25f);
+    REQUIRE(scene.Commands()[2].kind == SceneCommandKind::Cube);
+}
+
+TEST_CASE("Forked Interpreter shares the parent symbols")
+{
+    Interpreter parent;
+    SymbolHandle foo = parent.SymbolRef("foo");
+    parent.SetSymbolValue(foo, 42);
+    auto child = parent.Fork();
+    REQUIRE(child->SymbolRef("foo") == foo);
+    REQUIRE(child->SymbolValue(foo).GetInteger() == 42);
+    REQUIRE(child->Eval(child->Read("(+ 2 3)")).GetInteger() == 5);
+}
+
+TEST_CASE("Forked Interpreter calls closures made by the parent")
+{
+    Interpreter parent;
+    SymbolHandle f = parent.SymbolRef("f");
+    parent.SetSymbolValue(f, parent.Eval(parent.Read("(let ((n 2)) (lambda (x) (* x n)))")));
+    std::unique_ptr<Interpreter> child = parent.Fork();
+    REQUIRE(child->Eval(child->Read("(f 21)")).GetInteger() == 42);
+}
+
+TEST_CASE("Forked Interpreter writes are copy-on-write")
+{
+    Interpreter parent;
+    SymbolHandle foo = parent.SymbolRef("foo");
+    parent.SetSymbolValue(foo, 1);
+    auto child = parent.Fork();
+
+    child->SetSymbolValue(foo, 2);
+    REQUIRE(parent.SymbolValue(foo).GetInteger() == 1);
+    REQUIRE(child->SymbolValue(foo).GetInteger() == 2);
+
+    parent.SetSymbolValue(foo, 3);
+    REQUIRE(parent.SymbolValue(foo).GetInteger() == 3);
+    REQUIRE(child->SymbolValue(foo).GetInteger() == 2);
+
+    SymbolHandle bar = child->SymbolRef("bar");
+    REQUIRE(child->SymbolName(bar) == "bar");
+    REQUIRE(parent.SymbolRef("baz") == bar);
+    REQUIRE(parent.SymbolName(bar) == "baz");
+}
+
+#ifndef PROCDRAW_SINGLE_THREADED
+TEST_CASE("Forked Interpreters evaluate on other threads")
+{
+    const int numChildren = 4;
+    Interpreter parent;
+    SymbolHandle foo = parent.SymbolRef("foo");
+    parent.SetSymbolValue(foo, -1);
+
+    std::vector<std::unique_ptr<Interpreter>> children;
+    for (int i = 0; i < numChildren; ++i) {
+        children.push_back(parent.Fork());
+    }
+
+    std::vector<int> results(numChildren);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < numChildren; ++i) {
+        threads.emplace_back([&children, &results, foo, i]() {
+            Interpreter* child = children[i].get();
+            int sum = 0;
+            for (int n = 0; n < 1000; ++n) {
+                child->SetSymbolValue(foo, n * i);
+                sum += child->Eval(Object::MakeSymbolHandle(foo)).GetInteger();
+            }
+            results[i] = sum;
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (int i = 0; i < numChildren; ++i) {
+        REQUIRE(results[i] == 499500 * i);
+    }
+    REQUIRE(parent.SymbolValue(foo).GetInteger() == -1);
+}
+#endif
+
+TEST_CASE("Restore an environment snapshot")
+{
+    Interpreter interpreter;
+    SymbolHandle foo = interpreter.SymbolRef("foo");
+    interpreter.SetSymbolValue(foo, 1);
+    EnvironmentSnapshot snapshot = interpreter.Snapshot();
+
+    interpreter.SetSymbolValue(foo, 2);
+    SymbolHandle bar = interpreter.SymbolRef("bar");
+    interpreter.SetSymbolValue(bar, 3);
+
+    interpreter.Restore(snapshot);
+    REQUIRE(interpreter.SymbolValue(foo).GetInteger() == 1);
+    REQUIRE(interpreter.SymbolName(bar) == "bar");
+    REQUIRE(interpreter.SymbolValue(bar).Type() == ObjectType::None);
+    REQUIRE(interpreter.SymbolValue(interpreter.SymbolRef("+")).Type() == ObjectType::CFunctionHandle);
+}
+
+TEST_CASE("Restore does not undo changes to mutable objects")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define v [1 2])"));
+    interpreter.Eval(interpreter.Read("(define h {})"));
+    interpreter.Eval(interpreter.Read("(define s (signal 1))"));
+    EnvironmentSnapshot snapshot = interpreter.Snapshot();
+
+    interpreter.Eval(interpreter.Read("(vector-set! v 0 10)"));
+    interpreter.Eval(interpreter.Read("(hash-set! h 'a 1)"));
+    interpreter.Eval(interpreter.Read("(set-signal! s 2)"));
+    interpreter.Eval(interpreter.Read("(define v [3 4])"));
+
+    // The symbol is restored, but the Vector it names keeps its change
+    interpreter.Restore(snapshot);
+    REQUIRE(interpreter.Eval(interpreter.Read("(vector-ref v 0)")).GetInteger() == 10);
+    REQUIRE(interpreter.Eval(interpreter.Read("(hash-ref h 'a)")).GetInteger() == 1);
+    REQUIRE(interpreter.Eval(interpreter.Read("(signal-value s)")).GetInteger() == 2);
+}
+
+TEST_CASE("Compare environment snapshots")
+{
+    Interpreter interpreter;
+    SymbolHandle foo = interpreter.SymbolRef("foo");
+    SymbolHandle bar = interpreter.SymbolRef("bar");
+    interpreter.SetSymbolValue(bar, 1);
+    EnvironmentSnapshot before = interpreter.Snapshot();
+
+    interpreter.SetSymbolValue(foo, 1);
+    interpreter.SetSymbolValue(bar, 1);
+    SymbolHandle baz = interpreter.SymbolRef("baz");
+    interpreter.SetSymbolValue(baz, 2);
+    EnvironmentSnapshot after = interpreter.Snapshot();
+
+    REQUIRE(interpreter.ChangedSymbols(before, before).empty());
+    REQUIRE(interpreter.ChangedSymbols(before, after) == std::vector<SymbolHandle>{foo, baz});
+}
+
+TEST_CASE("Computed signals are recomputed only when a signal they read changes")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define calls 0)"));
+    interpreter.Eval(interpreter.Read("(define a (signal 1))"));
+    interpreter.Eval(interpreter.Read("(define b (signal 10))"));
+    interpreter.Eval(interpreter.Read("(define twice-a (computed (lambda () (define calls (+ calls 1)) (* 2 (signal-value a)))))"));
+    interpreter.Eval(interpreter.Read("(define sum (computed (lambda () (+ (signal-value twice-a) (signal-value b)))))"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(signal-value sum)")).GetInteger() == 12);
+    REQUIRE(interpreter.Eval(interpreter.Read("(signal-value sum)")).GetInteger() == 12);
+    REQUIRE(interpreter.Eval(interpreter.Read("calls")).GetInteger() == 1);
+
+    // Only the signals that read b are recomputed
+    interpreter.Eval(interpreter.Read("(set-signal! b 20)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(signal-value sum)")).GetInteger() == 22);
+    REQUIRE(interpreter.Eval(interpreter.Read("calls")).GetInteger() == 1);
+
+    // Setting a signal to the value it has is not a change
+    interpreter.Eval(interpreter.Read("(set-signal! a 1)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(signal-value sum)")).GetInteger() == 22);
+    REQUIRE(interpreter.Eval(interpreter.Read("calls")).GetInteger() == 1);
+
+    interpreter.Eval(interpreter.Read("(set-signal! a 2)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(signal-value sum)")).GetInteger() == 24);
+    REQUIRE(interpreter.Eval(interpreter.Read("calls")).GetInteger() == 2);
+}
+
+TEST_CASE("Setting a Float signal compares bit patterns")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define calls 0)"));
+    interpreter.Eval(interpreter.Read("(define a (signal (/ 0.0 0.0)))"));
+    interpreter.Eval(interpreter.Read("(define s (computed (lambda () (define calls (+ calls 1)) (signal-value a))))"));
+    interpreter.Eval(interpreter.Read("(signal-value s)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("calls")).GetInteger() == 1);
+
+    // The same NaN is not a change
+    interpreter.Eval(interpreter.Read("(set-signal! a (signal-value a))"));
+    interpreter.Eval(interpreter.Read("(signal-value s)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("calls")).GetInteger() == 1);
+
+    // 0.0 to -0.0 is a change
+    interpreter.Eval(interpreter.Read("(set-signal! a 0.0)"));
+    interpreter.Eval(interpreter.Read("(signal-value s)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("calls")).GetInteger() == 2);
+    interpreter.Eval(interpreter.Read("(set-signal! a -0.0)"));
+    REQUIRE(std::signbit(interpreter.Eval(interpreter.Read("(signal-value s)")).GetFloat()));
+    REQUIRE(interpreter.Eval(interpreter.Read("calls")).GetInteger() == 3);
+
+    REQUIRE(IdenticalObjects(Object{std::nan("")}, Object{std::nan("")}));
+    REQUIRE_FALSE(IdenticalObjects(Object{0.0}, Object{-0.0}));
+}
+
+TEST_CASE("Computed signals depend on the signals read in their last computation")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define calls 0)"));
+    interpreter.Eval(interpreter.Read("(define use-a (signal true))"));
+    interpreter.Eval(interpreter.Read("(define a (signal 1))"));
+    interpreter.Eval(interpreter.Read("(define b (signal 2))"));
+    interpreter.Eval(interpreter.Read(
+        "(define s (computed (lambda ()"
+        "  (define calls (+ calls 1))"
+        "  (if (signal-value use-a) (signal-value a) (signal-value b)))))"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(signal-value s)")).GetInteger() == 1);
+    interpreter.Eval(interpreter.Read("(set-signal! b 3)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(signal-value s)")).GetInteger() == 1);
+    REQUIRE(interpreter.Eval(interpreter.Read("calls")).GetInteger() == 1);
+    interpreter.Eval(interpreter.Read("(set-signal! use-a false)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(signal-value s)")).GetInteger() == 3);
+    interpreter.Eval(interpreter.Read("(set-signal! a 4)"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(signal-value s)")).GetInteger() == 3);
+    REQUIRE(interpreter.Eval(interpreter.Read("calls")).GetInteger() == 2);
+}
+
+TEST_CASE("Computed signals replay their scene commands")
+{
+    Interpreter interpreter;
+    interpreter.Eval(interpreter.Read("(define calls 0)"));
+    interpreter.Eval(interpreter.Read("(define angle (signal 0.25))"));
+    interpreter.Eval(interpreter.Read("(define shape (computed (lambda () (define calls (+ calls 1)) (rotate-y (signal-value angle)) (cube))))"));
+    Object draw = interpreter.Read("((lambda () (color 1 1 1) (signal-value shape) (tetrahedron)))");
+
+    Scene scene;
+    interpreter.SetScene(&scene);
+    interpreter.Eval(draw);
+    interpreter.Eval(draw);
+    REQUIRE(interpreter.Eval(interpreter.Read("calls")).GetInteger() == 1);
+    REQUIRE(scene.Commands().size() == 8);
+    for (size_t i = 0; i < 8; i += 4) {
+        REQUIRE(scene.Commands()[i].kind == SceneCommandKind::Color);
+        REQUIRE(scene.Commands()[i + 1].kind == SceneCommandKind::RotateY);
+        REQUIRE(scene.Commands()[i + 1].args[0] == 0.25f);
+        REQUIRE(scene.Commands()[i + 2].kind == SceneCommandKind::Cube);
+        REQUIRE(scene.Commands()[i + 3].kind == SceneCommandKind::Tetrahedron);
+    }
+
+    // A signal whose commands changed is a change to its dependents,
+    // even if its value is the same
+    interpreter.Eval(interpreter.Read("(define outer (computed (lambda () (signal-value shape))))"));
+    interpreter.Eval(interpreter.Read("(signal-value outer)"));
+    interpreter.Eval(interpreter.Read("(set-signal! angle 0.5)"));
+    scene.Clear();
+    interpreter.Eval(interpreter.Read("(signal-value outer)"));
+    interpreter.SetScene(nullptr);
+    REQUIRE(scene.Commands().size() == 2);
+    REQUIRE(scene.Commands()[0].args[0] == 0.5f);
+    REQUIRE(interpreter.Eval(interpreter.Read("calls")).GetInteger() == 2);
+}
+
+TEST_CASE("Signal errors")
+{
+    Interpreter interpreter;
+    // A signal that reads itself
+    interpreter.Eval(interpreter.Read("(define s (computed (lambda () (+ 1 (signal-value s)))))"));
+    REQUIRE(interpreter.Eval(interpreter.Read("(signal-value s)")).GetError() == ErrorKind::InvalidArgument);
+    REQUIRE(interpreter.Eval(interpreter.Read("(set-signal! s 1)")).GetError() == ErrorKind::InvalidArgument);
+    REQUIRE(interpreter.Eval(interpreter.Read("(signal-value 1)")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(set-signal! 1 1)")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(computed 1)")).GetError() == ErrorKind::TypeError);
+    REQUIRE(interpreter.Eval(interpreter.Read("(signal)")).GetError() == ErrorKind::WrongNumberOfArgs);
+    REQUIRE(interpreter.Print(interpreter.Eval(interpreter.Read("(signal 1)"))) == "#<signal>");
+}
@@ -14,7 +14,9 @@
 
 #include "../lib/InterpreterTypes.h"
 #include <catch.hpp>
+#include <cstdint>
 #include <functional>
+#include <utility>
 
 using namespace Procdraw;
 
@@ -23,18 +25,41 @@ TEST_CASE("Interpreter Types")
     Object trueObj{true};
     Object falseObj{false};
     Object cfunctionHandleObj = Object::MakeCFunctionHandle(10);
+    SpecialFormPtr lambda = SpecialForm::MakeLambda(0, 0, {}, Cons(1, nullptr));
+    Object closurePtrObj{ClosurePtr(new Closure(lambda, {}))};
+    Object errorObj = Object::MakeError(ErrorKind::TypeError);
+    Object floatObj{1.5};
+    Object hashMapPtrObj{HashMapPtr(new HashMap())};
     Object integerObj{42};
     Object listPtrObj = Object::EmptyList();
+    Object localRefObj = Object::MakeLocalRef(LocalRef{true, 3});
+    Object macroPtrObj{MacroPtr(new Macro(closurePtrObj.GetClosurePtr()))};
     Object noneObj = Object::None();
+    Object sequencePtrObj{Sequence::MakeRange(0, 10, 1)};
+    Object signalPtrObj{Signal::MakeInput(7)};
+    Object specialFormPtrObj{lambda};
+    Object stringPtrObj{String::Make("abc")};
     Object symbolHandleObj = Object::MakeSymbolHandle(20);
+    Object vectorPtrObj{VectorPtr(new Vector())};
 
     auto allTypesObjs = {
         trueObj,
         cfunctionHandleObj,
+        closurePtrObj,
+        errorObj,
+        floatObj,
+        hashMapPtrObj,
         integerObj,
         listPtrObj,
+        localRefObj,
+        macroPtrObj,
         noneObj,
-        symbolHandleObj};
+        sequencePtrObj,
+        signalPtrObj,
+        specialFormPtrObj,
+        stringPtrObj,
+        symbolHandleObj,
+        vectorPtrObj};
 
     auto forAllTypesExcept = [allTypesObjs](
                                  ObjectType type,
@@ -50,12 +75,15 @@ TEST_CASE("Interpreter Types")
     {
         REQUIRE(trueObj.Type() == ObjectType::Boolean);
         REQUIRE(trueObj.GetBoolean());
+        REQUIRE(trueObj.TryGetBoolean() == true);
+        REQUIRE(trueObj.GetBooleanUnchecked());
 
         REQUIRE(falseObj.Type() == ObjectType::Boolean);
         REQUIRE_FALSE(falseObj.GetBoolean());
 
         forAllTypesExcept(ObjectType::Boolean, [](const Object& obj) {
             REQUIRE_THROWS_AS(obj.GetBoolean(), BadObjectAccess);
+            REQUIRE_FALSE(obj.TryGetBoolean());
         });
     }
 
@@ -63,9 +91,47 @@ TEST_CASE("Interpreter Types")
     {
         REQUIRE(cfunctionHandleObj.Type() == ObjectType::CFunctionHandle);
         REQUIRE(cfunctionHandleObj.GetCFunctionHandle() == 10);
+        REQUIRE(cfunctionHandleObj.TryGetCFunctionHandle() == 10);
 
         forAllTypesExcept(ObjectType::CFunctionHandle, [](const Object& obj) {
             REQUIRE_THROWS_AS(obj.GetCFunctionHandle(), BadObjectAccess);
+            REQUIRE_FALSE(obj.TryGetCFunctionHandle());
+        });
+    }
+
+    SECTION("ClosurePtr")
+    {
+        REQUIRE(closurePtrObj.Type() == ObjectType::ClosurePtr);
+        REQUIRE(closurePtrObj.GetClosurePtr()->Lambda().Body()->First().GetInteger() == 1);
+        REQUIRE(closurePtrObj.TryGetClosurePtr() == &closurePtrObj.GetClosurePtr());
+        REQUIRE(closurePtrObj.GetClosurePtrUnchecked() == closurePtrObj.GetClosurePtr());
+
+        forAllTypesExcept(ObjectType::ClosurePtr, [](const Object& obj) {
+            REQUIRE_THROWS_AS(obj.GetClosurePtr(), BadObjectAccess);
+            REQUIRE(obj.TryGetClosurePtr() == nullptr);
+        });
+    }
+
+    SECTION("Error")
+    {
+        REQUIRE(errorObj.Type() == ObjectType::Error);
+        REQUIRE(errorObj.GetError() == ErrorKind::TypeError);
+
+        forAllTypesExcept(ObjectType::Error, [](const Object& obj) {
+            REQUIRE_THROWS_AS(obj.GetError(), BadObjectAccess);
+        });
+    }
+
+    SECTION("Float")
+    {
+        REQUIRE(floatObj.Type() == ObjectType::Float);
+        REQUIRE(floatObj.GetFloat() == 1.5);
+        REQUIRE(floatObj.TryGetFloat() == 1.5);
+        REQUIRE(floatObj.GetFloatUnchecked() == 1.5);
+
+        forAllTypesExcept(ObjectType::Float, [](const Object& obj) {
+            REQUIRE_THROWS_AS(obj.GetFloat(), BadObjectAccess);
+            REQUIRE_FALSE(obj.TryGetFloat());
         });
     }
 
@@ -73,9 +139,12 @@ TEST_CASE("Interpreter Types")
     {
         REQUIRE(integerObj.Type() == ObjectType::Integer);
         REQUIRE(integerObj.GetInteger() == 42);
+        REQUIRE(integerObj.TryGetInteger() == 42);
+        REQUIRE(integerObj.GetIntegerUnchecked() == 42);
 
         forAllTypesExcept(ObjectType::Integer, [](const Object& obj) {
             REQUIRE_THROWS_AS(obj.GetInteger(), BadObjectAccess);
+            REQUIRE_FALSE(obj.TryGetInteger());
         });
     }
 
@@ -83,9 +152,26 @@ TEST_CASE("Interpreter Types")
     {
         REQUIRE(listPtrObj.Type() == ObjectType::ListPtr);
         REQUIRE(listPtrObj.GetListPtr() == nullptr);
+        REQUIRE(listPtrObj.TryGetListPtr() == &listPtrObj.GetListPtr());
+        REQUIRE(listPtrObj.GetListPtrUnchecked() == nullptr);
 
         forAllTypesExcept(ObjectType::ListPtr, [](const Object& obj) {
             REQUIRE_THROWS_AS(obj.GetListPtr(), BadObjectAccess);
+            REQUIRE(obj.TryGetListPtr() == nullptr);
+        });
+    }
+
+    SECTION("LocalRef")
+    {
+        REQUIRE(localRefObj.Type() == ObjectType::LocalRef);
+        REQUIRE(localRefObj.GetLocalRef().captured);
+        REQUIRE(localRefObj.GetLocalRef().slot == 3);
+        REQUIRE(localRefObj.TryGetLocalRef()->slot == 3);
+        REQUIRE(localRefObj.GetLocalRefUnchecked().slot == 3);
+
+        forAllTypesExcept(ObjectType::LocalRef, [](const Object& obj) {
+            REQUIRE_THROWS_AS(obj.GetLocalRef(), BadObjectAccess);
+            REQUIRE_FALSE(obj.TryGetLocalRef());
         });
     }
 
@@ -98,9 +184,287 @@ TEST_CASE("Interpreter Types")
     {
         REQUIRE(symbolHandleObj.Type() == ObjectType::SymbolHandle);
         REQUIRE(symbolHandleObj.GetSymbolHandle() == 20);
+        REQUIRE(symbolHandleObj.TryGetSymbolHandle() == 20);
 
         forAllTypesExcept(ObjectType::SymbolHandle, [](const Object& obj) {
             REQUIRE_THROWS_AS(obj.GetSymbolHandle(), BadObjectAccess);
+            REQUIRE_FALSE(obj.TryGetSymbolHandle());
+        });
+    }
+
+    SECTION("HashMapPtr")
+    {
+        REQUIRE(hashMapPtrObj.Type() == ObjectType::HashMapPtr);
+        REQUIRE(hashMapPtrObj.GetHashMapPtr()->Size() == 0);
+        REQUIRE(hashMapPtrObj.TryGetHashMapPtr() == &hashMapPtrObj.GetHashMapPtr());
+        REQUIRE(hashMapPtrObj.GetHashMapPtrUnchecked() == hashMapPtrObj.GetHashMapPtr());
+
+        forAllTypesExcept(ObjectType::HashMapPtr, [](const Object& obj) {
+            REQUIRE_THROWS_AS(obj.GetHashMapPtr(), BadObjectAccess);
+            REQUIRE(obj.TryGetHashMapPtr() == nullptr);
         });
     }
+
+    SECTION("MacroPtr")
+    {
+        REQUIRE(macroPtrObj.Type() == ObjectType::MacroPtr);
+        REQUIRE(macroPtrObj.GetMacroPtr()->Expander() == closurePtrObj.GetClosurePtr());
+        REQUIRE(macroPtrObj.TryGetMacroPtr() == &macroPtrObj.GetMacroPtr());
+        REQUIRE(macroPtrObj.GetMacroPtrUnchecked() == macroPtrObj.GetMacroPtr());
+
+        forAllTypesExcept(ObjectType::MacroPtr, [](const Object& obj) {
+            REQUIRE_THROWS_AS(obj.GetMacroPtr(), BadObjectAccess);
+            REQUIRE(obj.TryGetMacroPtr() == nullptr);
+        });
+    }
+
+    SECTION("SequencePtr")
+    {
+        REQUIRE(sequencePtrObj.Type() == ObjectType::SequencePtr);
+        REQUIRE(sequencePtrObj.GetSequencePtr()->Kind() == SequenceKind::Range);
+        REQUIRE(sequencePtrObj.TryGetSequencePtr() == &sequencePtrObj.GetSequencePtr());
+        REQUIRE(sequencePtrObj.GetSequencePtrUnchecked() == sequencePtrObj.GetSequencePtr());
+
+        forAllTypesExcept(ObjectType::SequencePtr, [](const Object& obj) {
+            REQUIRE_THROWS_AS(obj.GetSequencePtr(), BadObjectAccess);
+            REQUIRE(obj.TryGetSequencePtr() == nullptr);
+        });
+    }
+
+    SECTION("SignalPtr")
+    {
+        REQUIRE(signalPtrObj.Type() == ObjectType::SignalPtr);
+        REQUIRE(signalPtrObj.GetSignalPtr()->Value().GetInteger() == 7);
+        REQUIRE(signalPtrObj.TryGetSignalPtr() == &signalPtrObj.GetSignalPtr());
+        REQUIRE(signalPtrObj.GetSignalPtrUnchecked() == signalPtrObj.GetSignalPtr());
+
+        forAllTypesExcept(ObjectType::SignalPtr, [](const Object& obj) {
+            REQUIRE_THROWS_AS(obj.GetSignalPtr(), BadObjectAccess);
+            REQUIRE(obj.TryGetSignalPtr() == nullptr);
+        });
+    }
+
+    SECTION("SpecialFormPtr")
+    {
+        REQUIRE(specialFormPtrObj.Type() == ObjectType::SpecialFormPtr);
+        REQUIRE(specialFormPtrObj.GetSpecialFormPtr()->Kind() == SpecialFormKind::Lambda);
+        REQUIRE(specialFormPtrObj.TryGetSpecialFormPtr() == &specialFormPtrObj.GetSpecialFormPtr());
+        REQUIRE(specialFormPtrObj.GetSpecialFormPtrUnchecked() == specialFormPtrObj.GetSpecialFormPtr());
+
+        forAllTypesExcept(ObjectType::SpecialFormPtr, [](const Object& obj) {
+            REQUIRE_THROWS_AS(obj.GetSpecialFormPtr(), BadObjectAccess);
+            REQUIRE(obj.TryGetSpecialFormPtr() == nullptr);
+        });
+    }
+
+    SECTION("StringPtr")
+    {
+        REQUIRE(stringPtrObj.Type() == ObjectType::StringPtr);
+        REQUIRE(stringPtrObj.GetStringPtr()->View() == "abc");
+        REQUIRE(stringPtrObj.TryGetStringPtr() == &stringPtrObj.GetStringPtr());
+        REQUIRE(stringPtrObj.GetStringPtrUnchecked() == stringPtrObj.GetStringPtr());
+
+        forAllTypesExcept(ObjectType::StringPtr, [](const Object& obj) {
+            REQUIRE_THROWS_AS(obj.GetStringPtr(), BadObjectAccess);
+            REQUIRE(obj.TryGetStringPtr() == nullptr);
+        });
+    }
+
+    SECTION("VectorPtr")
+    {
+        REQUIRE(vectorPtrObj.Type() == ObjectType::VectorPtr);
+        REQUIRE(vectorPtrObj.GetVectorPtr()->Size() == 0);
+        REQUIRE(vectorPtrObj.TryGetVectorPtr() == &vectorPtrObj.GetVectorPtr());
+        REQUIRE(vectorPtrObj.GetVectorPtrUnchecked() == vectorPtrObj.GetVectorPtr());
+
+        forAllTypesExcept(ObjectType::VectorPtr, [](const Object& obj) {
+            REQUIRE_THROWS_AS(obj.GetVectorPtr(), BadObjectAccess);
+            REQUIRE(obj.TryGetVectorPtr() == nullptr);
+        });
+    }
+}
+
+TEST_CASE("HashMap keeps Integer and SymbolHandle keys apart")
+{
+    HashMap map;
+    map.Insert(1, 10);
+    map.Insert(Object::MakeSymbolHandle(1), 20);
+    REQUIRE(map.Size() == 2);
+    REQUIRE(map.Find(1)->GetInteger() == 10);
+    REQUIRE(map.Find(Object::MakeSymbolHandle(1))->GetInteger() == 20);
+    REQUIRE(map.Find(2) == nullptr);
+
+    REQUIRE(map.Erase(Object::MakeSymbolHandle(1)));
+    REQUIRE(map.Find(Object::MakeSymbolHandle(1)) == nullptr);
+    REQUIRE(map.Find(1)->GetInteger() == 10);
+}
+
+TEST_CASE("Vector indexing and growth")
+{
+    Vector vec;
+    for (int i = 0; i < 1000; ++i) {
+        vec.PushBack(i);
+    }
+    REQUIRE(vec.Size() == 1000);
+    vec.SetAt(500, 1.5);
+    REQUIRE(vec.At(0).GetInteger() == 0);
+    REQUIRE(vec.At(500).GetFloat() == 1.5);
+    REQUIRE(vec.At(999).GetInteger() == 999);
+}
+
+TEST_CASE("Long lists are freed without deep recursion")
+{
+    const int n = 10000000;
+
+    ListPtr lst = nullptr;
+    for (int i = 0; i < n; ++i) {
+        lst = Cons(i, lst);
+    }
+    REQUIRE(lst->First().GetInteger() == n - 1);
+    lst = nullptr;
+
+    // A list that shares its tail with another only frees its own nodes
+    ListPtr tail = nullptr;
+    for (int i = 0; i < n; ++i) {
+        tail = Cons(i, tail);
+    }
+    ListPtr head = Cons(-1, tail);
+    head = nullptr;
+    REQUIRE(tail->First().GetInteger() == n - 1);
+    tail = nullptr;
+}
+
+TEST_CASE("ListBuilder allocates adjacent nodes")
+{
+    ListBuilder builder(3);
+    builder.Append(1);
+    builder.Append(2);
+    builder.Append(3);
+    ListPtr lst = builder.Finish();
+
+    const ListNode* node = lst.get();
+    for (int i = 1; i <= 3; ++i) {
+        REQUIRE(node->First().GetInteger() == i);
+        if (i < 3) {
+            REQUIRE(node->Rest().get() == node + 1);
+        }
+        node = node->Rest().get();
+    }
+    REQUIRE(node == nullptr);
+}
+
+TEST_CASE("ListBuilder allocates past its capacity")
+{
+    ListBuilder builder(2);
+    for (int i = 0; i < 5; ++i) {
+        builder.Append(i);
+    }
+    ListPtr lst = builder.Finish();
+    int i = 0;
+    for (const ListNode* node = lst.get(); node != nullptr; node = node->Rest().get()) {
+        REQUIRE(node->First().GetInteger() == i++);
+    }
+    REQUIRE(i == 5);
+
+    REQUIRE(ListBuilder(0).Finish() == nullptr);
+}
+
+TEST_CASE("Freed short list blocks are reused by the same thread")
+{
+    auto build = []() {
+        ListBuilder builder(3);
+        for (int i = 0; i < 3; ++i) {
+            builder.Append(i);
+        }
+        return builder.Finish();
+    };
+    ListPtr lst = build();
+    const ListNode* first = lst.get();
+    lst = nullptr;
+    lst = build();
+    REQUIRE(lst.get() == first);
+}
+
+TEST_CASE("A tail of a block list outlives its head")
+{
+    ListPtr tail;
+    {
+        ListBuilder builder(4);
+        for (int i = 0; i < 4; ++i) {
+            builder.Append(Cons(i, nullptr));
+        }
+        ListPtr lst = builder.Finish();
+        tail = lst->Rest()->Rest();
+    }
+    REQUIRE(tail->First().GetListPtr()->First().GetInteger() == 2);
+    REQUIRE(tail->Rest()->First().GetListPtr()->First().GetInteger() == 3);
+    REQUIRE(tail->Rest()->Rest() == nullptr);
+
+    // An unfinished builder releases the nodes it has built
+    ListBuilder unfinished(10);
+    unfinished.Append(1);
+}
+
+TEST_CASE("Long block lists are freed without deep recursion")
+{
+    const int n = 10000000;
+    ListBuilder builder(n);
+    for (int i = 0; i < n; ++i) {
+        builder.Append(i);
+    }
+    ListPtr lst = builder.Finish();
+    REQUIRE(lst->First().GetInteger() == 0);
+    lst = nullptr;
+}
+
+TEST_CASE("Moving an Object transfers its list reference")
+{
+    ListPtr lst = Cons(1, Cons(2, nullptr));
+    Object a{lst};
+    REQUIRE(lst.use_count() == 2);
+
+    Object b{std::move(a)};
+    REQUIRE(lst.use_count() == 2);
+    REQUIRE(b.GetListPtr() == lst);
+
+    Object c{42};
+    c = std::move(b);
+    REQUIRE(lst.use_count() == 2);
+    REQUIRE(c.GetListPtr() == lst);
+
+    c = Object{7};
+    REQUIRE(lst.use_count() == 1);
+    REQUIRE(c.GetInteger() == 7);
+}
+
+TEST_CASE("ListNode accessors do not copy")
+{
+    ListPtr rest = Cons(2, nullptr);
+    ListPtr lst = Cons(1, rest);
+    REQUIRE(rest.use_count() == 2);
+    const ListPtr& borrowed = lst->Rest();
+    REQUIRE(borrowed == rest);
+    REQUIRE(rest.use_count() == 2);
+    REQUIRE(&lst->First() == &lst->First());
+}
+
+TEST_CASE("HeapUsage counts the memory held by heap objects")
+{
+    std::int64_t before = HeapUsage::Bytes();
+    {
+        ListPtr lst = Cons(1, Cons(2, nullptr));
+        REQUIRE(HeapUsage::Bytes() - before == 2 * static_cast<std::int64_t>(sizeof(ListNode)));
+        VectorPtr vec(new Vector());
+        for (int i = 0; i < 100; ++i) {
+            vec->PushBack(i);
+        }
+        HashMapPtr map(new HashMap());
+        map->Insert(1, 10);
+        map->Insert(1, 11);
+        map->Insert(2, 20);
+        map->Erase(Object{2});
+        NumericArrayPtr array(new NumericArray(NumericArrayType::Float32, 1000));
+        REQUIRE(HeapUsage::Bytes() - before >= static_cast<std::int64_t>(2 * sizeof(ListNode) + 100 * sizeof(Object) + 1000 * sizeof(float)));
+    }
+    REQUIRE(HeapUsage::Bytes() == before);
 }
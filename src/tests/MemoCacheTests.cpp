@@ -0,0 +1,100 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../lib/MemoCache.h"
+#include <catch.hpp>
+
+using namespace Procdraw;
+
+namespace {
+
+ListPtr Args(Object a, Object b)
+{
+    return Cons(std::move(a), Cons(std::move(b), nullptr));
+}
+
+} // namespace
+
+TEST_CASE("MemoCache finds results by function and args")
+{
+    MemoCache cache;
+    Object f = Object::MakeCFunctionHandle(1);
+    Object g = Object::MakeCFunctionHandle(2);
+    cache.Insert(f, Args(1, 2.5), 10);
+    REQUIRE(cache.Find(f, Args(1, 2.5))->GetInteger() == 10);
+    REQUIRE(cache.Find(g, Args(1, 2.5)) == nullptr);
+    REQUIRE(cache.Find(f, Args(1.0, 2.5)) == nullptr);
+    REQUIRE(cache.Find(f, Args(1, 2)) == nullptr);
+    REQUIRE(cache.Find(f, Cons(1, nullptr)) == nullptr);
+
+    MemoCache::Stats stats = cache.GetStats();
+    REQUIRE(stats.hits == 1);
+    REQUIRE(stats.misses == 4);
+    REQUIRE(stats.size == 1);
+}
+
+TEST_CASE("MemoCache caches only atom args and immutable results")
+{
+    Object f = Object::MakeCFunctionHandle(1);
+    REQUIRE(MemoCache::CanCache(nullptr));
+    REQUIRE(MemoCache::CanCache(Args(true, Object::MakeSymbolHandle(3))));
+    REQUIRE_FALSE(MemoCache::CanCache(Args(1, VectorPtr(new Vector()))));
+    REQUIRE_FALSE(MemoCache::CanCache(Args(1, Cons(1, nullptr))));
+
+    MemoCache cache;
+    cache.Insert(f, Args(1, 2), Object::MakeError(ErrorKind::TypeError));
+    cache.Insert(f, Args(1, 3), Object{VectorPtr(new Vector())});
+    REQUIRE(cache.GetStats().size == 0);
+}
+
+TEST_CASE("MemoCache evicts the least recently used entry")
+{
+    MemoCache cache;
+    cache.SetCapacity(2);
+    Object f = Object::MakeCFunctionHandle(1);
+    cache.Insert(f, Cons(1, nullptr), 1);
+    cache.Insert(f, Cons(2, nullptr), 2);
+    REQUIRE(cache.Find(f, Cons(1, nullptr)) != nullptr);
+    cache.Insert(f, Cons(3, nullptr), 3);
+    REQUIRE(cache.GetStats().size == 2);
+    REQUIRE(cache.Find(f, Cons(2, nullptr)) == nullptr);
+    REQUIRE(cache.Find(f, Cons(1, nullptr))->GetInteger() == 1);
+    REQUIRE(cache.Find(f, Cons(3, nullptr))->GetInteger() == 3);
+
+    for (int i = 0; i < 100; ++i) {
+        cache.Insert(f, Cons(i, nullptr), i);
+    }
+    REQUIRE(cache.GetStats().size == 2);
+    REQUIRE(cache.Find(f, Cons(98, nullptr))->GetInteger() == 98);
+    REQUIRE(cache.Find(f, Cons(99, nullptr))->GetInteger() == 99);
+}
+
+TEST_CASE("MemoCache unmarking a pure function drops its results")
+{
+    MemoCache cache;
+    Object f = Object::MakeCFunctionHandle(1);
+    REQUIRE_FALSE(cache.IsPure(f));
+    cache.SetPure(f, true);
+    REQUIRE(cache.IsPure(f));
+    REQUIRE_FALSE(cache.IsPure(Object::MakeCFunctionHandle(2)));
+    cache.Insert(f, nullptr, 1);
+
+    MemoCache copy(cache);
+    REQUIRE(copy.IsPure(f));
+    REQUIRE(copy.GetStats().size == 0);
+
+    cache.SetPure(f, false);
+    REQUIRE_FALSE(cache.IsPure(f));
+    REQUIRE(cache.Find(f, nullptr) == nullptr);
+}
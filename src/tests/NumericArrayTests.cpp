@@ -0,0 +1,139 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../lib/NumericArray.h"
+#include "../lib/ProcdrawMath.h"
+#include <algorithm>
+#include <catch.hpp>
+#include <cstdint>
+#include <initializer_list>
+
+using namespace Procdraw;
+
+namespace {
+
+NumericArrayPtr FloatArray(std::initializer_list<float> vals)
+{
+    NumericArrayPtr array(new NumericArray(NumericArrayType::Float32, vals.size()));
+    std::copy(vals.begin(), vals.end(), array->Float32Data());
+    return array;
+}
+
+NumericArrayPtr IntArray(std::initializer_list<std::int32_t> vals)
+{
+    NumericArrayPtr array(new NumericArray(NumericArrayType::Int32, vals.size()));
+    std::copy(vals.begin(), vals.end(), array->Int32Data());
+    return array;
+}
+
+} // namespace
+
+TEST_CASE("NumericArray is zeroed and aligned")
+{
+    NumericArray array(NumericArrayType::Float32, 1000);
+    REQUIRE(array.Size() == 1000);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(array.Float32Data()) % NumericArray::alignment == 0);
+    for (size_t i = 0; i < array.Size(); ++i) {
+        REQUIRE(array.Float32Data()[i] == 0.0f);
+    }
+}
+
+TEST_CASE("ArrayAdd of Int32 arrays is Int32")
+{
+    auto result = ArrayAdd(IntArray({1, 2, 3}).get(), IntArray({10, 20, 30}).get(), nullptr);
+    REQUIRE(result->Type() == NumericArrayType::Int32);
+    REQUIRE(result->Size() == 3);
+    REQUIRE(result->Int32Data()[0] == 11);
+    REQUIRE(result->Int32Data()[1] == 22);
+    REQUIRE(result->Int32Data()[2] == 33);
+}
+
+TEST_CASE("ArrayAdd promotes to Float32")
+{
+    auto ints = IntArray({1, 2, 3});
+
+    auto result = ArrayAdd(ints.get(), 0.5, nullptr);
+    REQUIRE(result->Type() == NumericArrayType::Float32);
+    REQUIRE(result->Float32Data()[0] == 1.5f);
+    REQUIRE(result->Float32Data()[2] == 3.5f);
+
+    result = ArrayAdd(FloatArray({0.25f, 0.5f, 0.75f}).get(), ints.get(), nullptr);
+    REQUIRE(result->Type() == NumericArrayType::Float32);
+    REQUIRE(result->Float32Data()[0] == 1.25f);
+    REQUIRE(result->Float32Data()[2] == 3.75f);
+}
+
+TEST_CASE("ArrayMultiply broadcasts scalars")
+{
+    auto result = ArrayMultiply(2, IntArray({1, 2, 3}).get(), nullptr);
+    REQUIRE(result->Type() == NumericArrayType::Int32);
+    REQUIRE(result->Int32Data()[0] == 2);
+    REQUIRE(result->Int32Data()[2] == 6);
+}
+
+TEST_CASE("ArrayLerp, ArrayClamp and ArrayMapRange match the scalar functions")
+{
+    const size_t n = 1003;
+    NumericArrayPtr vals(new NumericArray(NumericArrayType::Float32, n));
+    for (size_t i = 0; i < n; ++i) {
+        vals->Float32Data()[i] = static_cast<float>(i) / (n - 1) * 2.0f - 0.5f;
+    }
+
+    auto lerped = ArrayLerp(4.0, -4.0, vals.get(), nullptr);
+    auto clamped = ArrayClamp(vals.get(), 0, 1, nullptr);
+    auto mapped = ArrayMapRange(0.0, 10.0, -1.0, 0.0, vals.get(), nullptr);
+
+    for (size_t i = 0; i < n; ++i) {
+        float val = vals->Float32Data()[i];
+        REQUIRE(lerped->Float32Data()[i] == Lerp(4.0f, -4.0f, val));
+        REQUIRE(clamped->Float32Data()[i] == Clamp(val, 0.0f, 1.0f));
+        REQUIRE(mapped->Float32Data()[i] == MapRange(0.0f, 10.0f, -1.0f, 0.0f, val));
+    }
+}
+
+TEST_CASE("Elementwise operations use the reuse array when it fits")
+{
+    auto a = FloatArray({1.0f, 2.0f});
+    NumericArray* storage = a.get();
+
+    auto result = ArrayAdd(a.get(), 1, a);
+    REQUIRE(result.get() == storage);
+    REQUIRE(result->Float32Data()[0] == 2.0f);
+    REQUIRE(result->Float32Data()[1] == 3.0f);
+
+    // An Int32 result does not fit a Float32 array
+    result = ArrayAdd(IntArray({1, 2}).get(), 1, a);
+    REQUIRE(result.get() != storage);
+    REQUIRE(result->Type() == NumericArrayType::Int32);
+}
+
+TEST_CASE("NumericArray reductions")
+{
+    const size_t n = 1001;
+    NumericArrayPtr ints(new NumericArray(NumericArrayType::Int32, n));
+    for (size_t i = 0; i < n; ++i) {
+        ints->Int32Data()[i] = static_cast<std::int32_t>(i) - 500;
+    }
+    REQUIRE(ArraySum(*ints) == 0.0);
+    REQUIRE(ArrayMin(*ints) == -500.0);
+    REQUIRE(ArrayMax(*ints) == 500.0);
+
+    auto floats = FloatArray({0.5f, -2.0f, 3.25f});
+    REQUIRE(ArraySum(*floats) == 1.75);
+    REQUIRE(ArrayMin(*floats) == -2.0);
+    REQUIRE(ArrayMax(*floats) == 3.25);
+
+    NumericArray empty(NumericArrayType::Float32, 0);
+    REQUIRE(ArraySum(empty) == 0.0);
+}
@@ -0,0 +1,107 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../lib/OpenHashMap.h"
+#include <catch.hpp>
+#include <cstddef>
+#include <random>
+#include <unordered_map>
+
+using namespace Procdraw;
+
+namespace {
+
+struct IdentityHash {
+    size_t operator()(int key) const
+    {
+        return static_cast<size_t>(key);
+    }
+};
+
+// Every key collides, so all entries share one probe sequence
+struct ConstantHash {
+    size_t operator()(int) const
+    {
+        return 3;
+    }
+};
+
+} // namespace
+
+TEST_CASE("OpenHashMap Insert and Find")
+{
+    OpenHashMap<int, int, IdentityHash> map;
+    REQUIRE(map.Size() == 0);
+    REQUIRE(map.Find(1) == nullptr);
+
+    for (int i = 0; i < 1000; ++i) {
+        map.Insert(i, i * 10);
+    }
+    REQUIRE(map.Size() == 1000);
+    for (int i = 0; i < 1000; ++i) {
+        REQUIRE(*map.Find(i) == i * 10);
+    }
+    REQUIRE(map.Find(1000) == nullptr);
+
+    map.Insert(5, 42);
+    REQUIRE(map.Size() == 1000);
+    REQUIRE(*map.Find(5) == 42);
+}
+
+TEST_CASE("OpenHashMap Erase keeps colliding entries reachable")
+{
+    OpenHashMap<int, int, ConstantHash> map;
+    for (int i = 0; i < 20; ++i) {
+        map.Insert(i, i);
+    }
+    REQUIRE(map.Erase(0));
+    REQUIRE(map.Erase(10));
+    REQUIRE_FALSE(map.Erase(10));
+    REQUIRE(map.Size() == 18);
+    for (int i = 0; i < 20; ++i) {
+        if (i == 0 || i == 10) {
+            REQUIRE(map.Find(i) == nullptr);
+        }
+        else {
+            REQUIRE(*map.Find(i) == i);
+        }
+    }
+}
+
+TEST_CASE("OpenHashMap matches std::unordered_map under random operations")
+{
+    OpenHashMap<int, int, IdentityHash> map;
+    std::unordered_map<int, int> expected;
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<int> keys(0, 500);
+
+    for (int i = 0; i < 20000; ++i) {
+        int key = keys(rng);
+        if (rng() % 3 == 0) {
+            REQUIRE(map.Erase(key) == (expected.erase(key) == 1));
+        }
+        else {
+            map.Insert(key, i);
+            expected[key] = i;
+        }
+    }
+
+    REQUIRE(map.Size() == expected.size());
+    size_t visited = 0;
+    map.ForEach([&](int key, int value) {
+        REQUIRE(expected.at(key) == value);
+        ++visited;
+    });
+    REQUIRE(visited == expected.size());
+}
@@ -0,0 +1,71 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../lib/PersistentVector.h"
+#include <catch.hpp>
+#include <stdexcept>
+#include <vector>
+
+using namespace Procdraw;
+
+TEST_CASE("PersistentVector PushBack and At")
+{
+    const int n = 5000;
+    PersistentVector<int> v;
+    REQUIRE(v.Size() == 0);
+    for (int i = 0; i < n; ++i) {
+        v = v.PushBack(i * 2);
+    }
+    REQUIRE(v.Size() == n);
+    for (int i = 0; i < n; ++i) {
+        REQUIRE(v.At(i) == i * 2);
+    }
+    REQUIRE_THROWS_AS(v.At(n), std::out_of_range);
+}
+
+TEST_CASE("PersistentVector updates do not modify the original")
+{
+    PersistentVector<int> v;
+    for (int i = 0; i < 100; ++i) {
+        v = v.PushBack(i);
+    }
+    PersistentVector<int> w = v.Set(42, -1).PushBack(100);
+    REQUIRE(v.Size() == 100);
+    REQUIRE(v.At(42) == 42);
+    REQUIRE(w.Size() == 101);
+    REQUIRE(w.At(42) == -1);
+    REQUIRE(w.At(100) == 100);
+    REQUIRE_THROWS_AS(v.Set(100, 0), std::out_of_range);
+}
+
+TEST_CASE("PersistentVector ForEachUnsharedIndex")
+{
+    PersistentVector<int> v;
+    for (int i = 0; i < 2000; ++i) {
+        v = v.PushBack(i);
+    }
+
+    std::vector<size_t> unshared;
+    auto collect = [&unshared](size_t index) { unshared.push_back(index); };
+
+    v.ForEachUnsharedIndex(v, collect);
+    REQUIRE(unshared.empty());
+
+    // Only the leaf holding index 1000 (indexes 992 to 1023) is unshared
+    PersistentVector<int> w = v.Set(1000, -1);
+    w.ForEachUnsharedIndex(v, collect);
+    REQUIRE(unshared.size() == 32);
+    REQUIRE(unshared.front() == 992);
+    REQUIRE(unshared.back() == 1023);
+}
@@ -0,0 +1,114 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../lib/ReplServer.h"
+#include <algorithm>
+#include <catch.hpp>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace Procdraw;
+
+namespace {
+
+const wchar_t* testPipeName = L"\\\\.\\pipe\\procdraw-tests";
+
+// A local client, using blocking writes and polled reads, so that the
+// server can be polled on the same thread
+
+class ReplClient {
+public:
+    ReplClient()
+    {
+        pipe.reset(CreateFileW(testPipeName, GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr));
+        REQUIRE(pipe);
+    }
+    void Send(const std::string& text)
+    {
+        DWORD written = 0;
+        REQUIRE(WriteFile(pipe.get(), text.data(), static_cast<DWORD>(text.size()), &written, nullptr));
+        REQUIRE(written == text.size());
+    }
+    // Polls the server until numLines lines have been received
+    std::string Receive(ReplServer& server, int numLines)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        std::string received;
+        while (std::count(received.begin(), received.end(), '\n') < numLines) {
+            REQUIRE(std::chrono::steady_clock::now() < deadline);
+            server.Poll();
+            DWORD available = 0;
+            REQUIRE(PeekNamedPipe(pipe.get(), nullptr, 0, nullptr, &available, nullptr));
+            if (available > 0) {
+                std::string buffer(available, '\0');
+                DWORD read = 0;
+                REQUIRE(ReadFile(pipe.get(), buffer.data(), available, &read, nullptr));
+                received.append(buffer, 0, read);
+            }
+            else {
+                std::this_thread::yield();
+            }
+        }
+        return received;
+    }
+
+private:
+    wil::unique_hfile pipe;
+};
+
+std::unique_ptr<SceneThread> MakeSceneThread()
+{
+    auto interpreter = std::make_unique<Interpreter>();
+    interpreter->Eval(interpreter->Read("(define draw (lambda () (cube)))"));
+    return std::make_unique<SceneThread>(std::move(interpreter));
+}
+
+} // namespace
+
+TEST_CASE("ReplServer returns the result of each form sent by a client")
+{
+    auto sceneThread = MakeSceneThread();
+    ReplServer server(sceneThread.get(), testPipeName);
+    ReplClient client;
+
+    // Pipelined, and split across writes
+    client.Send("(define a 1) (+ a");
+    client.Send(" 2)\n(+ a\n");
+    REQUIRE(client.Receive(server, 2) == "1\n3\n");
+    client.Send(" 1) (lerp 1 2 true) (a]\n");
+    REQUIRE(client.Receive(server, 3) == "2\n#<error type-error>\n#<error bad-syntax>\n");
+}
+
+TEST_CASE("ReplServer serves several clients")
+{
+    auto sceneThread = MakeSceneThread();
+    ReplServer server(sceneThread.get(), testPipeName);
+    ReplClient client1;
+    server.Poll();
+    ReplClient client2;
+    client1.Send("(define a 10)\n");
+    REQUIRE(client1.Receive(server, 1) == "10\n");
+    client2.Send("(+ a 1)\n");
+    REQUIRE(client2.Receive(server, 1) == "11\n");
+    {
+        // A client that disconnects with results pending
+        ReplClient client3;
+        server.Poll();
+        client3.Send("(+ a 2)\n");
+    }
+    client1.Send("(+ a 3)\n");
+    REQUIRE(client1.Receive(server, 1) == "13\n");
+}
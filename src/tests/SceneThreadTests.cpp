@@ -0,0 +1,193 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../lib/SceneThread.h"
+#include <catch.hpp>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Procdraw;
+
+namespace {
+
+std::unique_ptr<Interpreter> MakeInterpreter(const char* drawDefinition)
+{
+    auto interpreter = std::make_unique<Interpreter>();
+    interpreter->Eval(interpreter->Read(drawDefinition));
+    return interpreter;
+}
+
+// Waits for the scene thread to draw a frame for input mouseX
+const Scene& WaitForScene(SceneThread& sceneThread, float mouseX)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (true) {
+        const Scene& scene = sceneThread.LatestScene();
+        if (!scene.Commands().empty() && scene.Commands()[0].args[0] == mouseX) {
+            return scene;
+        }
+        REQUIRE(std::chrono::steady_clock::now() < deadline);
+        std::this_thread::yield();
+    }
+}
+
+// Waits for the scene thread to evaluate count REPL requests
+std::vector<ReplResponse> WaitForResponses(SceneThread& sceneThread, size_t count)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    std::vector<ReplResponse> responses;
+    while (responses.size() < count) {
+        REQUIRE(std::chrono::steady_clock::now() < deadline);
+        sceneThread.TakeResponses(responses);
+        std::this_thread::yield();
+    }
+    return responses;
+}
+
+} // namespace
+
+TEST_CASE("SceneThread draws a Scene for each input")
+{
+    SceneThread sceneThread(MakeInterpreter("(define draw (lambda () (translate mouse-x mouse-y 0) (cube)))"));
+    REQUIRE(sceneThread.LatestScene().Commands().empty());
+
+    sceneThread.SetInput(FrameInput{0.25, 0.5});
+    const Scene& scene = WaitForScene(sceneThread, 0.25f);
+    REQUIRE(scene.Frame() == 1);
+    REQUIRE(scene.Commands().size() == 2);
+    REQUIRE(scene.Commands()[0].kind == SceneCommandKind::Translate);
+    REQUIRE(scene.Commands()[0].args[1] == 0.5f);
+    REQUIRE(scene.Commands()[1].kind == SceneCommandKind::Cube);
+
+    // The latest Scene is kept until another is drawn
+    REQUIRE(&sceneThread.LatestScene() == &scene);
+    REQUIRE(sceneThread.LatestScene().Frame() == 1);
+}
+
+TEST_CASE("SceneThread keeps the Scene drawn before an error")
+{
+    SceneThread sceneThread(MakeInterpreter("(define draw (lambda () (translate mouse-x 0 0) (cube true)))"));
+    sceneThread.SetInput(FrameInput{0.75, 0.0});
+    REQUIRE(WaitForScene(sceneThread, 0.75f).Commands().size() == 1);
+}
+
+TEST_CASE("SceneThread stress test: the render thread only sees whole Scenes")
+{
+    // Each Scene is a translate by the input, many cubes, and a rotate by
+    // the same input, so a Scene mixing two frames would not match
+    constexpr int numCubes = 50;
+    SceneThread sceneThread(MakeInterpreter(
+        "(define draw (lambda ()"
+        "  (translate mouse-x mouse-y 0)"
+        "  (do ((i 0 (+ i 1))) ((= i 50)) (cube))"
+        "  (rotate-x mouse-x)))"));
+
+    constexpr std::uint64_t numScenes = 1000;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    std::uint64_t lastFrame = 0;
+    std::uint64_t scenesSeen = 0;
+    int input = 0;
+    while (scenesSeen < numScenes) {
+        REQUIRE(std::chrono::steady_clock::now() < deadline);
+        ++input;
+        sceneThread.SetInput(FrameInput{static_cast<double>(input), static_cast<double>(input)});
+        const Scene& scene = sceneThread.LatestScene();
+        if (scene.Frame() == 0) {
+            continue;
+        }
+        const std::vector<SceneCommand>& commands = scene.Commands();
+        REQUIRE(commands.size() == numCubes + 2);
+        REQUIRE(commands.front().kind == SceneCommandKind::Translate);
+        REQUIRE(commands.back().kind == SceneCommandKind::RotateX);
+        REQUIRE(commands.back().args[0] == commands.front().args[0]);
+        REQUIRE(commands.front().args[0] <= input);
+        REQUIRE(scene.Frame() >= lastFrame);
+        if (scene.Frame() > lastFrame) {
+            ++scenesSeen;
+        }
+        lastFrame = scene.Frame();
+    }
+    // The scene thread catches up with the last input
+    REQUIRE(WaitForScene(sceneThread, static_cast<float>(input)).Frame() >= lastFrame);
+}
+
+TEST_CASE("SceneThread evaluates REPL requests in order")
+{
+    SceneThread sceneThread(MakeInterpreter("(define draw (lambda () (cube)))"));
+    sceneThread.Submit(ReplRequest{1, "(define a 1)"});
+    sceneThread.Submit(ReplRequest{2, "(+ a 2)"});
+    sceneThread.Submit(ReplRequest{1, "(+ a"});
+    sceneThread.Submit(ReplRequest{1, "(lerp a 2 true)"});
+    std::vector<ReplResponse> responses = WaitForResponses(sceneThread, 4);
+    REQUIRE(responses.size() == 4);
+    REQUIRE(responses[0].client == 1);
+    REQUIRE(responses[0].text == "1");
+    REQUIRE(responses[1].client == 2);
+    REQUIRE(responses[1].text == "3");
+    REQUIRE(responses[2].text == "#<error bad-syntax>");
+    REQUIRE(responses[3].text == "#<error type-error>");
+}
+
+TEST_CASE("SceneThread responds to a REPL request for a builtin")
+{
+    SceneThread sceneThread(MakeInterpreter("(define draw (lambda () (cube)))"));
+    sceneThread.Submit(ReplRequest{1, "+"});
+    sceneThread.Submit(ReplRequest{1, "(+ 1 2)"});
+    std::vector<ReplResponse> responses = WaitForResponses(sceneThread, 2);
+    REQUIRE(responses[0].text == "#<builtin>");
+    REQUIRE(responses[1].text == "3");
+}
+
+TEST_CASE("SceneThread applies a REPL definition in the next Scene")
+{
+    SceneThread sceneThread(MakeInterpreter("(define draw (lambda () (translate mouse-x 0 0) (cube)))"));
+    sceneThread.SetInput(FrameInput{0.25, 0.0});
+    REQUIRE(WaitForScene(sceneThread, 0.25f).Commands()[1].kind == SceneCommandKind::Cube);
+
+    // Submitted before the input is set, so it is evaluated before the
+    // input is drawn
+    sceneThread.Submit(ReplRequest{1, "(define draw (lambda () (translate mouse-x 0 0) (tetrahedron)))"});
+    sceneThread.SetInput(FrameInput{0.5, 0.0});
+    REQUIRE(WaitForScene(sceneThread, 0.5f).Commands()[1].kind == SceneCommandKind::Tetrahedron);
+}
+
+TEST_CASE("SceneThread recomputes signals that read the mouse only when it moves")
+{
+    SceneThread sceneThread(MakeInterpreter("(define calls 0)"));
+    sceneThread.Submit(ReplRequest{1,
+                                   "(define shape (computed (lambda ()"
+                                   "  (define calls (+ calls 1))"
+                                   "  (translate (signal-value mouse-x-signal) 0 0)"
+                                   "  (cube))))"});
+    sceneThread.Submit(ReplRequest{1, "(define draw (lambda () (signal-value shape)))"});
+    std::uint64_t lastFrame = 0;
+    for (double mouseX : {0.25, 0.25, 0.25, 0.5}) {
+        sceneThread.SetInput(FrameInput{mouseX, 0.0});
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (sceneThread.LatestScene().Frame() == lastFrame) {
+            REQUIRE(std::chrono::steady_clock::now() < deadline);
+            std::this_thread::yield();
+        }
+        const Scene& scene = sceneThread.LatestScene();
+        REQUIRE(scene.Commands().size() == 2);
+        REQUIRE(scene.Commands()[0].args[0] == static_cast<float>(mouseX));
+        lastFrame = scene.Frame();
+    }
+    sceneThread.Submit(ReplRequest{1, "calls"});
+    REQUIRE(WaitForResponses(sceneThread, 3)[2].text == "2");
+}
@@ -0,0 +1,153 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../lib/HeapUsage.h"
+#include "../lib/Strings.h"
+#include <catch.hpp>
+#include <string>
+
+using namespace Procdraw;
+
+TEST_CASE("Short strings are stored inline")
+{
+    StringPtr empty = String::Make("");
+    REQUIRE(empty->Size() == 0);
+    REQUIRE(empty->Buffer() == nullptr);
+
+    std::string chars(String::inlineCapacity, 'a');
+    StringPtr inlined = String::Make(chars);
+    REQUIRE(inlined->View() == chars);
+    REQUIRE(inlined->Buffer() == nullptr);
+
+    StringPtr buffered = String::Make(chars + "b");
+    REQUIRE(buffered->View() == chars + "b");
+    REQUIRE(buffered->Buffer() != nullptr);
+}
+
+TEST_CASE("Slices share the buffer of a long string")
+{
+    StringPtr str = String::Make("the quick brown fox jumps over the lazy dog");
+    StringPtr slice = Slice(str, 4, 30);
+    REQUIRE(slice->View() == "quick brown fox jumps over");
+    REQUIRE(slice->Buffer() == str->Buffer());
+    REQUIRE(slice->Data() == str->Data() + 4);
+
+    REQUIRE(Slice(str, 0, str->Size()) == str);
+    StringPtr shortSlice = Slice(str, 4, 9);
+    REQUIRE(shortSlice->View() == "quick");
+    REQUIRE(shortSlice->Buffer() == nullptr);
+    REQUIRE(Slice(str, 5, 5)->Size() == 0);
+
+    // The buffer outlives the string it was made for
+    str = nullptr;
+    REQUIRE(slice->View() == "quick brown fox jumps over");
+}
+
+TEST_CASE("Concat shares buffers where it can")
+{
+    StringPtr a = String::Make("abc");
+    StringPtr empty = String::Make("");
+    REQUIRE(Concat(a, empty) == a);
+    REQUIRE(Concat(empty, a) == a);
+    StringPtr ab = Concat(a, String::Make("def"));
+    REQUIRE(ab->View() == "abcdef");
+    REQUIRE(ab->Buffer() == nullptr);
+
+    // Appending to a long result extends its buffer in place
+    StringPtr part = String::Make("0123456789");
+    StringPtr str = Concat(part, part);
+    REQUIRE(str->View() == "01234567890123456789");
+    const StringBuffer* buffer = str->Buffer();
+    REQUIRE(buffer != nullptr);
+    StringPtr longer = Concat(str, part);
+    REQUIRE(longer->View() == "012345678901234567890123456789");
+    REQUIRE(longer->Buffer() == buffer);
+    REQUIRE(longer->Data() == str->Data());
+    REQUIRE(str->View() == "01234567890123456789");
+
+    // The rest of the buffer has been claimed by longer, so appending to
+    // str again copies
+    StringPtr other = Concat(str, String::Make("!"));
+    REQUIRE(other->View() == "01234567890123456789!");
+    REQUIRE(other->Buffer() != buffer);
+    REQUIRE(longer->View() == "012345678901234567890123456789");
+
+    // Adjacent slices of a buffer are joined without copying
+    StringPtr whole = String::Make("abcdefghijklmnopqrstuvwxyz0123456789");
+    StringPtr joined = Concat(Slice(whole, 0, 18), Slice(whole, 18, 36));
+    REQUIRE(joined->View() == whole->View());
+    REQUIRE(joined->Data() == whole->Data());
+}
+
+TEST_CASE("Repeated appends build a string in place")
+{
+    StringPtr piece = String::Make("xy");
+    StringPtr str = String::Make("");
+    int buffers = 0;
+    const StringBuffer* buffer = nullptr;
+    for (int i = 0; i < 1000; ++i) {
+        str = Concat(str, piece);
+        if (str->Buffer() != buffer) {
+            buffer = str->Buffer();
+            ++buffers;
+        }
+    }
+    REQUIRE(str->Size() == 2000);
+    REQUIRE(str->View().substr(1996) == "xyxy");
+    // Each new buffer has room for the string to double
+    REQUIRE(buffers <= 8);
+}
+
+TEST_CASE("StringTable interns strings by their characters")
+{
+    StringTable table;
+    StringPtr a = table.Intern(String::Make("label"));
+    StringPtr b = table.Intern(String::Make("label"));
+    REQUIRE(a == b);
+    REQUIRE(table.Intern(String::Make("other")) != a);
+    REQUIRE(table.Size() == 2);
+
+    // A slice is copied rather than keeping its buffer alive
+    StringPtr str = Concat(String::Make("a long string to be sliced"), String::Make("!"));
+    StringPtr interned = table.Intern(Slice(str, 2, 24));
+    REQUIRE(interned->View() == "long string to be slic");
+    REQUIRE(interned->Buffer() != str->Buffer());
+
+    // Strings referenced only by the table are released
+    b = nullptr;
+    table.Sweep();
+    REQUIRE(table.Size() == 2);
+    a = nullptr;
+    interned = nullptr;
+    table.Sweep();
+    REQUIRE(table.Size() == 0);
+}
+
+TEST_CASE("StringHash depends on every character")
+{
+    REQUIRE(StringHash("abcdefghij") == StringHash(std::string("abcdefghij")));
+    REQUIRE(StringHash("abcdefghij") != StringHash("abcdefghik"));
+    REQUIRE(StringHash("abcdefghij") != StringHash("bbcdefghij"));
+    REQUIRE(StringHash("") != StringHash(std::string(1, '\0')));
+}
+
+TEST_CASE("HeapUsage counts strings and their buffers")
+{
+    std::int64_t before = HeapUsage::Bytes();
+    {
+        StringPtr str = String::Make(std::string(1000, 'a'));
+        REQUIRE(HeapUsage::Bytes() - before >= 1000);
+    }
+    REQUIRE(HeapUsage::Bytes() == before);
+}
@@ -0,0 +1,76 @@
+// Copyright 2020 Simon Bates
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../lib/TripleBuffer.h"
+#include <catch.hpp>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+using namespace Procdraw;
+
+TEST_CASE("TripleBuffer passes the latest published value")
+{
+    TripleBuffer<int> buffer;
+    REQUIRE_FALSE(buffer.Update());
+    buffer.Back() = 1;
+    buffer.Publish();
+    buffer.Back() = 2;
+    buffer.Publish();
+    REQUIRE(buffer.Update());
+    REQUIRE(buffer.Front() == 2);
+    REQUIRE_FALSE(buffer.Update());
+    REQUIRE(buffer.Front() == 2);
+    buffer.Back() = 3;
+    buffer.Publish();
+    REQUIRE(buffer.Update());
+    REQUIRE(buffer.Front() == 3);
+}
+
+TEST_CASE("TripleBuffer readers never see a partly written value")
+{
+    // Each value is a frame number repeated, so a torn value would have
+    // mixed elements
+    constexpr std::uint64_t numFrames = 200000;
+    constexpr size_t frameSize = 64;
+    TripleBuffer<std::vector<std::uint64_t>> buffer;
+
+    std::thread writer([&]() {
+        for (std::uint64_t frame = 1; frame <= numFrames; ++frame) {
+            std::vector<std::uint64_t>& back = buffer.Back();
+            back.assign(frameSize, frame);
+            buffer.Publish();
+        }
+    });
+
+    std::uint64_t lastFrame = 0;
+    std::uint64_t updates = 0;
+    while (lastFrame < numFrames) {
+        if (!buffer.Update()) {
+            continue;
+        }
+        const std::vector<std::uint64_t>& front = buffer.Front();
+        REQUIRE(front.size() == frameSize);
+        std::uint64_t frame = front[0];
+        for (std::uint64_t val : front) {
+            REQUIRE(val == frame);
+        }
+        REQUIRE(frame > lastFrame);
+        lastFrame = frame;
+        ++updates;
+    }
+    writer.join();
+    REQUIRE(lastFrame == numFrames);
+    REQUIRE(updates <= numFrames);
+}